@@ -0,0 +1,90 @@
+// Throughput benchmark for the base64 codecs.
+//
+// Usage: base64_benchmark [payload_bytes] [iterations]
+// Configure with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+#include "../src/http/base64.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Old per-byte decoder from session.cc, kept as the baseline.
+std::string legacy_decode(const std::string &in) {
+  std::string out;
+  std::vector<int> T(256, -1);
+  for (int i = 0; i < 64; i++)
+    T["ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[i]] =
+        i;
+  int val = 0, valb = -8;
+  for (unsigned char c : in) {
+    if (T[c] == -1)
+      break;
+    val = (val << 6) + T[c];
+    valb += 6;
+    if (valb >= 0) {
+      out.push_back(char((val >> valb) & 0xFF));
+      valb -= 8;
+    }
+  }
+  return out;
+}
+
+template <class F> double seconds(int iterations, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i)
+    f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void report(const char *name, std::size_t bytes, int iterations, double s) {
+  std::printf("%-18s %10.1f MB/s\n", name,
+              bytes * double(iterations) / s / (1024 * 1024));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::size_t size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 20;
+  int iterations = argc > 2 ? std::atoi(argv[2]) : 200;
+
+  std::mt19937 gen(42);
+  std::string raw(size, '\0');
+  for (auto &c : raw)
+    c = static_cast<char>(gen() & 0xff);
+  std::string encoded = base64::encode(raw);
+
+  std::printf("payload %zu bytes, %d iterations, dispatch picks %s\n", size,
+              iterations,
+              base64::implementation_name(base64::active_implementation()));
+
+  volatile std::size_t sink = 0;
+  double s = seconds(iterations, [&] { sink += legacy_decode(encoded).size(); });
+  report("decode legacy", encoded.size(), iterations, s);
+
+  for (auto impl :
+       {base64::Implementation::Scalar, base64::Implementation::SSE41,
+        base64::Implementation::AVX2}) {
+    if (!base64::is_supported(impl))
+      continue;
+    std::string name = std::string("encode ") + base64::implementation_name(impl);
+    s = seconds(iterations, [&] {
+      sink += base64::encode_with(impl, raw.data(), raw.size()).size();
+    });
+    report(name.c_str(), raw.size(), iterations, s);
+
+    name = std::string("decode ") + base64::implementation_name(impl);
+    std::string out;
+    s = seconds(iterations, [&] {
+      base64::decode_with(impl, encoded.data(), encoded.size(), &out);
+      sink += out.size();
+    });
+    report(name.c_str(), encoded.size(), iterations, s);
+  }
+  return 0;
+}
@@ -0,0 +1,120 @@
+// Compares one POST <prefix>/_batch request against the same operations sent
+// as individual requests, through RequestHandlerAPI on a file-backed
+// CRUDHandler. Connection setup and auth are not included, so the batch wins
+// by at least this much over the network.
+//
+// Usage: batch_benchmark [operations] [rounds] [durable 0|1]
+// Configure with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+#include "../src/api/crud_handler.h"
+#include "../src/request_handler/request_handler_api.h"
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+namespace http = boost::beast::http;
+
+namespace {
+
+const char kRoot[] = "batch_benchmark_data/";
+const char kBody[] = "{\"name\": \"runner\", \"size\": 42, \"color\": \"red\"}";
+
+int handle(RequestHandlerAPI *handler, http::verb method,
+           const std::string &target, const std::string &body) {
+  http::request<http::string_body> req{method, target, 11};
+  req.body() = body;
+  req.prepare_payload();
+  http::response<http::string_body> res;
+  handler->handleRequest(req, &res);
+  return res.result_int();
+}
+
+template <class F> double seconds(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void report(const char *name, int operations, int rounds, double s) {
+  std::printf("%-22s %10.0f ops/s %10.1f us/op\n", name,
+              operations * double(rounds) / s,
+              s * 1e6 / (operations * double(rounds)));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int operations = argc > 1 ? std::atoi(argv[1]) : 100;
+  int rounds = argc > 2 ? std::atoi(argv[2]) : 20;
+  bool durable = argc > 3 && std::atoi(argv[3]) != 0;
+  std::filesystem::remove_all(kRoot);
+  RequestHandlerAPI handler(std::make_shared<CRUDHandler>(kRoot, durable), "/api");
+  std::printf("%d operations, %d rounds, durable writes %s\n", operations,
+              rounds, durable ? "on" : "off");
+
+  // every phase runs rounds times over ids 1..operations; the rounds of the
+  // create and delete phases are undone in between, so each sees the same state
+  const char *phases[] = {"create", "read", "update", "delete"};
+  for (const char *phase : phases) {
+    std::string op = phase;
+    std::string body;
+    http::verb method = op == "create"   ? http::verb::post
+                        : op == "read"   ? http::verb::get
+                        : op == "update" ? http::verb::put
+                                         : http::verb::delete_;
+    if (op == "create" || op == "update")
+      body = kBody;
+
+    double single = 0, batched = 0;
+    for (int round = 0; round < rounds; ++round) {
+      // one by one on Single, batched on Batch
+      single += seconds([&] {
+        for (int id = 1; id <= operations; ++id) {
+          std::string target = op == "create"
+                                   ? "/api/Single"
+                                   : "/api/Single/" + std::to_string(id);
+          handle(&handler, method, target, body);
+        }
+      });
+
+      std::string batch = "[";
+      for (int id = 1; id <= operations; ++id) {
+        batch += id > 1 ? ", " : "";
+        batch += "{\"op\": \"" + op + "\", \"entity\": \"Batch\"";
+        if (op != "create")
+          batch += ", \"id\": " + std::to_string(id);
+        if (!body.empty())
+          batch += ", \"data\": " + body;
+        batch += "}";
+      }
+      batch += "]";
+      batched += seconds(
+          [&] { handle(&handler, http::verb::post, "/api/_batch", batch); });
+
+      // keep the entities around for the phases that need them
+      if (round + 1 < rounds && op == "create") {
+        for (int id = 1; id <= operations; ++id) {
+          handle(&handler, http::verb::delete_,
+                 "/api/Single/" + std::to_string(id), "");
+          handle(&handler, http::verb::delete_,
+                 "/api/Batch/" + std::to_string(id), "");
+        }
+      }
+      if (round + 1 < rounds && op == "delete") {
+        for (int id = 1; id <= operations; ++id) {
+          handle(&handler, http::verb::post, "/api/Single", kBody);
+          handle(&handler, http::verb::post, "/api/Batch", kBody);
+        }
+      }
+    }
+    report((op + " one by one").c_str(), operations, rounds, single);
+    report((op + " batched").c_str(), operations, rounds, batched);
+  }
+
+  std::filesystem::remove_all(kRoot);
+  return 0;
+}
@@ -0,0 +1,85 @@
+// Throughput benchmark for JSON body validation and minification.
+//
+// Usage: json_benchmark [payload_bytes] [iterations]
+// Configure with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+#include "../src/http/json.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+namespace {
+
+// A pretty-printed array of records, roughly what a client would PUT.
+std::string make_document(std::size_t size) {
+  std::mt19937 gen(42);
+  const char *words[] = {"leather", "suede", "canvas", "caf\xc3\xa9",
+                         "waterproof", "\xe2\x82\xac", "lace-up",
+                         "quote \\\" inside", "slip-on"};
+  std::string doc = "[\n";
+  for (int id = 1; doc.size() < size; ++id) {
+    if (id > 1)
+      doc += ",\n";
+    doc += "  {\n    \"id\": " + std::to_string(id) + ",\n";
+    doc += "    \"price\": " + std::to_string(gen() % 20000 / 100.0) + ",\n";
+    doc += "    \"description\": \"";
+    for (int w = 0; w < 12; ++w) {
+      doc += words[gen() % (sizeof(words) / sizeof(words[0]))];
+      doc += ' ';
+    }
+    doc += "\",\n    \"tags\": [\"a\", \"b\", \"c\"],\n";
+    doc += "    \"in_stock\": true\n  }";
+  }
+  doc += "\n]\n";
+  return doc;
+}
+
+template <class F> double seconds(int iterations, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i)
+    f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void report(const char *name, std::size_t bytes, int iterations, double s) {
+  std::printf("%-18s %10.1f MB/s %10.1f us/body\n", name,
+              bytes * double(iterations) / s / (1024 * 1024),
+              s / iterations * 1e6);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::size_t size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1 << 20;
+  int iterations = argc > 2 ? std::atoi(argv[2]) : 200;
+
+  std::string doc = make_document(size);
+  std::printf("payload %zu bytes, %d iterations, dispatch picks %s\n",
+              doc.size(), iterations,
+              json::implementation_name(json::active_implementation()));
+
+  volatile std::size_t sink = 0;
+  std::string out;
+  for (auto impl : {json::Implementation::Scalar, json::Implementation::SSE2,
+                    json::Implementation::AVX2}) {
+    if (!json::is_supported(impl))
+      continue;
+    std::string name =
+        std::string("validate ") + json::implementation_name(impl);
+    double s = seconds(iterations,
+                       [&] { sink += json::validate_with(impl, doc); });
+    report(name.c_str(), doc.size(), iterations, s);
+
+    name = std::string("minify ") + json::implementation_name(impl);
+    s = seconds(iterations, [&] {
+      json::minify_with(impl, doc, &out);
+      sink += out.size();
+    });
+    report(name.c_str(), doc.size(), iterations, s);
+  }
+  std::printf("minified to %zu bytes\n", out.size());
+  return 0;
+}
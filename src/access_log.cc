@@ -0,0 +1,243 @@
+#include "access_log.h"
+#include "http/json.h"
+#include <algorithm>
+#include <cmath>
+
+const char AccessLog::kHeader[] = "SWAL\x01";
+const size_t AccessLog::kHeaderSize;
+
+namespace {
+
+// A record is far smaller than this; anything bigger is corruption.
+const uint64_t kMaxRecordSize = 1 << 20;
+
+void putVarint(uint64_t value, std::string *out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void putString(const std::string &value, std::string *out) {
+  putVarint(value.size(), out);
+  out->append(value);
+}
+
+bool getVarint(const std::string &in, size_t *pos, uint64_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *pos < in.size(); shift += 7) {
+    unsigned char byte = in[(*pos)++];
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool getString(const std::string &in, size_t *pos, std::string *value) {
+  uint64_t size;
+  if (!getVarint(in, pos, &size) || size > in.size() - *pos)
+    return false;
+  value->assign(in, *pos, size);
+  *pos += size;
+  return true;
+}
+
+// Quote field for CSV if it needs it.
+std::string csvField(const std::string &field) {
+  if (field.find_first_of(",\"\r\n") == std::string::npos)
+    return field;
+  std::string out = "\"";
+  for (char c : field) {
+    if (c == '"')
+      out.push_back('"');
+    out.push_back(c);
+  }
+  return out + "\"";
+}
+
+} // namespace
+
+/**
+ * open() - Open or create the access log at path.
+ */
+std::shared_ptr<AccessLog>
+AccessLog::open(const std::string &path,
+                std::chrono::milliseconds flush_interval) {
+  std::unique_ptr<AppendFile> file = AppendFile::open(
+      path, std::string(kHeader, kHeaderSize), flush_interval);
+  if (!file)
+    return nullptr;
+  return std::shared_ptr<AccessLog>(new AccessLog(std::move(file)));
+}
+
+void AccessLog::write(const AccessRecord &record) {
+  // encode outside the lock, so logging threads only contend on the append
+  thread_local std::string encoded;
+  encoded.clear();
+  encode(record, &encoded);
+  file_->append(encoded);
+}
+
+/**
+ * encode() - Append the length of record's body, then the body.
+ */
+void AccessLog::encode(const AccessRecord &record, std::string *out) {
+  thread_local std::string body;
+  body.clear();
+  putVarint(record.timestamp_us, &body);
+  putVarint(record.status, &body);
+  putVarint(record.bytes_in, &body);
+  putVarint(record.bytes_out, &body);
+  putVarint(record.read_us, &body);
+  putVarint(record.handle_us, &body);
+  putVarint(record.write_us, &body);
+  putString(record.handler, &body);
+  putString(record.route, &body);
+  putString(record.client, &body);
+  putString(record.user, &body);
+  putVarint(body.size(), out);
+  out->append(body);
+}
+
+bool AccessLog::decode(const std::string &body, AccessRecord *record) {
+  size_t pos = 0;
+  uint64_t status;
+  bool ok = getVarint(body, &pos, &record->timestamp_us) &&
+            getVarint(body, &pos, &status) &&
+            getVarint(body, &pos, &record->bytes_in) &&
+            getVarint(body, &pos, &record->bytes_out) &&
+            getVarint(body, &pos, &record->read_us) &&
+            getVarint(body, &pos, &record->handle_us) &&
+            getVarint(body, &pos, &record->write_us) &&
+            getString(body, &pos, &record->handler) &&
+            getString(body, &pos, &record->route) &&
+            getString(body, &pos, &record->client) &&
+            getString(body, &pos, &record->user);
+  record->status = static_cast<uint32_t>(status);
+  // whatever follows is fields added after this reader was written
+  return ok;
+}
+
+AccessLogReader::AccessLogReader(std::istream &in) : in_(in) {
+  char header[AccessLog::kHeaderSize];
+  valid_ = static_cast<bool>(in_.read(header, sizeof(header))) &&
+           std::equal(header, header + sizeof(header), AccessLog::kHeader);
+}
+
+bool AccessLogReader::next(AccessRecord *record) {
+  if (!valid_ || truncated_)
+    return false;
+  uint64_t size = 0;
+  int shift = 0;
+  int c;
+  while ((c = in_.get()) != EOF) {
+    size |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      break;
+    shift += 7;
+    if (shift >= 64)
+      break;
+  }
+  if (c == EOF) {
+    // a clean end, unless it came in the middle of the length
+    truncated_ = shift > 0;
+    return false;
+  }
+  if (size > kMaxRecordSize) {
+    truncated_ = true;
+    return false;
+  }
+  body_.resize(size);
+  if (!in_.read(&body_[0], size) || !AccessLog::decode(body_, record)) {
+    truncated_ = true;
+    return false;
+  }
+  return true;
+}
+
+void AccessLogSummary::add(const AccessRecord &record) {
+  Route &route = routes_[record.route];
+  route.requests++;
+  if (record.status >= 500)
+    route.server_errors++;
+  else if (record.status >= 400)
+    route.client_errors++;
+  route.bytes_in += record.bytes_in;
+  route.bytes_out += record.bytes_out;
+  route.latencies_us.push_back(record.latency_us());
+}
+
+/**
+ * percentile() - Nearest-rank percentile of route's latencies.
+ */
+uint64_t AccessLogSummary::percentile(const Route &route, double q) {
+  if (route.latencies_us.empty())
+    return 0;
+  std::vector<uint64_t> sorted = route.latencies_us;
+  size_t rank = static_cast<size_t>(std::ceil(q * sorted.size()));
+  rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+  std::nth_element(sorted.begin(), sorted.begin() + rank - 1, sorted.end());
+  return sorted[rank - 1];
+}
+
+void AccessLogSummary::writeCsv(std::ostream &out) const {
+  out << "route,requests,4xx,5xx,bytes_in,bytes_out,p50_us,p90_us,p99_us,"
+         "max_us\n";
+  for (const auto &entry : routes_) {
+    const Route &route = entry.second;
+    out << csvField(entry.first) << ',' << route.requests << ','
+        << route.client_errors << ',' << route.server_errors << ','
+        << route.bytes_in << ',' << route.bytes_out << ','
+        << percentile(route, 0.5) << ',' << percentile(route, 0.9) << ','
+        << percentile(route, 0.99) << ',' << percentile(route, 1) << '\n';
+  }
+}
+
+void AccessLogSummary::writeJson(std::ostream &out) const {
+  out << '[';
+  bool first = true;
+  for (const auto &entry : routes_) {
+    const Route &route = entry.second;
+    out << (first ? "" : ",") << "\n{\"route\":" << json::quote(entry.first)
+        << ",\"requests\":" << route.requests
+        << ",\"4xx\":" << route.client_errors
+        << ",\"5xx\":" << route.server_errors
+        << ",\"bytes_in\":" << route.bytes_in
+        << ",\"bytes_out\":" << route.bytes_out
+        << ",\"p50_us\":" << percentile(route, 0.5)
+        << ",\"p90_us\":" << percentile(route, 0.9)
+        << ",\"p99_us\":" << percentile(route, 0.99)
+        << ",\"max_us\":" << percentile(route, 1) << '}';
+    first = false;
+  }
+  out << "\n]\n";
+}
+
+void writeJson(const AccessRecord &record, std::ostream &out) {
+  out << "{\"timestamp_us\":" << record.timestamp_us
+      << ",\"status\":" << record.status
+      << ",\"bytes_in\":" << record.bytes_in
+      << ",\"bytes_out\":" << record.bytes_out
+      << ",\"read_us\":" << record.read_us
+      << ",\"handle_us\":" << record.handle_us
+      << ",\"write_us\":" << record.write_us
+      << ",\"handler\":" << json::quote(record.handler)
+      << ",\"route\":" << json::quote(record.route)
+      << ",\"client\":" << json::quote(record.client)
+      << ",\"user\":" << json::quote(record.user) << "}\n";
+}
+
+void writeCsvHeader(std::ostream &out) {
+  out << "timestamp_us,status,bytes_in,bytes_out,read_us,handle_us,write_us,"
+         "handler,route,client,user\n";
+}
+
+void writeCsv(const AccessRecord &record, std::ostream &out) {
+  out << record.timestamp_us << ',' << record.status << ','
+      << record.bytes_in << ',' << record.bytes_out << ',' << record.read_us
+      << ',' << record.handle_us << ',' << record.write_us << ','
+      << csvField(record.handler) << ',' << csvField(record.route) << ','
+      << csvField(record.client) << ',' << csvField(record.user) << '\n';
+}
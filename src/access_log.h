@@ -0,0 +1,120 @@
+/**
+ * Structured access log, one binary record per response.
+ *
+ * A file starts with the 5 byte header "SWAL" 0x01, followed by records.
+ * Each record is its length as a varint and then its fields in a fixed order:
+ * the integers as varints and the strings as a varint length and their bytes.
+ * Encoding is a handful of shifts and appends, and the length prefix lets a
+ * reader detect a record cut short by a crash.
+ *
+ * Records go out through an AppendFile flushed once a second, so a record is
+ * on disk within about a second. The access_log_decode tool turns a file back
+ * into JSON or CSV and computes per-route aggregates.
+ */
+
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include "append_file.h"
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct AccessRecord {
+  uint64_t timestamp_us = 0; // when the request started, since the epoch
+  uint32_t status = 0;
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  // time spent reading and parsing the request, producing the response and
+  // writing it out
+  uint64_t read_us = 0;
+  uint64_t handle_us = 0;
+  uint64_t write_us = 0;
+  std::string handler;
+  std::string route; // the location the request was dispatched to
+  std::string client;
+  std::string user;
+
+  uint64_t latency_us() const { return read_us + handle_us + write_us; }
+};
+
+class AccessLog {
+public:
+  static const char kHeader[];
+  static const size_t kHeaderSize = 5;
+
+  // Open path for appending, writing the header if the file is new. Returns
+  // nullptr if it can't be opened or isn't an access log.
+  static std::shared_ptr<AccessLog>
+  open(const std::string &path,
+       std::chrono::milliseconds flush_interval = std::chrono::seconds(1));
+
+  void write(const AccessRecord &record);
+  void flush() { file_->flush(); }
+
+  // Append record, length prefix included, to *out.
+  static void encode(const AccessRecord &record, std::string *out);
+  // Decode a record body without its length prefix.
+  static bool decode(const std::string &body, AccessRecord *record);
+
+private:
+  explicit AccessLog(std::unique_ptr<AppendFile> file)
+      : file_(std::move(file)) {}
+
+  const std::unique_ptr<AppendFile> file_;
+};
+
+// Reads the records of an access log one at a time.
+class AccessLogReader {
+public:
+  // Checks the header; valid() says whether it was there.
+  explicit AccessLogReader(std::istream &in);
+  bool valid() const { return valid_; }
+  // Read the next record. Returns false at the end of the log, or at a record
+  // that is truncated or malformed, which truncated() tells apart.
+  bool next(AccessRecord *record);
+  bool truncated() const { return truncated_; }
+
+private:
+  std::istream &in_;
+  bool valid_;
+  bool truncated_ = false;
+  std::string body_;
+};
+
+// Per-route request counts, error counts, bytes and latency percentiles.
+class AccessLogSummary {
+public:
+  struct Route {
+    uint64_t requests = 0;
+    uint64_t client_errors = 0; // 4xx
+    uint64_t server_errors = 0; // 5xx
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    std::vector<uint64_t> latencies_us;
+  };
+
+  void add(const AccessRecord &record);
+  const std::map<std::string, Route> &routes() const { return routes_; }
+
+  // The latency below which fraction q of route's requests fall.
+  static uint64_t percentile(const Route &route, double q);
+
+  void writeCsv(std::ostream &out) const;
+  void writeJson(std::ostream &out) const;
+
+private:
+  std::map<std::string, Route> routes_;
+};
+
+// One record as a JSON object or a CSV row, and the matching CSV header.
+void writeJson(const AccessRecord &record, std::ostream &out);
+void writeCsv(const AccessRecord &record, std::ostream &out);
+void writeCsvHeader(std::ostream &out);
+
+#endif // ACCESS_LOG_H
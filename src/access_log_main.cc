@@ -0,0 +1,61 @@
+// Decodes a binary access log ("access_log <path>;") written by the server.
+//
+// Usage: access_log_decode [--csv] [--summary] <file>
+// Prints one JSON object per record, or CSV rows with --csv. With --summary
+// it prints per-route request and error counts, bytes and latency percentiles
+// instead. A record cut short at the end of the file, as a crash can leave
+// it, is reported and ends the output.
+#include "access_log.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char *argv[]) {
+  bool csv = false, summary = false;
+  const char *file = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--csv") == 0)
+      csv = true;
+    else if (std::strcmp(argv[i], "--summary") == 0)
+      summary = true;
+    else if (!file && argv[i][0] != '-')
+      file = argv[i];
+    else
+      file = nullptr, argc = 0;
+  }
+  if (!file) {
+    std::fprintf(stderr, "usage: %s [--csv] [--summary] <file>\n", argv[0]);
+    return 1;
+  }
+  std::ifstream in(file, std::ios::binary);
+  AccessLogReader reader(in);
+  if (!reader.valid()) {
+    std::fprintf(stderr, "%s: not an access log\n", file);
+    return 1;
+  }
+
+  AccessRecord record;
+  AccessLogSummary aggregates;
+  if (csv && !summary)
+    writeCsvHeader(std::cout);
+  while (reader.next(&record)) {
+    if (summary)
+      aggregates.add(record);
+    else if (csv)
+      writeCsv(record, std::cout);
+    else
+      writeJson(record, std::cout);
+  }
+  if (summary) {
+    if (csv)
+      aggregates.writeCsv(std::cout);
+    else
+      aggregates.writeJson(std::cout);
+  }
+  if (reader.truncated()) {
+    std::fprintf(stderr, "%s: truncated record at the end\n", file);
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,192 @@
+#include "caching_crud_handler.h"
+#include <cstdlib>
+#include <functional>
+
+const size_t CachingCRUDHandler::kShards;
+const size_t CachingCRUDHandler::kEntryOverhead;
+
+CachingCRUDHandler::CachingCRUDHandler(ICRUDHandler* backend, size_t capacity_bytes)
+    : backend_(backend), shard_capacity_(capacity_bytes / kShards) {}
+
+std::string CachingCRUDHandler::key(const std::string& entity, int id) {
+    return entity + "/" + std::to_string(id);
+}
+
+CachingCRUDHandler::Shard& CachingCRUDHandler::shardFor(const std::string& key) {
+    return shards_[std::hash<std::string>()(key) % kShards];
+}
+
+/**
+ * lookup() - Find key in its shard and mark it most recently used.
+ */
+CachingCRUDHandler::Lookup CachingCRUDHandler::lookup(const std::string& key) {
+    Shard& shard = shardFor(key);
+    Lookup result;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        result.found = true;
+        result.present = it->second->present;
+        result.body = it->second->body;
+        hits_++;
+        return result;
+    }
+    result.epoch = shard.epoch;
+    misses_++;
+    return result;
+}
+
+void CachingCRUDHandler::fill(const std::string& key, uint64_t epoch,
+                              const std::string* body) {
+    size_t charge = kEntryOverhead + key.size() + (body ? body->size() : 0);
+    if (charge > shard_capacity_) {
+        return;
+    }
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.epoch != epoch) {
+        return;
+    }
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+        shard.bytes -= it->second->charge;
+        shard.lru.erase(it->second);
+        shard.map.erase(it);
+    }
+    while (shard.bytes + charge > shard_capacity_ && !shard.lru.empty()) {
+        shard.bytes -= shard.lru.back().charge;
+        shard.map.erase(shard.lru.back().key);
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front(Entry{key, body != nullptr,
+                               body ? *body : std::string(), charge});
+    shard.map[key] = shard.lru.begin();
+    shard.bytes += charge;
+}
+
+void CachingCRUDHandler::invalidate(const std::string& key) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.epoch++;
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+        shard.bytes -= it->second->charge;
+        shard.lru.erase(it->second);
+        shard.map.erase(it);
+    }
+}
+
+std::string CachingCRUDHandler::create(const std::string& entity, const std::string& data) {
+    std::string result = backend_->create(entity, data);
+    // the new id may have been cached as missing
+    int id = createdId(result);
+    if (id != 0) {
+        invalidate(key(entity, id));
+    }
+    return result;
+}
+
+std::string CachingCRUDHandler::read(const std::string& entity, int id) {
+    std::string k = key(entity, id);
+    Lookup cached = lookup(k);
+    if (cached.found) {
+        return cached.body;
+    }
+    // backends read a missing id as "", which can't be told apart from an
+    // empty body, so ask first
+    if (!backend_->exists(entity, id)) {
+        fill(k, cached.epoch, nullptr);
+        return "";
+    }
+    std::string body = backend_->read(entity, id);
+    fill(k, cached.epoch, &body);
+    return body;
+}
+
+bool CachingCRUDHandler::update(const std::string& entity, int id, const std::string& data) {
+    bool updated = backend_->update(entity, id, data);
+    invalidate(key(entity, id));
+    return updated;
+}
+
+bool CachingCRUDHandler::delete_(const std::string& entity, int id) {
+    bool deleted = backend_->delete_(entity, id);
+    invalidate(key(entity, id));
+    return deleted;
+}
+
+bool CachingCRUDHandler::exists(const std::string& entity, int id) {
+    std::string k = key(entity, id);
+    Lookup cached = lookup(k);
+    if (cached.found) {
+        return cached.present;
+    }
+    bool present = backend_->exists(entity, id);
+    // present ids get cached by the read that normally follows
+    if (!present) {
+        fill(k, cached.epoch, nullptr);
+    }
+    return present;
+}
+
+std::vector<int> CachingCRUDHandler::list(const std::string& entity) {
+    return backend_->list(entity);
+}
+
+std::vector<int> CachingCRUDHandler::list(const std::string& entity, int after, size_t limit) {
+    return backend_->list(entity, after, limit);
+}
+
+std::vector<BatchResult> CachingCRUDHandler::batch(
+        const std::vector<BatchOperation>& operations) {
+    std::vector<BatchResult> results = backend_->batch(operations);
+    for (size_t i = 0; i < operations.size(); i++) {
+        if (operations[i].type != BatchOperation::kRead && results[i].ok) {
+            invalidate(key(operations[i].entity, results[i].id));
+        }
+    }
+    return results;
+}
+
+bool CachingCRUDHandler::query(const std::string& entity, const std::string& field,
+                               const std::string& value, std::vector<int>* ids) {
+    return backend_->query(entity, field, value, ids);
+}
+
+uint64_t CachingCRUDHandler::version(const std::string& entity, int id) {
+    return backend_->version(entity, id);
+}
+
+ICRUDHandler::WriteStatus CachingCRUDHandler::updateIf(const std::string& entity, int id,
+                                                       const std::string& data,
+                                                       uint64_t expected, uint64_t* version) {
+    WriteStatus status = backend_->updateIf(entity, id, data, expected, version);
+    invalidate(key(entity, id));
+    return status;
+}
+
+ICRUDHandler::WriteStatus CachingCRUDHandler::deleteIf(const std::string& entity, int id,
+                                                       uint64_t expected) {
+    WriteStatus status = backend_->deleteIf(entity, id, expected);
+    invalidate(key(entity, id));
+    return status;
+}
+
+size_t CachingCRUDHandler::bytes() const {
+    size_t total = 0;
+    for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.bytes;
+    }
+    return total;
+}
+
+size_t CachingCRUDHandler::entries() const {
+    size_t total = 0;
+    for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.map.size();
+    }
+    return total;
+}
@@ -0,0 +1,91 @@
+#ifndef CACHING_CRUD_HANDLER_H
+#define CACHING_CRUD_HANDLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "crud_handler.h"
+
+// Read-through cache in front of another CRUD backend.
+//
+// Entity bodies are kept in kShards independently locked LRU lists whose
+// combined size stays under a byte budget. Lookups of ids that do not exist
+// are cached too, so repeated misses don't reach the backend either. Every
+// write through this handler invalidates the affected id.
+class CachingCRUDHandler : public ICRUDHandler {
+public:
+    static const size_t kShards = 16;
+    // bookkeeping charged per entry on top of its key and body
+    static const size_t kEntryOverhead = 64;
+
+    // takes ownership of backend
+    CachingCRUDHandler(ICRUDHandler* backend, size_t capacity_bytes);
+
+    std::string create(const std::string& entity, const std::string& data) override;
+    std::string read(const std::string& entity, int id) override;
+    bool update(const std::string& entity, int id, const std::string& data) override;
+    bool delete_(const std::string& entity, int id) override;
+    bool exists(const std::string& entity, int id) override;
+    std::vector<int> list(const std::string& entity) override;
+    std::vector<int> list(const std::string& entity, int after, size_t limit) override;
+    // runs on the backend, so its writes stay grouped; reads bypass the cache
+    std::vector<BatchResult> batch(const std::vector<BatchOperation>& operations) override;
+    bool query(const std::string& entity, const std::string& field,
+               const std::string& value, std::vector<int>* ids) override;
+    uint64_t version(const std::string& entity, int id) override;
+    WriteStatus updateIf(const std::string& entity, int id, const std::string& data,
+                         uint64_t expected, uint64_t* version = nullptr) override;
+    WriteStatus deleteIf(const std::string& entity, int id, uint64_t expected) override;
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+    size_t bytes() const;
+    size_t entries() const;
+
+private:
+    struct Entry {
+        std::string key;
+        bool present;       // false for a cached "does not exist"
+        std::string body;
+        size_t charge;
+    };
+    typedef std::list<Entry> EntryList;
+
+    struct Shard {
+        mutable std::mutex mutex;
+        EntryList lru;      // most recently used first
+        std::unordered_map<std::string, EntryList::iterator> map;
+        size_t bytes = 0;
+        // bumped by every invalidation, so a fill that raced with a write
+        // does not store what it read before the write
+        uint64_t epoch = 0;
+    };
+
+    static std::string key(const std::string& entity, int id);
+    Shard& shardFor(const std::string& key);
+
+    // result of a lookup; when found is false, epoch is the ticket for fill()
+    struct Lookup {
+        bool found = false;
+        bool present = false;
+        std::string body;
+        uint64_t epoch = 0;
+    };
+    Lookup lookup(const std::string& key);
+    // store body for key, or a "does not exist" entry if body is null
+    void fill(const std::string& key, uint64_t epoch, const std::string* body);
+    void invalidate(const std::string& key);
+
+    std::unique_ptr<ICRUDHandler> backend_;
+    const size_t shard_capacity_;
+    Shard shards_[kShards];
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
+
+#endif // CACHING_CRUD_HANDLER_H
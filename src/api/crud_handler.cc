@@ -1,51 +1,315 @@
 #include "crud_handler.h"
 #include <boost/filesystem.hpp>
+#include <cstdlib>
 #include <fstream>
+#include <set>
 #include <sstream>
 
-CRUDHandler::CRUDHandler(const std::string& base_path) : file_storage_(base_path) {}
+int ICRUDHandler::createdId(const std::string& result) {
+    size_t digits = result.find_first_of("0123456789");
+    return digits == std::string::npos ? 0 : std::atoi(result.c_str() + digits);
+}
+
+std::vector<BatchResult> ICRUDHandler::batch(const std::vector<BatchOperation>& operations) {
+    std::vector<BatchResult> results(operations.size());
+    for (size_t i = 0; i < operations.size(); i++) {
+        const BatchOperation& op = operations[i];
+        BatchResult& result = results[i];
+        result.id = op.id;
+        switch (op.type) {
+        case BatchOperation::kCreate:
+            result.id = createdId(create(op.entity, op.data));
+            result.ok = result.id != 0;
+            break;
+        case BatchOperation::kRead:
+            result.ok = exists(op.entity, op.id);
+            if (result.ok) {
+                result.data = read(op.entity, op.id);
+            }
+            break;
+        case BatchOperation::kUpdate:
+            result.ok = update(op.entity, op.id, op.data);
+            break;
+        case BatchOperation::kDelete:
+            result.ok = delete_(op.entity, op.id);
+            break;
+        }
+    }
+    return results;
+}
+
+/**
+ * updateIf() - Check the version, then update. Not atomic; backends that keep
+ * versions override it.
+ */
+ICRUDHandler::WriteStatus ICRUDHandler::updateIf(const std::string& entity, int id,
+                                                 const std::string& data, uint64_t expected,
+                                                 uint64_t* version) {
+    if (expected != 0 && this->version(entity, id) != expected) {
+        return exists(entity, id) ? kVersionMismatch : kNotFound;
+    }
+    if (!update(entity, id, data)) {
+        return kNotFound;
+    }
+    if (version) {
+        *version = this->version(entity, id);
+    }
+    return kWritten;
+}
+
+ICRUDHandler::WriteStatus ICRUDHandler::deleteIf(const std::string& entity, int id,
+                                                 uint64_t expected) {
+    if (expected != 0 && version(entity, id) != expected) {
+        return exists(entity, id) ? kVersionMismatch : kNotFound;
+    }
+    return delete_(entity, id) ? kWritten : kNotFound;
+}
+
+CRUDHandler::CRUDHandler(const std::string& base_path, bool durable,
+                         std::chrono::microseconds commit_window,
+                         FileStorage::Layout layout)
+    : file_storage_(base_path, durable, commit_window, layout) {}
+
+const size_t CRUDHandler::kStripes;
+const size_t CRUDHandler::kMinMappedSize;
+
+std::shared_mutex& CRUDHandler::stripe(const std::string& entity, int id) {
+    size_t hash = std::hash<std::string>()(entity) ^
+                  (static_cast<size_t>(id) * 0x9e3779b97f4a7c15ULL);
+    return stripes_[(hash ^ (hash >> 32)) % kStripes];
+}
+
+CRUDHandler::EntityIds& CRUDHandler::lockEntityIds(const std::string& entity,
+                                                   std::unique_lock<std::mutex>* lock) {
+    EntityIds* ids = nullptr;
+    {
+        std::shared_lock<std::shared_mutex> map_lock(ids_mutex_);
+        auto it = ids_.find(entity);
+        if (it != ids_.end()) {
+            ids = it->second.get();
+        }
+    }
+    if (ids == nullptr) {
+        std::unique_lock<std::shared_mutex> map_lock(ids_mutex_);
+        std::unique_ptr<EntityIds>& slot = ids_[entity];
+        if (!slot) {
+            slot.reset(new EntityIds());
+        }
+        ids = slot.get();
+    }
+
+    *lock = std::unique_lock<std::mutex>(ids->mutex);
+    if (!ids->loaded) {
+        std::vector<int> on_disk = file_storage_.listIds(entity);
+        ids->live.insert(on_disk.begin(), on_disk.end());
+        for (int id : ids->live) {
+            while (ids->next < id) {
+                ids->free.insert(ids->next++);
+            }
+            ids->next = id + 1;
+        }
+        ids->loaded = true;
+    }
+    return *ids;
+}
 
 int CRUDHandler::getNextId(const std::string& entity) {
-    // start at id(1) if no other entitties
-    int id = 1;
-    // get next available id
-    while (boost::filesystem::exists(file_storage_.getPath(entity, id))) {
-        ++id;
+    std::unique_lock<std::mutex> lock;
+    EntityIds& ids = lockEntityIds(entity, &lock);
+    // reuse the lowest freed id first, otherwise extend the range
+    if (ids.free.empty()) {
+        return ids.next++;
     }
+    int id = *ids.free.begin();
+    ids.free.erase(ids.free.begin());
     return id;
 }
 
+void CRUDHandler::publishId(const std::string& entity, int id) {
+    std::unique_lock<std::mutex> lock;
+    lockEntityIds(entity, &lock).live.insert(id);
+}
+
+void CRUDHandler::releaseId(const std::string& entity, int id) {
+    std::unique_lock<std::mutex> lock;
+    EntityIds& ids = lockEntityIds(entity, &lock);
+    ids.live.erase(id);
+    if (id < ids.next) {
+        ids.free.insert(id);
+    }
+}
+
 std::string CRUDHandler::create(const std::string& entity, const std::string& data) {
     int id = getNextId(entity);
-    file_storage_.write(entity, id, data);
+    {
+        std::unique_lock<std::shared_mutex> lock(stripe(entity, id));
+        if (!file_storage_.write(entity, id, data)) {
+            releaseId(entity, id);
+            return "";
+        }
+        publishId(entity, id);
+    }
     std::ostringstream oss;
     oss << "{\"id\": " << id << "}";
     return oss.str();
 }
 
 std::string CRUDHandler::read(const std::string& entity, int id) {
+    std::shared_lock<std::shared_mutex> lock(stripe(entity, id));
     return file_storage_.read(entity, id);
 }
 
+std::shared_ptr<const MappedFile> CRUDHandler::readMapped(const std::string& entity, int id) {
+    std::shared_lock<std::shared_mutex> lock(stripe(entity, id));
+    return file_storage_.map(entity, id, kMinMappedSize);
+}
+
 bool CRUDHandler::update(const std::string& entity, int id, const std::string& data) {
-    if (!CRUDHandler::exists(entity, id)) {
+    std::unique_lock<std::shared_mutex> lock(stripe(entity, id));
+    if (!existsLocked(entity, id)) {
         return false;
     }
-    file_storage_.write(entity, id, data);
-    return true;
+    return file_storage_.write(entity, id, data);
 }
 
 bool CRUDHandler::delete_(const std::string& entity, int id) {
-    if (!CRUDHandler::exists(entity, id)) {
+    std::unique_lock<std::shared_mutex> lock(stripe(entity, id));
+    if (!existsLocked(entity, id)) {
         return false;
     }
     file_storage_.remove(entity, id);
+    releaseId(entity, id);
     return true;
 }
 
 bool CRUDHandler::exists(const std::string& entity, int id) {
-    if (boost::filesystem::exists(file_storage_.getPath(entity, id))) {
-        return true;
+    std::shared_lock<std::shared_mutex> lock(stripe(entity, id));
+    return existsLocked(entity, id);
+}
+
+bool CRUDHandler::existsLocked(const std::string& entity, int id) {
+    return file_storage_.exists(entity, id);
+}
+
+std::vector<int> CRUDHandler::list(const std::string& entity) {
+    std::unique_lock<std::mutex> lock;
+    const std::set<int>& live = lockEntityIds(entity, &lock).live;
+    return std::vector<int>(live.begin(), live.end());
+}
+
+std::vector<int> CRUDHandler::list(const std::string& entity, int after, size_t limit) {
+    std::unique_lock<std::mutex> lock;
+    const std::set<int>& live = lockEntityIds(entity, &lock).live;
+    std::vector<int> ids;
+    for (auto it = live.upper_bound(after); it != live.end() && ids.size() < limit; ++it) {
+        ids.push_back(*it);
+    }
+    return ids;
+}
+
+std::vector<BatchResult> CRUDHandler::batch(const std::vector<BatchOperation>& operations) {
+    std::vector<BatchResult> results(operations.size());
+    size_t i = 0;
+    while (i < operations.size()) {
+        // extend a run of writes until an operation that is not a write, or
+        // an update of a key the run already writes, since its result would
+        // depend on the order within the run
+        std::set<std::pair<std::string, int>> updated;
+        size_t end = i;
+        while (end < operations.size()) {
+            const BatchOperation& op = operations[end];
+            if (op.type == BatchOperation::kUpdate) {
+                if (!updated.insert(std::make_pair(op.entity, op.id)).second) {
+                    break;
+                }
+            } else if (op.type != BatchOperation::kCreate) {
+                break;
+            }
+            end++;
+        }
+        if (end > i) {
+            i = batchWrites(operations, i, end, &results);
+            continue;
+        }
+
+        const BatchOperation& op = operations[i];
+        BatchResult& result = results[i];
+        result.id = op.id;
+        if (op.type == BatchOperation::kRead) {
+            std::shared_lock<std::shared_mutex> lock(stripe(op.entity, op.id));
+            result.ok = existsLocked(op.entity, op.id);
+            if (result.ok) {
+                result.data = file_storage_.read(op.entity, op.id);
+            }
+        } else {
+            result.ok = delete_(op.entity, op.id);
+        }
+        i++;
+    }
+    return results;
+}
+
+/**
+ * batchWrites() - Allocate ids for the creates in [begin, end), lock every
+ * key the run touches and hand all the writes to the storage at once. The
+ * run is cut short before an update of an id it creates, which has to see
+ * the create; returns where it stopped.
+ */
+size_t CRUDHandler::batchWrites(const std::vector<BatchOperation>& operations, size_t begin,
+                                size_t end, std::vector<BatchResult>* results) {
+    std::set<std::pair<std::string, int>> created;
+    for (size_t i = begin; i < end; i++) {
+        const BatchOperation& op = operations[i];
+        if (op.type == BatchOperation::kUpdate) {
+            if (created.count(std::make_pair(op.entity, op.id))) {
+                end = i;
+                break;
+            }
+            (*results)[i].id = op.id;
+        } else {
+            (*results)[i].id = getNextId(op.entity);
+            created.insert(std::make_pair(op.entity, (*results)[i].id));
+        }
+    }
+
+    // stripes are always taken in ascending order, so two batches can't deadlock
+    std::set<std::shared_mutex*> stripes;
+    for (size_t i = begin; i < end; i++) {
+        stripes.insert(&stripe(operations[i].entity, (*results)[i].id));
+    }
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    for (std::shared_mutex* mutex : stripes) {
+        locks.emplace_back(*mutex);
     }
-    return false;
-}
\ No newline at end of file
+
+    std::vector<FileStorage::Write> writes;
+    std::vector<size_t> indexes;   // operation index of each entry in writes
+    for (size_t i = begin; i < end; i++) {
+        const BatchOperation& op = operations[i];
+        if (op.type == BatchOperation::kUpdate && !existsLocked(op.entity, op.id)) {
+            continue;
+        }
+        writes.push_back(FileStorage::Write{&op.entity, (*results)[i].id, &op.data});
+        indexes.push_back(i);
+    }
+    std::vector<bool> ok;
+    file_storage_.writeAll(writes, &ok);
+    for (size_t w = 0; w < writes.size(); w++) {
+        (*results)[indexes[w]].ok = ok[w];
+    }
+
+    for (size_t i = begin; i < end; i++) {
+        const BatchOperation& op = operations[i];
+        BatchResult& result = (*results)[i];
+        if (op.type != BatchOperation::kCreate) {
+            continue;
+        }
+        if (result.ok) {
+            publishId(op.entity, result.id);
+        } else {
+            releaseId(op.entity, result.id);
+            result.id = 0;
+        }
+    }
+    return end;
+}
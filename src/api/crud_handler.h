@@ -1,34 +1,146 @@
 #ifndef CRUD_HANDLER_H
 #define CRUD_HANDLER_H
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include "file_storage.h"
+#include "mapped_file.h"
+
+// One operation of a batch. id is unused by creates, data only by creates and updates.
+struct BatchOperation {
+    enum Type { kCreate, kRead, kUpdate, kDelete };
+    Type type;
+    std::string entity;
+    int id = 0;
+    std::string data;
+};
+
+// Outcome of one BatchOperation.
+struct BatchResult {
+    bool ok = false;     // false if the id does not exist or the write failed
+    int id = 0;          // the new id for a create, otherwise the operation's
+    std::string data;    // the body for a read
+};
 
 // CRUD handler interface class to handle CRUD operations as assigned by the api request handler
 class ICRUDHandler {
 public:
     ICRUDHandler() = default;
+    // answers {"id": N}, or "" if the write failed
     virtual std::string create(const std::string& entity, const std::string& data) = 0;
     virtual std::string read(const std::string& entity, int id) = 0;
     virtual bool update(const std::string& entity, int id, const std::string& data) = 0;
     virtual bool delete_(const std::string& entity, int id) = 0;
     virtual bool exists(const std::string& entity, int id) = 0;
+    // ids of every stored instance of entity, in ascending order
+    virtual std::vector<int> list(const std::string& entity) = 0;
+    // at most limit ids of entity greater than after, in ascending order
+    virtual std::vector<int> list(const std::string& entity, int after, size_t limit) {
+        std::vector<int> ids = list(entity);
+        auto begin = std::upper_bound(ids.begin(), ids.end(), after);
+        auto end = begin + std::min<size_t>(limit, ids.end() - begin);
+        return std::vector<int>(begin, end);
+    }
+    // zero-copy alternative to read() for large bodies; null means use read()
+    virtual std::shared_ptr<const MappedFile> readMapped(const std::string& entity, int id) {
+        return nullptr;
+    }
+    // Ids of entity whose indexed field equals value, in ascending order.
+    // Returns false if the backend keeps no index on field.
+    virtual bool query(const std::string& entity, const std::string& field,
+                       const std::string& value, std::vector<int>* ids) {
+        return false;
+    }
+    // Run operations in order and report each one's outcome. Backends may
+    // group the underlying I/O; the default just calls the methods above.
+    virtual std::vector<BatchResult> batch(const std::vector<BatchOperation>& operations);
+
+    // outcome of a conditional write
+    enum WriteStatus { kWritten, kNotFound, kVersionMismatch };
+    // Version of a stored instance: positive, and larger after every write to
+    // it. 0 if the instance does not exist or the backend keeps no versions.
+    virtual uint64_t version(const std::string& entity, int id) { return 0; }
+    // update() and delete_() that only go ahead while version() still equals
+    // expected; 0 skips the check. Backends that keep versions check and write
+    // atomically. updateIf() stores the new version in *version if it isn't null.
+    virtual WriteStatus updateIf(const std::string& entity, int id, const std::string& data,
+                                 uint64_t expected, uint64_t* version = nullptr);
+    virtual WriteStatus deleteIf(const std::string& entity, int id, uint64_t expected);
+
+    // Make an existing instance expire ttl from now: after that it reads as
+    // missing and is deleted. A zero ttl takes its expiry away. Returns false
+    // if the instance does not exist or the backend can't expire instances.
+    virtual bool expire(const std::string& entity, int id, std::chrono::seconds ttl) {
+        return false;
+    }
+
+    // the N of a create() answer, or 0 if the create failed
+    static int createdId(const std::string& result);
+
     virtual ~ICRUDHandler() = default;
 };
 
 class CRUDHandler : public ICRUDHandler{
 public:
-    CRUDHandler(const std::string& base_path);
+    CRUDHandler(const std::string& base_path, bool durable = false,
+                std::chrono::microseconds commit_window = std::chrono::microseconds(0),
+                FileStorage::Layout layout = FileStorage::kFlat);
     
     std::string create(const std::string& entity, const std::string& data) override;
     std::string read(const std::string& entity, int id) override;
     bool update(const std::string& entity, int id, const std::string& data) override;
     bool delete_(const std::string& entity, int id) override;
     bool exists(const std::string& entity, int id) override;
+    std::vector<int> list(const std::string& entity) override;
+    std::vector<int> list(const std::string& entity, int after, size_t limit) override;
+    std::shared_ptr<const MappedFile> readMapped(const std::string& entity, int id) override;
+    // consecutive creates and updates are written together, sharing one group commit
+    std::vector<BatchResult> batch(const std::vector<BatchOperation>& operations) override;
+
+    // bodies smaller than this are cheaper to read() than to map
+    static const size_t kMinMappedSize = 64 * 1024;
 
 private:
+    // number of locks that (entity, id) keys are spread over
+    static const size_t kStripes = 64;
+
+    // ids handed out for one entity; built by a single directory scan the first
+    // time the entity is touched and kept in step with create and delete after that
+    struct EntityIds {
+        std::mutex mutex;        // guards everything below
+        bool loaded = false;
+        int next = 1;            // lowest id never handed out
+        std::set<int> free;      // ids below next that are not in use
+        std::set<int> live;      // ids whose data has been written
+    };
+
     FileStorage file_storage_;
+    // Reads and exists take the key's stripe shared, writes take it exclusive,
+    // so operations on one key are linearizable while unrelated keys rarely
+    // contend. Id allocation only locks the entity's own EntityIds.
+    std::shared_mutex stripes_[kStripes];
+    std::shared_mutex ids_mutex_;   // guards the map itself, not its values
+    std::unordered_map<std::string, std::unique_ptr<EntityIds>> ids_;
+
+    std::shared_mutex& stripe(const std::string& entity, int id);
     int getNextId(const std::string& entity);
+    void publishId(const std::string& entity, int id);
+    void releaseId(const std::string& entity, int id);
+    // find or load entity's ids and lock them into lock
+    EntityIds& lockEntityIds(const std::string& entity, std::unique_lock<std::mutex>* lock);
+    bool existsLocked(const std::string& entity, int id);
+    // run a prefix of operations [begin, end), all creates and updates of
+    // distinct existing keys; returns the end of the prefix
+    size_t batchWrites(const std::vector<BatchOperation>& operations, size_t begin,
+                       size_t end, std::vector<BatchResult>* results);
 };
 
 #endif // CRUD_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,451 @@
+#include "expiring_crud_handler.h"
+#include "../logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+const size_t ExpiringCRUDHandler::kMinJournalGarbage;
+const size_t ExpiringCRUDHandler::kStripes;
+
+namespace {
+
+uint64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+std::string journalLine(uint64_t deadline, const std::string& entity, int id) {
+    return std::to_string(deadline) + " " + std::to_string(id) + " " + entity + "\n";
+}
+
+} // namespace
+
+/**
+ * Constructor - Rebuild the deadlines from the journal, and start the reclaim
+ * thread if it held any.
+ */
+ExpiringCRUDHandler::ExpiringCRUDHandler(ICRUDHandler* backend,
+                                         const std::string& journal_path,
+                                         std::chrono::milliseconds reclaim_interval,
+                                         Clock clock)
+    : backend_(backend), journal_path_(journal_path),
+      reclaim_interval_(reclaim_interval), clock_(clock ? clock : nowSeconds),
+      wheel_(clock_()) {
+    loadJournal();
+    if (expiring_ > 0) {
+        startReclaiming();
+    }
+}
+
+ExpiringCRUDHandler::~ExpiringCRUDHandler() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+    if (reclaim_thread_.joinable()) {
+        reclaim_thread_.join();
+    }
+    if (journal_fd_ >= 0) {
+        ::close(journal_fd_);
+    }
+}
+
+std::string ExpiringCRUDHandler::key(const std::string& entity, int id) {
+    return entity + "/" + std::to_string(id);
+}
+
+ExpiringCRUDHandler::Stripe& ExpiringCRUDHandler::stripe(const std::string& key) {
+    return stripes_[std::hash<std::string>()(key) % kStripes];
+}
+
+bool ExpiringCRUDHandler::clearLocked(Stripe& stripe, const std::string& key,
+                                      const std::string& entity, int id) {
+    auto it = stripe.deadlines.find(key);
+    if (it == stripe.deadlines.end()) {
+        return true;
+    }
+    stripe.deadlines.erase(it);
+    expiring_--;
+    {
+        std::lock_guard<std::mutex> lock(wheel_mutex_);
+        wheel_.cancel(key);
+    }
+    // a freed id can be handed out again, so its deadline must not come back
+    // at the next startup
+    return appendJournal(0, entity, id);
+}
+
+bool ExpiringCRUDHandler::expiredLocked(Stripe& stripe, const std::string& key,
+                                        const std::string& entity, int id) {
+    auto it = stripe.deadlines.find(key);
+    if (it == stripe.deadlines.end() || it->second > clock_()) {
+        return false;
+    }
+    backend_->delete_(entity, id);
+    clearLocked(stripe, key, entity, id);
+    return true;
+}
+
+bool ExpiringCRUDHandler::expired(const std::string& entity, int id) {
+    if (expiring_ == 0) {
+        return false;
+    }
+    std::string k = key(entity, id);
+    Stripe& s = stripe(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return expiredLocked(s, k, entity, id);
+}
+
+void ExpiringCRUDHandler::filterExpired(const std::string& entity, std::vector<int>* ids) {
+    if (expiring_ == 0) {
+        return;
+    }
+    uint64_t now = clock_();
+    ids->erase(std::remove_if(ids->begin(), ids->end(),
+                              [&](int id) {
+                                  std::string k = key(entity, id);
+                                  Stripe& s = stripe(k);
+                                  std::lock_guard<std::mutex> lock(s.mutex);
+                                  auto it = s.deadlines.find(k);
+                                  return it != s.deadlines.end() && it->second <= now;
+                              }),
+               ids->end());
+}
+
+std::string ExpiringCRUDHandler::create(const std::string& entity, const std::string& data) {
+    std::string result = backend_->create(entity, data);
+    int id = createdId(result);
+    if (id != 0 && expiring_ > 0) {
+        // new instances start without a deadline, whatever the id had before
+        std::string k = key(entity, id);
+        Stripe& s = stripe(k);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        clearLocked(s, k, entity, id);
+    }
+    return result;
+}
+
+std::string ExpiringCRUDHandler::read(const std::string& entity, int id) {
+    return expired(entity, id) ? "" : backend_->read(entity, id);
+}
+
+bool ExpiringCRUDHandler::update(const std::string& entity, int id, const std::string& data) {
+    return updateIf(entity, id, data, 0) == kWritten;
+}
+
+bool ExpiringCRUDHandler::delete_(const std::string& entity, int id) {
+    return deleteIf(entity, id, 0) == kWritten;
+}
+
+bool ExpiringCRUDHandler::exists(const std::string& entity, int id) {
+    return !expired(entity, id) && backend_->exists(entity, id);
+}
+
+std::vector<int> ExpiringCRUDHandler::list(const std::string& entity) {
+    std::vector<int> ids = backend_->list(entity);
+    filterExpired(entity, &ids);
+    return ids;
+}
+
+/**
+ * list() - Page of ids after after, topped up from further pages as far as
+ * expired ids had to be dropped, so a short page still means the end.
+ */
+std::vector<int> ExpiringCRUDHandler::list(const std::string& entity, int after,
+                                           size_t limit) {
+    if (expiring_ == 0) {
+        return backend_->list(entity, after, limit);
+    }
+    std::vector<int> live;
+    size_t want = limit;
+    while (true) {
+        std::vector<int> ids = backend_->list(entity, after, want);
+        bool more = ids.size() == want;
+        if (!ids.empty()) {
+            after = ids.back();
+        }
+        filterExpired(entity, &ids);
+        live.insert(live.end(), ids.begin(), ids.end());
+        if (!more || live.size() >= limit) {
+            return live;
+        }
+        want = limit - live.size();
+    }
+}
+
+std::shared_ptr<const MappedFile> ExpiringCRUDHandler::readMapped(const std::string& entity,
+                                                                  int id) {
+    return expired(entity, id) ? nullptr : backend_->readMapped(entity, id);
+}
+
+/**
+ * batch() - Run operations on the backend once every expired instance they
+ * touch is gone, so those see a missing id just like single requests do.
+ */
+std::vector<BatchResult> ExpiringCRUDHandler::batch(
+    const std::vector<BatchOperation>& operations) {
+    if (expiring_ > 0) {
+        for (const BatchOperation& operation : operations) {
+            if (operation.type != BatchOperation::kCreate) {
+                expired(operation.entity, operation.id);
+            }
+        }
+    }
+    std::vector<BatchResult> results = backend_->batch(operations);
+    if (expiring_ > 0) {
+        for (size_t i = 0; i < operations.size(); i++) {
+            if (!results[i].ok || (operations[i].type != BatchOperation::kCreate &&
+                                   operations[i].type != BatchOperation::kDelete)) {
+                continue;
+            }
+            std::string k = key(operations[i].entity, results[i].id);
+            Stripe& s = stripe(k);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            clearLocked(s, k, operations[i].entity, results[i].id);
+        }
+    }
+    return results;
+}
+
+bool ExpiringCRUDHandler::query(const std::string& entity, const std::string& field,
+                                const std::string& value, std::vector<int>* ids) {
+    if (!backend_->query(entity, field, value, ids)) {
+        return false;
+    }
+    filterExpired(entity, ids);
+    return true;
+}
+
+uint64_t ExpiringCRUDHandler::version(const std::string& entity, int id) {
+    return expired(entity, id) ? 0 : backend_->version(entity, id);
+}
+
+ICRUDHandler::WriteStatus ExpiringCRUDHandler::updateIf(const std::string& entity, int id,
+                                                        const std::string& data,
+                                                        uint64_t expected,
+                                                        uint64_t* version) {
+    std::string k = key(entity, id);
+    Stripe& s = stripe(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (expiredLocked(s, k, entity, id)) {
+        return kNotFound;
+    }
+    return backend_->updateIf(entity, id, data, expected, version);
+}
+
+ICRUDHandler::WriteStatus ExpiringCRUDHandler::deleteIf(const std::string& entity, int id,
+                                                        uint64_t expected) {
+    std::string k = key(entity, id);
+    Stripe& s = stripe(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (expiredLocked(s, k, entity, id)) {
+        return kNotFound;
+    }
+    WriteStatus status = backend_->deleteIf(entity, id, expected);
+    if (status == kWritten) {
+        clearLocked(s, k, entity, id);
+    }
+    return status;
+}
+
+bool ExpiringCRUDHandler::expire(const std::string& entity, int id, std::chrono::seconds ttl) {
+    std::string k = key(entity, id);
+    Stripe& s = stripe(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (expiredLocked(s, k, entity, id) || !backend_->exists(entity, id)) {
+        return false;
+    }
+    if (ttl.count() <= 0) {
+        return clearLocked(s, k, entity, id);
+    }
+    uint64_t deadline = clock_() + ttl.count();
+    auto inserted = s.deadlines.emplace(k, deadline);
+    if (inserted.second) {
+        expiring_++;
+    } else {
+        inserted.first->second = deadline;
+    }
+    {
+        std::lock_guard<std::mutex> wheel_lock(wheel_mutex_);
+        wheel_.schedule(k, deadline);
+    }
+    if (!reclaiming_) {
+        startReclaiming();
+    }
+    return appendJournal(deadline, entity, id);
+}
+
+/**
+ * reclaimExpired() - Advance the wheel to now and delete the instances whose
+ * timers fired, unless a write has moved their deadline meanwhile.
+ */
+size_t ExpiringCRUDHandler::reclaimExpired() {
+    std::vector<std::string> due;
+    {
+        std::lock_guard<std::mutex> lock(wheel_mutex_);
+        wheel_.advance(clock_(), &due);
+    }
+    size_t reclaimed = 0;
+    for (const std::string& k : due) {
+        size_t slash = k.rfind('/');
+        std::string entity = k.substr(0, slash);
+        int id = std::atoi(k.c_str() + slash + 1);
+        Stripe& s = stripe(k);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (expiredLocked(s, k, entity, id)) {
+            reclaimed++;
+        }
+    }
+    return reclaimed;
+}
+
+/**
+ * loadJournal() - Replay the journal into the stripes and the wheel. Deadlines
+ * that passed while the server was down fire on the first reclaim. A last
+ * line without its newline was torn by a crash and is ignored.
+ */
+void ExpiringCRUDHandler::loadJournal() {
+    std::ifstream in(journal_path_);
+    if (!in) {
+        return;
+    }
+    std::unordered_map<std::string, uint64_t> deadlines;
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(in, line) && !in.eof()) {
+        lines++;
+        char* end;
+        uint64_t deadline = std::strtoull(line.c_str(), &end, 10);
+        if (*end != ' ') {
+            continue;
+        }
+        int id = std::strtol(end + 1, &end, 10);
+        if (*end != ' ' || id <= 0) {
+            continue;
+        }
+        std::string k = key(end + 1, id);
+        if (deadline == 0) {
+            deadlines.erase(k);
+        } else {
+            deadlines[k] = deadline;
+        }
+    }
+    for (const auto& entry : deadlines) {
+        stripe(entry.first).deadlines.emplace(entry.first, entry.second);
+        wheel_.schedule(entry.first, entry.second);
+    }
+    expiring_ = deadlines.size();
+    journal_lines_ = lines;
+    if (lines > deadlines.size()) {
+        compactJournal();
+    }
+}
+
+bool ExpiringCRUDHandler::appendJournal(uint64_t deadline, const std::string& entity,
+                                        int id) {
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    if (journal_fd_ < 0) {
+        journal_fd_ = ::open(journal_path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                             0644);
+        if (journal_fd_ < 0) {
+            Logger::getLogger()->logErrorFile("Unable to open TTL journal " + journal_path_);
+            return false;
+        }
+    }
+    journal_lines_++;
+    return writeAll(journal_fd_, journalLine(deadline, entity, id));
+}
+
+/**
+ * compactJournal() - Write the current deadlines to a new journal and rename
+ * it over the old one. Every stripe is held meanwhile so no deadline changes
+ * under it.
+ */
+void ExpiringCRUDHandler::compactJournal() {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (Stripe& s : stripes_) {
+        locks.emplace_back(s.mutex);
+    }
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    std::string tmp_path = journal_path_ + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        Logger::getLogger()->logErrorFile("Unable to rewrite TTL journal " + journal_path_);
+        return;
+    }
+    bool ok = true;
+    size_t lines = 0;
+    std::string buffer;
+    for (Stripe& s : stripes_) {
+        for (const auto& entry : s.deadlines) {
+            size_t slash = entry.first.rfind('/');
+            buffer += journalLine(entry.second, entry.first.substr(0, slash),
+                                  std::atoi(entry.first.c_str() + slash + 1));
+            lines++;
+        }
+        if (buffer.size() >= 1 << 20) {
+            ok = ok && writeAll(fd, buffer);
+            buffer.clear();
+        }
+    }
+    ok = ok && writeAll(fd, buffer);
+    ::close(fd);
+    if (!ok || std::rename(tmp_path.c_str(), journal_path_.c_str()) != 0) {
+        Logger::getLogger()->logErrorFile("Unable to rewrite TTL journal " + journal_path_);
+        std::remove(tmp_path.c_str());
+        return;
+    }
+    if (journal_fd_ >= 0) {
+        ::close(journal_fd_);
+        journal_fd_ = -1;
+    }
+    journal_lines_ = lines;
+}
+
+void ExpiringCRUDHandler::startReclaiming() {
+    if (reclaim_interval_.count() <= 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    if (!reclaim_thread_.joinable() && !stopping_) {
+        reclaim_thread_ = std::thread(&ExpiringCRUDHandler::reclaimLoop, this);
+        reclaiming_ = true;
+    }
+}
+
+void ExpiringCRUDHandler::reclaimLoop() {
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    while (!stop_cv_.wait_for(lock, reclaim_interval_, [this] { return stopping_; })) {
+        lock.unlock();
+        size_t reclaimed = reclaimExpired();
+        if (reclaimed > 0) {
+            LOGGER_DEBUG("Reclaimed " + std::to_string(reclaimed) + " expired entities");
+        }
+        size_t lines;
+        {
+            std::lock_guard<std::mutex> journal_lock(journal_mutex_);
+            lines = journal_lines_;
+        }
+        if (lines > 2 * expiring_ + kMinJournalGarbage) {
+            compactJournal();
+        }
+        lock.lock();
+    }
+}
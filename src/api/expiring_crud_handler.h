@@ -0,0 +1,127 @@
+#ifndef EXPIRING_CRUD_HANDLER_H
+#define EXPIRING_CRUD_HANDLER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "crud_handler.h"
+#include "timer_wheel.h"
+
+// Lets stored instances expire a given number of seconds after a write.
+//
+// Deadlines are kept per key in memory and indexed by a TimerWheel ticking in
+// seconds. An expired instance reads as missing from the moment its deadline
+// passes: any access to it deletes it on the spot, and a background thread
+// advances the wheel and deletes the rest. Deadlines are also appended to a
+// journal, "<deadline> <id> <entity>" per line with 0 for a removed deadline,
+// which is replayed at startup and rewritten once it is mostly dead lines.
+// Neither the thread nor the journal file exist until there is a deadline, so
+// a location whose instances never expire pays nothing for them.
+// The journal is not fsynced, so a crash can lose the deadlines set just
+// before it.
+//
+// Sits at the top of the handler chain so reclaiming deletes go through any
+// caches and indexes below.
+class ExpiringCRUDHandler : public ICRUDHandler {
+public:
+    // wall clock time in seconds
+    typedef std::function<uint64_t()> Clock;
+
+    // Takes ownership of backend and replays the journal at journal_path, if
+    // there is one. A zero reclaim_interval leaves reclaiming to explicit
+    // reclaimExpired() calls and lazy deletes.
+    ExpiringCRUDHandler(ICRUDHandler* backend, const std::string& journal_path,
+                        std::chrono::milliseconds reclaim_interval = std::chrono::seconds(1),
+                        Clock clock = nullptr);
+    ~ExpiringCRUDHandler() override;
+
+    std::string create(const std::string& entity, const std::string& data) override;
+    std::string read(const std::string& entity, int id) override;
+    bool update(const std::string& entity, int id, const std::string& data) override;
+    bool delete_(const std::string& entity, int id) override;
+    bool exists(const std::string& entity, int id) override;
+    std::vector<int> list(const std::string& entity) override;
+    std::vector<int> list(const std::string& entity, int after, size_t limit) override;
+    std::shared_ptr<const MappedFile> readMapped(const std::string& entity, int id) override;
+    std::vector<BatchResult> batch(const std::vector<BatchOperation>& operations) override;
+    bool query(const std::string& entity, const std::string& field,
+               const std::string& value, std::vector<int>* ids) override;
+    uint64_t version(const std::string& entity, int id) override;
+    WriteStatus updateIf(const std::string& entity, int id, const std::string& data,
+                         uint64_t expected, uint64_t* version = nullptr) override;
+    WriteStatus deleteIf(const std::string& entity, int id, uint64_t expected) override;
+    bool expire(const std::string& entity, int id, std::chrono::seconds ttl) override;
+
+    // delete every instance whose deadline has passed; returns how many
+    size_t reclaimExpired();
+    // number of instances with a deadline
+    size_t expiring() const { return expiring_; }
+    // whether the background thread has been started
+    bool reclaiming() const { return reclaiming_; }
+
+    // the journal is rewritten once it has this many lines more than twice
+    // the number of deadlines
+    static const size_t kMinJournalGarbage = 4096;
+
+private:
+    static const size_t kStripes = 64;
+
+    // Writes to a key and changes to its deadline hold the key's stripe, so
+    // an instance is never reclaimed after a write has given it a new life.
+    struct Stripe {
+        std::mutex mutex;
+        // "entity/id" -> deadline
+        std::unordered_map<std::string, uint64_t> deadlines;
+    };
+
+    static std::string key(const std::string& entity, int id);
+    Stripe& stripe(const std::string& key);
+    // whether entity/id is past its deadline; if so it is deleted
+    bool expired(const std::string& entity, int id);
+    // caller holds the key's stripe
+    bool expiredLocked(Stripe& stripe, const std::string& key, const std::string& entity,
+                       int id);
+    bool clearLocked(Stripe& stripe, const std::string& key, const std::string& entity,
+                     int id);
+    // drop the ids of entity that are past their deadline
+    void filterExpired(const std::string& entity, std::vector<int>* ids);
+
+    void loadJournal();
+    bool appendJournal(uint64_t deadline, const std::string& entity, int id);
+    // rewrite the journal with one line per current deadline
+    void compactJournal();
+    // start the reclaim thread unless it is running or disabled
+    void startReclaiming();
+    void reclaimLoop();
+
+    std::unique_ptr<ICRUDHandler> backend_;
+    const std::string journal_path_;
+    const std::chrono::milliseconds reclaim_interval_;
+    Clock clock_;
+
+    Stripe stripes_[kStripes];
+    std::atomic<size_t> expiring_{0};   // 0 lets reads skip the stripes
+
+    std::mutex wheel_mutex_;            // taken after a stripe, never before
+    TimerWheel wheel_;
+
+    std::mutex journal_mutex_;          // likewise
+    int journal_fd_ = -1;               // opened on the first append
+    size_t journal_lines_ = 0;
+
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    std::atomic<bool> reclaiming_{false};   // set once reclaim_thread_ runs
+    std::thread reclaim_thread_;
+};
+
+#endif // EXPIRING_CRUD_HANDLER_H
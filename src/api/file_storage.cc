@@ -1,36 +1,366 @@
 #include "file_storage.h"
 #include <boost/filesystem.hpp>
 #include <fstream>
+#include <set>
 #include <sstream>
 #include <filesystem>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 
-FileStorage::FileStorage(const std::string& base_path) : base_path_(base_path) {}
+namespace {
 
-void FileStorage::write(const std::string& entity, int id, const std::string& data) {
+// id file names are all digits, which also keeps them apart from temp files
+bool parseId(const std::string& name, int* id) {
+    if (name.empty() || name.size() > 9 ||
+        name.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    *id = std::stoi(name);
+    return *id > 0;
+}
+
+// Shard directories are named by a byte of the id's hash written as two
+// letters 'a' to 'p', one per nibble. Plain hex won't do: a name like "13"
+// could collide with the flat file of id 13, which shares the directory
+// until it is migrated.
+void appendShardName(uint32_t byte, std::string* out) {
+    out->push_back(static_cast<char>('a' + ((byte >> 4) & 0xf)));
+    out->push_back(static_cast<char>('a' + (byte & 0xf)));
+}
+
+bool isShardName(const std::string& name) {
+    return name.size() == 2 && name.find_first_not_of("abcdefghijklmnop") == std::string::npos;
+}
+
+bool syncDirectory(const std::string& dir) {
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+} // namespace
+
+FileStorage::FileStorage(const std::string& base_path, bool durable,
+                         std::chrono::microseconds commit_window, Layout layout)
+    : base_path_(base_path), layout_(layout) {
+    if (durable) {
+        committer_.reset(new GroupCommitter(commit_window));
+    }
+}
+
+/**
+ * writeTemp() - Write data to a fresh temp file next to path. Returns its
+ * open fd, or -1 if it could not be written.
+ */
+int FileStorage::writeTemp(const std::string& path, const std::string& data,
+                           std::string* temp) {
+    std::error_code ec;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (std::filesystem::create_directories(parent, ec) && committer_) {
+        // the new directories must survive a crash for the file to, so sync
+        // every level that may have gained one, up to where entities live
+        std::filesystem::path top = std::filesystem::path(base_path_).parent_path();
+        std::filesystem::path dir = parent;
+        do {
+            dir = dir.parent_path();
+            syncDirectory(dir.string());
+        } while (dir != top && dir.has_parent_path() && dir != dir.parent_path());
+    }
+
+    // the name is not all digits, so listIds() never mistakes it for an id
+    *temp = path + ".tmp." + std::to_string(getpid()) + "." +
+            std::to_string(temp_counter_++);
+    int fd = ::open(temp->c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ::close(fd);
+            ::unlink(temp->c_str());
+            return -1;
+        }
+        written += n;
+    }
+    return fd;
+}
+
+/**
+ * replace() - Close the temp file open as fd and rename it over path.
+ */
+bool FileStorage::replace(int fd, const std::string& temp, const std::string& path) {
+    // replace rather than truncate, so readers and mappings of the old
+    // contents never see a partial file
+    ::close(fd);
+    if (::rename(temp.c_str(), path.c_str()) != 0) {
+        ::unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool FileStorage::write(const std::string& entity, int id, const std::string& data) {
     std::string path = getPath(entity, id);
-    std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+    std::string temp;
+    int fd = writeTemp(path, data, &temp);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = committer_ ? committer_->commit(fd, temp, path) : replace(fd, temp, path);
+    if (ok) {
+        removeFlat(entity, id);
+    }
+    return ok;
+}
 
-    std::ofstream ofs(path);
-    ofs << data;
-    ofs.flush();
-    ofs.close();
+void FileStorage::writeAll(const std::vector<Write>& writes, std::vector<bool>* ok) {
+    ok->assign(writes.size(), false);
+    std::vector<GroupCommitter::File> files;
+    std::vector<size_t> committed;   // index into writes of each entry in files
+    for (size_t i = 0; i < writes.size(); i++) {
+        std::string path = getPath(*writes[i].entity, writes[i].id);
+        std::string temp;
+        int fd = writeTemp(path, *writes[i].data, &temp);
+        if (fd < 0) {
+            continue;
+        }
+        if (!committer_) {
+            (*ok)[i] = replace(fd, temp, path);
+            if ((*ok)[i]) {
+                removeFlat(*writes[i].entity, writes[i].id);
+            }
+            continue;
+        }
+        files.push_back(GroupCommitter::File{fd, temp, path});
+        committed.push_back(i);
+    }
+    if (files.empty()) {
+        return;
+    }
+    std::vector<bool> files_ok;
+    committer_->commitAll(files, &files_ok);
+    for (size_t i = 0; i < committed.size(); i++) {
+        (*ok)[committed[i]] = files_ok[i];
+    }
+    for (size_t i : committed) {
+        if ((*ok)[i]) {
+            removeFlat(*writes[i].entity, writes[i].id);
+        }
+    }
 }
 
 std::string FileStorage::read(const std::string& entity, int id) {
-    std::string path = getPath(entity, id);
-    std::ifstream ifs(path);
-    std::stringstream buffer;
-    buffer << ifs.rdbuf();
-    return buffer.str();
+    // read straight into the result instead of through a stringstream
+    std::ifstream ifs(getPath(entity, id), std::ios::binary | std::ios::ate);
+    if (!ifs && layout_ == kSharded) {
+        ifs.clear();
+        ifs.open(getFlatPath(entity, id), std::ios::binary | std::ios::ate);
+    }
+    if (!ifs) {
+        return "";
+    }
+    std::string data(static_cast<size_t>(ifs.tellg()), '\0');
+    ifs.seekg(0);
+    ifs.read(&data[0], data.size());
+    data.resize(ifs.gcount());
+    return data;
+}
+
+std::shared_ptr<const MappedFile> FileStorage::map(const std::string& entity, int id,
+                                                    size_t min_size) {
+    std::string path = findPath(entity, id);
+    boost::system::error_code ec;
+    uint64_t size = boost::filesystem::file_size(path, ec);
+    if (ec || size < min_size) {
+        return nullptr;
+    }
+    return MappedFile::open(path);
 }
 
 void FileStorage::remove(const std::string& entity, int id) {
+    // the flat copy goes first: migrate() can only move it before that, and
+    // then the sharded copy it made is removed below
+    if (layout_ == kSharded) {
+        removeFlat(entity, id);
+    }
     std::string path = getPath(entity, id);
+    if (committer_) {
+        committer_->remove(path);
+        return;
+    }
     boost::filesystem::remove(path);
 }
 
+void FileStorage::removeFlat(const std::string& entity, int id) {
+    if (layout_ != kSharded) {
+        return;
+    }
+    std::string flat = getFlatPath(entity, id);
+    if (::access(flat.c_str(), F_OK) != 0) {
+        return;
+    }
+    if (committer_) {
+        committer_->remove(flat);
+    } else {
+        ::unlink(flat.c_str());
+    }
+}
+
+bool FileStorage::exists(const std::string& entity, int id) const {
+    return ::access(getPath(entity, id).c_str(), F_OK) == 0 ||
+           (layout_ == kSharded && ::access(getFlatPath(entity, id).c_str(), F_OK) == 0);
+}
+
+std::string FileStorage::findPath(const std::string& entity, int id) const {
+    std::string path = getPath(entity, id);
+    if (layout_ == kSharded && ::access(path.c_str(), F_OK) != 0) {
+        std::string flat = getFlatPath(entity, id);
+        if (::access(flat.c_str(), F_OK) == 0) {
+            return flat;
+        }
+    }
+    return path;
+}
+
 std::string FileStorage::getPath(const std::string& entity, int id) const {
+    if (layout_ == kFlat) {
+        return getFlatPath(entity, id);
+    }
+    // FNV-1a of the decimal id, stable across builds and platforms unlike
+    // std::hash, then the murmur3 finalizer so the top bytes of short,
+    // consecutive ids differ too
+    std::string name = std::to_string(id);
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    std::string path = getEntityPath(entity) + "/";
+    appendShardName(hash >> 24, &path);
+    path += "/";
+    appendShardName(hash >> 16, &path);
+    return path + "/" + name;
+}
+
+std::string FileStorage::getFlatPath(const std::string& entity, int id) const {
     std::ostringstream oss;
-    oss << base_path_ << entity << "/" << id;
+    oss << getEntityPath(entity) << "/" << id;
     return oss.str();
-}
\ No newline at end of file
+}
+
+std::string FileStorage::getEntityPath(const std::string& entity) const {
+    return base_path_ + entity;
+}
+
+std::vector<int> FileStorage::listIds(const std::string& entity) const {
+    // ids caught mid-migration can be in both spots for a moment
+    std::set<int> ids;
+    int id;
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator it(getEntityPath(entity), ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        const std::string name = it->path().filename().string();
+        if (parseId(name, &id)) {
+            ids.insert(id);
+            continue;
+        }
+        if (layout_ != kSharded || !isShardName(name)) {
+            continue;
+        }
+        boost::system::error_code shard_ec;
+        boost::filesystem::directory_iterator shard(it->path(), shard_ec);
+        for (; !shard_ec && shard != end; shard.increment(shard_ec)) {
+            if (!isShardName(shard->path().filename().string())) {
+                continue;
+            }
+            boost::system::error_code leaf_ec;
+            boost::filesystem::directory_iterator leaf(shard->path(), leaf_ec);
+            for (; !leaf_ec && leaf != end; leaf.increment(leaf_ec)) {
+                if (parseId(leaf->path().filename().string(), &id)) {
+                    ids.insert(id);
+                }
+            }
+        }
+    }
+    return std::vector<int>(ids.begin(), ids.end());
+}
+
+std::vector<std::string> FileStorage::listEntities() const {
+    // entity directories are named base_path_ + entity, so with a base path
+    // like "data/" they are the children of data, and with "data/api_" they
+    // are the siblings starting with "api_"
+    boost::filesystem::path probe(getEntityPath("x"));
+    std::string dir = probe.parent_path().string();
+    std::string prefix = probe.filename().string();
+    prefix.pop_back();
+    std::vector<std::string> entities;
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator it(dir.empty() ? "." : dir, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        const std::string name = it->path().filename().string();
+        if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+            boost::filesystem::is_directory(it->status())) {
+            entities.push_back(name.substr(prefix.size()));
+        }
+    }
+    return entities;
+}
+
+/**
+ * migrate() - Hard-link each flat id file into its sharded spot and unlink
+ * the flat name. link() never replaces an existing file, so a sharded copy
+ * written meanwhile wins over the flat one, and since remove() unlinks the
+ * flat name first a deleted id can't be resurrected either.
+ */
+size_t FileStorage::migrate(const std::string& entity) {
+    if (layout_ != kSharded) {
+        return 0;
+    }
+    size_t moved = 0;
+    std::set<std::string> touched;
+    std::vector<int> flat_ids;
+    int id;
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator it(getEntityPath(entity), ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        if (parseId(it->path().filename().string(), &id)) {
+            flat_ids.push_back(id);
+        }
+    }
+    for (int id : flat_ids) {
+        std::string flat = getFlatPath(entity, id);
+        std::string path = getPath(entity, id);
+        std::string parent = boost::filesystem::path(path).parent_path().string();
+        boost::system::error_code dir_ec;
+        boost::filesystem::create_directories(parent, dir_ec);
+        if (::link(flat.c_str(), path.c_str()) == 0) {
+            moved++;
+        } else if (errno != EEXIST) {
+            // gone already, or can't be moved; leave it to be read in place
+            continue;
+        }
+        ::unlink(flat.c_str());
+        touched.insert(parent);
+        touched.insert(boost::filesystem::path(parent).parent_path().string());
+    }
+    // make the new names and the removal of the old ones durable
+    for (const std::string& dir : touched) {
+        syncDirectory(dir);
+    }
+    syncDirectory(getEntityPath(entity));
+    return moved;
+}
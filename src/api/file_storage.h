@@ -1,20 +1,90 @@
 #ifndef FILE_STORAGE_H
 #define FILE_STORAGE_H
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
+#include <vector>
+#include "group_committer.h"
+#include "mapped_file.h"
 
 // file storage class to handle file I/O for CRUD api calls
 class FileStorage {
 public:
-    FileStorage(const std::string& base_path);
+    // Where ids live inside an entity's directory. kFlat keeps them all
+    // directly in it. kSharded fans them out as entity/ab/cd/id, where ab and
+    // cd are two bytes of a hash of the id, so directories stay small however
+    // large the collection gets. A sharded storage still
+    // finds ids left in the flat spot and moves them on their next write, so
+    // it can serve while migrate() moves the rest.
+    enum Layout { kFlat, kSharded };
+
+    // Writes go to a temp file that is renamed over the target. In durable
+    // mode the temp file is fsynced first and the rename is made durable
+    // before write() returns; concurrent writes within commit_window share
+    // one group commit.
+    FileStorage(const std::string& base_path, bool durable = false,
+                std::chrono::microseconds commit_window = std::chrono::microseconds(0),
+                Layout layout = kFlat);
     
-    void write(const std::string& entity, int id, const std::string& data);
+    // returns false if the data could not be written (or, in durable mode,
+    // could not be made durable)
+    bool write(const std::string& entity, int id, const std::string& data);
+    // One write for writeAll(); the pointed-to strings must outlive the call.
+    struct Write {
+        const std::string* entity;
+        int id;
+        const std::string* data;
+    };
+    // Perform several writes, sharing one group commit in durable mode;
+    // (*ok)[i] is what write() would have returned for writes[i]. Ids must be
+    // distinct per entity.
+    void writeAll(const std::vector<Write>& writes, std::vector<bool>* ok);
     std::string read(const std::string& entity, int id);
+    // Map the stored data instead of copying it. Returns null if it is missing or
+    // smaller than min_size, where a plain read is cheaper than a mapping.
+    // Writes never modify a file in place, so the mapping stays intact.
+    std::shared_ptr<const MappedFile> map(const std::string& entity, int id,
+                                          size_t min_size = 0);
     void remove(const std::string& entity, int id);
+    bool exists(const std::string& entity, int id) const;
+    // where the layout puts id; writes always go here
     std::string getPath(const std::string& entity, int id) const;
+    // where the flat layout puts id
+    std::string getFlatPath(const std::string& entity, int id) const;
+    // directory holding every id of entity
+    std::string getEntityPath(const std::string& entity) const;
+    // ids of entity currently on disk, in no particular order; one scan of
+    // the entity's directory tree
+    std::vector<int> listIds(const std::string& entity) const;
+    // entities with a directory under the base path
+    std::vector<std::string> listEntities() const;
+
+    // Move every id of entity still in the flat spot to its sharded one.
+    // Safe to run while this or another sharded storage on the same base
+    // path is serving: an id written or deleted meanwhile is never brought
+    // back in its old state. Returns the number of ids moved; does nothing
+    // for a flat storage.
+    size_t migrate(const std::string& entity);
+
+    Layout layout() const { return layout_; }
+
+    // null unless durable
+    const GroupCommitter* committer() const { return committer_.get(); }
 
 private:
+    int writeTemp(const std::string& path, const std::string& data, std::string* temp);
+    static bool replace(int fd, const std::string& temp, const std::string& path);
+    // path of the stored copy of id, preferring the layout's spot over the flat one
+    std::string findPath(const std::string& entity, int id) const;
+    // after id was written to its sharded spot, drop a copy left in the flat one
+    void removeFlat(const std::string& entity, int id);
+
     std::string base_path_;
+    const Layout layout_;
+    std::unique_ptr<GroupCommitter> committer_;
+    std::atomic<uint64_t> temp_counter_{0};
 };
 
 #endif // FILE_STORAGE_H
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "group_committer.h"
+#include <boost/filesystem.hpp>
+#include <fcntl.h>
+#include <map>
+#include <stdio.h>
+#include <unistd.h>
+
+GroupCommitter::GroupCommitter(std::chrono::microseconds window)
+    : window_(window), thread_(&GroupCommitter::run, this) {}
+
+GroupCommitter::~GroupCommitter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    thread_.join();
+}
+
+bool GroupCommitter::commit(int fd, const std::string& temp, const std::string& target) {
+    Pending pending{fd, temp, target};
+    return submit(&pending);
+}
+
+void GroupCommitter::commitAll(const std::vector<File>& files, std::vector<bool>* ok) {
+    std::vector<Pending> pending;
+    pending.reserve(files.size());
+    for (const File& file : files) {
+        pending.push_back(Pending{file.fd, file.temp, file.target});
+    }
+    submitAll(&pending);
+    ok->clear();
+    for (const Pending& p : pending) {
+        ok->push_back(p.ok);
+    }
+}
+
+bool GroupCommitter::remove(const std::string& target) {
+    Pending pending{-1, "", target};
+    return submit(&pending);
+}
+
+bool GroupCommitter::submit(Pending* pending) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_.push_back(pending);
+    work_cv_.notify_one();
+    done_cv_.wait(lock, [pending] { return pending->done; });
+    return pending->ok;
+}
+
+void GroupCommitter::submitAll(std::vector<Pending>* pending) {
+    if (pending->empty()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (Pending& p : *pending) {
+        queue_.push_back(&p);
+    }
+    work_cv_.notify_one();
+    // the whole vector is queued under one lock hold, so it lands in one batch
+    Pending* last = &pending->back();
+    done_cv_.wait(lock, [last] { return last->done; });
+}
+
+void GroupCommitter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        if (window_.count() > 0) {
+            // let concurrent writers join this batch
+            lock.unlock();
+            std::this_thread::sleep_for(window_);
+            lock.lock();
+        }
+        std::vector<Pending*> batch;
+        batch.swap(queue_);
+        lock.unlock();
+
+        flush(batch);
+
+        lock.lock();
+        for (Pending* pending : batch) {
+            pending->done = true;
+        }
+        batches_++;
+        commits_ += batch.size();
+        done_cv_.notify_all();
+    }
+}
+
+/**
+ * flush() - Commit one batch: start writeback of every file, wait for each,
+ * rename them into place, then fsync each directory once.
+ */
+void GroupCommitter::flush(const std::vector<Pending*>& batch) {
+    for (Pending* pending : batch) {
+        if (pending->fd >= 0) {
+            sync_file_range(pending->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+        }
+    }
+
+    std::map<std::string, std::vector<Pending*>> directories;
+    for (Pending* pending : batch) {
+        if (pending->fd >= 0) {
+            pending->ok = fdatasync(pending->fd) == 0;
+            close(pending->fd);
+            if (pending->ok) {
+                pending->ok = rename(pending->temp.c_str(), pending->target.c_str()) == 0;
+            }
+            if (!pending->ok) {
+                unlink(pending->temp.c_str());
+            }
+        } else {
+            pending->ok = unlink(pending->target.c_str()) == 0;
+        }
+        if (pending->ok) {
+            std::string dir = boost::filesystem::path(pending->target).parent_path().string();
+            directories[dir.empty() ? "." : dir].push_back(pending);
+        }
+    }
+
+    for (const auto& directory : directories) {
+        int fd = open(directory.first.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        bool synced = fd >= 0 && fsync(fd) == 0;
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!synced) {
+            for (Pending* pending : directory.second) {
+                pending->ok = false;
+            }
+        }
+    }
+}
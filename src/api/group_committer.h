@@ -0,0 +1,70 @@
+#ifndef GROUP_COMMITTER_H
+#define GROUP_COMMITTER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Makes file replacements durable in batches.
+//
+// Writers hand over a fully written temp file and block. A single committer
+// thread collects everything submitted within the commit window (and while
+// the previous batch was flushing), flushes the files back to back, renames
+// each over its target and then fsyncs every touched directory once, so a
+// burst of concurrent writes costs one round of flushes instead of one per
+// write.
+class GroupCommitter {
+public:
+    explicit GroupCommitter(std::chrono::microseconds window);
+    ~GroupCommitter();
+
+    // Flush the temp file open as fd, rename it to target and make the rename
+    // durable. Takes ownership of fd. Returns false if any step failed, in
+    // which case target is left as it was.
+    bool commit(int fd, const std::string& temp, const std::string& target);
+    // One replacement for commitAll().
+    struct File {
+        int fd;
+        std::string temp;
+        std::string target;
+    };
+    // Commit several replacements in the same batch and wait for all of them;
+    // (*ok)[i] is what commit() would have returned for files[i].
+    void commitAll(const std::vector<File>& files, std::vector<bool>* ok);
+    // Durably remove target.
+    bool remove(const std::string& target);
+
+    uint64_t batches() const { return batches_; }
+    uint64_t commits() const { return commits_; }
+
+private:
+    struct Pending {
+        int fd;             // -1 for a removal
+        std::string temp;
+        std::string target;
+        bool done = false;
+        bool ok = false;
+    };
+
+    bool submit(Pending* pending);
+    void submitAll(std::vector<Pending>* pending);
+    void run();
+    void flush(const std::vector<Pending*>& batch);
+
+    const std::chrono::microseconds window_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::vector<Pending*> queue_;
+    bool stopping_ = false;
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> commits_{0};
+    std::thread thread_;
+};
+
+#endif // GROUP_COMMITTER_H
@@ -0,0 +1,235 @@
+#include "indexed_crud_handler.h"
+#include <cstdlib>
+#include <functional>
+#include "../http/json.h"
+
+const size_t IndexedCRUDHandler::kStripes;
+
+IndexedCRUDHandler::IndexedCRUDHandler(ICRUDHandler* backend, const IndexSpec& spec)
+    : backend_(backend) {
+    for (const auto& entity : spec) {
+        EntityIndex& index = indexes_[entity.first];
+        index.fields.assign(entity.second.begin(), entity.second.end());
+        index.values.resize(index.fields.size());
+        for (int id : backend_->list(entity.first)) {
+            indexPut(&index, id, backend_->read(entity.first, id));
+        }
+    }
+}
+
+/**
+ * extract() - Find the value of the dotted path field in the JSON object data.
+ * Returns false if data has no string, number, boolean or null there.
+ */
+bool IndexedCRUDHandler::extract(const std::string& data, const std::string& field,
+                                 std::string* value) {
+    std::string_view current = data;
+    std::vector<std::pair<std::string, std::string_view>> members;
+    size_t start = 0;
+    while (true) {
+        size_t dot = field.find('.', start);
+        std::string name = field.substr(start, dot == std::string::npos ? dot : dot - start);
+        if (!json::split_object(current, &members)) {
+            return false;
+        }
+        bool found = false;
+        // the last of duplicate keys wins, as in most parsers
+        for (const auto& member : members) {
+            if (member.first == name) {
+                current = member.second;
+                found = true;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        if (dot == std::string::npos) {
+            break;
+        }
+        start = dot + 1;
+    }
+    if (current[0] == '"') {
+        return json::parse_string(current, value);
+    }
+    if (current[0] == '{' || current[0] == '[') {
+        return false;
+    }
+    *value = std::string(current);
+    return true;
+}
+
+void IndexedCRUDHandler::indexPut(EntityIndex* index, int id, const std::string& data) {
+    indexErase(index, id);
+    std::map<size_t, std::string> entry;
+    for (size_t f = 0; f < index->fields.size(); f++) {
+        std::string value;
+        if (extract(data, index->fields[f], &value)) {
+            index->values[f][value].insert(id);
+            entry[f] = value;
+        }
+    }
+    index->entries[id] = std::move(entry);
+}
+
+void IndexedCRUDHandler::indexErase(EntityIndex* index, int id) {
+    auto it = index->entries.find(id);
+    if (it == index->entries.end()) {
+        return;
+    }
+    for (const auto& field : it->second) {
+        auto ids = index->values[field.first].find(field.second);
+        ids->second.erase(id);
+        if (ids->second.empty()) {
+            index->values[field.first].erase(ids);
+        }
+    }
+    index->entries.erase(it);
+}
+
+IndexedCRUDHandler::EntityIndex* IndexedCRUDHandler::find(const std::string& entity) {
+    // the set of indexed entities is fixed at construction, so no lock is needed
+    auto it = indexes_.find(entity);
+    return it == indexes_.end() ? nullptr : &it->second;
+}
+
+std::mutex& IndexedCRUDHandler::stripe(const std::string& entity, int id) {
+    size_t hash = std::hash<std::string>()(entity) ^
+                  (static_cast<size_t>(id) * 0x9e3779b97f4a7c15ULL);
+    return stripes_[(hash ^ (hash >> 32)) % kStripes];
+}
+
+std::string IndexedCRUDHandler::create(const std::string& entity, const std::string& data) {
+    EntityIndex* index = find(entity);
+    std::string result = backend_->create(entity, data);
+    int id = createdId(result);
+    if (index == nullptr || id == 0) {
+        return result;
+    }
+    std::lock_guard<std::mutex> lock(stripe(entity, id));
+    // by now the id may have been updated, or deleted and handed to another
+    // create, so what is indexed is what it holds under the stripe
+    std::string stored = backend_->read(entity, id);
+    std::unique_lock<std::shared_mutex> index_lock(mutex_);
+    if (stored.empty() && !backend_->exists(entity, id)) {
+        indexErase(index, id);
+    } else {
+        indexPut(index, id, stored);
+    }
+    return result;
+}
+
+std::string IndexedCRUDHandler::read(const std::string& entity, int id) {
+    return backend_->read(entity, id);
+}
+
+bool IndexedCRUDHandler::update(const std::string& entity, int id, const std::string& data) {
+    EntityIndex* index = find(entity);
+    if (index == nullptr) {
+        return backend_->update(entity, id, data);
+    }
+    std::lock_guard<std::mutex> lock(stripe(entity, id));
+    if (!backend_->update(entity, id, data)) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> index_lock(mutex_);
+    indexPut(index, id, data);
+    return true;
+}
+
+bool IndexedCRUDHandler::delete_(const std::string& entity, int id) {
+    EntityIndex* index = find(entity);
+    if (index == nullptr) {
+        return backend_->delete_(entity, id);
+    }
+    std::lock_guard<std::mutex> lock(stripe(entity, id));
+    if (!backend_->delete_(entity, id)) {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> index_lock(mutex_);
+    indexErase(index, id);
+    return true;
+}
+
+bool IndexedCRUDHandler::exists(const std::string& entity, int id) {
+    return backend_->exists(entity, id);
+}
+
+std::vector<int> IndexedCRUDHandler::list(const std::string& entity) {
+    return backend_->list(entity);
+}
+
+std::vector<int> IndexedCRUDHandler::list(const std::string& entity, int after, size_t limit) {
+    return backend_->list(entity, after, limit);
+}
+
+std::shared_ptr<const MappedFile> IndexedCRUDHandler::readMapped(const std::string& entity,
+                                                                 int id) {
+    return backend_->readMapped(entity, id);
+}
+
+std::vector<BatchResult> IndexedCRUDHandler::batch(
+        const std::vector<BatchOperation>& operations) {
+    for (const BatchOperation& op : operations) {
+        if (op.type != BatchOperation::kRead && find(op.entity) != nullptr) {
+            // one at a time through this handler, so every write is indexed
+            return ICRUDHandler::batch(operations);
+        }
+    }
+    return backend_->batch(operations);
+}
+
+bool IndexedCRUDHandler::query(const std::string& entity, const std::string& field,
+                               const std::string& value, std::vector<int>* ids) {
+    EntityIndex* index = find(entity);
+    if (index == nullptr) {
+        return false;
+    }
+    for (size_t f = 0; f < index->fields.size(); f++) {
+        if (index->fields[f] != field) {
+            continue;
+        }
+        std::shared_lock<std::shared_mutex> index_lock(mutex_);
+        auto it = index->values[f].find(value);
+        ids->clear();
+        if (it != index->values[f].end()) {
+            ids->assign(it->second.begin(), it->second.end());
+        }
+        return true;
+    }
+    return false;
+}
+
+uint64_t IndexedCRUDHandler::version(const std::string& entity, int id) {
+    return backend_->version(entity, id);
+}
+
+ICRUDHandler::WriteStatus IndexedCRUDHandler::updateIf(const std::string& entity, int id,
+                                                       const std::string& data,
+                                                       uint64_t expected, uint64_t* version) {
+    EntityIndex* index = find(entity);
+    if (index == nullptr) {
+        return backend_->updateIf(entity, id, data, expected, version);
+    }
+    std::lock_guard<std::mutex> lock(stripe(entity, id));
+    WriteStatus status = backend_->updateIf(entity, id, data, expected, version);
+    if (status == kWritten) {
+        std::unique_lock<std::shared_mutex> index_lock(mutex_);
+        indexPut(index, id, data);
+    }
+    return status;
+}
+
+ICRUDHandler::WriteStatus IndexedCRUDHandler::deleteIf(const std::string& entity, int id,
+                                                       uint64_t expected) {
+    EntityIndex* index = find(entity);
+    if (index == nullptr) {
+        return backend_->deleteIf(entity, id, expected);
+    }
+    std::lock_guard<std::mutex> lock(stripe(entity, id));
+    WriteStatus status = backend_->deleteIf(entity, id, expected);
+    if (status == kWritten) {
+        std::unique_lock<std::shared_mutex> index_lock(mutex_);
+        indexErase(index, id);
+    }
+    return status;
+}
@@ -0,0 +1,78 @@
+#ifndef INDEXED_CRUD_HANDLER_H
+#define INDEXED_CRUD_HANDLER_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "crud_handler.h"
+
+// Maintains in-memory secondary indexes over fields of stored JSON entities.
+//
+// Each declared (entity, field) pair maps every value the field holds to the
+// ids holding it. The indexes are built by reading every instance of the
+// indexed entities once at startup and are updated by every write through
+// this handler, so query() answers without touching the backend. A field is
+// a top-level member name or a dotted path into nested objects; only string,
+// number, boolean and null values are indexed, strings by their decoded text
+// and the others by their JSON spelling.
+class IndexedCRUDHandler : public ICRUDHandler {
+public:
+    // entity name -> fields of it to index
+    typedef std::map<std::string, std::set<std::string>> IndexSpec;
+
+    // takes ownership of backend
+    IndexedCRUDHandler(ICRUDHandler* backend, const IndexSpec& spec);
+
+    std::string create(const std::string& entity, const std::string& data) override;
+    std::string read(const std::string& entity, int id) override;
+    bool update(const std::string& entity, int id, const std::string& data) override;
+    bool delete_(const std::string& entity, int id) override;
+    bool exists(const std::string& entity, int id) override;
+    std::vector<int> list(const std::string& entity) override;
+    std::vector<int> list(const std::string& entity, int after, size_t limit) override;
+    std::shared_ptr<const MappedFile> readMapped(const std::string& entity, int id) override;
+    // forwarded whole unless it writes an indexed entity
+    std::vector<BatchResult> batch(const std::vector<BatchOperation>& operations) override;
+    bool query(const std::string& entity, const std::string& field,
+               const std::string& value, std::vector<int>* ids) override;
+    uint64_t version(const std::string& entity, int id) override;
+    WriteStatus updateIf(const std::string& entity, int id, const std::string& data,
+                         uint64_t expected, uint64_t* version = nullptr) override;
+    WriteStatus deleteIf(const std::string& entity, int id, uint64_t expected) override;
+
+private:
+    static const size_t kStripes = 64;
+
+    struct EntityIndex {
+        std::vector<std::string> fields;
+        // per field, value -> ids; indexed like fields
+        std::vector<std::unordered_map<std::string, std::set<int>>> values;
+        // id -> its value of each field, for unindexing on update and delete;
+        // fields without an indexable value are absent
+        std::unordered_map<int, std::map<size_t, std::string>> entries;
+    };
+
+    // the indexable value of field in data, if it has one
+    static bool extract(const std::string& data, const std::string& field, std::string* value);
+    // caller holds mutex_ exclusively
+    void indexPut(EntityIndex* index, int id, const std::string& data);
+    void indexErase(EntityIndex* index, int id);
+
+    EntityIndex* find(const std::string& entity);
+    std::mutex& stripe(const std::string& entity, int id);
+
+    std::unique_ptr<ICRUDHandler> backend_;
+    // Writes to an indexed entity hold their key's stripe across the backend
+    // write and the index update, so the index ends up agreeing with the
+    // backend even when writes to one id race.
+    std::mutex stripes_[kStripes];
+    std::shared_mutex mutex_;    // guards the contents of indexes_
+    std::map<std::string, EntityIndex> indexes_;
+};
+
+#endif // INDEXED_CRUD_HANDLER_H
@@ -0,0 +1,524 @@
+#include "log_crud_handler.h"
+#include "../logger.h"
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char kSegmentPrefix[] = "segment-";
+const char kSegmentSuffix[] = ".log";
+
+enum RecordType : uint8_t { kPut = 1, kDelete = 2 };
+
+// crc(4) type(1) id(4) entity length(4) data length(4)
+const size_t kHeaderSize = 17;
+
+struct Record {
+    RecordType type;
+    int id;
+    std::string entity;
+    const char* data;
+    uint32_t data_size;
+};
+
+uint32_t crc32(const char* data, size_t size) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+template <typename T>
+void put(std::string* out, T value) {
+    out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T get(const char* in) {
+    T value;
+    std::memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+std::string encode(RecordType type, const std::string& entity, int id,
+                   const std::string& data) {
+    std::string record(sizeof(uint32_t), '\0');
+    record.reserve(kHeaderSize + entity.size() + data.size());
+    put<uint8_t>(&record, type);
+    put<int32_t>(&record, id);
+    put<uint32_t>(&record, entity.size());
+    put<uint32_t>(&record, data.size());
+    record += entity;
+    record += data;
+    uint32_t crc = crc32(record.data() + sizeof(uint32_t),
+                         record.size() - sizeof(uint32_t));
+    std::memcpy(&record[0], &crc, sizeof(crc));
+    return record;
+}
+
+// Parse the record at the start of buf. Returns its size, or 0 if it is
+// truncated or fails its checksum.
+size_t decode(const char* buf, size_t available, Record* record) {
+    if (available < kHeaderSize) {
+        return 0;
+    }
+    uint8_t type = get<uint8_t>(buf + 4);
+    uint32_t entity_size = get<uint32_t>(buf + 9);
+    uint32_t data_size = get<uint32_t>(buf + 13);
+    uint64_t size = uint64_t(kHeaderSize) + entity_size + data_size;
+    if ((type != kPut && type != kDelete) || size > available) {
+        return 0;
+    }
+    if (get<uint32_t>(buf) != crc32(buf + 4, size - 4)) {
+        return 0;
+    }
+    record->type = static_cast<RecordType>(type);
+    record->id = get<int32_t>(buf + 5);
+    record->entity.assign(buf + kHeaderSize, entity_size);
+    record->data = buf + kHeaderSize + entity_size;
+    record->data_size = data_size;
+    return size;
+}
+
+bool preadAll(int fd, char* buf, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = ::pread(fd, buf, size, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+} // namespace
+
+const size_t LogCRUDHandler::kDefaultSegmentSize;
+
+/**
+ * Constructor - Replay the segments in dir and start the compaction thread.
+ * A zero compaction_interval leaves compaction to explicit compact() calls.
+ */
+LogCRUDHandler::LogCRUDHandler(const std::string& dir, size_t segment_size,
+                               std::chrono::milliseconds compaction_interval)
+    : dir_(dir), segment_size_(segment_size),
+      compaction_interval_(compaction_interval) {
+    recover();
+    if (compaction_interval_.count() > 0) {
+        compaction_thread_ = std::thread(&LogCRUDHandler::compactionLoop, this);
+    }
+}
+
+LogCRUDHandler::~LogCRUDHandler() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stopping_ = true;
+    }
+    stop_cv_.notify_all();
+    if (compaction_thread_.joinable()) {
+        compaction_thread_.join();
+    }
+    for (auto& segment : segments_) {
+        ::close(segment.second.fd);
+    }
+}
+
+std::string LogCRUDHandler::segmentPath(uint64_t segment) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s%010llu%s", kSegmentPrefix,
+                  static_cast<unsigned long long>(segment), kSegmentSuffix);
+    return (boost::filesystem::path(dir_) / name).string();
+}
+
+void LogCRUDHandler::openSegment(uint64_t segment) {
+    std::string path = segmentPath(segment);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw std::runtime_error("Unable to open log segment " + path + ": " +
+                                 std::strerror(errno));
+    }
+    Segment& s = segments_[segment];
+    s.fd = fd;
+    s.size = st.st_size;
+}
+
+/**
+ * recover() - Open every segment in dir_ and rebuild the index from them.
+ */
+void LogCRUDHandler::recover() {
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(dir_, ec);
+    if (ec) {
+        throw std::runtime_error("Unable to create log directory " + dir_ +
+                                 ": " + ec.message());
+    }
+
+    std::set<uint64_t> found;
+    const std::string prefix(kSegmentPrefix), suffix(kSegmentSuffix);
+    for (boost::filesystem::directory_iterator it(dir_, ec), end;
+         !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.size() <= prefix.size() + suffix.size() ||
+            name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        std::string number =
+            name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        if (number.find_first_not_of("0123456789") == std::string::npos) {
+            found.insert(std::stoull(number));
+        }
+    }
+    if (ec) {
+        throw std::runtime_error("Unable to read log directory " + dir_ + ": " +
+                                 ec.message());
+    }
+
+    for (uint64_t segment : found) {
+        openSegment(segment);
+        replay(segment, segment == *found.rbegin());
+    }
+    if (segments_.empty()) {
+        openSegment(1);
+    }
+}
+
+void LogCRUDHandler::replay(uint64_t segment, bool is_last) {
+    Segment& s = segments_[segment];
+    std::string contents(s.size, '\0');
+    if (!preadAll(s.fd, &contents[0], contents.size(), 0)) {
+        throw std::runtime_error("Unable to read log segment " +
+                                 segmentPath(segment));
+    }
+
+    uint64_t offset = 0;
+    Record record;
+    while (offset < contents.size()) {
+        size_t size = decode(contents.data() + offset, contents.size() - offset,
+                             &record);
+        if (size == 0) {
+            break;
+        }
+        if (record.type == kPut) {
+            indexPut(record.entity, record.id,
+                     Location{segment, offset, static_cast<uint32_t>(size)});
+        } else {
+            indexErase(record.entity, record.id);
+        }
+        offset += size;
+    }
+
+    if (offset < contents.size()) {
+        if (is_last && ::ftruncate(s.fd, offset) == 0) {
+            // a write was cut short by a crash; drop the torn tail
+            Logger::getLogger()->logWarningFile(
+                "Truncated torn record at " + segmentPath(segment) + ":" +
+                std::to_string(offset));
+            s.size = offset;
+        } else {
+            Logger::getLogger()->logErrorFile(
+                "Skipping corrupt records after " + segmentPath(segment) + ":" +
+                std::to_string(offset));
+        }
+    }
+}
+
+bool LogCRUDHandler::append(const std::string& record, Location* location) {
+    uint64_t segment = segments_.rbegin()->first;
+    if (segments_.rbegin()->second.size > 0 &&
+        segments_.rbegin()->second.size + record.size() > segment_size_) {
+        try {
+            openSegment(++segment);
+        } catch (const std::runtime_error& e) {
+            Logger::getLogger()->logErrorFile(e.what());
+            return false;
+        }
+    }
+
+    Segment& s = segments_[segment];
+    size_t written = 0;
+    while (written < record.size()) {
+        ssize_t n = ::write(s.fd, record.data() + written, record.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            Logger::getLogger()->logErrorFile("Unable to append to " +
+                                              segmentPath(segment) + ": " +
+                                              std::strerror(errno));
+            // don't leave a partial record in front of the next append
+            if (::ftruncate(s.fd, s.size) != 0) {
+                Logger::getLogger()->logErrorFile("Unable to truncate " +
+                                                  segmentPath(segment));
+            }
+            return false;
+        }
+        written += n;
+    }
+
+    *location = Location{segment, s.size, static_cast<uint32_t>(record.size())};
+    s.size += record.size();
+    return true;
+}
+
+void LogCRUDHandler::indexPut(const std::string& entity, int id,
+                              const Location& location) {
+    EntityIndex& index = index_[entity];
+    auto it = index.records.find(id);
+    if (it != index.records.end()) {
+        segments_[it->second.segment].live_bytes -= it->second.size;
+        it->second = location;
+    } else {
+        index.records.emplace(id, location);
+        index.ids.insert(id);
+    }
+    segments_[location.segment].live_bytes += location.size;
+
+    if (id >= index.next) {
+        while (index.next < id) {
+            index.free.insert(index.next++);
+        }
+        index.next = id + 1;
+    } else {
+        index.free.erase(id);
+    }
+}
+
+void LogCRUDHandler::indexErase(const std::string& entity, int id) {
+    auto index = index_.find(entity);
+    if (index == index_.end()) {
+        return;
+    }
+    auto it = index->second.records.find(id);
+    if (it == index->second.records.end()) {
+        return;
+    }
+    segments_[it->second.segment].live_bytes -= it->second.size;
+    index->second.records.erase(it);
+    index->second.ids.erase(id);
+    if (id < index->second.next) {
+        index->second.free.insert(id);
+    }
+}
+
+bool LogCRUDHandler::find(const std::string& entity, int id,
+                          Location* location) const {
+    auto index = index_.find(entity);
+    if (index == index_.end()) {
+        return false;
+    }
+    auto it = index->second.records.find(id);
+    if (it == index->second.records.end()) {
+        return false;
+    }
+    *location = it->second;
+    return true;
+}
+
+std::string LogCRUDHandler::create(const std::string& entity, const std::string& data) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    EntityIndex& index = index_[entity];
+    int id;
+    if (index.free.empty()) {
+        id = index.next;
+    } else {
+        id = *index.free.begin();
+    }
+
+    Location location;
+    if (!append(encode(kPut, entity, id, data), &location)) {
+        return "";
+    }
+    indexPut(entity, id, location);
+    return "{\"id\": " + std::to_string(id) + "}";
+}
+
+std::string LogCRUDHandler::read(const std::string& entity, int id) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    Location location;
+    if (!find(entity, id, &location)) {
+        return "";
+    }
+    std::string buf(location.size, '\0');
+    Record record;
+    if (!preadAll(segments_.at(location.segment).fd, &buf[0], buf.size(),
+                  location.offset) ||
+        decode(buf.data(), buf.size(), &record) != buf.size()) {
+        Logger::getLogger()->logErrorFile("Corrupt record for " + entity + "/" +
+                                          std::to_string(id));
+        return "";
+    }
+    return std::string(record.data, record.data_size);
+}
+
+bool LogCRUDHandler::update(const std::string& entity, int id, const std::string& data) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    Location location;
+    if (!find(entity, id, &location) ||
+        !append(encode(kPut, entity, id, data), &location)) {
+        return false;
+    }
+    indexPut(entity, id, location);
+    return true;
+}
+
+bool LogCRUDHandler::delete_(const std::string& entity, int id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    Location location;
+    if (!find(entity, id, &location) ||
+        !append(encode(kDelete, entity, id, ""), &location)) {
+        return false;
+    }
+    indexErase(entity, id);
+    return true;
+}
+
+bool LogCRUDHandler::exists(const std::string& entity, int id) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    Location location;
+    return find(entity, id, &location);
+}
+
+std::vector<int> LogCRUDHandler::list(const std::string& entity) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto index = index_.find(entity);
+    if (index == index_.end()) {
+        return {};
+    }
+    return std::vector<int>(index->second.ids.begin(), index->second.ids.end());
+}
+
+std::vector<int> LogCRUDHandler::list(const std::string& entity, int after, size_t limit) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<int> ids;
+    auto index = index_.find(entity);
+    if (index == index_.end()) {
+        return ids;
+    }
+    const std::set<int>& all = index->second.ids;
+    for (auto it = all.upper_bound(after); it != all.end() && ids.size() < limit; ++it) {
+        ids.push_back(*it);
+    }
+    return ids;
+}
+
+/**
+ * compact() - Rewrite the live records of sealed segments at the head of the
+ * log, then delete those segments.
+ *
+ * Segments are only ever removed oldest first: a tombstone in a kept segment
+ * may still be hiding a record in an older one.
+ */
+size_t LogCRUDHandler::compact() {
+    std::lock_guard<std::mutex> compaction_lock(compaction_mutex_);
+    std::vector<std::pair<uint64_t, Segment>> sealed;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (const auto& segment : segments_) {
+            if (segment.first != segments_.rbegin()->first) {
+                sealed.push_back(segment);
+            }
+        }
+    }
+
+    // sealed segments never change and only this function closes them, so
+    // they can be read without holding mutex_
+    for (const auto& segment : sealed) {
+        std::string contents(segment.second.size, '\0');
+        if (!preadAll(segment.second.fd, &contents[0], contents.size(), 0)) {
+            break;
+        }
+        uint64_t offset = 0;
+        Record record;
+        while (offset < contents.size()) {
+            size_t size = decode(contents.data() + offset,
+                                 contents.size() - offset, &record);
+            if (size == 0) {
+                break;
+            }
+            if (record.type == kPut) {
+                std::unique_lock<std::shared_mutex> lock(mutex_);
+                Location current, moved;
+                if (find(record.entity, record.id, &current) &&
+                    current.segment == segment.first && current.offset == offset &&
+                    append(contents.substr(offset, size), &moved)) {
+                    indexPut(record.entity, record.id, moved);
+                }
+            }
+            offset += size;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (::fdatasync(segments_.rbegin()->second.fd) != 0) {
+        return 0;
+    }
+    size_t removed = 0;
+    for (const auto& segment : sealed) {
+        auto it = segments_.find(segment.first);
+        if (it->second.live_bytes != 0) {
+            break;
+        }
+        ::close(it->second.fd);
+        boost::system::error_code ec;
+        boost::filesystem::remove(segmentPath(segment.first), ec);
+        segments_.erase(it);
+        removed++;
+    }
+    return removed;
+}
+
+size_t LogCRUDHandler::segmentCount() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return segments_.size();
+}
+
+uint64_t LogCRUDHandler::deadBytes() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    uint64_t dead = 0;
+    for (const auto& segment : segments_) {
+        if (segment.first != segments_.rbegin()->first) {
+            dead += segment.second.size - segment.second.live_bytes;
+        }
+    }
+    return dead;
+}
+
+void LogCRUDHandler::compactionLoop() {
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    while (!stop_cv_.wait_for(lock, compaction_interval_,
+                              [this] { return stopping_; })) {
+        lock.unlock();
+        uint64_t sealed_bytes = 0;
+        {
+            std::shared_lock<std::shared_mutex> segments_lock(mutex_);
+            for (const auto& segment : segments_) {
+                if (segment.first != segments_.rbegin()->first) {
+                    sealed_bytes += segment.second.size;
+                }
+            }
+        }
+        uint64_t dead = deadBytes();
+        if (dead > 0 && dead * 2 >= sealed_bytes) {
+            size_t removed = compact();
+            LOGGER_DEBUG("Compacted " + std::to_string(removed) + " log segments in " +
+                         dir_);
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef LOG_CRUD_HANDLER_H
+#define LOG_CRUD_HANDLER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "crud_handler.h"
+
+// CRUD backend that keeps every entity in a set of append-only segment files
+// inside one directory instead of one file per id.
+//
+// Each write appends a record "crc | type | id | entity length | data length |
+// entity | data" (integers in host byte order, crc is CRC-32 of everything
+// after it) to the newest segment, and an in-memory hash index maps
+// (entity, id) to the record's location. Deletes append a tombstone. On
+// startup the segments are replayed oldest first to rebuild the index; a torn
+// record at the end of the newest segment is cut off.
+//
+// A background thread compacts the log: once at least half of the bytes in
+// the older, sealed segments are dead, their live records are copied to the
+// newest segment and the sealed files are removed.
+class LogCRUDHandler : public ICRUDHandler {
+public:
+    static const size_t kDefaultSegmentSize = 64 * 1024 * 1024;
+
+    // throws std::runtime_error if dir cannot be created or read
+    explicit LogCRUDHandler(const std::string& dir,
+                            size_t segment_size = kDefaultSegmentSize,
+                            std::chrono::milliseconds compaction_interval =
+                                std::chrono::seconds(10));
+    ~LogCRUDHandler() override;
+
+    std::string create(const std::string& entity, const std::string& data) override;
+    std::string read(const std::string& entity, int id) override;
+    bool update(const std::string& entity, int id, const std::string& data) override;
+    bool delete_(const std::string& entity, int id) override;
+    bool exists(const std::string& entity, int id) override;
+    std::vector<int> list(const std::string& entity) override;
+    std::vector<int> list(const std::string& entity, int after, size_t limit) override;
+
+    // copy live records out of every sealed segment and remove those segments;
+    // returns the number of segments removed
+    size_t compact();
+
+    size_t segmentCount() const;
+    // bytes in sealed segments no longer referenced by the index
+    uint64_t deadBytes() const;
+
+private:
+    struct Location {
+        uint64_t segment;
+        uint64_t offset;   // start of the record
+        uint32_t size;     // whole record, header included
+    };
+    struct EntityIndex {
+        std::unordered_map<int, Location> records;
+        std::set<int> ids;       // same keys as records, sorted for list()
+        int next = 1;            // lowest id never handed out
+        std::set<int> free;      // ids below next that are not in use
+    };
+    struct Segment {
+        int fd = -1;
+        uint64_t size = 0;
+        uint64_t live_bytes = 0;
+    };
+
+    std::string segmentPath(uint64_t segment) const;
+    void openSegment(uint64_t segment);
+    void recover();
+    void replay(uint64_t segment, bool is_last);
+
+    // caller holds mutex_ exclusively
+    bool append(const std::string& record, Location* location);
+    void indexPut(const std::string& entity, int id, const Location& location);
+    void indexErase(const std::string& entity, int id);
+    bool find(const std::string& entity, int id, Location* location) const;
+
+    void compactionLoop();
+
+    const std::string dir_;
+    const size_t segment_size_;
+    const std::chrono::milliseconds compaction_interval_;
+
+    mutable std::shared_mutex mutex_;
+    std::map<uint64_t, Segment> segments_;   // the last one is being appended to
+    std::unordered_map<std::string, EntityIndex> index_;
+
+    std::mutex compaction_mutex_;            // one compaction at a time
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stopping_ = false;
+    std::thread compaction_thread_;
+};
+
+#endif // LOG_CRUD_HANDLER_H
@@ -0,0 +1,81 @@
+#include "storage_executor.h"
+#include <algorithm>
+
+StorageExecutor::StorageExecutor(size_t threads, size_t queue_capacity)
+    : state_(std::make_shared<State>(queue_capacity)) {
+    state_->stats.threads = threads;
+    state_->stats.queue_capacity = queue_capacity;
+    for (size_t i = 0; i < threads; i++) {
+        threads_.emplace_back(&StorageExecutor::work, state_);
+    }
+}
+
+StorageExecutor::~StorageExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->stopping = true;
+    }
+    state_->work_cv.notify_all();
+    for (std::thread& thread : threads_) {
+        // a task may have held the last reference to whatever owns this executor
+        if (thread.get_id() == std::this_thread::get_id()) {
+            thread.detach();
+        } else {
+            thread.join();
+        }
+    }
+}
+
+bool StorageExecutor::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->queue.size() >= state_->queue_capacity || state_->stopping) {
+            state_->stats.rejected++;
+            return false;
+        }
+        state_->queue.push_back(Task{std::move(task), Clock::now()});
+        state_->stats.queued = state_->queue.size();
+    }
+    state_->work_cv.notify_one();
+    return true;
+}
+
+StorageExecutor::Stats StorageExecutor::stats() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->stats;
+}
+
+void StorageExecutor::work(std::shared_ptr<State> state) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (true) {
+        state->work_cv.wait(lock, [&state] {
+            return state->stopping || !state->queue.empty();
+        });
+        if (state->queue.empty()) {
+            return;
+        }
+        Task task = std::move(state->queue.front());
+        state->queue.pop_front();
+        state->stats.queued = state->queue.size();
+        state->stats.running++;
+        lock.unlock();
+
+        Clock::time_point started = Clock::now();
+        task.run();
+        Clock::time_point finished = Clock::now();
+        // drop the task's captures outside the lock; see State
+        task.run = nullptr;
+
+        uint64_t wait = std::chrono::duration_cast<std::chrono::microseconds>(
+                            started - task.queued_at).count();
+        uint64_t run = std::chrono::duration_cast<std::chrono::microseconds>(
+                           finished - started).count();
+        lock.lock();
+        state->stats.running--;
+        state->stats.completed++;
+        state->stats.total_wait_us += wait;
+        state->stats.max_wait_us = std::max(state->stats.max_wait_us, wait);
+        state->stats.total_run_us += run;
+        state->stats.max_run_us = std::max(state->stats.max_run_us, run);
+    }
+}
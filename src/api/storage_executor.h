@@ -0,0 +1,71 @@
+#ifndef STORAGE_EXECUTOR_H
+#define STORAGE_EXECUTOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs storage work on a dedicated pool of I/O threads.
+//
+// Tasks wait in one FIFO queue with a fixed capacity; submit() refuses new
+// work instead of blocking once it is full, so a slow disk turns into fast
+// rejections rather than a network thread stuck behind it. The time tasks
+// spend queued and running is tracked for stats().
+class StorageExecutor {
+public:
+    StorageExecutor(size_t threads, size_t queue_capacity);
+    // runs whatever is still queued, then joins the threads
+    ~StorageExecutor();
+
+    // Queue task to run on one of the I/O threads. Returns false, without
+    // running it, if the queue is full.
+    bool submit(std::function<void()> task);
+
+    struct Stats {
+        size_t threads = 0;
+        size_t queue_capacity = 0;
+        size_t queued = 0;          // waiting for a thread right now
+        size_t running = 0;         // on a thread right now
+        uint64_t completed = 0;
+        uint64_t rejected = 0;
+        // totals and maxima over completed tasks, in microseconds
+        uint64_t total_wait_us = 0;
+        uint64_t max_wait_us = 0;
+        uint64_t total_run_us = 0;
+        uint64_t max_run_us = 0;
+    };
+    Stats stats() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Task {
+        std::function<void()> run;
+        Clock::time_point queued_at;
+    };
+
+    // Shared with the threads, so a thread whose task drops the last
+    // reference to this executor can still finish safely after it is gone.
+    struct State {
+        explicit State(size_t capacity) : queue_capacity(capacity) {}
+        const size_t queue_capacity;
+        std::mutex mutex;           // guards everything below
+        std::condition_variable work_cv;
+        std::deque<Task> queue;
+        bool stopping = false;
+        Stats stats;
+    };
+
+    static void work(std::shared_ptr<State> state);
+
+    std::shared_ptr<State> state_;
+    std::vector<std::thread> threads_;
+};
+
+#endif // STORAGE_EXECUTOR_H
@@ -0,0 +1,111 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+const size_t TimerWheel::kSlots;
+
+namespace {
+
+// ticks covered by the whole wheel
+const uint64_t kSpan = uint64_t(1) << (TimerWheel::kLevelBits * TimerWheel::kLevels);
+
+} // namespace
+
+TimerWheel::TimerWheel(uint64_t now) : now_(now) {}
+
+/**
+ * place() - Put timer into the slot of the lowest level whose span reaches its
+ * deadline, but no earlier than tick earliest. That slot comes up again no
+ * later than the deadline, and by then the timer is within reach of the level
+ * below.
+ */
+void TimerWheel::place(const std::string& key, Timer* timer, uint64_t earliest) {
+    uint64_t due = std::max(timer->deadline, earliest);
+    due = std::min(due, now_ + kSpan - 1);
+    uint64_t delta = due - now_;
+    int level = 0;
+    while (level < kLevels - 1 && delta >> (kLevelBits * (level + 1)) != 0) {
+        level++;
+    }
+    Slot& slot = slots_[level][(due >> (kLevelBits * level)) & (kSlots - 1)];
+    timer->slot = &slot;
+    timer->position = slot.insert(slot.end(), &key);
+}
+
+void TimerWheel::schedule(const std::string& key, uint64_t deadline) {
+    auto it = timers_.find(key);
+    if (it == timers_.end()) {
+        it = timers_.emplace(key, Timer()).first;
+    } else {
+        it->second.slot->erase(it->second.position);
+    }
+    it->second.deadline = deadline;
+    place(it->first, &it->second, now_ + 1);
+}
+
+bool TimerWheel::cancel(const std::string& key) {
+    auto it = timers_.find(key);
+    if (it == timers_.end()) {
+        return false;
+    }
+    it->second.slot->erase(it->second.position);
+    timers_.erase(it);
+    return true;
+}
+
+uint64_t TimerWheel::deadline(const std::string& key) const {
+    auto it = timers_.find(key);
+    return it == timers_.end() ? 0 : it->second.deadline;
+}
+
+/**
+ * cascade() - Move the timers in the current slot of level down to the levels
+ * below, now that they are due within that slot's span. Those due right now go
+ * to the level 0 slot about to fire.
+ */
+void TimerWheel::cascade(int level) {
+    Slot moving;
+    moving.swap(slots_[level][(now_ >> (kLevelBits * level)) & (kSlots - 1)]);
+    for (const std::string* key : moving) {
+        place(*key, &timers_.find(*key)->second, now_);
+    }
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<std::string>* expired) {
+    if (now <= now_) {
+        return;
+    }
+    if (now - now_ >= kSpan) {
+        // jumped past the whole wheel: cheaper to sort every timer out afresh
+        // than to turn it over tick by tick
+        for (auto& level : slots_) {
+            for (Slot& slot : level) {
+                slot.clear();
+            }
+        }
+        now_ = now;
+        for (auto it = timers_.begin(); it != timers_.end();) {
+            if (it->second.deadline <= now_) {
+                expired->push_back(it->first);
+                it = timers_.erase(it);
+            } else {
+                place(it->first, &it->second, now_ + 1);
+                ++it;
+            }
+        }
+        return;
+    }
+    while (now_ < now) {
+        now_++;
+        for (int level = 1;
+             level < kLevels && (now_ & ((uint64_t(1) << (kLevelBits * level)) - 1)) == 0;
+             level++) {
+            cascade(level);
+        }
+        Slot due;
+        due.swap(slots_[0][now_ & (kSlots - 1)]);
+        for (const std::string* key : due) {
+            expired->push_back(*key);
+            timers_.erase(expired->back());
+        }
+    }
+}
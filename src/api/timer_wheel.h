@@ -0,0 +1,62 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchical timing wheel of string keys with deadlines in abstract ticks.
+//
+// There are kLevels wheels of kSlots slots. Level 0 holds timers due within
+// kSlots ticks, one slot per tick; each level above covers kSlots times the
+// span of the one below. A timer sits in the slot of the lowest level whose
+// span reaches its deadline, and when a lower wheel wraps around, the next
+// slot of the level above is cascaded down. Scheduling, rescheduling and
+// cancelling are O(1), and each timer is touched at most kLevels times on its
+// way to firing. Not thread-safe.
+class TimerWheel {
+public:
+    static const int kLevelBits = 6;
+    static const size_t kSlots = size_t(1) << kLevelBits;
+    static const int kLevels = 5;
+
+    // the wheel starts out at tick now
+    explicit TimerWheel(uint64_t now);
+
+    // Fire key at deadline, replacing any timer it already has. Deadlines at
+    // or before now() fire on the next tick; ones beyond the wheel's span are
+    // kept at its far end and cascade until they are due.
+    void schedule(const std::string& key, uint64_t deadline);
+    // returns false if key had no timer
+    bool cancel(const std::string& key);
+    // The deadline of key's timer, or 0 if it has none.
+    uint64_t deadline(const std::string& key) const;
+
+    // Move the wheel to tick now, appending the keys of every timer that fired
+    // on the way to expired. Their timers are removed. A wheel can't go back.
+    void advance(uint64_t now, std::vector<std::string>* expired);
+
+    uint64_t now() const { return now_; }
+    size_t size() const { return timers_.size(); }
+
+private:
+    // a slot holds pointers to the keys of timers_, which never move
+    typedef std::list<const std::string*> Slot;
+
+    struct Timer {
+        uint64_t deadline;
+        Slot* slot;
+        Slot::iterator position;
+    };
+
+    void place(const std::string& key, Timer* timer, uint64_t earliest);
+    void cascade(int level);
+
+    uint64_t now_;
+    std::unordered_map<std::string, Timer> timers_;
+    Slot slots_[kLevels][kSlots];
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,188 @@
+#include "versioned_crud_handler.h"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <set>
+
+const size_t VersionedCRUDHandler::kStripes;
+
+namespace {
+
+uint64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace
+
+VersionedCRUDHandler::VersionedCRUDHandler(ICRUDHandler* backend)
+    : backend_(backend), seed_(nowMicros()), clock_(seed_) {}
+
+std::string VersionedCRUDHandler::key(const std::string& entity, int id) {
+    return entity + "/" + std::to_string(id);
+}
+
+VersionedCRUDHandler::Stripe& VersionedCRUDHandler::stripe(const std::string& key) {
+    return stripes_[std::hash<std::string>()(key) % kStripes];
+}
+
+uint64_t VersionedCRUDHandler::versionLocked(Stripe& stripe, const std::string& key,
+                                             const std::string& entity, int id) {
+    auto it = stripe.versions.find(key);
+    if (it != stripe.versions.end()) {
+        return it->second;
+    }
+    return backend_->exists(entity, id) ? seed_ : 0;
+}
+
+/**
+ * bump() - Give key a version newer than any handed out so far. The counter
+ * is bumped under the stripe, so versions of one key only ever go up.
+ */
+uint64_t VersionedCRUDHandler::bump(Stripe& stripe, const std::string& key) {
+    uint64_t version = ++clock_;
+    stripe.versions[key] = version;
+    return version;
+}
+
+std::string VersionedCRUDHandler::create(const std::string& entity, const std::string& data) {
+    std::string result = backend_->create(entity, data);
+    int id = createdId(result);
+    if (id != 0) {
+        std::string k = key(entity, id);
+        Stripe& s = stripe(k);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        bump(s, k);
+    }
+    return result;
+}
+
+std::string VersionedCRUDHandler::read(const std::string& entity, int id) {
+    return backend_->read(entity, id);
+}
+
+bool VersionedCRUDHandler::update(const std::string& entity, int id, const std::string& data) {
+    return updateIf(entity, id, data, 0) == kWritten;
+}
+
+bool VersionedCRUDHandler::delete_(const std::string& entity, int id) {
+    return deleteIf(entity, id, 0) == kWritten;
+}
+
+bool VersionedCRUDHandler::exists(const std::string& entity, int id) {
+    return backend_->exists(entity, id);
+}
+
+std::vector<int> VersionedCRUDHandler::list(const std::string& entity) {
+    return backend_->list(entity);
+}
+
+std::vector<int> VersionedCRUDHandler::list(const std::string& entity, int after, size_t limit) {
+    return backend_->list(entity, after, limit);
+}
+
+std::shared_ptr<const MappedFile> VersionedCRUDHandler::readMapped(const std::string& entity,
+                                                                   int id) {
+    return backend_->readMapped(entity, id);
+}
+
+std::vector<BatchResult> VersionedCRUDHandler::batch(
+        const std::vector<BatchOperation>& operations) {
+    std::vector<BatchResult> results;
+    {
+        // stripes are always taken in ascending order, so two batches can't deadlock
+        std::set<std::mutex*> held;
+        for (const BatchOperation& op : operations) {
+            if (op.type == BatchOperation::kUpdate || op.type == BatchOperation::kDelete) {
+                held.insert(&stripe(key(op.entity, op.id)).mutex);
+            }
+        }
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (std::mutex* mutex : held) {
+            locks.emplace_back(*mutex);
+        }
+        results = backend_->batch(operations);
+        for (size_t i = 0; i < operations.size(); i++) {
+            const BatchOperation& op = operations[i];
+            if (!results[i].ok) {
+                continue;
+            }
+            std::string k = key(op.entity, op.id);
+            if (op.type == BatchOperation::kUpdate) {
+                bump(stripe(k), k);
+            } else if (op.type == BatchOperation::kDelete) {
+                stripe(k).versions.erase(k);
+            }
+        }
+    }
+    // nobody could have targeted the new ids before they existed, so their
+    // stripes are only taken now
+    for (size_t i = 0; i < operations.size(); i++) {
+        if (operations[i].type == BatchOperation::kCreate && results[i].ok) {
+            std::string k = key(operations[i].entity, results[i].id);
+            Stripe& s = stripe(k);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            bump(s, k);
+        }
+    }
+    return results;
+}
+
+bool VersionedCRUDHandler::query(const std::string& entity, const std::string& field,
+                                 const std::string& value, std::vector<int>* ids) {
+    return backend_->query(entity, field, value, ids);
+}
+
+uint64_t VersionedCRUDHandler::version(const std::string& entity, int id) {
+    std::string k = key(entity, id);
+    Stripe& s = stripe(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return versionLocked(s, k, entity, id);
+}
+
+ICRUDHandler::WriteStatus VersionedCRUDHandler::updateIf(const std::string& entity, int id,
+                                                         const std::string& data,
+                                                         uint64_t expected, uint64_t* version) {
+    std::string k = key(entity, id);
+    Stripe& s = stripe(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (expected != 0) {
+        uint64_t current = versionLocked(s, k, entity, id);
+        if (current == 0) {
+            return kNotFound;
+        }
+        if (current != expected) {
+            return kVersionMismatch;
+        }
+    }
+    if (!backend_->update(entity, id, data)) {
+        return kNotFound;
+    }
+    uint64_t written = bump(s, k);
+    if (version) {
+        *version = written;
+    }
+    return kWritten;
+}
+
+ICRUDHandler::WriteStatus VersionedCRUDHandler::deleteIf(const std::string& entity, int id,
+                                                         uint64_t expected) {
+    std::string k = key(entity, id);
+    Stripe& s = stripe(k);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (expected != 0) {
+        uint64_t current = versionLocked(s, k, entity, id);
+        if (current == 0) {
+            return kNotFound;
+        }
+        if (current != expected) {
+            return kVersionMismatch;
+        }
+    }
+    if (!backend_->delete_(entity, id)) {
+        return kNotFound;
+    }
+    s.versions.erase(k);
+    return kWritten;
+}
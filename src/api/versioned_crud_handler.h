@@ -0,0 +1,68 @@
+#ifndef VERSIONED_CRUD_HANDLER_H
+#define VERSIONED_CRUD_HANDLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "crud_handler.h"
+
+// Keeps a version per stored instance and makes conditional writes atomic.
+//
+// Versions come from one counter shared by every entity, bumped by each
+// write through this handler and seeded with the wall clock in microseconds
+// at construction. Versions live in memory only; instances not written since
+// startup report the seed. A restart therefore never reuses a version handed
+// out before it, so a stale ETag can only fail to match, never match the
+// wrong body.
+class VersionedCRUDHandler : public ICRUDHandler {
+public:
+    // takes ownership of backend
+    explicit VersionedCRUDHandler(ICRUDHandler* backend);
+
+    std::string create(const std::string& entity, const std::string& data) override;
+    std::string read(const std::string& entity, int id) override;
+    bool update(const std::string& entity, int id, const std::string& data) override;
+    bool delete_(const std::string& entity, int id) override;
+    bool exists(const std::string& entity, int id) override;
+    std::vector<int> list(const std::string& entity) override;
+    std::vector<int> list(const std::string& entity, int after, size_t limit) override;
+    std::shared_ptr<const MappedFile> readMapped(const std::string& entity, int id) override;
+    // runs on the backend, holding the stripes of the ids it updates or deletes
+    std::vector<BatchResult> batch(const std::vector<BatchOperation>& operations) override;
+    bool query(const std::string& entity, const std::string& field,
+               const std::string& value, std::vector<int>* ids) override;
+
+    uint64_t version(const std::string& entity, int id) override;
+    WriteStatus updateIf(const std::string& entity, int id, const std::string& data,
+                         uint64_t expected, uint64_t* version = nullptr) override;
+    WriteStatus deleteIf(const std::string& entity, int id, uint64_t expected) override;
+
+private:
+    static const size_t kStripes = 64;
+
+    // Writes hold their key's stripe across the backend write and the version
+    // bump, and conditional writes across the check too.
+    struct Stripe {
+        std::mutex mutex;
+        // "entity/id" -> version, for ids written since startup
+        std::unordered_map<std::string, uint64_t> versions;
+    };
+
+    static std::string key(const std::string& entity, int id);
+    Stripe& stripe(const std::string& key);
+    // caller holds the key's stripe
+    uint64_t versionLocked(Stripe& stripe, const std::string& key,
+                           const std::string& entity, int id);
+    uint64_t bump(Stripe& stripe, const std::string& key);
+
+    std::unique_ptr<ICRUDHandler> backend_;
+    const uint64_t seed_;
+    std::atomic<uint64_t> clock_;
+    Stripe stripes_[kStripes];
+};
+
+#endif // VERSIONED_CRUD_HANDLER_H
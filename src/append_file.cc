@@ -0,0 +1,83 @@
+#include "append_file.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+const size_t AppendFile::kBufferSize;
+
+AppendFile::AppendFile(int fd, std::chrono::milliseconds flush_interval)
+    : fd_(fd) {
+  buffer_.reserve(kBufferSize);
+  flusher_ = std::thread(&AppendFile::flushLoop, this, flush_interval);
+}
+
+/**
+ * open() - Open or create the file at path and check or write its header.
+ */
+std::unique_ptr<AppendFile>
+AppendFile::open(const std::string &path, const std::string &header,
+                 std::chrono::milliseconds flush_interval) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  if (ok && st.st_size == 0) {
+    ok = ::write(fd, header.data(), header.size()) ==
+         static_cast<ssize_t>(header.size());
+  } else if (ok && !header.empty()) {
+    std::vector<char> existing(header.size());
+    ok = pread(fd, existing.data(), existing.size(), 0) ==
+             static_cast<ssize_t>(existing.size()) &&
+         std::equal(existing.begin(), existing.end(), header.begin());
+  }
+  if (!ok) {
+    close(fd);
+    return nullptr;
+  }
+  return std::unique_ptr<AppendFile>(new AppendFile(fd, flush_interval));
+}
+
+AppendFile::~AppendFile() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  flusher_.join();
+  flushLocked();
+  close(fd_);
+}
+
+void AppendFile::append(const std::string &record) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffer_.append(record);
+  if (buffer_.size() >= kBufferSize)
+    flushLocked();
+}
+
+void AppendFile::flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  flushLocked();
+}
+
+void AppendFile::flushLocked() {
+  size_t written = 0;
+  while (written < buffer_.size()) {
+    ssize_t n = ::write(fd_, buffer_.data() + written, buffer_.size() - written);
+    if (n <= 0)
+      break;
+    written += n;
+  }
+  buffer_.clear();
+}
+
+void AppendFile::flushLoop(std::chrono::milliseconds flush_interval) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    cv_.wait_for(lock, flush_interval);
+    flushLocked();
+  }
+}
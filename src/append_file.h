@@ -0,0 +1,51 @@
+/**
+ * A file that many threads append whole records to, through one buffer.
+ *
+ * Appends go to an in-memory buffer, which is written out with a single
+ * write() to a file opened with O_APPEND when it fills up, and otherwise by a
+ * background thread once every flush interval. The buffer only ever holds
+ * whole records, so records from another writer on the same file, such as the
+ * one a config reload opens, never interleave with ours.
+ */
+
+#ifndef APPEND_FILE_H
+#define APPEND_FILE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class AppendFile {
+public:
+  // buffered bytes that trigger a write from the appending thread
+  static const size_t kBufferSize = 64 * 1024;
+
+  // Open path for appending. A new file is started with header, and an
+  // existing one must start with it. Returns nullptr if path can't be opened
+  // or starts with something else.
+  static std::unique_ptr<AppendFile> open(const std::string &path,
+                                          const std::string &header,
+                                          std::chrono::milliseconds flush_interval);
+  // writes out whatever is buffered
+  ~AppendFile();
+
+  void append(const std::string &record);
+  void flush();
+
+private:
+  AppendFile(int fd, std::chrono::milliseconds flush_interval);
+  void flushLocked();
+  void flushLoop(std::chrono::milliseconds flush_interval);
+
+  const int fd_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::string buffer_;
+  bool stopping_ = false;
+  std::thread flusher_;
+};
+
+#endif // APPEND_FILE_H
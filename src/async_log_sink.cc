@@ -0,0 +1,103 @@
+#include "async_log_sink.h"
+
+AsyncLogSink::AsyncLogSink(
+    std::vector<boost::shared_ptr<boost::log::sinks::sink>> outputs,
+    size_t capacity, OverflowPolicy policy)
+    : boost::log::sinks::sink(true), ring_(capacity),
+      outputs_(std::move(outputs)), policy_(policy) {
+  writer_ = std::thread(&AsyncLogSink::writeLoop, this);
+}
+
+AsyncLogSink::~AsyncLogSink() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_cv_.notify_all();
+  writer_.join();
+}
+
+void AsyncLogSink::consume(boost::log::record_view const &rec) {
+  push(rec, policy_ == kBlock);
+}
+
+// The core offers each record here first and only falls back to consume() if
+// this refuses it, so a full ring isn't a drop yet.
+bool AsyncLogSink::try_consume(boost::log::record_view const &rec) {
+  if (!ring_.tryPush(boost::log::record_view(rec)))
+    return false;
+  queued_++;
+  wake();
+  return true;
+}
+
+/**
+ * push() - Queue rec for the writer. If the ring is full, either wait for the
+ * writer to make room or drop rec, as may_wait says.
+ */
+bool AsyncLogSink::push(boost::log::record_view rec, bool may_wait) {
+  while (!ring_.tryPush(std::move(rec))) {
+    if (!may_wait) {
+      dropped_++;
+      return false;
+    }
+    wake();
+    std::this_thread::yield();
+  }
+  queued_++;
+  wake();
+  return true;
+}
+
+// Wake the writer if it has gone to sleep on an empty ring. The fence pairs
+// with the one in writeLoop(): either the writer sees the record just pushed
+// before it sleeps, or this sees it sleeping.
+void AsyncLogSink::wake() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping_.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wake_cv_.notify_one();
+  }
+}
+
+void AsyncLogSink::flush() {
+  uint64_t target = queued_;
+  std::unique_lock<std::mutex> lock(mutex_);
+  written_cv_.wait(lock, [this, target] { return written_ >= target; });
+}
+
+/**
+ * writeLoop() - Hand queued records to the outputs a batch at a time,
+ * flushing them after each batch, and sleep while the ring is empty.
+ */
+void AsyncLogSink::writeLoop() {
+  boost::log::record_view rec;
+  while (true) {
+    uint64_t batch = 0;
+    // a ring's worth at most, so a steady stream still gets flushed
+    while (batch < ring_.capacity() && ring_.tryPop(&rec)) {
+      for (const auto &output : outputs_) {
+        if (output->will_consume(rec.attribute_values()))
+          output->consume(rec);
+      }
+      batch++;
+    }
+    rec = boost::log::record_view();
+    if (batch > 0) {
+      for (const auto &output : outputs_)
+        output->flush();
+      written_ += batch;
+      std::lock_guard<std::mutex> lock(mutex_);
+      written_cv_.notify_all();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopping_)
+      return;
+    sleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wake_cv_.wait(lock, [this] { return stopping_ || !ring_.empty(); });
+    sleeping_.store(false, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,68 @@
+#ifndef ASYNC_LOG_SINK_H
+#define ASYNC_LOG_SINK_H
+
+#include "mpsc_ring.h"
+#include <atomic>
+#include <boost/log/core/record_view.hpp>
+#include <boost/log/sinks/sink.hpp>
+#include <boost/shared_ptr.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Boost.Log sink that takes records off the logging thread.
+//
+// consume() only moves the record into a bounded lock-free ring; a background
+// writer drains the ring in batches into the output sinks and flushes them
+// once per batch, so formatting, the sinks' locks and disk writes all stay off
+// the threads doing the logging. When the ring is full a record is either
+// dropped and counted or the logging thread waits for room, as the overflow
+// policy says.
+class AsyncLogSink : public boost::log::sinks::sink {
+public:
+  enum OverflowPolicy { kDrop, kBlock };
+
+  // outputs receive every record on the writer thread and must not also be
+  // registered with the logging core
+  AsyncLogSink(std::vector<boost::shared_ptr<boost::log::sinks::sink>> outputs,
+               size_t capacity, OverflowPolicy policy);
+  // writes out whatever is queued, then stops the writer
+  ~AsyncLogSink() override;
+
+  bool will_consume(boost::log::attribute_value_set const &) override {
+    return true;
+  }
+  void consume(boost::log::record_view const &rec) override;
+  // never waits or drops, whatever the policy
+  bool try_consume(boost::log::record_view const &rec) override;
+  // returns once every record queued before the call is written and flushed
+  void flush() override;
+
+  // records lost to a full ring so far
+  uint64_t dropped() const { return dropped_; }
+  size_t capacity() const { return ring_.capacity(); }
+
+private:
+  bool push(boost::log::record_view rec, bool may_wait);
+  void wake();
+  void writeLoop();
+
+  MpscRing<boost::log::record_view> ring_;
+  const std::vector<boost::shared_ptr<boost::log::sinks::sink>> outputs_;
+  const OverflowPolicy policy_;
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> queued_{0};    // records pushed so far
+  std::atomic<uint64_t> written_{0};   // of those, records written and flushed
+
+  // producers only take the mutex to wake a sleeping writer
+  std::atomic<bool> sleeping_{false};
+  std::mutex mutex_;
+  std::condition_variable wake_cv_;
+  std::condition_variable written_cv_;
+  bool stopping_ = false;
+  std::thread writer_;
+};
+
+#endif // ASYNC_LOG_SINK_H
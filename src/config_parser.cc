@@ -274,7 +274,7 @@ bool NginxConfigParser::Parse(const char *file_name, NginxConfig *config) {
 
 // Get port number from parsed config.
 // Return the first outer-most valid one if there are many, and -1 on error.
-int NginxConfig::get_config_port() {
+int NginxConfig::get_config_port() const {
   // First traverse statements without child blocks
   for (auto pStatement : statements_) {
     if (pStatement->child_block_.get() == nullptr) {
@@ -297,7 +297,7 @@ int NginxConfig::get_config_port() {
 
 // Get authorization timeout time from parsed config.
 // Return the first outer-most valid one if there are many, and -1 on error.
-int NginxConfig::get_auth_time() {
+int NginxConfig::get_auth_time() const {
   // First traverse statements without child blocks
   for (auto pStatement : statements_) {
     if (pStatement->child_block_.get() == nullptr) {
@@ -318,7 +318,7 @@ int NginxConfig::get_auth_time() {
   return -1; // Ret type should be int to cover -1
 }
 
-std::map<std::string, std::string> NginxConfig::get_credentials() {
+std::map<std::string, std::string> NginxConfig::get_credentials() const {
   std::map<std::string, std::string> credentials;
   for (auto pStatement : statements_) {
     if (pStatement->tokens_[0] == "credentials") {
@@ -336,8 +336,187 @@ std::map<std::string, std::string> NginxConfig::get_credentials() {
       return credentials;
     }
     if (pStatement->child_block_.get() != nullptr) {
-      return pStatement->child_block_->get_credentials();
+      // other blocks, such as async_log, may come before the one holding the
+      // credentials, so keep looking until a block yields some
+      credentials = pStatement->child_block_->get_credentials();
+      if (!credentials.empty())
+        return credentials;
     }
   }
   return credentials;
 }
+
+// Get signed session cookie settings from a "session_cookie { ttl N; secret S; }"
+// block. Returns false if there is no such block or its ttl is invalid.
+bool NginxConfig::get_session_cookie(std::string *secret, int *ttl) const {
+  for (auto pStatement : statements_) {
+    if (pStatement->child_block_.get() == nullptr)
+      continue;
+    if (pStatement->tokens_[0] != "session_cookie") {
+      if (pStatement->child_block_->get_session_cookie(secret, ttl))
+        return true;
+      continue;
+    }
+    *secret = "";
+    *ttl = 3600; // Default to one hour
+    for (const auto &childStatement : pStatement->child_block_->statements_) {
+      if (childStatement->tokens_.size() != 2)
+        continue;
+      if (childStatement->tokens_[0] == "secret") {
+        *secret = childStatement->tokens_[1];
+      } else if (childStatement->tokens_[0] == "ttl") {
+        *ttl = atoi(childStatement->tokens_[1].c_str());
+      }
+    }
+    return *ttl > 0;
+  }
+  return false;
+}
+
+// Get password verification cache settings from a
+// "credential_cache { size N; ttl S; }" block. Returns false if there is no
+// such block. A size of 0 disables the cache.
+bool NginxConfig::get_credential_cache(size_t *size, int *ttl) const {
+  for (auto pStatement : statements_) {
+    if (pStatement->child_block_.get() == nullptr)
+      continue;
+    if (pStatement->tokens_[0] != "credential_cache") {
+      if (pStatement->child_block_->get_credential_cache(size, ttl))
+        return true;
+      continue;
+    }
+    *size = 1024;
+    *ttl = 300; // Default to five minutes
+    for (const auto &childStatement : pStatement->child_block_->statements_) {
+      if (childStatement->tokens_.size() != 2)
+        continue;
+      int value = atoi(childStatement->tokens_[1].c_str());
+      if (childStatement->tokens_[0] == "size" && value >= 0) {
+        *size = value;
+      } else if (childStatement->tokens_[0] == "ttl" && value >= 0) {
+        *ttl = value;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+// Get asynchronous logging settings from an
+// "async_log { queue N; overflow drop|block; }" block. Returns false if there
+// is no such block.
+bool NginxConfig::get_async_log(size_t *queue, bool *block) const {
+  for (auto pStatement : statements_) {
+    if (pStatement->child_block_.get() == nullptr)
+      continue;
+    if (pStatement->tokens_[0] != "async_log") {
+      if (pStatement->child_block_->get_async_log(queue, block))
+        return true;
+      continue;
+    }
+    *queue = 8192;
+    *block = false; // Default to dropping records rather than stalling
+    for (const auto &childStatement : pStatement->child_block_->statements_) {
+      if (childStatement->tokens_.size() != 2)
+        continue;
+      if (childStatement->tokens_[0] == "queue") {
+        int value = atoi(childStatement->tokens_[1].c_str());
+        if (value > 0)
+          *queue = value;
+      } else if (childStatement->tokens_[0] == "overflow") {
+        *block = childStatement->tokens_[1] == "block";
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+// Get the request size limit in bytes from a "client_max_body_size N;"
+// statement. Return the first outer-most valid one, and -1 if there is none.
+long NginxConfig::get_max_request_size() const {
+  for (auto pStatement : statements_) {
+    if (pStatement->child_block_.get() == nullptr &&
+        pStatement->tokens_.size() == 2 &&
+        pStatement->tokens_[0] == "client_max_body_size") {
+      long ret = atol(pStatement->tokens_[1].c_str());
+      return ret > 0 ? ret : -1;
+    }
+  }
+  for (auto pStatement : statements_) {
+    if (pStatement->child_block_.get() != nullptr) {
+      long ret;
+      if ((ret = pStatement->child_block_->get_max_request_size()) != -1)
+        return ret;
+    }
+  }
+  return -1;
+}
+
+// Get the logging threshold from a "log_level <severity>;" statement. Return
+// the first outer-most one, and an empty string if there is none.
+std::string NginxConfig::get_log_level() const {
+  for (auto pStatement : statements_) {
+    if (pStatement->child_block_.get() == nullptr &&
+        pStatement->tokens_.size() == 2 &&
+        pStatement->tokens_[0] == "log_level")
+      return pStatement->tokens_[1];
+  }
+  for (auto pStatement : statements_) {
+    if (pStatement->child_block_.get() != nullptr) {
+      std::string ret = pStatement->child_block_->get_log_level();
+      if (!ret.empty())
+        return ret;
+    }
+  }
+  return "";
+}
+
+// Get the path of the binary access log from an "access_log <path>;"
+// statement. Return the first outer-most one, and an empty string if there is
+// none.
+std::string NginxConfig::get_access_log() const {
+  for (auto pStatement : statements_) {
+    if (pStatement->child_block_.get() == nullptr &&
+        pStatement->tokens_.size() == 2 &&
+        pStatement->tokens_[0] == "access_log")
+      return pStatement->tokens_[1];
+  }
+  for (auto pStatement : statements_) {
+    if (pStatement->child_block_.get() != nullptr) {
+      std::string ret = pStatement->child_block_->get_access_log();
+      if (!ret.empty())
+        return ret;
+    }
+  }
+  return "";
+}
+
+// Get request tracing settings from a "tracing { file <path>; sample R; }"
+// block. Returns false if there is no such block or it names no file.
+bool NginxConfig::get_tracing(std::string *file, double *sample) const {
+  for (auto pStatement : statements_) {
+    if (pStatement->child_block_.get() == nullptr)
+      continue;
+    if (pStatement->tokens_[0] != "tracing") {
+      if (pStatement->child_block_->get_tracing(file, sample))
+        return true;
+      continue;
+    }
+    *file = "";
+    *sample = 0.01; // Default to one request in a hundred
+    for (const auto &childStatement : pStatement->child_block_->statements_) {
+      if (childStatement->tokens_.size() != 2)
+        continue;
+      if (childStatement->tokens_[0] == "file") {
+        *file = childStatement->tokens_[1];
+      } else if (childStatement->tokens_[0] == "sample") {
+        double value = atof(childStatement->tokens_[1].c_str());
+        if (value >= 0 && value <= 1)
+          *sample = value;
+      }
+    }
+    return !file->empty();
+  }
+  return false;
+}
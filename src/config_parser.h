@@ -22,9 +22,16 @@ class NginxConfig {
 public:
   std::string ToString(int depth = 0);
   std::vector<std::shared_ptr<NginxConfigStatement>> statements_;
-  int get_config_port();
-  int get_auth_time();
-  std::map<std::string, std::string> get_credentials();
+  int get_config_port() const;
+  int get_auth_time() const;
+  std::map<std::string, std::string> get_credentials() const;
+  bool get_session_cookie(std::string *secret, int *ttl) const;
+  bool get_credential_cache(size_t *size, int *ttl) const;
+  bool get_async_log(size_t *queue, bool *block) const;
+  long get_max_request_size() const;
+  std::string get_log_level() const;
+  std::string get_access_log() const;
+  bool get_tracing(std::string *file, double *sample) const;
 };
 
 // The driver that parses a config file and generates an NginxConfig.
@@ -0,0 +1,195 @@
+#include "credential_store.h"
+#include "api/storage_executor.h"
+#include <crypt.h>
+#include <memory>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <stdexcept>
+
+const int CredentialStore::kRejectedTtlSeconds;
+const size_t CredentialStore::kVerifyThreads;
+const size_t CredentialStore::kVerifyQueue;
+
+/**
+ * Constructor - Take the username -> stored password map from the config.
+ */
+CredentialStore::CredentialStore(
+    const std::map<std::string, std::string> &credentials,
+    size_t cache_capacity, std::chrono::seconds cache_ttl)
+    : credentials_(credentials), cache_capacity_(cache_capacity),
+      cache_ttl_(cache_ttl), cache_key_(32, '\0'),
+      verifier_(new StorageExecutor(kVerifyThreads, kVerifyQueue)) {
+  if (RAND_bytes(reinterpret_cast<unsigned char *>(&cache_key_[0]),
+                 static_cast<int>(cache_key_.size())) != 1)
+    throw std::runtime_error("Unable to generate credential cache key");
+
+  // a stored hash is a valid crypt setting for a new one of the same kind;
+  // the password it hashes is the hex of the cache key, which no one knows
+  static const char kHex[] = "0123456789abcdef";
+  std::string password;
+  for (unsigned char byte : cache_key_) {
+    password += kHex[byte >> 4];
+    password += kHex[byte & 15];
+  }
+  for (const auto &entry : credentials_) {
+    if (!isHash(entry.second))
+      continue;
+    std::unique_ptr<crypt_data> data(new crypt_data());
+    const char *hashed =
+        crypt_r(password.c_str(), entry.second.c_str(), data.get());
+    if (hashed != nullptr && hashed[0] != '*') {
+      dummy_hash_ = hashed;
+      break;
+    }
+  }
+}
+
+CredentialStore::~CredentialStore() = default;
+
+bool CredentialStore::isHash(const std::string &stored) {
+  return !stored.empty() && stored[0] == '$';
+}
+
+/**
+ * verify() - Check a password, consulting the verification caches before
+ * paying for a slow hash.
+ */
+bool CredentialStore::verify(const std::string &username,
+                             const std::string &password) const {
+  std::string key;
+  Verdict verdict = quickVerify(username, password, &key);
+  if (verdict != kPending)
+    return verdict == kAccepted;
+  return slowVerify(username, password, std::move(key));
+}
+
+/**
+ * verifyAsync() - Like verify(), but hand a slow hash to the verification
+ * threads.
+ */
+CredentialStore::Verdict
+CredentialStore::verifyAsync(const std::string &username,
+                             const std::string &password,
+                             std::function<void(bool)> done) const {
+  std::string key;
+  Verdict verdict = quickVerify(username, password, &key);
+  if (verdict != kPending)
+    return verdict;
+  bool queued = verifier_->submit(
+      [this, username, password, key, done = std::move(done)]() mutable {
+        done(slowVerify(username, password, std::move(key)));
+      });
+  return queued ? kPending : kBusy;
+}
+
+CredentialStore::Verdict
+CredentialStore::quickVerify(const std::string &username,
+                             const std::string &password,
+                             std::string *key) const {
+  auto it = credentials_.find(username);
+  // unknown users are hashed like known ones, unless no one is hashed
+  if (it == credentials_.end() && dummy_hash_.empty())
+    return kRejected;
+  if (it != credentials_.end() && !isHash(it->second)) {
+    bool match = it->second.size() == password.size() &&
+                 CRYPTO_memcmp(it->second.data(), password.data(),
+                               password.size()) == 0;
+    return match ? kAccepted : kRejected;
+  }
+
+  *key = digest(username, password);
+  if (cache_capacity_ > 0 && cacheLookup(accepted_, username, *key)) {
+    cache_hits_++;
+    return kAccepted;
+  }
+  if (cache_capacity_ > 0 && cacheLookup(rejected_, username, *key)) {
+    rejected_hits_++;
+    return kRejected;
+  }
+  cache_misses_++;
+  return kPending;
+}
+
+bool CredentialStore::slowVerify(const std::string &username,
+                                 const std::string &password,
+                                 std::string key) const {
+  auto it = credentials_.find(username);
+  bool match = false;
+  if (it != credentials_.end())
+    match = slowVerify(it->second, password);
+  else
+    slowVerify(dummy_hash_, password); // as slow, and never a match
+  if (cache_capacity_ > 0) {
+    if (match)
+      cacheInsert(accepted_, username, std::move(key), cache_ttl_);
+    else
+      cacheInsert(rejected_, username, std::move(key),
+                  std::chrono::seconds(kRejectedTtlSeconds));
+  }
+  return match;
+}
+
+bool CredentialStore::slowVerify(const std::string &stored,
+                                 const std::string &password) const {
+  // crypt_data is large, keep it off the stack
+  std::unique_ptr<crypt_data> data(new crypt_data());
+  const char *hashed = crypt_r(password.c_str(), stored.c_str(), data.get());
+  // crypt_r reports failure with NULL or a string starting with '*'
+  if (hashed == nullptr || hashed[0] == '*')
+    return false;
+  std::string result(hashed);
+  return result.size() == stored.size() &&
+         CRYPTO_memcmp(result.data(), stored.data(), stored.size()) == 0;
+}
+
+std::string CredentialStore::digest(const std::string &username,
+                                    const std::string &password) const {
+  std::string message = username + ":" + password;
+  unsigned char out[EVP_MAX_MD_SIZE];
+  unsigned int out_len = 0;
+  HMAC(EVP_sha256(), cache_key_.data(), static_cast<int>(cache_key_.size()),
+       reinterpret_cast<const unsigned char *>(message.data()), message.size(),
+       out, &out_len);
+  return std::string(reinterpret_cast<char *>(out), out_len);
+}
+
+bool CredentialStore::cacheLookup(Cache &cache, const std::string &username,
+                                  const std::string &digest) const {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  auto it = cache.map.find(username);
+  if (it == cache.map.end())
+    return false;
+  const CacheEntry &entry = *it->second;
+  if (std::chrono::steady_clock::now() >= entry.expires) {
+    cache.lru.erase(it->second);
+    cache.map.erase(it);
+    return false;
+  }
+  if (entry.digest.size() != digest.size() ||
+      CRYPTO_memcmp(entry.digest.data(), digest.data(), digest.size()) != 0)
+    return false;
+  cache.lru.splice(cache.lru.begin(), cache.lru, it->second);
+  return true;
+}
+
+void CredentialStore::cacheInsert(Cache &cache, const std::string &username,
+                                  std::string digest,
+                                  std::chrono::seconds ttl) const {
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  auto expires = std::chrono::steady_clock::now() + ttl;
+  auto it = cache.map.find(username);
+  if (it != cache.map.end()) {
+    it->second->digest = std::move(digest);
+    it->second->expires = expires;
+    cache.lru.splice(cache.lru.begin(), cache.lru, it->second);
+    return;
+  }
+  if (cache.lru.size() >= cache_capacity_) {
+    cache.map.erase(cache.lru.back().username);
+    cache.lru.pop_back();
+  }
+  cache.lru.push_front(CacheEntry{username, std::move(digest), expires});
+  cache.map[username] = cache.lru.begin();
+}
@@ -0,0 +1,113 @@
+/**
+ * Username/password verification backed by salted slow hashes.
+ *
+ * Passwords in the config may be stored as crypt(3) strings, e.g. bcrypt
+ * ("$2b$..."), yescrypt ("$y$...") or scrypt ("$7$..."); anything not
+ * starting with '$' is treated as a legacy plaintext password. Because slow
+ * hashes are deliberately expensive, successful verifications are memoized in
+ * a bounded, time-limited cache shared by every session, so the hash is paid
+ * once per credential per TTL instead of once per request. The last wrong
+ * password of each user is remembered for a short while too, so retrying it
+ * costs nothing. Hashes that do have to be computed run on a small pool of
+ * verification threads, never on the network thread. Unknown usernames are
+ * checked against a dummy hash of the same scheme, so how long a rejection
+ * takes does not tell whether the user exists.
+ */
+
+#ifndef CREDENTIAL_STORE_H
+#define CREDENTIAL_STORE_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class StorageExecutor;
+
+class CredentialStore {
+public:
+  // how long a wrong password is remembered
+  static const int kRejectedTtlSeconds = 30;
+  static const size_t kVerifyThreads = 2;
+  static const size_t kVerifyQueue = 256;
+
+  explicit CredentialStore(
+      const std::map<std::string, std::string> &credentials,
+      size_t cache_capacity = 1024,
+      std::chrono::seconds cache_ttl = std::chrono::seconds(300));
+  ~CredentialStore();
+
+  // Thread-safe. Computes a slow hash on the calling thread if it has to.
+  bool verify(const std::string &username, const std::string &password) const;
+
+  enum Verdict { kRejected, kAccepted, kPending, kBusy };
+  // Thread-safe. Answers kAccepted or kRejected when the answer is known
+  // without a slow hash. Otherwise queues the hash and returns kPending, and
+  // done receives the answer on a verification thread; or returns kBusy,
+  // without calling done, if the queue is full.
+  Verdict verifyAsync(const std::string &username, const std::string &password,
+                      std::function<void(bool)> done) const;
+
+  // Whether a stored password is a crypt(3) hash rather than plaintext.
+  static bool isHash(const std::string &stored);
+
+  size_t size() const { return credentials_.size(); }
+  uint64_t cacheHits() const { return cache_hits_; }
+  uint64_t cacheMisses() const { return cache_misses_; }
+  // wrong passwords turned away without a slow hash
+  uint64_t rejectedHits() const { return rejected_hits_; }
+
+private:
+  struct CacheEntry {
+    std::string username;
+    std::string digest; // keyed digest of the password that verified
+    std::chrono::steady_clock::time_point expires;
+  };
+  typedef std::list<CacheEntry> CacheList;
+  // one digest per user, evicted least recently used first
+  struct Cache {
+    CacheList lru; // most recently used first
+    std::unordered_map<std::string, CacheList::iterator> map;
+  };
+
+  // The answer for a hashed password if it can be had without a slow hash;
+  // kPending otherwise.
+  Verdict quickVerify(const std::string &username, const std::string &password,
+                      std::string *key) const;
+  // Pay for the slow hash of the stored password of username and remember the
+  // answer.
+  bool slowVerify(const std::string &username, const std::string &password,
+                  std::string key) const;
+  bool slowVerify(const std::string &stored, const std::string &password) const;
+  std::string digest(const std::string &username,
+                     const std::string &password) const;
+  bool cacheLookup(Cache &cache, const std::string &username,
+                   const std::string &digest) const;
+  void cacheInsert(Cache &cache, const std::string &username,
+                   std::string digest, std::chrono::seconds ttl) const;
+
+  const std::map<std::string, std::string> credentials_;
+  const size_t cache_capacity_;
+  const std::chrono::seconds cache_ttl_;
+  // Random per-process key, so the cache never holds reusable password hashes
+  std::string cache_key_;
+  // a stored hash's scheme and cost over a random password, which unknown
+  // users are checked against; empty if no password is hashed
+  std::string dummy_hash_;
+
+  mutable std::mutex cache_mutex_; // guards both caches
+  mutable Cache accepted_;
+  mutable Cache rejected_;
+  mutable std::atomic<uint64_t> cache_hits_{0};
+  mutable std::atomic<uint64_t> cache_misses_{0};
+  mutable std::atomic<uint64_t> rejected_hits_{0};
+  // runs the slow hashes of verifyAsync()
+  std::unique_ptr<StorageExecutor> verifier_;
+};
+
+#endif // CREDENTIAL_STORE_H
@@ -0,0 +1,405 @@
+// base64.cc
+//
+// Scalar, SSE4.1 and AVX2 base64 codecs. The vector kernels follow the
+// pshufb based lookup scheme described by Wojciech Mula and Daniel Lemire
+// ("Faster Base64 Encoding and Decoding using AVX2 Instructions"). They only
+// ever handle whole blocks without padding; the scalar code finishes the tail
+// and deals with '=' so every implementation validates exactly the same way.
+#include "base64.h"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+namespace base64 {
+namespace {
+
+const char kAlphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Reverse lookup table built once at compile time; 0xff marks bytes outside
+// the alphabet (including '=').
+struct DecodeTable {
+  uint8_t value[256];
+  constexpr DecodeTable() : value() {
+    for (int i = 0; i < 256; ++i)
+      value[i] = 0xff;
+    for (int i = 0; i < 64; ++i)
+      value[static_cast<unsigned char>(kAlphabet[i])] = static_cast<uint8_t>(i);
+  }
+};
+constexpr DecodeTable kDecode;
+
+// Kernels return how many input bytes (encode) or characters (decode) they
+// consumed. Decode kernels return false on the first invalid character.
+typedef std::size_t (*EncodeKernel)(const uint8_t *src, std::size_t len,
+                                    char *dst);
+typedef bool (*DecodeKernel)(const uint8_t *src, std::size_t len,
+                             uint8_t *dst, std::size_t *consumed);
+
+std::size_t encode_scalar(const uint8_t *src, std::size_t len, char *dst) {
+  std::size_t i = 0;
+  for (; i + 3 <= len; i += 3) {
+    uint32_t v = (uint32_t(src[i]) << 16) | (uint32_t(src[i + 1]) << 8) |
+                 uint32_t(src[i + 2]);
+    *dst++ = kAlphabet[(v >> 18) & 0x3f];
+    *dst++ = kAlphabet[(v >> 12) & 0x3f];
+    *dst++ = kAlphabet[(v >> 6) & 0x3f];
+    *dst++ = kAlphabet[v & 0x3f];
+  }
+  return i;
+}
+
+bool decode_scalar(const uint8_t *src, std::size_t len, uint8_t *dst,
+                   std::size_t *consumed) {
+  std::size_t i = 0;
+  for (; i + 4 <= len; i += 4) {
+    uint8_t a = kDecode.value[src[i]];
+    uint8_t b = kDecode.value[src[i + 1]];
+    uint8_t c = kDecode.value[src[i + 2]];
+    uint8_t d = kDecode.value[src[i + 3]];
+    if ((a | b | c | d) & 0x80)
+      return false;
+    uint32_t v = (uint32_t(a) << 18) | (uint32_t(b) << 12) |
+                 (uint32_t(c) << 6) | uint32_t(d);
+    *dst++ = uint8_t(v >> 16);
+    *dst++ = uint8_t(v >> 8);
+    *dst++ = uint8_t(v);
+  }
+  *consumed = i;
+  return true;
+}
+
+#ifdef BASE64_X86
+
+// Encodes 12 input bytes per iteration; every load reads 16 bytes.
+__attribute__((target("sse4.1"))) std::size_t
+encode_sse41(const uint8_t *src, std::size_t len, char *dst) {
+  const __m128i shuffle =
+      _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  const __m128i shift_lut =
+      _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                    '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  std::size_t i = 0;
+  for (; i + 16 <= len; i += 12) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    in = _mm_shuffle_epi8(in, shuffle);
+    // Split every 3 bytes into four 6-bit indices.
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(t1, t3);
+    // Map indices to ASCII by adding a per-range offset.
+    __m128i reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    reduced = _mm_or_si128(reduced, _mm_and_si128(less, _mm_set1_epi8(13)));
+    const __m128i out =
+        _mm_add_epi8(_mm_shuffle_epi8(shift_lut, reduced), indices);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), out);
+    dst += 16;
+  }
+  return i;
+}
+
+// Decodes 16 characters into 12 bytes per iteration; every store writes 16
+// bytes, so the destination needs 4 bytes of slack.
+__attribute__((target("sse4.1"))) bool
+decode_sse41(const uint8_t *src, std::size_t len, uint8_t *dst,
+             std::size_t *consumed) {
+  const __m128i shift_lut =
+      _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  // For each low nibble, the set of high nibbles forming a valid character.
+  const __m128i mask_lut = _mm_setr_epi8(
+      char(0xa8), char(0xf8), char(0xf8), char(0xf8), char(0xf8), char(0xf8),
+      char(0xf8), char(0xf8), char(0xf8), char(0xf8), char(0xf0), char(0x54),
+      char(0x50), char(0x50), char(0x50), char(0x54));
+  const __m128i bitpos_lut =
+      _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, char(0x80), 0,
+                    0, 0, 0, 0, 0, 0, 0);
+  const __m128i pack =
+      _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  std::size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const __m128i in =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    const __m128i hi =
+        _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    const __m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+    const __m128i m = _mm_shuffle_epi8(mask_lut, lo);
+    const __m128i bit = _mm_shuffle_epi8(bitpos_lut, hi);
+    const __m128i bad =
+        _mm_cmpeq_epi8(_mm_and_si128(m, bit), _mm_setzero_si128());
+    if (_mm_movemask_epi8(bad)) {
+      *consumed = i;
+      return false;
+    }
+    const __m128i is_slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    const __m128i shift = _mm_blendv_epi8(_mm_shuffle_epi8(shift_lut, hi),
+                                          _mm_set1_epi8(16), is_slash);
+    const __m128i values = _mm_add_epi8(in, shift);
+    // Merge four 6-bit values into 24 bits, then drop the empty byte.
+    const __m128i ab_bc =
+        _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i merged = _mm_madd_epi16(ab_bc, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                     _mm_shuffle_epi8(merged, pack));
+    dst += 12;
+  }
+  *consumed = i;
+  return true;
+}
+
+// Encodes 24 input bytes per iteration, loading each 12-byte half into its
+// own 128-bit lane; the second load reaches 28 bytes past the block start.
+__attribute__((target("avx2"))) std::size_t
+encode_avx2(const uint8_t *src, std::size_t len, char *dst) {
+  const __m256i shuffle = _mm256_set_epi8(
+      10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1, 10, 11, 9, 10, 7, 8,
+      6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  const __m256i shift_lut = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  std::size_t i = 0;
+  for (; i + 28 <= len; i += 24) {
+    const __m128i lo =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    const __m128i hi =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 12));
+    __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    in = _mm256_shuffle_epi8(in, shuffle);
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    const __m256i indices = _mm256_or_si256(t1, t3);
+    __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    reduced =
+        _mm256_or_si256(reduced, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    const __m256i out =
+        _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, reduced), indices);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), out);
+    dst += 32;
+  }
+  return i + encode_sse41(src + i, len - i, dst);
+}
+
+// Decodes 32 characters into 24 bytes per iteration; every store writes 32
+// bytes, so the destination needs 8 bytes of slack.
+__attribute__((target("avx2"))) bool
+decode_avx2(const uint8_t *src, std::size_t len, uint8_t *dst,
+            std::size_t *consumed) {
+  const __m256i shift_lut = _mm256_setr_epi8(
+      0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 19, 4,
+      -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_lut = _mm256_setr_epi8(
+      char(0xa8), char(0xf8), char(0xf8), char(0xf8), char(0xf8), char(0xf8),
+      char(0xf8), char(0xf8), char(0xf8), char(0xf8), char(0xf0), char(0x54),
+      char(0x50), char(0x50), char(0x50), char(0x54), char(0xa8), char(0xf8),
+      char(0xf8), char(0xf8), char(0xf8), char(0xf8), char(0xf8), char(0xf8),
+      char(0xf8), char(0xf8), char(0xf0), char(0x54), char(0x50), char(0x50),
+      char(0x50), char(0x54));
+  const __m256i bitpos_lut = _mm256_setr_epi8(
+      0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, char(0x80), 0, 0, 0, 0, 0, 0,
+      0, 0, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, char(0x80), 0, 0, 0, 0,
+      0, 0, 0, 0);
+  const __m256i pack = _mm256_setr_epi8(
+      2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4,
+      10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+  std::size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    const __m256i in =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    const __m256i hi =
+        _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+    const __m256i lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+    const __m256i m = _mm256_shuffle_epi8(mask_lut, lo);
+    const __m256i bit = _mm256_shuffle_epi8(bitpos_lut, hi);
+    const __m256i bad =
+        _mm256_cmpeq_epi8(_mm256_and_si256(m, bit), _mm256_setzero_si256());
+    if (_mm256_movemask_epi8(bad)) {
+      *consumed = i;
+      return false;
+    }
+    const __m256i is_slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+    const __m256i shift = _mm256_blendv_epi8(
+        _mm256_shuffle_epi8(shift_lut, hi), _mm256_set1_epi8(16), is_slash);
+    const __m256i values = _mm256_add_epi8(in, shift);
+    const __m256i ab_bc =
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    const __m256i merged =
+        _mm256_madd_epi16(ab_bc, _mm256_set1_epi32(0x00011000));
+    // Each lane now holds 12 bytes; make the 24 output bytes contiguous.
+    const __m256i packed = _mm256_permutevar8x32_epi32(
+        _mm256_shuffle_epi8(merged, pack), lanes);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), packed);
+    dst += 24;
+  }
+  std::size_t rest = 0;
+  bool ok = decode_sse41(src + i, len - i, dst, &rest);
+  *consumed = i + rest;
+  return ok;
+}
+
+#endif // BASE64_X86
+
+// Bytes of slack any decode kernel may write past the decoded data.
+const std::size_t kDecodeSlack = 8;
+
+struct Kernels {
+  Implementation impl;
+  EncodeKernel encode;
+  DecodeKernel decode;
+};
+
+Kernels kernels_for(Implementation impl) {
+#ifdef BASE64_X86
+  if (impl == Implementation::AVX2)
+    return {impl, encode_avx2, decode_avx2};
+  if (impl == Implementation::SSE41)
+    return {impl, encode_sse41, decode_sse41};
+#endif
+  return {Implementation::Scalar, encode_scalar, decode_scalar};
+}
+
+const Kernels &active_kernels() {
+  static const Kernels kernels = [] {
+    if (is_supported(Implementation::AVX2))
+      return kernels_for(Implementation::AVX2);
+    if (is_supported(Implementation::SSE41))
+      return kernels_for(Implementation::SSE41);
+    return kernels_for(Implementation::Scalar);
+  }();
+  return kernels;
+}
+
+std::string encode_impl(const Kernels &k, const char *data, std::size_t len) {
+  const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+  std::string out(encoded_length(len), '\0');
+  char *dst = &out[0];
+
+  std::size_t done = k.encode(src, len, dst);
+  done += encode_scalar(src + done, len - done, dst + done / 3 * 4);
+  dst += done / 3 * 4;
+
+  // Up to two trailing bytes, padded with '='.
+  std::size_t rest = len - done;
+  if (rest == 1) {
+    uint32_t v = uint32_t(src[done]) << 16;
+    dst[0] = kAlphabet[(v >> 18) & 0x3f];
+    dst[1] = kAlphabet[(v >> 12) & 0x3f];
+    dst[2] = '=';
+    dst[3] = '=';
+  } else if (rest == 2) {
+    uint32_t v = (uint32_t(src[done]) << 16) | (uint32_t(src[done + 1]) << 8);
+    dst[0] = kAlphabet[(v >> 18) & 0x3f];
+    dst[1] = kAlphabet[(v >> 12) & 0x3f];
+    dst[2] = kAlphabet[(v >> 6) & 0x3f];
+    dst[3] = '=';
+  }
+  return out;
+}
+
+bool decode_impl(const Kernels &k, const char *data, std::size_t len,
+                 std::string *out) {
+  if (len % 4 != 0)
+    return false;
+  const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+
+  std::size_t padding = 0;
+  if (len > 0 && src[len - 1] == '=')
+    padding = (src[len - 2] == '=') ? 2 : 1;
+  // Characters made of whole 3-byte groups; the padded quad is handled below.
+  std::size_t body = padding ? len - 4 : len;
+  std::size_t decoded = body / 4 * 3 + (padding ? 3 - padding : 0);
+
+  out->resize(decoded + kDecodeSlack);
+  uint8_t *dst = reinterpret_cast<uint8_t *>(&(*out)[0]);
+
+  std::size_t done = 0, rest = 0;
+  if (!k.decode(src, body, dst, &done) ||
+      !decode_scalar(src + done, body - done, dst + done / 4 * 3, &rest))
+    return false;
+  dst += (done + rest) / 4 * 3;
+
+  if (padding) {
+    const uint8_t *q = src + body;
+    uint8_t a = kDecode.value[q[0]];
+    uint8_t b = kDecode.value[q[1]];
+    uint8_t c = padding == 1 ? kDecode.value[q[2]] : 0;
+    if ((a | b | c) & 0x80)
+      return false;
+    // Bits that do not make it into an output byte must be zero.
+    if (padding == 2 && (b & 0x0f))
+      return false;
+    if (padding == 1 && (c & 0x03))
+      return false;
+    dst[0] = uint8_t((a << 2) | (b >> 4));
+    if (padding == 1)
+      dst[1] = uint8_t((b << 4) | (c >> 2));
+  }
+  out->resize(decoded);
+  return true;
+}
+
+} // namespace
+
+std::size_t encoded_length(std::size_t len) { return (len + 2) / 3 * 4; }
+
+std::string encode(const std::string &in) {
+  return encode(in.data(), in.size());
+}
+
+std::string encode(const char *data, std::size_t len) {
+  return encode_impl(active_kernels(), data, len);
+}
+
+bool decode(const std::string &in, std::string *out) {
+  return decode(in.data(), in.size(), out);
+}
+
+bool decode(const char *data, std::size_t len, std::string *out) {
+  return decode_impl(active_kernels(), data, len, out);
+}
+
+Implementation active_implementation() { return active_kernels().impl; }
+
+const char *implementation_name(Implementation impl) {
+  switch (impl) {
+  case Implementation::AVX2:
+    return "avx2";
+  case Implementation::SSE41:
+    return "sse4.1";
+  default:
+    return "scalar";
+  }
+}
+
+bool is_supported(Implementation impl) {
+#ifdef BASE64_X86
+  if (impl == Implementation::AVX2)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.1");
+  if (impl == Implementation::SSE41)
+    return __builtin_cpu_supports("sse4.1");
+#endif
+  return impl == Implementation::Scalar;
+}
+
+std::string encode_with(Implementation impl, const char *data,
+                        std::size_t len) {
+  return encode_impl(kernels_for(impl), data, len);
+}
+
+bool decode_with(Implementation impl, const char *data, std::size_t len,
+                 std::string *out) {
+  return decode_impl(kernels_for(impl), data, len, out);
+}
+
+} // namespace base64
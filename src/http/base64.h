@@ -0,0 +1,43 @@
+// base64.h
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <cstddef>
+#include <string>
+
+namespace base64 {
+
+// Implementations selectable at runtime. The fastest one supported by the
+// running CPU is picked once on first use.
+enum class Implementation { Scalar, SSE41, AVX2 };
+
+// Encode arbitrary bytes into padded standard base64 (RFC 4648, section 4).
+std::string encode(const std::string &in);
+std::string encode(const char *data, std::size_t len);
+
+// Decode padded standard base64. Returns false (leaving *out unspecified) if
+// the input is not strictly valid: the length must be a multiple of four,
+// only the standard alphabet is accepted, '=' may only appear as one or two
+// trailing padding characters, and unused trailing bits must be zero.
+bool decode(const std::string &in, std::string *out);
+bool decode(const char *data, std::size_t len, std::string *out);
+
+// Number of characters produced by encoding len bytes.
+std::size_t encoded_length(std::size_t len);
+
+// Implementation chosen by CPU dispatch, and a human readable name for it.
+Implementation active_implementation();
+const char *implementation_name(Implementation impl);
+
+// Whether impl can run on this CPU.
+bool is_supported(Implementation impl);
+
+// Same as encode()/decode() but forced onto a specific implementation, for
+// tests and benchmarks. impl must be supported on this CPU.
+std::string encode_with(Implementation impl, const char *data, std::size_t len);
+bool decode_with(Implementation impl, const char *data, std::size_t len,
+                 std::string *out);
+
+} // namespace base64
+
+#endif // BASE64_H
@@ -0,0 +1,661 @@
+// json.cc
+//
+// A recursive descent validator whose inner loops are pluggable kernels.
+// Each kernel reports how long a run of "boring" bytes is: plain printable
+// ASCII inside a string, or whitespace between tokens. The SSE2 and AVX2
+// kernels classify a whole vector of bytes with a few compares and a
+// movemask, so the scalar grammar code only runs at quotes, escapes,
+// non-ASCII bytes and tokens, in the spirit of the structural scanning in
+// simdjson (Langdale and Lemire, "Parsing Gigabytes of JSON per Second").
+#include "json.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JSON_X86 1
+#include <immintrin.h>
+#endif
+
+namespace json {
+
+namespace {
+
+// Kernels return the length of the run at the start of [p, p + len).
+typedef std::size_t (*RunKernel)(const char *p, std::size_t len);
+
+struct Kernels {
+  Implementation impl;
+  RunKernel string_run;     // bytes 0x20-0x7f other than '"' and '\\'
+  RunKernel whitespace_run; // ' ', '\t', '\n' and '\r'
+};
+
+bool is_whitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Whether c can appear in a string as is: printable ASCII other than the
+// quote and the backslash.
+bool is_plain(char c) {
+  unsigned char u = c;
+  return u >= 0x20 && u < 0x80 && c != '"' && c != '\\';
+}
+
+std::size_t string_run_scalar(const char *p, std::size_t len) {
+  std::size_t i = 0;
+  while (i < len && is_plain(p[i]))
+    ++i;
+  return i;
+}
+
+std::size_t whitespace_run_scalar(const char *p, std::size_t len) {
+  std::size_t i = 0;
+  while (i < len && is_whitespace(p[i]))
+    ++i;
+  return i;
+}
+
+#ifdef JSON_X86
+
+// In a signed compare every byte >= 0x80 is negative, so "less than 0x20"
+// catches control characters and non-ASCII bytes at once.
+__attribute__((target("sse2"))) std::size_t
+string_run_sse2(const char *p, std::size_t len) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(0x20);
+  std::size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    __m128i stop = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmplt_epi8(v, space));
+    int mask = _mm_movemask_epi8(stop);
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+  return i + string_run_scalar(p + i, len - i);
+}
+
+__attribute__((target("sse2"))) std::size_t
+whitespace_run_sse2(const char *p, std::size_t len) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  std::size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    __m128i ws = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, cr)));
+    int mask = ~_mm_movemask_epi8(ws) & 0xffff;
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+  return i + whitespace_run_scalar(p + i, len - i);
+}
+
+__attribute__((target("avx2"))) std::size_t
+string_run_avx2(const char *p, std::size_t len) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  // a > b is the only signed byte compare AVX2 has
+  const __m256i below_space = _mm256_set1_epi8(0x1f);
+  std::size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+    __m256i stop = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                        _mm256_cmpeq_epi8(v, backslash)),
+        _mm256_cmpgt_epi8(below_space, v));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(stop));
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+  return i + string_run_sse2(p + i, len - i);
+}
+
+__attribute__((target("avx2"))) std::size_t
+whitespace_run_avx2(const char *p, std::size_t len) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  std::size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+    __m256i ws = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                        _mm256_cmpeq_epi8(v, tab)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, newline),
+                        _mm256_cmpeq_epi8(v, cr)));
+    uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(ws));
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+  return i + whitespace_run_sse2(p + i, len - i);
+}
+
+#endif // JSON_X86
+
+Kernels kernels_for(Implementation impl) {
+#ifdef JSON_X86
+  if (impl == Implementation::AVX2)
+    return {impl, string_run_avx2, whitespace_run_avx2};
+  if (impl == Implementation::SSE2)
+    return {impl, string_run_sse2, whitespace_run_sse2};
+#endif
+  return {Implementation::Scalar, string_run_scalar, whitespace_run_scalar};
+}
+
+const Kernels &active_kernels() {
+  static const Kernels kernels = [] {
+    if (is_supported(Implementation::AVX2))
+      return kernels_for(Implementation::AVX2);
+    if (is_supported(Implementation::SSE2))
+      return kernels_for(Implementation::SSE2);
+    return kernels_for(Implementation::Scalar);
+  }();
+  return kernels;
+}
+
+// The parser proper. Every function takes the text and a position and
+// returns false at the first error. Given an out string, the parser also
+// minifies: all whitespace it skips is left out of *out.
+class Parser {
+public:
+  Parser(const Kernels &k, std::string_view text, std::string *out = nullptr)
+      : k_(k), text_(text), out_(out) {}
+
+  void skip_whitespace(std::size_t *pos) {
+    std::size_t start = *pos;
+    *pos = run(*pos, [](char c) { return !is_whitespace(c); },
+               k_.whitespace_run);
+    if (out_ && *pos != start) {
+      out_->append(text_.data() + span_, start - span_);
+      span_ = *pos;
+    }
+  }
+
+  // Copy whatever is left after the last whitespace skipped to *out.
+  void finish_output() {
+    out_->append(text_.data() + span_, text_.size() - span_);
+  }
+
+  // Index of the first byte at or after i that ends a plain string run.
+  std::size_t string_run(std::size_t i) {
+    return run(i, [](char c) { return !is_plain(c); }, k_.string_run);
+  }
+
+  // text_[*pos] is the opening quote.
+  bool skip_string(std::size_t *pos) {
+    std::size_t i = *pos + 1;
+    while (true) {
+      i = string_run(i);
+      if (i >= text_.size())
+        return false;
+      unsigned char c = text_[i];
+      if (c == '"') {
+        *pos = i + 1;
+        return true;
+      }
+      if (c == '\\') {
+        if (!skip_escape(&i))
+          return false;
+      } else if (c >= 0x80) {
+        if (!skip_utf8(&i))
+          return false;
+      } else {
+        return false; // raw control character
+      }
+    }
+  }
+
+  bool skip(std::size_t *pos, int depth) {
+    skip_whitespace(pos);
+    if (*pos >= text_.size())
+      return false;
+    switch (text_[*pos]) {
+    case '"':
+      return skip_string(pos);
+    case 't':
+      return skip_literal(pos, "true");
+    case 'f':
+      return skip_literal(pos, "false");
+    case 'n':
+      return skip_literal(pos, "null");
+    case '[':
+    case '{': {
+      if (depth >= kMaxDepth)
+        return false;
+      bool object = text_[*pos] == '{';
+      char close = object ? '}' : ']';
+      ++*pos;
+      skip_whitespace(pos);
+      if (*pos < text_.size() && text_[*pos] == close) {
+        ++*pos;
+        return true;
+      }
+      while (true) {
+        if (object && !skip_key(pos, nullptr))
+          return false;
+        if (!skip(pos, depth + 1))
+          return false;
+        skip_whitespace(pos);
+        if (*pos >= text_.size())
+          return false;
+        if (text_[*pos] == close) {
+          ++*pos;
+          return true;
+        }
+        if (text_[*pos] != ',')
+          return false;
+        ++*pos;
+      }
+    }
+    default:
+      return skip_number(pos);
+    }
+  }
+
+  // Skip '"key" :' and store the raw key in key if it isn't null.
+  bool skip_key(std::size_t *pos, std::string_view *key) {
+    skip_whitespace(pos);
+    std::size_t start = *pos;
+    if (*pos >= text_.size() || text_[*pos] != '"' || !skip_string(pos))
+      return false;
+    if (key)
+      *key = text_.substr(start, *pos - start);
+    skip_whitespace(pos);
+    if (*pos >= text_.size() || text_[*pos] != ':')
+      return false;
+    ++*pos;
+    return true;
+  }
+
+  bool skip_number(std::size_t *pos) {
+    std::size_t i = *pos;
+    if (i < text_.size() && text_[i] == '-')
+      ++i;
+    if (i >= text_.size() || !is_digit(text_[i]))
+      return false;
+    if (text_[i] == '0') {
+      ++i;
+    } else {
+      skip_digits(&i);
+    }
+    if (i < text_.size() && text_[i] == '.') {
+      if (++i >= text_.size() || !is_digit(text_[i]))
+        return false;
+      skip_digits(&i);
+    }
+    if (i < text_.size() && (text_[i] == 'e' || text_[i] == 'E')) {
+      ++i;
+      if (i < text_.size() && (text_[i] == '+' || text_[i] == '-'))
+        ++i;
+      if (i >= text_.size() || !is_digit(text_[i]))
+        return false;
+      skip_digits(&i);
+    }
+    *pos = i;
+    return true;
+  }
+
+  bool at_end(std::size_t pos) {
+    skip_whitespace(&pos);
+    return pos == text_.size();
+  }
+
+private:
+  // Most runs are short (a single space, a one word string), so the first
+  // few bytes are checked inline before paying for a kernel call.
+  static const std::size_t kInlineRun = 16;
+
+  template <class Stop>
+  std::size_t run(std::size_t i, Stop stop, RunKernel kernel) {
+    std::size_t end = std::min(text_.size(), i + kInlineRun);
+    for (; i < end; ++i) {
+      if (stop(text_[i]))
+        return i;
+    }
+    return i + kernel(text_.data() + i, text_.size() - i);
+  }
+
+  static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+  void skip_digits(std::size_t *i) {
+    while (*i < text_.size() && is_digit(text_[*i]))
+      ++*i;
+  }
+
+  bool skip_literal(std::size_t *pos, std::string_view literal) {
+    if (text_.substr(*pos, literal.size()) != literal)
+      return false;
+    *pos += literal.size();
+    return true;
+  }
+
+  // text_[*i] is a backslash.
+  bool skip_escape(std::size_t *i) {
+    if (*i + 1 >= text_.size())
+      return false;
+    switch (text_[*i + 1]) {
+    case '"':
+    case '\\':
+    case '/':
+    case 'b':
+    case 'f':
+    case 'n':
+    case 'r':
+    case 't':
+      *i += 2;
+      return true;
+    case 'u':
+      if (*i + 6 > text_.size())
+        return false;
+      for (std::size_t j = *i + 2; j < *i + 6; ++j) {
+        char c = text_[j];
+        if (!is_digit(c) && !(c >= 'a' && c <= 'f') && !(c >= 'A' && c <= 'F'))
+          return false;
+      }
+      *i += 6;
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // text_[*i] starts a multi-byte UTF-8 sequence (RFC 3629, table 3-7 of
+  // the Unicode standard).
+  bool skip_utf8(std::size_t *i) {
+    const unsigned char *p =
+        reinterpret_cast<const unsigned char *>(text_.data()) + *i;
+    std::size_t left = text_.size() - *i;
+    unsigned char c = p[0];
+    std::size_t n;
+    unsigned char low = 0x80, high = 0xbf; // range of the second byte
+    if (c >= 0xc2 && c <= 0xdf) {
+      n = 2;
+    } else if (c >= 0xe0 && c <= 0xef) {
+      n = 3;
+      if (c == 0xe0)
+        low = 0xa0; // overlong
+      else if (c == 0xed)
+        high = 0x9f; // surrogates
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      n = 4;
+      if (c == 0xf0)
+        low = 0x90; // overlong
+      else if (c == 0xf4)
+        high = 0x8f; // past U+10FFFF
+    } else {
+      return false;
+    }
+    if (left < n || p[1] < low || p[1] > high)
+      return false;
+    for (std::size_t j = 2; j < n; ++j) {
+      if (p[j] < 0x80 || p[j] > 0xbf)
+        return false;
+    }
+    *i += n;
+    return true;
+  }
+
+  const Kernels &k_;
+  const std::string_view text_;
+  std::string *const out_;
+  std::size_t span_ = 0; // start of the text not yet copied to *out_
+};
+
+bool validate_impl(const Kernels &k, std::string_view text) {
+  Parser parser(k, text);
+  std::size_t pos = 0;
+  return parser.skip(&pos, 0) && parser.at_end(pos);
+}
+
+bool minify_impl(const Kernels &k, std::string_view text, std::string *out) {
+  out->clear();
+  out->reserve(text.size());
+  Parser parser(k, text, out);
+  std::size_t pos = 0;
+  if (!parser.skip(&pos, 0) || !parser.at_end(pos))
+    return false;
+  parser.finish_output();
+  return true;
+}
+
+// Shared by split_array() and split_object(): walk the members of the
+// container spanning all of text, calling member(key_raw, value) for each,
+// where key_raw is empty for arrays.
+template <class F>
+bool split(std::string_view text, char open, char close, F member) {
+  Parser parser(active_kernels(), text);
+  std::size_t pos = 0;
+  parser.skip_whitespace(&pos);
+  if (pos >= text.size() || text[pos] != open)
+    return false;
+  ++pos;
+  parser.skip_whitespace(&pos);
+  if (pos < text.size() && text[pos] == close)
+    return parser.at_end(pos + 1);
+  while (true) {
+    std::string_view key;
+    if (open == '{' && !parser.skip_key(&pos, &key))
+      return false;
+    parser.skip_whitespace(&pos);
+    std::size_t start = pos;
+    if (!parser.skip(&pos, 1))
+      return false;
+    if (!member(key, text.substr(start, pos - start)))
+      return false;
+    parser.skip_whitespace(&pos);
+    if (pos >= text.size())
+      return false;
+    if (text[pos] == close)
+      return parser.at_end(pos + 1);
+    if (text[pos] != ',')
+      return false;
+    ++pos;
+  }
+}
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Read the four hex digits of a \u escape starting at text[pos].
+bool read_hex4(std::string_view text, std::size_t pos, unsigned *value) {
+  if (pos + 4 > text.size())
+    return false;
+  *value = 0;
+  for (std::size_t i = pos; i < pos + 4; ++i) {
+    int digit = hex_value(text[i]);
+    if (digit < 0)
+      return false;
+    *value = (*value << 4) | digit;
+  }
+  return true;
+}
+
+void append_utf8(unsigned code_point, std::string *out) {
+  if (code_point < 0x80) {
+    out->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out->push_back(static_cast<char>(0xc0 | (code_point >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+  } else if (code_point < 0x10000) {
+    out->push_back(static_cast<char>(0xe0 | (code_point >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+  } else {
+    out->push_back(static_cast<char>(0xf0 | (code_point >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+  }
+}
+
+} // namespace
+
+bool validate(std::string_view text) {
+  return validate_impl(active_kernels(), text);
+}
+
+bool minify(std::string_view text, std::string *out) {
+  return minify_impl(active_kernels(), text, out);
+}
+
+bool skip_value(std::string_view text, std::size_t *pos) {
+  return Parser(active_kernels(), text).skip(pos, 0);
+}
+
+bool split_array(std::string_view text,
+                 std::vector<std::string_view> *elements) {
+  elements->clear();
+  return split(text, '[', ']', [elements](std::string_view, std::string_view value) {
+    elements->push_back(value);
+    return true;
+  });
+}
+
+bool split_object(std::string_view text,
+                  std::vector<std::pair<std::string, std::string_view>> *members) {
+  members->clear();
+  return split(text, '{', '}', [members](std::string_view key, std::string_view value) {
+    std::string decoded;
+    if (!parse_string(key, &decoded))
+      return false;
+    members->emplace_back(std::move(decoded), value);
+    return true;
+  });
+}
+
+bool parse_string(std::string_view raw, std::string *out) {
+  std::size_t end = 0;
+  if (raw.empty() || raw[0] != '"' ||
+      !Parser(active_kernels(), raw).skip_string(&end) || end != raw.size())
+    return false;
+  out->clear();
+  for (std::size_t i = 1; i + 1 < raw.size(); ++i) {
+    if (raw[i] != '\\') {
+      out->push_back(raw[i]);
+      continue;
+    }
+    switch (raw[++i]) {
+    case 'b': out->push_back('\b'); break;
+    case 'f': out->push_back('\f'); break;
+    case 'n': out->push_back('\n'); break;
+    case 'r': out->push_back('\r'); break;
+    case 't': out->push_back('\t'); break;
+    case 'u': {
+      unsigned code_point;
+      read_hex4(raw, i + 1, &code_point);
+      i += 4;
+      // a high surrogate followed by a low one encodes a single code point;
+      // unpaired surrogates become U+FFFD
+      unsigned low;
+      if (code_point >= 0xd800 && code_point < 0xdc00 && i + 6 < raw.size() &&
+          raw[i + 1] == '\\' && raw[i + 2] == 'u' &&
+          read_hex4(raw, i + 3, &low) && low >= 0xdc00 && low < 0xe000) {
+        code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+        i += 6;
+      } else if (code_point >= 0xd800 && code_point < 0xe000) {
+        code_point = 0xfffd;
+      }
+      append_utf8(code_point, out);
+      break;
+    }
+    default:
+      out->push_back(raw[i]);
+    }
+  }
+  return true;
+}
+
+bool parse_int(std::string_view raw, int *out) {
+  std::size_t end = 0;
+  if (!Parser(active_kernels(), raw).skip_number(&end) || end != raw.size() ||
+      raw.find_first_of(".eE") != std::string_view::npos)
+    return false;
+  bool negative = raw[0] == '-';
+  long long value = 0;
+  for (std::size_t i = negative ? 1 : 0; i < raw.size(); ++i) {
+    value = value * 10 + (raw[i] - '0');
+    if (value > static_cast<long long>(INT_MAX) + 1)
+      return false;
+  }
+  if (negative)
+    value = -value;
+  if (value > INT_MAX)
+    return false;
+  *out = static_cast<int>(value);
+  return true;
+}
+
+std::string quote(std::string_view s) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string out;
+  out.reserve(s.size() + 2);
+  out.push_back('"');
+  for (char c : s) {
+    switch (c) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        out += "\\u00";
+        out.push_back(kHex[(c >> 4) & 0xf]);
+        out.push_back(kHex[c & 0xf]);
+      } else {
+        out.push_back(c);
+      }
+    }
+  }
+  out.push_back('"');
+  return out;
+}
+
+Implementation active_implementation() { return active_kernels().impl; }
+
+const char *implementation_name(Implementation impl) {
+  switch (impl) {
+  case Implementation::AVX2:
+    return "avx2";
+  case Implementation::SSE2:
+    return "sse2";
+  default:
+    return "scalar";
+  }
+}
+
+bool is_supported(Implementation impl) {
+#ifdef JSON_X86
+  if (impl == Implementation::AVX2)
+    return __builtin_cpu_supports("avx2");
+  if (impl == Implementation::SSE2)
+    return __builtin_cpu_supports("sse2");
+#endif
+  return impl == Implementation::Scalar;
+}
+
+bool validate_with(Implementation impl, std::string_view text) {
+  return validate_impl(kernels_for(impl), text);
+}
+
+bool minify_with(Implementation impl, std::string_view text,
+                 std::string *out) {
+  return minify_impl(kernels_for(impl), text, out);
+}
+
+} // namespace json
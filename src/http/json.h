@@ -0,0 +1,72 @@
+// json.h
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Just enough JSON (RFC 8259) to pick request bodies apart without building a
+// document tree: values are handed back as views of their raw text, and only
+// the pieces a caller asks for are decoded.
+//
+// Parsing is strict: strings must be valid UTF-8 (no overlong forms,
+// surrogates or code points past U+10FFFF) and free of raw control
+// characters. The long runs that make up most of a large document, string
+// contents and whitespace, are scanned 16 or 32 bytes at a time with SSE2 or
+// AVX2 when the CPU has them.
+namespace json {
+
+// Implementations selectable at runtime. The fastest one supported by the
+// running CPU is picked once on first use.
+enum class Implementation { Scalar, SSE2, AVX2 };
+
+// Nesting deeper than this is rejected instead of risking the stack.
+const int kMaxDepth = 256;
+
+// Whether text is exactly one valid JSON value, surrounded only by whitespace.
+bool validate(std::string_view text);
+
+// Validate text and store it in *out with all whitespace outside strings
+// removed. Returns false, leaving *out unspecified, if text is not valid.
+bool minify(std::string_view text, std::string *out);
+
+// Advance *pos past the whitespace and the one JSON value starting at or after
+// it. Returns false if that value is malformed.
+bool skip_value(std::string_view text, std::size_t *pos);
+
+// Split a JSON array into the raw text of its elements. Returns false if text
+// is not a valid array.
+bool split_array(std::string_view text, std::vector<std::string_view> *elements);
+
+// Split a JSON object into its decoded keys and the raw text of their values,
+// in document order. Returns false if text is not a valid object.
+bool split_object(std::string_view text,
+                  std::vector<std::pair<std::string, std::string_view>> *members);
+
+// Decode the raw text of a JSON string, quotes included.
+bool parse_string(std::string_view raw, std::string *out);
+
+// Parse the raw text of a JSON number that must be an integer in int's range.
+bool parse_int(std::string_view raw, int *out);
+
+// Quote and escape s as a JSON string.
+std::string quote(std::string_view s);
+
+// Implementation chosen by CPU dispatch, and a human readable name for it.
+Implementation active_implementation();
+const char *implementation_name(Implementation impl);
+
+// Whether impl can run on this CPU.
+bool is_supported(Implementation impl);
+
+// Same as validate()/minify() but forced onto a specific implementation, for
+// tests and benchmarks. impl must be supported on this CPU.
+bool validate_with(Implementation impl, std::string_view text);
+bool minify_with(Implementation impl, std::string_view text, std::string *out);
+
+} // namespace json
+
+#endif // JSON_H
@@ -0,0 +1,91 @@
+/**
+ * A Beast body whose bytes are pulled from a BodySource instead of being held
+ * in a string.
+ *
+ * The serializer asks the source for one buffer at a time and hands it
+ * straight to the socket, so a source that points into memory it already owns
+ * (an mmap'd file, say) is written without any user-space copy, and a source
+ * that produces its output piece by piece never needs the whole body in memory.
+ * Set content_length() for sources of known size, or chunked(true) otherwise.
+ */
+
+#ifndef SOURCE_BODY_H
+#define SOURCE_BODY_H
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/optional.hpp>
+#include <memory>
+#include <utility>
+
+class BodySource {
+public:
+  virtual ~BodySource() = default;
+
+  // Point chunk at the next piece of the body, which must stay valid until
+  // the following call. Returns false once the body is complete.
+  virtual bool next(boost::asio::const_buffer *chunk) = 0;
+
+  // A source that yields size bytes at data once. owner keeps them alive.
+  static std::shared_ptr<BodySource> fromBuffer(std::shared_ptr<const void> owner,
+                                                const char *data, size_t size);
+};
+
+struct SourceBody {
+  using value_type = std::shared_ptr<BodySource>;
+
+  class writer {
+  public:
+    using const_buffers_type = boost::asio::const_buffer;
+
+    template <bool isRequest, class Fields>
+    writer(boost::beast::http::header<isRequest, Fields> const &,
+           value_type const &source)
+        : source_(source) {}
+
+    void init(boost::beast::error_code &ec) { ec = {}; }
+
+    boost::optional<std::pair<const_buffers_type, bool>>
+    get(boost::beast::error_code &ec) {
+      ec = {};
+      boost::asio::const_buffer chunk;
+      // skip empty pieces, Beast takes an empty buffer to mean "no more"
+      while (source_ && source_->next(&chunk)) {
+        if (chunk.size() > 0)
+          return std::make_pair(chunk, true);
+      }
+      return boost::none;
+    }
+
+  private:
+    value_type const &source_;
+  };
+};
+
+class BufferSource : public BodySource {
+public:
+  BufferSource(std::shared_ptr<const void> owner, const char *data, size_t size)
+      : owner_(std::move(owner)), data_(data), size_(size) {}
+
+  bool next(boost::asio::const_buffer *chunk) override {
+    if (sent_)
+      return false;
+    sent_ = true;
+    *chunk = boost::asio::const_buffer(data_, size_);
+    return true;
+  }
+
+private:
+  std::shared_ptr<const void> owner_;
+  const char *data_;
+  size_t size_;
+  bool sent_ = false;
+};
+
+inline std::shared_ptr<BodySource>
+BodySource::fromBuffer(std::shared_ptr<const void> owner, const char *data,
+                       size_t size) {
+  return std::make_shared<BufferSource>(std::move(owner), data, size);
+}
+
+#endif // SOURCE_BODY_H
@@ -3,6 +3,7 @@
 #include <boost/asio/signal_set.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sinks/sync_frontend.hpp>
 #include <boost/log/sinks/text_file_backend.hpp>
 #include <boost/log/sources/record_ostream.hpp>
 #include <boost/log/sources/severity_logger.hpp>
@@ -10,6 +11,7 @@
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/file.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/signals2.hpp>
 #include <boost/beast/http.hpp>
 #include <sstream>
@@ -25,7 +27,7 @@ Logger::Logger() { init(); }
 
 void Logger::init() {
   logging::add_common_attributes();
-  logging::add_file_log(
+  file_sink_ = logging::add_file_log(
       keywords::file_name = "../logs/server_log_%Y-%m-%d.log",
       keywords::rotation_size = 10 * 1024 * 1024, // new log at 10mb
       keywords::time_based_rotation =
@@ -33,7 +35,58 @@ void Logger::init() {
               0, 0, 0), // new log every 24hr
       keywords::format = "[%TimeStamp%]:[%ThreadID%]:%Message%", // line format
       keywords::auto_flush = true);
-  logging::add_console_log(std::cout, keywords::format = ">> %Message%");
+  console_sink_ =
+      logging::add_console_log(std::cout, keywords::format = ">> %Message%");
+}
+
+typedef sinks::synchronous_sink<sinks::text_file_backend> file_sink;
+
+/**
+ * startAsync() - Swap the file and console sinks in the logging core for an
+ * AsyncLogSink feeding them. The writer flushes the file once per batch rather
+ * than once per record.
+ */
+void Logger::startAsync(size_t capacity, AsyncLogSink::OverflowPolicy policy) {
+  if (async_sink_)
+    return;
+  boost::shared_ptr<logging::core> core = logging::core::get();
+  core->remove_sink(file_sink_);
+  core->remove_sink(console_sink_);
+  boost::static_pointer_cast<file_sink>(file_sink_)->locked_backend()->auto_flush(false);
+  async_sink_ = boost::make_shared<AsyncLogSink>(
+      std::vector<boost::shared_ptr<sinks::sink>>{file_sink_, console_sink_},
+      capacity, policy);
+  core->add_sink(async_sink_);
+}
+
+void Logger::stopAsync() {
+  if (!async_sink_)
+    return;
+  boost::shared_ptr<logging::core> core = logging::core::get();
+  core->remove_sink(async_sink_);
+  dropped_before_ += async_sink_->dropped();
+  async_sink_.reset();
+  boost::static_pointer_cast<file_sink>(file_sink_)->locked_backend()->auto_flush(true);
+  core->add_sink(file_sink_);
+  core->add_sink(console_sink_);
+}
+
+void Logger::setLevel(severity_level level) {
+  level_.store(level, std::memory_order_relaxed);
+  logging::core::get()->set_filter(logging::trivial::severity >= level);
+}
+
+bool Logger::parseLevel(const std::string &name, severity_level *level) {
+  return logging::trivial::from_string(name.data(), name.size(), *level);
+}
+
+void Logger::flush() {
+  if (async_sink_)
+    async_sink_->flush();
+}
+
+uint64_t Logger::droppedRecords() const {
+  return dropped_before_ + (async_sink_ ? async_sink_->dropped() : 0);
 }
 void Logger::logServerInitialization() {
   BOOST_LOG_SEV(lg, trace) << "Server has been initialized";
@@ -83,6 +136,8 @@ void Logger::logFatal() {
 }
 
 void Logger::logTraceHTTPrequest(const boost::beast::http::request<boost::beast::http::string_body> &http_request, tcp::socket &m_socket) {
+  if (!enabled(trace))
+    return;
   std::stringstream stream;
   stream << "Trace: ";
   stream << http_request.method_string() << " " << http_request.target() << " HTTP "
@@ -92,3 +147,4 @@ void Logger::logTraceHTTPrequest(const boost::beast::http::request<boost::beast:
 }
 
 Logger *Logger::logger = nullptr;
+std::atomic<int> Logger::level_{trace};
@@ -3,10 +3,13 @@
 
 #include <boost/asio.hpp>
 #include <boost/beast/http.hpp>
+#include <boost/log/sinks/sink.hpp>
 #include <boost/log/sources/severity_logger.hpp>
 #include <boost/log/trivial.hpp>
+#include <atomic>
 #include <memory>
 #include <string>
+#include "async_log_sink.h"
 
 namespace logging = boost::log;
 namespace src = boost::log::sources;
@@ -35,11 +38,56 @@ public:
   void logFatal();
   void logTraceHTTPrequest(const boost::beast::http::request<boost::beast::http::string_body> &http_request, boost::asio::ip::tcp::socket &m_socket);
   void logResponse(const std::string &response_message);
+
+  // Drop records below level from here on, at the source and in the core.
+  static void setLevel(logging_trivial::severity_level level);
+  static bool enabled(logging_trivial::severity_level level) {
+    return level >= level_.load(std::memory_order_relaxed);
+  }
+  // Parse a severity name such as "debug". Returns false if name isn't one.
+  static bool parseLevel(const std::string &name,
+                         logging_trivial::severity_level *level);
+
+  // Write log records on a background thread, handing them over through a
+  // lock-free ring of capacity records; see AsyncLogSink.
+  void startAsync(size_t capacity, AsyncLogSink::OverflowPolicy policy);
+  // write out what is queued and go back to writing on the logging thread
+  void stopAsync();
+  // in async mode, wait until every record logged so far is written out
+  void flush();
+  // records dropped because the ring was full
+  uint64_t droppedRecords() const;
+
   Logger();
   static Logger *logger;
 
 private:
   src::severity_logger<logging_trivial::severity_level> lg;
+  boost::shared_ptr<boost::log::sinks::sink> file_sink_;
+  boost::shared_ptr<boost::log::sinks::sink> console_sink_;
+  boost::shared_ptr<AsyncLogSink> async_sink_;
+  uint64_t dropped_before_ = 0;   // by async sinks since stopped
+  static std::atomic<int> level_;
 };
 
+// Records below this severity are compiled out of the LOGGER_* macros
+// altogether, e.g. -DLOGGER_MIN_LEVEL=2 keeps nothing under info.
+#ifndef LOGGER_MIN_LEVEL
+#define LOGGER_MIN_LEVEL 0
+#endif
+
+// Run Logger::getLogger()->call only if level is enabled, so the arguments of
+// call aren't even evaluated for a record that would be filtered out anyway.
+#define LOGGER_AT(level, call)                                                 \
+  do {                                                                         \
+    if (logging_trivial::level >= LOGGER_MIN_LEVEL &&                          \
+        Logger::enabled(logging_trivial::level))                               \
+      Logger::getLogger()->call;                                               \
+  } while (0)
+
+#define LOGGER_TRACE(message) LOGGER_AT(trace, logTraceFile(message))
+#define LOGGER_DEBUG(message) LOGGER_AT(debug, logDebugFile(message))
+#define LOGGER_WARNING(message) LOGGER_AT(warning, logWarningFile(message))
+#define LOGGER_ERROR(message) LOGGER_AT(error, logErrorFile(message))
+
 #endif // LOGGER_H
@@ -0,0 +1,282 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace metrics {
+
+const uint64_t Histogram::kSubBuckets;
+const size_t Histogram::kBuckets;
+
+namespace {
+
+// Histogram buckets exposed to Prometheus: powers of two from 16us to ~33s.
+const int kFirstExposedBit = 4;
+const int kLastExposedBit = 25;
+
+// Quote a label value as the exposition format wants it.
+std::string escape(const std::string &value) {
+  std::string out;
+  for (char c : value) {
+    if (c == '\\' || c == '"')
+      out.push_back('\\');
+    if (c == '\n') {
+      out += "\\n";
+      continue;
+    }
+    out.push_back(c);
+  }
+  return out;
+}
+
+std::string renderLabels(const Labels &labels) {
+  std::string out;
+  for (const auto &label : labels) {
+    if (!out.empty())
+      out.push_back(',');
+    out += label.first + "=\"" + escape(label.second) + "\"";
+  }
+  return out;
+}
+
+// name{labels,extra}, leaving out the braces if there are no labels at all.
+std::string seriesName(const std::string &name, const std::string &labels,
+                       const std::string &extra = "") {
+  std::string all = labels;
+  if (!extra.empty())
+    all += (all.empty() ? "" : ",") + extra;
+  return all.empty() ? name : name + "{" + all + "}";
+}
+
+const char *typeName(Registry::Type type) {
+  switch (type) {
+  case Registry::kCounter:
+    return "counter";
+  case Registry::kGauge:
+    return "gauge";
+  default:
+    return "histogram";
+  }
+}
+
+} // namespace
+
+size_t shardIndex() {
+  static std::atomic<size_t> next{0};
+  thread_local size_t index =
+      next.fetch_add(1, std::memory_order_relaxed) % kShards;
+  return index;
+}
+
+uint64_t Counter::value() const {
+  uint64_t total = 0;
+  for (const Shard &shard : shards_)
+    total += shard.value.load(std::memory_order_relaxed);
+  return total;
+}
+
+int64_t Gauge::value() const {
+  int64_t total = base_.load(std::memory_order_relaxed);
+  for (const Shard &shard : shards_)
+    total += shard.value.load(std::memory_order_relaxed);
+  return total;
+}
+
+size_t Histogram::bucketOf(uint64_t value) {
+  if (value < kSubBuckets)
+    return value;
+  int bits = 63 - __builtin_clzll(value);
+  if (bits >= kMaxBits)
+    return kBuckets - 1;
+  int shift = bits - kSubBucketBits;
+  return kSubBuckets + shift * kSubBuckets +
+         ((value >> shift) - kSubBuckets);
+}
+
+uint64_t Histogram::bucketLimit(size_t bucket) {
+  if (bucket < kSubBuckets)
+    return bucket + 1;
+  size_t shift = (bucket - kSubBuckets) / kSubBuckets;
+  uint64_t sub = (bucket - kSubBuckets) % kSubBuckets;
+  return (kSubBuckets + sub + 1) << shift;
+}
+
+void Histogram::record(uint64_t value) {
+  Shard &shard = shards_[shardIndex()];
+  shard.buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+  shard.count.fetch_add(1, std::memory_order_relaxed);
+  shard.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::count() const {
+  uint64_t total = 0;
+  for (size_t i = 0; i < kShards; i++)
+    total += shards_[i].count.load(std::memory_order_relaxed);
+  return total;
+}
+
+uint64_t Histogram::sum() const {
+  uint64_t total = 0;
+  for (size_t i = 0; i < kShards; i++)
+    total += shards_[i].sum.load(std::memory_order_relaxed);
+  return total;
+}
+
+std::vector<uint64_t> Histogram::merged() const {
+  std::vector<uint64_t> buckets(kBuckets);
+  for (size_t i = 0; i < kShards; i++) {
+    for (size_t b = 0; b < kBuckets; b++)
+      buckets[b] += shards_[i].buckets[b].load(std::memory_order_relaxed);
+  }
+  return buckets;
+}
+
+uint64_t Histogram::countBelow(uint64_t bound) const {
+  std::vector<uint64_t> buckets = merged();
+  uint64_t total = 0;
+  for (size_t b = 0; b < kBuckets && bucketLimit(b) <= bound; b++)
+    total += buckets[b];
+  return total;
+}
+
+/**
+ * quantile() - Walk the merged buckets to the one holding the value of rank
+ * ceil(q * count).
+ */
+uint64_t Histogram::quantile(double q) const {
+  std::vector<uint64_t> buckets = merged();
+  uint64_t total = 0;
+  for (uint64_t count : buckets)
+    total += count;
+  if (total == 0)
+    return 0;
+  uint64_t rank = static_cast<uint64_t>(std::ceil(q * total));
+  rank = std::min(std::max<uint64_t>(rank, 1), total);
+  uint64_t seen = 0;
+  for (size_t b = 0; b < kBuckets; b++) {
+    seen += buckets[b];
+    if (seen >= rank)
+      return bucketLimit(b) - 1;
+  }
+  return bucketLimit(kBuckets - 1) - 1;
+}
+
+Registry::Registry() : id_([] {
+  static std::atomic<uint64_t> next{0};
+  return next++;
+}()) {}
+
+Registry &Registry::global() {
+  static Registry registry;
+  return registry;
+}
+
+/**
+ * find() - Look name{labels} up in this thread's cache, and failing that under
+ * the lock, creating it if it is new.
+ */
+Registry::Series &Registry::find(const std::string &name,
+                                 const std::string &help, Type type,
+                                 const Labels &labels) {
+  thread_local std::unordered_map<std::string, Series *> cache;
+  std::string rendered = renderLabels(labels);
+  std::string key = std::to_string(id_) + '\0' + char('0' + type) + name +
+                    '\0' + rendered;
+  auto cached = cache.find(key);
+  if (cached != cache.end())
+    return *cached->second;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto family = families_.find(name);
+  if (family == families_.end()) {
+    family = families_.emplace(name, Family()).first;
+    family->second.type = type;
+    family->second.help = help;
+  } else if (family->second.type != type) {
+    throw std::invalid_argument("metric " + name + " is a " +
+                                typeName(family->second.type));
+  }
+  std::unique_ptr<Series> &series = family->second.series[rendered];
+  if (!series) {
+    series.reset(new Series());
+    if (type == kHistogram)
+      series->histogram.reset(new Histogram());
+  }
+  cache.emplace(key, series.get());
+  return *series;
+}
+
+Counter &Registry::counter(const std::string &name, const std::string &help,
+                           const Labels &labels) {
+  return find(name, help, kCounter, labels).counter;
+}
+
+Gauge &Registry::gauge(const std::string &name, const std::string &help,
+                       const Labels &labels) {
+  return find(name, help, kGauge, labels).gauge;
+}
+
+Histogram &Registry::histogram(const std::string &name,
+                               const std::string &help, const Labels &labels) {
+  return *find(name, help, kHistogram, labels).histogram;
+}
+
+void Registry::callback(const std::string &name, const std::string &help,
+                        Type type, std::function<double()> read,
+                        const Labels &labels) {
+  if (type == kHistogram)
+    throw std::invalid_argument("metric " + name + " can't be a callback");
+  Series &series = find(name, help, type, labels);
+  std::lock_guard<std::mutex> lock(mutex_);
+  series.read = std::move(read);
+}
+
+std::string Registry::exposition() const {
+  std::ostringstream out;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &family : families_) {
+    const std::string &name = family.first;
+    out << "# HELP " << name << " " << family.second.help << "\n"
+        << "# TYPE " << name << " " << typeName(family.second.type) << "\n";
+    for (const auto &entry : family.second.series) {
+      const std::string &labels = entry.first;
+      const Series &series = *entry.second;
+      if (series.read) {
+        out << seriesName(name, labels) << " " << series.read() << "\n";
+      } else if (family.second.type == kCounter) {
+        out << seriesName(name, labels) << " " << series.counter.value()
+            << "\n";
+      } else if (family.second.type == kGauge) {
+        out << seriesName(name, labels) << " " << series.gauge.value() << "\n";
+      } else {
+        const Histogram &histogram = *series.histogram;
+        // read the count first, so no bucket can show more than it
+        uint64_t count = histogram.count();
+        std::vector<uint64_t> buckets = histogram.merged();
+        uint64_t below = 0;
+        size_t b = 0;
+        for (int bit = kFirstExposedBit; bit <= kLastExposedBit; bit++) {
+          uint64_t bound = uint64_t(1) << bit;
+          for (; b < Histogram::kBuckets && Histogram::bucketLimit(b) <= bound;
+               b++)
+            below += buckets[b];
+          std::ostringstream le;
+          le << "le=\"" << std::setprecision(12) << bound / 1e6 << "\"";
+          out << seriesName(name + "_bucket", labels, le.str()) << " "
+              << std::min(count, below) << "\n";
+        }
+        out << seriesName(name + "_bucket", labels, "le=\"+Inf\"") << " "
+            << count << "\n"
+            << seriesName(name + "_sum", labels) << " "
+            << std::setprecision(12) << histogram.sum() / 1e6 << "\n"
+            << seriesName(name + "_count", labels) << " " << count << "\n";
+      }
+    }
+  }
+  return out.str();
+}
+
+} // namespace metrics
@@ -0,0 +1,160 @@
+/**
+ * Process-wide metrics: counters, gauges and latency histograms, exposed in
+ * the Prometheus text format by MetricsHandler.
+ *
+ * Counters and histograms are split into shards, each on its own cache lines,
+ * and a thread always updates the same shard, so threads recording the same
+ * metric don't fight over a cache line. Reading a metric adds the shards up.
+ * Histograms are log-linear in the manner of HdrHistogram: every power of two
+ * is split into kSubBuckets equal buckets, so any recorded value is known to
+ * within 1/kSubBuckets of itself.
+ *
+ * Metrics are looked up by name and labels. Each thread keeps its own cache
+ * of the lookups it has done, so after the first time a lookup takes no lock.
+ * Metrics live as long as their registry.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace metrics {
+
+const size_t kShards = 16;
+
+// Index of the shard the calling thread updates.
+size_t shardIndex();
+
+class Counter {
+public:
+  void inc(uint64_t n = 1) {
+    shards_[shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+  uint64_t value() const;
+
+private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> value{0};
+  };
+  Shard shards_[kShards];
+};
+
+// A value that goes up and down, such as requests in flight. add() is sharded
+// like Counter so threads moving the same gauge never contend; set() is for
+// absolute gauges only and is not meant to be mixed with add().
+class Gauge {
+public:
+  void set(int64_t value) { base_.store(value, std::memory_order_relaxed); }
+  void add(int64_t n) {
+    shards_[shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+  int64_t value() const;
+
+private:
+  struct alignas(64) Shard {
+    std::atomic<int64_t> value{0};
+  };
+  std::atomic<int64_t> base_{0};
+  Shard shards_[kShards];
+};
+
+// Distribution of integer values, latencies in microseconds by convention.
+class Histogram {
+public:
+  static const int kSubBucketBits = 3;
+  static const uint64_t kSubBuckets = uint64_t(1) << kSubBucketBits;
+  // values up to 2^kMaxBits - 1 are told apart; larger ones share the top
+  // bucket
+  static const int kMaxBits = 40;
+  static const size_t kBuckets =
+      kSubBuckets + (kMaxBits - kSubBucketBits) * kSubBuckets;
+
+  void record(uint64_t value);
+
+  uint64_t count() const;
+  uint64_t sum() const;
+  // The number of values recorded below bound, which must be a power of two.
+  uint64_t countBelow(uint64_t bound) const;
+  // The value below which fraction q of the recorded values fall, rounded up
+  // to the top of its bucket. 0 if nothing has been recorded.
+  uint64_t quantile(double q) const;
+
+  static size_t bucketOf(uint64_t value);
+  // the smallest value of the bucket above
+  static uint64_t bucketLimit(size_t bucket);
+
+private:
+  friend class Registry;
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> buckets[kBuckets] = {};
+  };
+  std::vector<uint64_t> merged() const;
+
+  std::unique_ptr<Shard[]> shards_{new Shard[kShards]};
+};
+
+typedef std::vector<std::pair<std::string, std::string>> Labels;
+
+class Registry {
+public:
+  enum Type { kCounter, kGauge, kHistogram };
+
+  Registry();
+
+  // The registry the server reports through MetricsHandler.
+  static Registry &global();
+
+  // Find or create the metric name{labels}. A name is registered with one
+  // type; asking for it as another throws std::invalid_argument. help is
+  // taken from the first registration of name.
+  Counter &counter(const std::string &name, const std::string &help,
+                   const Labels &labels = Labels());
+  Gauge &gauge(const std::string &name, const std::string &help,
+               const Labels &labels = Labels());
+  // Values are microseconds and are exposed in seconds.
+  Histogram &histogram(const std::string &name, const std::string &help,
+                       const Labels &labels = Labels());
+  // A counter or gauge whose value is read from elsewhere at exposition time.
+  // Registering name{labels} again replaces its read function.
+  void callback(const std::string &name, const std::string &help, Type type,
+                std::function<double()> read, const Labels &labels = Labels());
+
+  // Every metric in the Prometheus text exposition format, version 0.0.4.
+  std::string exposition() const;
+
+private:
+  struct Series {
+    Counter counter;
+    Gauge gauge;
+    std::unique_ptr<Histogram> histogram;
+    std::function<double()> read;
+  };
+  struct Family {
+    Type type;
+    std::string help;
+    // by the rendered label set, e.g. handler="Echo",code="200"
+    std::map<std::string, std::unique_ptr<Series>> series;
+  };
+
+  Series &find(const std::string &name, const std::string &help, Type type,
+               const Labels &labels);
+
+  const uint64_t id_; // tells registries apart in the per-thread caches
+  mutable std::mutex mutex_;
+  std::map<std::string, Family> families_;
+};
+
+} // namespace metrics
+
+#endif // METRICS_H
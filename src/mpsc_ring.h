@@ -0,0 +1,88 @@
+#ifndef MPSC_RING_H
+#define MPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free queue for many producers and a single consumer.
+//
+// Every cell carries a sequence number telling whose turn it is: a producer
+// claims the cell at the head with one compare-and-swap, moves its value in
+// and publishes it by bumping the sequence; the consumer takes it once the
+// sequence says it is filled and hands it back to the producers one lap later.
+// Neither side ever takes a lock or allocates. A producer stalled between
+// claiming a cell and publishing it holds up the consumer at that cell only.
+template <class T> class MpscRing {
+public:
+  // capacity is rounded up to a power of two
+  explicit MpscRing(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; i++)
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  // Move value in, unless the ring is full. Safe from any number of threads.
+  bool tryPush(T &&value) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t lag = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (lag == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (lag < 0) {
+        // the consumer has not taken this cell's value of the last lap
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Move the oldest value out, if there is one. Only one thread may pop.
+  bool tryPop(T *value) {
+    Cell &cell = cells_[tail_ & mask_];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence != tail_ + 1)
+      return false;
+    *value = std::move(cell.value);
+    cell.value = T();
+    cell.sequence.store(tail_ + mask_ + 1, std::memory_order_release);
+    tail_++;
+    return true;
+  }
+
+  // Whether there is nothing to pop. Only meaningful to the consumer.
+  bool empty() const {
+    return cells_[tail_ & mask_].sequence.load(std::memory_order_acquire) !=
+           tail_ + 1;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  // producers and the consumer each keep to their own cache line
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) size_t tail_ = 0;
+};
+
+#endif // MPSC_RING_H
@@ -5,9 +5,12 @@
 #ifndef REQUEST_HANDLER_H
 #define REQUEST_HANDLER_H
 
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <boost/beast/http.hpp>
 #include "../config_parser.h"
+#include "../http/source_body.h"
 
 namespace http = boost::beast::http;
 
@@ -16,8 +19,27 @@ public:
     
     using Request = http::request<http::string_body>;
     using Response = http::response<http::string_body>;
+    // response whose body is pulled from a BodySource rather than a string
+    using SourceResponse = http::response<SourceBody>;
 
     virtual void handleRequest(const Request &request_, Response *response_) noexcept = 0;
+    // Optionally answer without building the body as a string. Returns false
+    // if the request should go to handleRequest instead.
+    virtual bool handleSourceRequest(const Request &request_, SourceResponse *response_) noexcept {
+        return false;
+    }
+    // Called once an asynchronous request has been answered, with true if the
+    // answer is in the SourceResponse rather than the Response.
+    using Completion = std::function<void(bool use_source_response)>;
+    // Optionally answer off the network thread. Returns false if the request
+    // should go to handleSourceRequest/handleRequest instead. Otherwise the
+    // handler fills in one of *response_ and *source_response_ and then calls
+    // done exactly once, from any thread, possibly before returning; both
+    // responses must stay alive until then.
+    virtual bool handleAsyncRequest(std::shared_ptr<const Request> request_, Response *response_,
+                                    SourceResponse *source_response_, Completion done) noexcept {
+        return false;
+    }
     virtual std::string getName() noexcept = 0;
 protected:
     
@@ -1,6 +1,5 @@
 #include "request_handler_404.h"
 #include <boost/beast/http.hpp>
-#include <iostream>
 
 
 namespace http = boost::beast::http;
@@ -21,8 +20,6 @@ RequestHandler404::RequestHandler404() {
  */
 void RequestHandler404::handleRequest(const Request &request_,
                                        Response *response_) noexcept {
-    std::cout << "RequestHandler404::handleRequest()" << std::endl;
-
     response_->result(http::status::not_found);
     response_->version(request_.version());
     response_->set(http::field::content_type, "text/plain");
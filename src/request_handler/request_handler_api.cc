@@ -1,15 +1,203 @@
 // request_handler_api.cc
 #include "request_handler_api.h"
 #include "../api/crud_handler.h"
+#include "../http/base64.h"
+#include "../http/json.h"
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
 #include <cctype>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <string>
 
 
 namespace http = boost::beast::http;
 
+namespace {
+
+// ids fetched from the backend per chunk of an unpaginated listing
+const size_t kListingPageSize = 512;
+
+// Append a stored body to out as a JSON value: null if it is empty, the body
+// itself if it is JSON (minified into scratch first, if minify), and a JSON
+// string holding it otherwise. Unless body_check_ asks for JSON, a stored body
+// can be anything, binary uploads included.
+void appendJsonValue(std::string *out, const std::string &body, bool minify,
+                     std::string *scratch) {
+  if (body.empty())
+    *out += "null";
+  else if (minify ? !json::minify(body, scratch) : !json::validate(body))
+    *out += json::quote(body);
+  else
+    *out += minify ? *scratch : body;
+}
+
+// How a ListingSource writes out each id: as a bare number, as an
+// {"id": N, "data": ...} element of the array, or as such an object on a line
+// of its own (newline-delimited JSON, no enclosing array)
+enum ListingStyle { kIds, kExpanded, kNdjson };
+
+// Produces "[1, 2, ...]", "[{"id": 1, "data": ...}, ...]" or NDJSON, one page
+// of ids per chunk so neither the id list nor the body is ever materialized in
+// full.
+//
+// Beast pulls the chunks on the network thread. With an executor, each chunk
+// is built there ahead of time, the listing and body reads included, while the
+// one before it is being written out; next() only waits for it. Without one,
+// or with its queue full, a chunk is built when it is asked for.
+class ListingSource : public BodySource,
+                      public std::enable_shared_from_this<ListingSource> {
+public:
+  // ids is the first page, written out kListingPageSize at a time; if
+  // fetch_more, further pages after its last id are pulled from crud_handler
+  // as the previous ones are written out. The first chunk is built right
+  // away if there is an executor, as its caller is then one of its threads.
+  ListingSource(std::shared_ptr<ICRUDHandler> crud_handler, const std::string &entity,
+                ListingStyle style, std::vector<int> ids, bool fetch_more,
+                std::shared_ptr<StorageExecutor> executor)
+      : crud_handler_(std::move(crud_handler)), entity_(entity), style_(style),
+        ids_(std::move(ids)), fetch_more_(fetch_more),
+        executor_(std::move(executor)) {
+    if (executor_) {
+      fill();
+      filled_ = true;
+    }
+  }
+
+  bool next(boost::asio::const_buffer *chunk) override {
+    if (done_)
+      return false;
+    if (prefetch_.valid())
+      prefetch_.get();
+    else if (!filled_)
+      fill();
+    filled_ = false;
+    chunk_.swap(next_chunk_);
+    *chunk = boost::asio::buffer(chunk_);
+    done_ = last_chunk_;
+    if (!done_)
+      prefetch();
+    return true;
+  }
+
+private:
+  // build the following chunk on the executor, if there is room for it
+  void prefetch() {
+    if (!executor_)
+      return;
+    auto self = shared_from_this();
+    auto filled = std::make_shared<std::promise<void>>();
+    prefetch_ = filled->get_future();
+    bool queued = executor_->submit([self, filled] {
+      try {
+        self->fill();
+        filled->set_value();
+      } catch (...) {
+        filled->set_exception(std::current_exception());
+      }
+    });
+    if (!queued)
+      prefetch_ = std::future<void>();
+  }
+
+  // build the next chunk into next_chunk_, setting last_chunk_ if it ends the
+  // body
+  void fill() {
+    next_chunk_.clear();
+    if (!started_) {
+      if (style_ != kNdjson)
+        next_chunk_ = "[";
+      started_ = true;
+    }
+    if (pos_ == ids_.size() && fetch_more_ && last_id_ > 0)
+      fetchPage();
+    size_t end = std::min(ids_.size(), pos_ + kListingPageSize);
+    bool empty_page = pos_ == end;
+    for (; pos_ < end; ++pos_)
+      append(ids_[pos_]);
+    last_chunk_ = pos_ == ids_.size() && (empty_page || !fetch_more_);
+    if (last_chunk_ && style_ != kNdjson)
+      next_chunk_ += "]";
+  }
+
+  void fetchPage() {
+    ids_ = crud_handler_->list(entity_, last_id_, kListingPageSize);
+    pos_ = 0;
+    if (ids_.size() < kListingPageSize)
+      fetch_more_ = false;
+  }
+
+  void append(int id) {
+    last_id_ = id;
+    std::string body;
+    if (style_ != kIds) {
+      body = crud_handler_->read(entity_, id);
+      // deleted since it was listed
+      if (body.empty() && !crud_handler_->exists(entity_, id))
+        return;
+    }
+    if (style_ == kIds) {
+      if (!first_)
+        next_chunk_ += ", ";
+      next_chunk_ += std::to_string(id);
+    } else if (style_ == kExpanded) {
+      if (!first_)
+        next_chunk_ += ", ";
+      next_chunk_ += "{\"id\": " + std::to_string(id) + ", \"data\": ";
+      appendJsonValue(&next_chunk_, body, false, &minified_);
+      next_chunk_ += "}";
+    } else {
+      // a line must hold the whole record, so JSON bodies are minified
+      next_chunk_ += "{\"id\":" + std::to_string(id) + ",\"data\":";
+      appendJsonValue(&next_chunk_, body, true, &minified_);
+      next_chunk_ += "}\n";
+    }
+    first_ = false;
+  }
+
+  // shared, so a listing still being written out keeps its storage open
+  std::shared_ptr<ICRUDHandler> crud_handler_;
+  const std::string entity_;
+  const ListingStyle style_;
+  // only fill() touches these, and never while next() does
+  std::vector<int> ids_;
+  size_t pos_ = 0;     // next id of ids_ to write out
+  bool fetch_more_;
+  int last_id_ = 0;
+  bool started_ = false;
+  bool first_ = true;
+  std::string next_chunk_;
+  bool last_chunk_ = false;
+  std::string minified_;
+
+  std::shared_ptr<StorageExecutor> executor_;
+  std::future<void> prefetch_;   // the fill() running on executor_, if any
+  bool filled_ = false;          // next_chunk_ was built by the constructor
+  bool done_ = false;
+  std::string chunk_;            // handed out by the last next()
+};
+
+// Calls f(line_number, line) for each line of text that is not blank, without
+// its terminator. Stops and returns false as soon as f does.
+template <class F> bool forEachLine(std::string_view text, F f) {
+  size_t line_number = 0;
+  while (!text.empty()) {
+    line_number++;
+    size_t newline = text.find('\n');
+    std::string_view line = text.substr(0, newline);
+    text.remove_prefix(newline == std::string_view::npos ? text.size()
+                                                         : newline + 1);
+    if (line.find_first_not_of(" \t\r") == std::string_view::npos)
+      continue;
+    if (!f(line_number, line))
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
 std::string RequestHandlerAPI::getName() noexcept {
     return "APIHandler";
 }
@@ -17,9 +205,12 @@ std::string RequestHandlerAPI::getName() noexcept {
  * handleRequest() - Fill response with static files.
  */
 
-RequestHandlerAPI::RequestHandlerAPI(ICRUDHandler *crud_handler,
-                                     const std::string &prefix)
-    : crud_handler_(crud_handler), prefix_(prefix) {
+RequestHandlerAPI::RequestHandlerAPI(std::shared_ptr<ICRUDHandler> crud_handler,
+                                     const std::string &prefix,
+                                     BodyCheck body_check,
+                                     std::shared_ptr<StorageExecutor> executor)
+    : crud_handler_(std::move(crud_handler)), prefix_(prefix), body_check_(body_check),
+      executor_(std::move(executor)) {
   // std::cout << "RequestHandlerAPI initialized with config." << std::endl;
 }
 
@@ -30,13 +221,67 @@ void RequestHandlerAPI::handleRequest(const Request &req,
   // CREATE and GET methods are implemented right now
   // TODO: add other methods
   if (req.method() == http::verb::post) {
-    std::string target = std::string(req.target());
+    std::map<std::string, std::string> params;
+    std::string target = parseTarget(req.target(), &params);
+    std::string path;
+    if (removePrefix(target, path) && path == kBatchPath) {
+      handleBatch(req, res);
+      return;
+    }
     std::string entity = target.substr(target.find_last_of('/') + 1);
-    std::string response_body = crud_handler_->create(entity, req.body());
+    std::string decoded;
+    std::string_view body;
+    if (!decodeBody(req, &decoded, &body)) {
+      res->result(http::status::bad_request);
+      res->body() = "Invalid Request: malformed base64 body";
+      res->prepare_payload();
+      return;
+    }
+    long ttl;
+    if (!parseTtl(req, params, &ttl)) {
+      res->result(http::status::bad_request);
+      res->body() = "Invalid Request: ttl must be a number of seconds";
+      res->prepare_payload();
+      return;
+    }
+    auto format = params.find("format");
+    if (format != params.end() && format->second == "ndjson") {
+      auto wrapped = params.find("wrapped");
+      handleImport(entity, body,
+                   wrapped != params.end() && wrapped->second == "true", ttl, res);
+      return;
+    }
+    std::string data(body);
+    if (!checkBody(&data)) {
+      res->result(http::status::bad_request);
+      res->body() = "Invalid Request: body is not valid JSON";
+      res->prepare_payload();
+      return;
+    }
+    std::string response_body = crud_handler_->create(entity, data);
+    // the backend couldn't write the instance out
+    if (response_body.empty()) {
+      res->result(http::status::internal_server_error);
+      res->body() = "Internal Server Error: could not store instance";
+      res->prepare_payload();
+      return;
+    }
+    if (ttl > 0) {
+      int id = ICRUDHandler::createdId(response_body);
+      // an instance that can't expire is not what the client asked for
+      if (id > 0 && !crud_handler_->expire(entity, id, std::chrono::seconds(ttl))) {
+        crud_handler_->delete_(entity, id);
+        res->result(http::status::internal_server_error);
+        res->body() = "Internal Server Error: could not set ttl";
+        res->prepare_payload();
+        return;
+      }
+    }
     res->result(http::status::ok);
     res->body() = response_body;
   } else if (req.method() == http::verb::get) {
-    std::string target = std::string(req.target());
+    std::map<std::string, std::string> params;
+    std::string target = parseTarget(req.target(), &params);
     std::string entity_id;
     bool success = removePrefix(target, entity_id);
 
@@ -46,23 +291,38 @@ void RequestHandlerAPI::handleRequest(const Request &req,
       res->prepare_payload();
       return;
     }
+    if (entity_id == kStoragePath) {
+      res->result(http::status::ok);
+      res->body() = storageStats();
+      res->prepare_payload();
+      return;
+    }
     std::string entity = entity_id.substr(0, entity_id.find_last_of('/'));
     std::string id_str = entity_id.substr(entity_id.find_last_of('/') + 1);
-    std::cout << "id_str: " << id_str << std::endl;
 
     // assumes entity cannot start with digit
     if (!std::isdigit(id_str[0])) {
       // list request
-      std::string response_body = "[";
-      int id = 1;
-      while (crud_handler_->exists(entity_id, id)) {
-        if (id > 1) {
-          response_body += ", ";
-        }
-        response_body += std::to_string(id);
-        id++;
+      std::shared_ptr<BodySource> listing;
+      std::string next_cursor, error;
+      bool ndjson = false;
+      // drained right here, so nothing to build ahead of time
+      if (!startListing(entity_id, params, nullptr, &listing, &next_cursor,
+                        &ndjson, &error)) {
+        res->result(http::status::bad_request);
+        res->body() = error;
+        res->prepare_payload();
+        return;
       }
-      response_body += "]";
+      if (ndjson)
+        res->set(http::field::content_type, kNdjsonContentType);
+      if (!next_cursor.empty())
+        res->set("X-Next-Cursor", next_cursor);
+      std::string response_body;
+      boost::asio::const_buffer chunk;
+      while (listing->next(&chunk))
+        response_body.append(static_cast<const char *>(chunk.data()),
+                             chunk.size());
       res->body() = response_body;
     } else {
       // read request
@@ -85,12 +345,26 @@ void RequestHandlerAPI::handleRequest(const Request &req,
         res->prepare_payload();
         return;
       }
+      // the version is taken before the body, so a racing write can only make
+      // the ETag older than the body, which costs a refetch, not a lost update
+      uint64_t version = crud_handler_->version(entity, id);
+      if (version > 0) {
+        res->set(http::field::etag, etag(version));
+        auto if_none_match = req.find(http::field::if_none_match);
+        if (if_none_match != req.end() &&
+            etagMatches(if_none_match->value(), version, true)) {
+          res->result(http::status::not_modified);
+          res->prepare_payload();
+          return;
+        }
+      }
       std::string response_body = crud_handler_->read(entity, id);
       res->body() = response_body;
     }
     res->result(http::status::ok);
   } else if (req.method() == http::verb::put) {
-    std::string target = std::string(req.target());
+    std::map<std::string, std::string> params;
+    std::string target = parseTarget(req.target(), &params);
     std::string entity_id;
     bool success = removePrefix(target, entity_id);
 
@@ -115,16 +389,66 @@ void RequestHandlerAPI::handleRequest(const Request &req,
       return;
     }
 
-    success = crud_handler_->update(entity, id, req.body());
-    if (!success) {
+    std::string data;
+    if (!decodeBody(req, &data)) {
+      res->result(http::status::bad_request);
+      res->body() = "Invalid Request: malformed base64 body";
+      res->prepare_payload();
+      return;
+    }
+    if (!checkBody(&data)) {
+      res->result(http::status::bad_request);
+      res->body() = "Invalid Request: body is not valid JSON";
+      res->prepare_payload();
+      return;
+    }
+    long ttl;
+    if (!parseTtl(req, params, &ttl)) {
+      res->result(http::status::bad_request);
+      res->body() = "Invalid Request: ttl must be a number of seconds";
+      res->prepare_payload();
+      return;
+    }
+    // with If-Match, the write only goes ahead if the version the client saw
+    // is still the current one
+    uint64_t expected = 0;
+    auto if_match = req.find(http::field::if_match);
+    if (if_match != req.end()) {
+      expected = crud_handler_->version(entity, id);
+      if (!etagMatches(if_match->value(), expected, false)) {
+        res->result(http::status::precondition_failed);
+        res->body() = "Precondition Failed: version does not match";
+        res->prepare_payload();
+        return;
+      }
+    }
+    uint64_t version = 0;
+    ICRUDHandler::WriteStatus status =
+        crud_handler_->updateIf(entity, id, data, expected, &version);
+    if (status == ICRUDHandler::kVersionMismatch ||
+        (status == ICRUDHandler::kNotFound && expected != 0)) {
+      res->result(http::status::precondition_failed);
+      res->body() = "Precondition Failed: version does not match";
+      res->prepare_payload();
+      return;
+    }
+    if (status != ICRUDHandler::kWritten) {
       res->result(http::status::not_found);
       res->body() = "Invalid Request";
       res->prepare_payload();
       return;
     }
+    if (ttl >= 0 && !crud_handler_->expire(entity, id, std::chrono::seconds(ttl))) {
+      res->result(http::status::internal_server_error);
+      res->body() = "Internal Server Error: could not set ttl";
+      res->prepare_payload();
+      return;
+    }
+    if (version > 0)
+      res->set(http::field::etag, etag(version));
     res->result(http::status::ok);
   } else if (req.method() == http::verb::delete_) {
-    std::string target = std::string(req.target());
+    std::string target = parseTarget(req.target(), nullptr);
     std::string entity_id;
     bool success = removePrefix(target, entity_id);
 
@@ -150,9 +474,27 @@ void RequestHandlerAPI::handleRequest(const Request &req,
       return;
     }
 
-    success = crud_handler_->delete_(entity, id);
+    uint64_t expected = 0;
+    auto if_match = req.find(http::field::if_match);
+    if (if_match != req.end()) {
+      expected = crud_handler_->version(entity, id);
+      if (!etagMatches(if_match->value(), expected, false)) {
+        res->result(http::status::precondition_failed);
+        res->body() = "Precondition Failed: version does not match";
+        res->prepare_payload();
+        return;
+      }
+    }
+    ICRUDHandler::WriteStatus status = crud_handler_->deleteIf(entity, id, expected);
+    if (status == ICRUDHandler::kVersionMismatch ||
+        (status == ICRUDHandler::kNotFound && expected != 0)) {
+      res->result(http::status::precondition_failed);
+      res->body() = "Precondition Failed: version does not match";
+      res->prepare_payload();
+      return;
+    }
     // if entity/id does not exist in file path
-    if (!success) {
+    if (status != ICRUDHandler::kWritten) {
       res->result(http::status::not_found);
       res->body() = "Invalid Request: entity id does not exist";
       res->prepare_payload();
@@ -168,11 +510,526 @@ void RequestHandlerAPI::handleRequest(const Request &req,
   res->prepare_payload();
 }
 
+bool RequestHandlerAPI::handleAsyncRequest(std::shared_ptr<const Request> req,
+                                           Response *res,
+                                           SourceResponse *source_res,
+                                           Completion done) noexcept {
+  if (!executor_)
+    return false;
+  std::string path;
+  // stats are answered inline, so they still get through when the queue is full
+  if (req->method() == http::verb::get &&
+      removePrefix(parseTarget(req->target(), nullptr), path) &&
+      path == kStoragePath)
+    return false;
+  bool queued = executor_->submit([this, req, res, source_res, done] {
+    bool use_source = handleSourceRequest(*req, source_res);
+    if (!use_source)
+      handleRequest(*req, res);
+    done(use_source);
+  });
+  if (!queued) {
+    res->version(req->version());
+    res->result(http::status::service_unavailable);
+    res->set(http::field::content_type, "application/json");
+    res->set(http::field::retry_after, "1");
+    res->body() = "Service Unavailable: storage queue is full";
+    res->prepare_payload();
+    done(false);
+  }
+  return true;
+}
+
+bool RequestHandlerAPI::handleSourceRequest(const Request &req,
+                                            SourceResponse *res) noexcept {
+  if (req.method() != http::verb::get)
+    return false;
+  std::map<std::string, std::string> params;
+  std::string entity_id;
+  if (!removePrefix(parseTarget(req.target(), &params), entity_id) ||
+      entity_id == kStoragePath)
+    return false;
+  size_t slash = entity_id.find_last_of('/');
+  std::string id_str =
+      slash == std::string::npos ? entity_id : entity_id.substr(slash + 1);
+  if (!std::isdigit(id_str[0])) {
+    // stream the listing out in chunks as the socket drains
+    std::shared_ptr<BodySource> listing;
+    std::string next_cursor, error;
+    bool ndjson = false;
+    if (!startListing(entity_id, params, executor_, &listing, &next_cursor,
+                      &ndjson, &error))
+      return false;
+    res->version(req.version());
+    res->result(http::status::ok);
+    res->set(http::field::content_type,
+             ndjson ? kNdjsonContentType : "application/json");
+    if (!next_cursor.empty())
+      res->set("X-Next-Cursor", next_cursor);
+    res->chunked(true);
+    res->body() = listing;
+    return true;
+  }
+  if (slash == std::string::npos)
+    return false;
+  std::string entity = entity_id.substr(0, slash);
+  int id;
+  try {
+    id = boost::lexical_cast<int>(id_str);
+  } catch (const boost::bad_lexical_cast &) {
+    return false;
+  }
+
+  // conditional GETs that come to a 304 are answered by handleRequest()
+  uint64_t version = crud_handler_->version(entity, id);
+  auto if_none_match = req.find(http::field::if_none_match);
+  if (if_none_match != req.end() &&
+      etagMatches(if_none_match->value(), version, true))
+    return false;
+  std::shared_ptr<const MappedFile> mapped = crud_handler_->readMapped(entity, id);
+  if (!mapped)
+    return false;
+  if (version > 0)
+    res->set(http::field::etag, etag(version));
+  res->version(req.version());
+  res->result(http::status::ok);
+  res->set(http::field::content_type, "application/json");
+  res->content_length(mapped->size());
+  res->body() = BodySource::fromBuffer(mapped, mapped->data(), mapped->size());
+  return true;
+}
+
+/**
+ * storageStats() - Describe the storage executor's load as a JSON object.
+ * Without an executor every figure is 0.
+ */
+std::string RequestHandlerAPI::storageStats() const {
+  StorageExecutor::Stats stats;
+  if (executor_)
+    stats = executor_->stats();
+  uint64_t completed = std::max<uint64_t>(stats.completed, 1);
+  return "{\"threads\": " + std::to_string(stats.threads) +
+         ", \"queue_capacity\": " + std::to_string(stats.queue_capacity) +
+         ", \"queued\": " + std::to_string(stats.queued) +
+         ", \"running\": " + std::to_string(stats.running) +
+         ", \"completed\": " + std::to_string(stats.completed) +
+         ", \"rejected\": " + std::to_string(stats.rejected) +
+         ", \"avg_wait_us\": " + std::to_string(stats.total_wait_us / completed) +
+         ", \"max_wait_us\": " + std::to_string(stats.max_wait_us) +
+         ", \"avg_run_us\": " + std::to_string(stats.total_run_us / completed) +
+         ", \"max_run_us\": " + std::to_string(stats.max_run_us) + "}";
+}
+
+/**
+ * handleBatch() - Run the JSON array of operations in the request body as one
+ * batch and answer with a JSON array holding each operation's outcome.
+ */
+void RequestHandlerAPI::handleBatch(const Request &req, Response *res) {
+  std::string body, error;
+  std::vector<BatchOperation> operations;
+  if (!decodeBody(req, &body)) {
+    error = "Invalid Request: malformed base64 body";
+  } else {
+    parseBatch(body, &operations, &error);
+  }
+  if (!error.empty()) {
+    res->result(http::status::bad_request);
+    res->body() = error;
+    res->prepare_payload();
+    return;
+  }
+
+  std::vector<BatchResult> results = crud_handler_->batch(operations);
+  std::string response_body = "[", scratch;
+  for (size_t i = 0; i < results.size(); i++) {
+    const BatchResult &result = results[i];
+    if (i > 0)
+      response_body += ", ";
+    // a create can only fail on a storage error, the others because the id is missing
+    int status = result.ok ? 200
+                 : operations[i].type == BatchOperation::kCreate ? 500
+                                                                  : 404;
+    response_body += "{\"status\": " + std::to_string(status);
+    if (result.id > 0)
+      response_body += ", \"id\": " + std::to_string(result.id);
+    if (result.ok && operations[i].type == BatchOperation::kRead) {
+      response_body += ", \"data\": ";
+      appendJsonValue(&response_body, result.data, false, &scratch);
+    }
+    response_body += "}";
+  }
+  response_body += "]";
+  res->result(http::status::ok);
+  res->body() = response_body;
+  res->prepare_payload();
+}
+
+/**
+ * handleImport() - Create one entity for each line of the NDJSON in body and
+ * answer with how many were created and, for the first kMaxBatchOperations
+ * lines, their ids in line order. With wrapped, lines are records as exported,
+ * {"id": N, "data": ...}, and only their "data" is stored. Nothing is written
+ * unless every line is valid. A positive ttl applies to each new instance; if
+ * one can't be given it, the import stops there with a 500.
+ *
+ * Besides body, only one group of kMaxBatchOperations lines is held at a
+ * time, however large the upload.
+ */
+void RequestHandlerAPI::handleImport(const std::string &entity,
+                                     std::string_view body, bool wrapped,
+                                     long ttl, Response *res) {
+  std::vector<std::pair<std::string, std::string_view>> members;
+  // the data a line stores, or an empty view if it has none
+  auto lineData = [wrapped, &members](std::string_view line) {
+    if (!wrapped)
+      return json::validate(line) ? line : std::string_view();
+    if (!json::split_object(line, &members))
+      return std::string_view();
+    for (const auto &member : members) {
+      if (member.first == "data")
+        return member.second;
+    }
+    return std::string_view();
+  };
+  // a line's data is valid JSON once it is found, which is all checkBody()
+  // could ask of it
+  std::string error;
+  forEachLine(body, [&](size_t line_number, std::string_view line) {
+    if (!lineData(line).empty())
+      return true;
+    error = "Invalid Request: line " + std::to_string(line_number) +
+            (wrapped ? " is not a record with \"data\"" : " is not valid JSON");
+    return false;
+  });
+  if (!error.empty()) {
+    res->result(http::status::bad_request);
+    res->body() = error;
+    res->prepare_payload();
+    return;
+  }
+
+  // written kMaxBatchOperations lines at a time, so each group shares one
+  // storage pass; only the data of a group is copied out of body, and a
+  // wrapped line is split again as its group comes up
+  size_t created = 0, failed = 0, listed = 0;
+  bool ttl_failed = false;
+  std::string ids;
+  std::vector<BatchOperation> operations;
+  auto listId = [&](const std::string &id) {
+    if (listed++ < kMaxBatchOperations)
+      ids += (ids.empty() ? "" : ", ") + id;
+  };
+  auto flush = [&] {
+    for (const BatchResult &result : crud_handler_->batch(operations)) {
+      if (!result.ok) {
+        failed++;
+        listId("null");
+        continue;
+      }
+      // an instance that can't expire is not what the client asked for, nor
+      // are the ones created after it
+      if (ttl > 0 && (ttl_failed || !crud_handler_->expire(
+                                        entity, result.id,
+                                        std::chrono::seconds(ttl)))) {
+        crud_handler_->delete_(entity, result.id);
+        ttl_failed = true;
+        continue;
+      }
+      created++;
+      listId(std::to_string(result.id));
+    }
+    operations.clear();
+  };
+  forEachLine(body, [&](size_t, std::string_view line) {
+    BatchOperation operation;
+    operation.type = BatchOperation::kCreate;
+    operation.entity = entity;
+    std::string_view data = wrapped ? lineData(line) : line;
+    if (body_check_ != kMinify || !json::minify(data, &operation.data))
+      operation.data = std::string(data);
+    operations.push_back(std::move(operation));
+    if (operations.size() < kMaxBatchOperations)
+      return true;
+    flush();
+    return !ttl_failed;
+  });
+  if (!operations.empty() && !ttl_failed)
+    flush();
+
+  if (ttl_failed) {
+    res->result(http::status::internal_server_error);
+    res->body() = "Internal Server Error: could not set ttl after creating " +
+                  std::to_string(created) + " instances";
+    res->prepare_payload();
+    return;
+  }
+  res->result(http::status::ok);
+  res->body() = "{\"created\": " + std::to_string(created) +
+                ", \"failed\": " + std::to_string(failed) + ", \"ids\": [" +
+                ids + "]}";
+  res->prepare_payload();
+}
+
+/**
+ * parseBatch() - Parse a batch request body such as
+ * [{"op": "create", "entity": "Shoes", "data": {...}},
+ *  {"op": "read", "entity": "Shoes", "id": 1}]
+ * into operations. On malformed input fills error and returns false.
+ */
+bool RequestHandlerAPI::parseBatch(const std::string &body,
+                                   std::vector<BatchOperation> *operations,
+                                   std::string *error) const {
+  std::vector<std::string_view> elements;
+  if (!json::split_array(body, &elements)) {
+    *error = "Invalid Request: batch body must be a JSON array";
+    return false;
+  }
+  if (elements.size() > kMaxBatchOperations) {
+    *error = "Invalid Request: at most " + std::to_string(kMaxBatchOperations) +
+             " operations per batch";
+    return false;
+  }
+  std::vector<std::pair<std::string, std::string_view>> members;
+  for (size_t i = 0; i < elements.size(); i++) {
+    std::string prefix = "Invalid Request: operation " + std::to_string(i) + ": ";
+    if (!json::split_object(elements[i], &members)) {
+      *error = prefix + "not an object";
+      return false;
+    }
+    std::string op;
+    BatchOperation operation;
+    bool has_id = false, has_data = false;
+    for (const auto &member : members) {
+      bool valid = true;
+      if (member.first == "op") {
+        valid = json::parse_string(member.second, &op);
+      } else if (member.first == "entity") {
+        valid = json::parse_string(member.second, &operation.entity);
+      } else if (member.first == "id") {
+        valid = json::parse_int(member.second, &operation.id) && operation.id > 0;
+        has_id = true;
+      } else if (member.first == "data") {
+        operation.data = std::string(member.second);
+        valid = checkBody(&operation.data);
+        has_data = true;
+      }
+      if (!valid) {
+        *error = prefix + "bad \"" + member.first + "\"";
+        return false;
+      }
+    }
+
+    if (op == "create") {
+      operation.type = BatchOperation::kCreate;
+    } else if (op == "read") {
+      operation.type = BatchOperation::kRead;
+    } else if (op == "update") {
+      operation.type = BatchOperation::kUpdate;
+    } else if (op == "delete") {
+      operation.type = BatchOperation::kDelete;
+    } else {
+      *error = prefix + "\"op\" must be create, read, update or delete";
+      return false;
+    }
+    // the entity becomes a directory name, so keep it to one path component
+    if (operation.entity.empty() || operation.entity[0] == '.' ||
+        operation.entity.find('/') != std::string::npos ||
+        std::isdigit(static_cast<unsigned char>(operation.entity[0]))) {
+      *error = prefix + "missing or bad \"entity\"";
+      return false;
+    }
+    if (operation.type != BatchOperation::kCreate && !has_id) {
+      *error = prefix + "missing \"id\"";
+      return false;
+    }
+    bool needs_data = operation.type == BatchOperation::kCreate ||
+                      operation.type == BatchOperation::kUpdate;
+    if (needs_data != has_data) {
+      *error = prefix + (needs_data ? "missing \"data\"" : "unexpected \"data\"");
+      return false;
+    }
+    operations->push_back(std::move(operation));
+  }
+  return true;
+}
+
+/**
+ * startListing() - Set up the listing of entity described by the limit, cursor,
+ * expand and format query parameters, building its chunks on executor if it is
+ * not null. On a bad parameter, fills error and returns false.
+ */
+bool RequestHandlerAPI::startListing(
+    const std::string &entity, const std::map<std::string, std::string> &params,
+    std::shared_ptr<StorageExecutor> executor,
+    std::shared_ptr<BodySource> *listing, std::string *next_cursor,
+    bool *ndjson, std::string *error) {
+  int after = 0;
+  auto cursor = params.find("cursor");
+  if (cursor != params.end() && !decodeCursor(entity, cursor->second, &after)) {
+    *error = "Invalid Request: bad cursor";
+    return false;
+  }
+  auto expand = params.find("expand");
+  ListingStyle style =
+      expand != params.end() && expand->second == "true" ? kExpanded : kIds;
+  auto format = params.find("format");
+  *ndjson = format != params.end() && format->second == "ndjson";
+  if (format != params.end() && !*ndjson && format->second != "json") {
+    *error = "Invalid Request: format must be json or ndjson";
+    return false;
+  }
+  // NDJSON exports always carry the bodies
+  if (*ndjson)
+    style = kNdjson;
+
+  // any other parameter naming an indexed field is a field=value filter
+  // answered by that index; the rest are ignored, as they always were, and
+  // never turn into a scan
+  bool filtered = false;
+  std::vector<int> matches;
+  for (const auto &param : params) {
+    if (param.first == "limit" || param.first == "cursor" ||
+        param.first == "expand" || param.first == "format")
+      continue;
+    std::vector<int> ids;
+    if (!crud_handler_->query(entity, param.first, param.second, &ids))
+      continue;
+    if (filtered) {
+      std::vector<int> both;
+      std::set_intersection(matches.begin(), matches.end(), ids.begin(),
+                            ids.end(), std::back_inserter(both));
+      ids.swap(both);
+    }
+    matches.swap(ids);
+    filtered = true;
+  }
+  if (filtered)
+    matches.erase(matches.begin(),
+                  std::upper_bound(matches.begin(), matches.end(), after));
+
+  auto limit_param = params.find("limit");
+  if (limit_param == params.end()) {
+    if (filtered) {
+      *listing = std::make_shared<ListingSource>(
+          crud_handler_, entity, style, std::move(matches), false, executor);
+      return true;
+    }
+    std::vector<int> ids = crud_handler_->list(entity, after, kListingPageSize);
+    bool more = ids.size() == kListingPageSize;
+    *listing = std::make_shared<ListingSource>(
+        crud_handler_, entity, style, std::move(ids), more, executor);
+    return true;
+  }
+
+  size_t limit = 0;
+  const std::string &value = limit_param->second;
+  if (value.empty() || value.size() > 4 ||
+      value.find_first_not_of("0123456789") != std::string::npos ||
+      (limit = std::stoul(value)) == 0 || limit > kMaxListLimit) {
+    *error = "Invalid Request: limit must be between 1 and " +
+             std::to_string(kMaxListLimit);
+    return false;
+  }
+  // one extra id tells whether there is a next page
+  std::vector<int> ids;
+  if (filtered) {
+    matches.resize(std::min(matches.size(), limit + 1));
+    ids.swap(matches);
+  } else {
+    ids = crud_handler_->list(entity, after, limit + 1);
+  }
+  if (ids.size() > limit) {
+    ids.resize(limit);
+    *next_cursor = encodeCursor(entity, ids.back());
+  }
+  *listing = std::make_shared<ListingSource>(
+      crud_handler_, entity, style, std::move(ids), false, executor);
+  return true;
+}
+
+// Cursors are url-safe, unpadded base64 of "<entity>\n<last id>", so they can
+// be pasted into a query string as they are and are only valid for their entity
+std::string RequestHandlerAPI::encodeCursor(const std::string &entity, int after) {
+  std::string cursor = base64::encode(entity + "\n" + std::to_string(after));
+  std::replace(cursor.begin(), cursor.end(), '+', '-');
+  std::replace(cursor.begin(), cursor.end(), '/', '_');
+  cursor.erase(cursor.find_last_not_of('=') + 1);
+  return cursor;
+}
+
+bool RequestHandlerAPI::decodeCursor(const std::string &entity,
+                                     std::string cursor, int *after) {
+  std::replace(cursor.begin(), cursor.end(), '-', '+');
+  std::replace(cursor.begin(), cursor.end(), '_', '/');
+  cursor.append((4 - cursor.size() % 4) % 4, '=');
+  std::string decoded;
+  if (!base64::decode(cursor, &decoded))
+    return false;
+  size_t newline = decoded.find('\n');
+  if (newline == std::string::npos || decoded.compare(0, newline, entity) != 0 ||
+      newline != entity.size())
+    return false;
+  try {
+    *after = boost::lexical_cast<int>(decoded.substr(newline + 1));
+  } catch (const boost::bad_lexical_cast &) {
+    return false;
+  }
+  return *after >= 0;
+}
+
+/**
+ * percentDecode() - Undo %XX escapes and '+' for space in a query string
+ * component. Malformed escapes are kept as they are.
+ */
+std::string RequestHandlerAPI::percentDecode(boost::beast::string_view in) {
+  std::string out;
+  out.reserve(in.size());
+  for (size_t i = 0; i < in.size(); i++) {
+    if (in[i] == '+') {
+      out.push_back(' ');
+    } else if (in[i] == '%' && i + 2 < in.size() &&
+               std::isxdigit(static_cast<unsigned char>(in[i + 1])) &&
+               std::isxdigit(static_cast<unsigned char>(in[i + 2]))) {
+      out.push_back(static_cast<char>(
+          std::stoi(std::string(in.substr(i + 1, 2)), nullptr, 16)));
+      i += 2;
+    } else {
+      out.push_back(in[i]);
+    }
+  }
+  return out;
+}
+
+/**
+ * parseTarget() - Split "/path?a=1&b=2" into its path, returned, and its
+ * query parameters, stored in params if it is not null.
+ */
+std::string RequestHandlerAPI::parseTarget(boost::beast::string_view target,
+                                           std::map<std::string, std::string> *params) {
+  size_t question = target.find('?');
+  if (question == boost::beast::string_view::npos)
+    return std::string(target);
+  if (params) {
+    boost::beast::string_view query = target.substr(question + 1);
+    while (!query.empty()) {
+      size_t amp = query.find('&');
+      boost::beast::string_view pair = query.substr(0, amp);
+      size_t equals = pair.find('=');
+      if (equals == boost::beast::string_view::npos)
+        (*params)[percentDecode(pair)] = "";
+      else
+        (*params)[percentDecode(pair.substr(0, equals))] =
+            percentDecode(pair.substr(equals + 1));
+      if (amp == boost::beast::string_view::npos)
+        break;
+      query.remove_prefix(amp + 1);
+    }
+  }
+  return std::string(target.substr(0, question));
+}
+
 bool RequestHandlerAPI::removePrefix(const std::string path,
                                      std::string &new_path) {
-  std::cout << "remove prefix" << std::endl;
-  std::cout << path << std::endl;
-  std::cout << prefix_ << std::endl;
   // invalid paths
   if (path.length() < prefix_.length()) {
     return false;
@@ -181,5 +1038,109 @@ bool RequestHandlerAPI::removePrefix(const std::string path,
   }
 
   new_path = path.substr(prefix_.length());
+  // "/api" and "/api/" prefixes should both yield "Shoes/1", the same entity
+  // name POST uses
+  size_t start = new_path.find_first_not_of('/');
+  new_path = start == std::string::npos ? "" : new_path.substr(start);
   return true;
-}
\ No newline at end of file
+}
+
+std::string RequestHandlerAPI::etag(uint64_t version) {
+  return "\"" + std::to_string(version) + "\"";
+}
+
+/**
+ * etagMatches() - Whether the comma separated entity tags of an If-Match or
+ * If-None-Match header include the one for version (RFC 9110 section 13.1).
+ */
+bool RequestHandlerAPI::etagMatches(boost::beast::string_view header,
+                                    uint64_t version, bool weak) {
+  if (version == 0)
+    return false;
+  std::string current = etag(version);
+  size_t start = 0;
+  while (start <= header.size()) {
+    size_t comma = header.find(',', start);
+    if (comma == boost::beast::string_view::npos)
+      comma = header.size();
+    boost::beast::string_view tag = header.substr(start, comma - start);
+    while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t'))
+      tag.remove_prefix(1);
+    while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t'))
+      tag.remove_suffix(1);
+    if (tag == "*")
+      return true;
+    bool is_weak = tag.starts_with("W/");
+    if (is_weak)
+      tag.remove_prefix(2);
+    if ((weak || !is_weak) && tag == current)
+      return true;
+    start = comma + 1;
+  }
+  return false;
+}
+
+/**
+ * parseTtl() - Read the lifetime a write asks for, in seconds, from the X-TTL
+ * header or else the ttl query parameter; -1 if there is neither. Returns
+ * false if the value is not a plain number.
+ */
+bool RequestHandlerAPI::parseTtl(const Request &req,
+                                 const std::map<std::string, std::string> &params,
+                                 long *ttl) {
+  *ttl = -1;
+  std::string value;
+  auto header = req.find(kTtlHeader);
+  auto param = params.find("ttl");
+  if (header != req.end())
+    value = std::string(header->value());
+  else if (param != params.end())
+    value = param->second;
+  else
+    return true;
+  if (value.empty() || value.size() > 10 ||
+      value.find_first_not_of("0123456789") != std::string::npos)
+    return false;
+  *ttl = std::stol(value);
+  return true;
+}
+
+bool RequestHandlerAPI::decodeBody(const Request &req, std::string *decoded,
+                                   std::string_view *data) {
+  auto encoding = req.find(http::field::content_transfer_encoding);
+  if (encoding == req.end() ||
+      !boost::beast::iequals(encoding->value(), "base64")) {
+    *data = req.body();
+    return true;
+  }
+  if (!base64::decode(req.body(), decoded))
+    return false;
+  *data = *decoded;
+  return true;
+}
+
+bool RequestHandlerAPI::decodeBody(const Request &req, std::string *data) {
+  auto encoding = req.find(http::field::content_transfer_encoding);
+  if (encoding == req.end() ||
+      !boost::beast::iequals(encoding->value(), "base64")) {
+    *data = req.body();
+    return true;
+  }
+  return base64::decode(req.body(), data);
+}
+
+/**
+ * checkBody() - Validate data as JSON, and minify it in place, as body_check_
+ * asks. Invalid bodies are caught here, before any storage I/O happens.
+ */
+bool RequestHandlerAPI::checkBody(std::string *data) const {
+  if (body_check_ == kValidate)
+    return json::validate(*data);
+  if (body_check_ == kMinify) {
+    std::string minified;
+    if (!json::minify(*data, &minified))
+      return false;
+    data->swap(minified);
+  }
+  return true;
+}
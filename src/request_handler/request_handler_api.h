@@ -2,24 +2,119 @@
 #define REQUEST_HANDLER_API_H
 
 #include <boost/beast/http.hpp>
+#include <map>
+#include <memory>
+#include <string_view>
 #include "request_handler.h"
 #include "../config_parser.h"
 #include "../api/crud_handler.h"
+#include "../api/storage_executor.h"
 
 class RequestHandlerAPI : public RequestHandler {
 public:
     std::string getName() noexcept override;
+    // what POST/PUT bodies (and batch "data" values) must be before they are stored:
+    // anything, valid JSON, or valid JSON which is then stored minified
+    enum BodyCheck { kNoCheck, kValidate, kMinify };
+
     // data_path parameter specifies root directory of the referenced data
-    RequestHandlerAPI(ICRUDHandler* crud_handler, const std::string &prefix);
+    // with an executor, requests are answered on its threads so storage I/O never
+    // blocks the network thread
+    RequestHandlerAPI(std::shared_ptr<ICRUDHandler> crud_handler, const std::string &prefix,
+                      BodyCheck body_check = kNoCheck,
+                      std::shared_ptr<StorageExecutor> executor = nullptr);
 
     void handleRequest(const Request &request_, Response *response_) noexcept override;
+    // queues the request on the executor, or answers 503 if its queue is full
+    bool handleAsyncRequest(std::shared_ptr<const Request> request_, Response *response_,
+                            SourceResponse *source_response_, Completion done) noexcept override;
+    // serves large single-entity GETs straight from a memory mapping
+    bool handleSourceRequest(const Request &request_, SourceResponse *response_) noexcept override;
+
+    // largest page a client may ask for with ?limit=
+    static const size_t kMaxListLimit = 1000;
+
+    // POST <prefix>/_batch runs a JSON array of operations in one storage pass
+    static constexpr const char *kBatchPath = "_batch";
+    static const size_t kMaxBatchOperations = 1000;
+
+    // GET <prefix>/<Entity>?format=ndjson streams the collection out one
+    // {"id": N, "data": ...} record per line; POST <prefix>/<Entity>?format=ndjson
+    // creates one entity per line of the body
+    static constexpr const char *kNdjsonContentType = "application/x-ndjson";
+
+    // POST and PUT make the instance expire after this many seconds if the
+    // header, or else a ttl query parameter, says so; 0 takes an expiry away
+    static constexpr const char *kTtlHeader = "X-TTL";
+
+    // GET <prefix>/_storage reports the executor's queue depth and latencies as JSON
+    static constexpr const char *kStoragePath = "_storage";
+
+    // opaque ?cursor= value resuming a listing of entity after the given id
+    static std::string encodeCursor(const std::string &entity, int after);
+    static bool decodeCursor(const std::string &entity, std::string cursor, int *after);
+
 private:
-    ICRUDHandler* crud_handler_;
+    std::shared_ptr<ICRUDHandler> crud_handler_;
     std::string prefix_;
+    BodyCheck body_check_;
+    std::shared_ptr<StorageExecutor> executor_;
 
     // helper function to remove api prefix from path and put result in new_path, returns whether prefix_ is a substring of path
     // and if path was able to successfully remove the prefix
     bool removePrefix(const std::string path, std::string& new_path);
+
+    // helper function to put the payload of a POST/PUT request in data. Bodies sent with
+    // "Content-Transfer-Encoding: base64" are decoded first; returns false if that fails
+    bool decodeBody(const Request &req, std::string* data);
+    // same, but leaves a body that isn't encoded where it is: data views either req.body()
+    // or decoded
+    bool decodeBody(const Request &req, std::string* decoded, std::string_view* data);
+
+    // helper function to apply body_check_ to data in place; returns false if data
+    // has to be valid JSON and is not
+    bool checkBody(std::string* data) const;
+
+    // helper functions for entity versions: the ETag of version, and whether an If-Match or
+    // If-None-Match value lists it ("*" lists any existing version; weak tags only count
+    // if weak is true)
+    static std::string etag(uint64_t version);
+    static bool etagMatches(boost::beast::string_view header, uint64_t version, bool weak);
+
+    // helper function to read the X-TTL header or ttl parameter into ttl, -1 if neither
+    // is set; returns false if it is malformed
+    static bool parseTtl(const Request &req, const std::map<std::string, std::string> &params,
+                         long *ttl);
+
+    // helper function to split a request target into its path (returned) and query parameters
+    static std::string percentDecode(boost::beast::string_view in);
+    static std::string parseTarget(boost::beast::string_view target,
+                                   std::map<std::string, std::string>* params);
+
+    // helper function for GET <prefix>/_storage
+    std::string storageStats() const;
+
+    // helper functions for POST <prefix>/_batch; parseBatch fills error and returns
+    // false if body is not a valid batch
+    void handleBatch(const Request &req, Response *res);
+    bool parseBatch(const std::string &body, std::vector<BatchOperation> *operations,
+                    std::string *error) const;
+
+    // helper function for POST <prefix>/<Entity>?format=ndjson; with wrapped, lines are
+    // exported records whose "data" is stored, and a positive ttl applies to each
+    void handleImport(const std::string &entity, std::string_view body, bool wrapped,
+                      long ttl, Response *res);
+
+    // helper function to set up a (possibly paginated and filtered) listing of entity from
+    // the limit, cursor, expand, format and field=value query parameters, setting ndjson
+    // if it is to be sent as NDJSON; its chunks are built ahead on executor, if given,
+    // which must not be the one the listing is drained on. On bad input fills error and
+    // returns false
+    bool startListing(const std::string &entity,
+                      const std::map<std::string, std::string> &params,
+                      std::shared_ptr<StorageExecutor> executor,
+                      std::shared_ptr<BodySource> *listing, std::string *next_cursor,
+                      bool *ndjson, std::string *error);
 };
 
 #endif // REQUEST_HANDLER_API_H
\ No newline at end of file
@@ -2,7 +2,7 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/asio.hpp>
-#include <iostream>
+#include <sstream>
 
 namespace http = boost::beast::http;
 
@@ -22,7 +22,6 @@ RequestHandlerEcho::RequestHandlerEcho() {
  */
 void RequestHandlerEcho::handleRequest(const Request &request_,
                                        Response *response_) noexcept {
-  std::cout << "RequestHandlerEcho::handleRequest()" << std::endl;
   response_->version(request_.version());
   response_->result(http::status::ok);
   // Echo back the request as the response body
@@ -2,7 +2,6 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/asio.hpp>
-#include <iostream>
 
 
 namespace http = boost::beast::http;
@@ -23,7 +22,6 @@ RequestHandlerHealth::RequestHandlerHealth() {
  */
 void RequestHandlerHealth::handleRequest(const Request &request_,
                                        Response *response_) noexcept {
-  std::cout << "RequestHandlerHealth::handleRequest()" << std::endl;
   response_->version(request_.version());
   response_->result(http::status::ok);
   response_->body() = "OK";
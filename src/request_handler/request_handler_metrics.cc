@@ -0,0 +1,43 @@
+#include "request_handler_metrics.h"
+#include <boost/beast/http.hpp>
+
+namespace http = boost::beast::http;
+
+std::string RequestHandlerMetrics::getName() noexcept {
+  return "MetricsHandler";
+}
+
+/**
+ * Constructor - Serve the metrics of registry.
+ */
+RequestHandlerMetrics::RequestHandlerMetrics(const metrics::Registry &registry)
+    : registry_(registry) {}
+
+/**
+ * handleRequest() - Reply to GET with the current metrics, and to HEAD with
+ * just the headers GET would get.
+ */
+void RequestHandlerMetrics::handleRequest(const Request &request_,
+                                          Response *response_) noexcept {
+  response_->version(request_.version());
+  response_->set(http::field::content_type, "text/plain; version=0.0.4");
+  if (request_.method() != http::verb::get &&
+      request_.method() != http::verb::head) {
+    response_->result(http::status::method_not_allowed);
+    response_->set(http::field::allow, "GET, HEAD");
+    response_->body() = "Method Not Allowed";
+    response_->prepare_payload();
+    return;
+  }
+  response_->result(http::status::ok);
+  try {
+    response_->body() = registry_.exposition();
+  } catch (const std::exception &) {
+    response_->result(http::status::internal_server_error);
+    response_->body() = "Internal Server Error";
+  }
+  response_->prepare_payload();
+  // keeps the Content-Length of the exposition
+  if (request_.method() == http::verb::head)
+    response_->body().clear();
+}
@@ -0,0 +1,21 @@
+#ifndef REQUEST_HANDLER_METRICS_H
+#define REQUEST_HANDLER_METRICS_H
+
+#include "../metrics.h"
+#include "request_handler.h"
+#include <boost/beast/http.hpp>
+
+// Serves the metrics of a registry in the Prometheus text format.
+class RequestHandlerMetrics : public RequestHandler {
+public:
+  explicit RequestHandlerMetrics(
+      const metrics::Registry &registry = metrics::Registry::global());
+  std::string getName() noexcept override;
+  void handleRequest(const Request &request_,
+                     Response *response_) noexcept override;
+
+private:
+  const metrics::Registry &registry_;
+};
+
+#endif // REQUEST_HANDLER_METRICS_H
@@ -4,7 +4,7 @@
 #include <boost/asio.hpp>
 #include <thread>   // For std::this_thread::sleep_for
 #include <chrono>   // For std::chrono::seconds
-#include <iostream>
+#include "../logger.h"
 
 namespace http = boost::beast::http;
 
@@ -17,7 +17,6 @@ std::string RequestHandlerSleep::getName() noexcept {
  */
 RequestHandlerSleep::RequestHandlerSleep() {
   // Optionally, process the config here
-  std::cout << "RequestHandlerSleep initialized with config." << std::endl;
 }
 
 /**
@@ -26,7 +25,7 @@ RequestHandlerSleep::RequestHandlerSleep() {
 void RequestHandlerSleep::handleRequest(const Request &request_,
                                        Response *response_) noexcept {
   // Log the incoming request (optional, for debug purposes)
-    std::cout << "Received request at /sleep, processing with delay..." << std::endl;
+    LOGGER_DEBUG("Received request at /sleep, processing with delay...");
 
     // Simulate processing time by sleeping
     std::this_thread::sleep_for(std::chrono::seconds(5)); // Sleep for 5 seconds
@@ -39,5 +38,5 @@ void RequestHandlerSleep::handleRequest(const Request &request_,
     response_->prepare_payload(); // Prepare the payload, which calculates Content-Length and other necessary headers
 
     // Log completion of request handling (optional)
-    std::cout << "Request processed and response sent after delay." << std::endl;
+    LOGGER_DEBUG("Request processed and response sent after delay.");
 }
@@ -1,10 +1,10 @@
 // request_handler_static.cc
-#include <iostream>
 #include <fstream>
 #include <boost/beast/http.hpp>
 #include <boost/filesystem.hpp>
 #include "request_handler_static.h"
 #include "../http/mime_types.h"
+#include "../logger.h"
 
 namespace http = boost::beast::http;
 
@@ -32,7 +32,7 @@ void RequestHandlerStatic::handleRequest(const Request &request_, Response *resp
     std::string uri = std::string(request_.target());
     uri.replace(0, prefix.length(), root);
     uri.replace(0, 1, "../"); // Change to relative path
-    std::cout << "RequestHandlerStatic::handleRequest() Serving file: " << uri << std::endl;
+    LOGGER_DEBUG("Serving file: " + uri);
 
     // Serve file
     boost::filesystem::path boost_path(uri);
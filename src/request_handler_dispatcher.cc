@@ -1,14 +1,80 @@
 #include "request_handler_dispatcher.h"
+#include "api/caching_crud_handler.h"
 #include "api/crud_handler.h"
+#include "api/expiring_crud_handler.h"
+#include "api/indexed_crud_handler.h"
+#include "api/log_crud_handler.h"
+#include "api/storage_executor.h"
+#include "api/versioned_crud_handler.h"
 #include "request_handler/request_handler_404.h"
 #include "request_handler/request_handler_api.h"
 #include "request_handler/request_handler_echo.h"
 #include "request_handler/request_handler_static.h"
 #include "request_handler/request_handler_health.h"
+#include "request_handler/request_handler_metrics.h"
 #include "request_handler/request_handler_sleep.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <string>
 #include "logger.h"
+#include "metrics.h"
 
+namespace {
+
+// The storage chains of the API locations, by root. A config reload builds a
+// new dispatcher while the old one still serves the requests in flight, and
+// two chains over the same files would allocate the same ids and compact
+// each other's log segments, so the new dispatcher gets the chain that is
+// already open.
+struct OpenStorage {
+  std::string settings;
+  std::weak_ptr<ICRUDHandler> chain;
+  bool open = false; // until the chain's destructor has finished
+};
+
+std::mutex storage_mutex;
+std::condition_variable storage_closed;
+std::map<std::string, OpenStorage> storages;
+
+/**
+ * openStorage() - Return the chain open over root, or build one. A chain
+ * still being destroyed is waited for, so its threads are done with the files
+ * before a new chain opens them. Settings only take effect on a new chain.
+ */
+std::shared_ptr<ICRUDHandler>
+openStorage(const std::string &root, const std::string &settings,
+            const std::function<std::unique_ptr<ICRUDHandler>()> &build) {
+  std::unique_lock<std::mutex> lock(storage_mutex);
+  OpenStorage &storage = storages[root];
+  std::shared_ptr<ICRUDHandler> chain;
+  storage_closed.wait(lock, [&storage, &chain] {
+    chain = storage.chain.lock();
+    return chain || !storage.open;
+  });
+  if (chain) {
+    if (storage.settings != settings)
+      Logger::getLogger()->logWarningFile(
+          "Storage settings for " + root +
+          " changed; they take effect on restart");
+    return chain;
+  }
+
+  std::unique_ptr<ICRUDHandler> built = build();
+  chain = std::shared_ptr<ICRUDHandler>(
+      built.release(), [root](ICRUDHandler *closing) {
+        delete closing;
+        std::lock_guard<std::mutex> lock(storage_mutex);
+        storages[root].open = false;
+        storage_closed.notify_all();
+      });
+  storage.settings = settings;
+  storage.chain = chain;
+  storage.open = true;
+  return chain;
+}
+
+} // namespace
 
 /**
  * Constructor - Construct the RequestHandler set.
@@ -21,7 +87,8 @@ RequestHandlerDispatcher::RequestHandlerDispatcher(const NginxConfig &config) {
  * getRequestHandler() - Return pointer to corresponding request handler object.
  */
 std::shared_ptr<RequestHandler>
-RequestHandlerDispatcher::getRequestHandler(const std::string &target) const {
+RequestHandlerDispatcher::getRequestHandler(const std::string &target,
+                                            PathUri *matched_prefix) const {
   std::string uri = target;
 
   // Remove trailing slashes
@@ -29,17 +96,19 @@ RequestHandlerDispatcher::getRequestHandler(const std::string &target) const {
     uri.pop_back();
 
   std::shared_ptr<RequestHandler> matched_handler = nullptr;
-  std::string matched_prefix;
+  std::string matched;
 
   for (const auto &entry : handlers_) {
     if (uri.substr(0, entry.first.length()) == entry.first) {
-      if (entry.first.length() > matched_prefix.length()) {
-        matched_prefix = entry.first;
+      if (entry.first.length() > matched.length()) {
+        matched = entry.first;
         matched_handler = entry.second;
       }
     }
   }
 
+  if (matched_prefix)
+    *matched_prefix = matched;
   return matched_handler;
 }
 
@@ -100,18 +169,144 @@ bool RequestHandlerDispatcher::registerPath(PathUri path_uri,
     handlers_[path_uri] = std::make_shared<RequestHandlerEcho>();
   else if (handler_type == "APIHandler") {
     std::string root = "/";
+    std::string storage = "file";
+    size_t cache_size = 0;
+    bool durable = false;
+    long commit_window = 0;
+    FileStorage::Layout layout = FileStorage::kFlat;
+    IndexedCRUDHandler::IndexSpec indexes;
+    RequestHandlerAPI::BodyCheck body_check = RequestHandlerAPI::kNoCheck;
+    size_t io_threads = 4;
+    size_t io_queue = 1024;
     for (const auto &statement : config.statements_) {
       if (statement->tokens_[0] == "root" && statement->tokens_.size() == 2) {
         root = statement->tokens_[1];
+      } else if (statement->tokens_[0] == "storage" &&
+                 statement->tokens_.size() == 2) {
+        storage = statement->tokens_[1];
+      } else if (statement->tokens_[0] == "cache_size" &&
+                 statement->tokens_.size() == 2) {
+        const std::string &size = statement->tokens_[1];
+        if (size.empty() ||
+            size.find_first_not_of("0123456789") != std::string::npos)
+          return false;
+        cache_size = std::stoull(size);
+      } else if (statement->tokens_[0] == "durable_writes" &&
+                 statement->tokens_.size() == 2) {
+        durable = statement->tokens_[1] == "on";
+      } else if (statement->tokens_[0] == "commit_window" &&
+                 statement->tokens_.size() == 2) {
+        // microseconds
+        const std::string &window = statement->tokens_[1];
+        if (window.empty() || window.size() > 9 ||
+            window.find_first_not_of("0123456789") != std::string::npos)
+          return false;
+        commit_window = std::stol(window);
+      } else if (statement->tokens_[0] == "layout" &&
+                 statement->tokens_.size() == 2) {
+        if (statement->tokens_[1] == "sharded")
+          layout = FileStorage::kSharded;
+        else if (statement->tokens_[1] != "flat")
+          return false;
+      } else if ((statement->tokens_[0] == "io_threads" ||
+                  statement->tokens_[0] == "io_queue") &&
+                 statement->tokens_.size() == 2) {
+        // io_threads 0; answers on the network thread
+        const std::string &count = statement->tokens_[1];
+        if (count.empty() || count.size() > 6 ||
+            count.find_first_not_of("0123456789") != std::string::npos)
+          return false;
+        (statement->tokens_[0] == "io_threads" ? io_threads : io_queue) =
+            std::stoul(count);
+      } else if (statement->tokens_[0] == "json_bodies" &&
+                 statement->tokens_.size() == 2) {
+        if (statement->tokens_[1] == "validate")
+          body_check = RequestHandlerAPI::kValidate;
+        else if (statement->tokens_[1] == "minify")
+          body_check = RequestHandlerAPI::kMinify;
+        else if (statement->tokens_[1] != "any")
+          return false;
+      } else if (statement->tokens_[0] == "index") {
+        // index Shoes.color Shoes.details.size;
+        for (size_t i = 1; i < statement->tokens_.size(); i++) {
+          const std::string &index = statement->tokens_[i];
+          size_t dot = index.find('.');
+          if (dot == std::string::npos || dot == 0 || dot + 1 == index.size())
+            return false;
+          indexes[index.substr(0, dot)].insert(index.substr(dot + 1));
+        }
       }
     }
-    CRUDHandler *crud_handler = new CRUDHandler(root);
-    handlers_[path_uri] =
-        std::make_shared<RequestHandlerAPI>(crud_handler, path_uri);
+    if (io_queue == 0 || (storage != "file" && storage != "log"))
+      return false;
+    std::string settings = storage + " " + std::to_string(durable) + " " +
+                           std::to_string(commit_window) + " " +
+                           std::to_string(layout) + " " +
+                           std::to_string(cache_size);
+    for (const auto &index : indexes) {
+      for (const std::string &field : index.second)
+        settings += " " + index.first + "." + field;
+    }
+    std::shared_ptr<ICRUDHandler> crud_handler;
+    CachingCRUDHandler *cache = nullptr; // set if a new chain has one
+    try {
+      crud_handler = openStorage(root, settings, [&] {
+        std::unique_ptr<ICRUDHandler> chain;
+        if (storage == "file")
+          chain.reset(new CRUDHandler(
+              root, durable, std::chrono::microseconds(commit_window), layout));
+        else
+          chain.reset(new LogCRUDHandler(root));
+        // versions back the ETags and conditional requests of every API
+        // location
+        chain.reset(new VersionedCRUDHandler(chain.release()));
+        if (!indexes.empty())
+          chain.reset(new IndexedCRUDHandler(chain.release(), indexes));
+        if (cache_size > 0) {
+          cache = new CachingCRUDHandler(chain.release(), cache_size);
+          chain.reset(cache);
+        }
+        // on top, so expired instances are deleted through the caches and
+        // indexes
+        chain.reset(new ExpiringCRUDHandler(chain.release(), root + ".expiry"));
+        return chain;
+      });
+    } catch (const std::runtime_error &e) {
+      Logger::getLogger()->logErrorFile(e.what());
+      return false;
+    }
+    if (cache) {
+      // read through the chain, so the metrics don't keep storage open
+      std::weak_ptr<ICRUDHandler> chain = crud_handler;
+      metrics::Registry &registry = metrics::Registry::global();
+      registry.callback(
+          "api_cache_hits_total", "API reads answered from the cache.",
+          metrics::Registry::kCounter,
+          [chain, cache] {
+            auto open = chain.lock();
+            return open ? static_cast<double>(cache->hits()) : 0;
+          },
+          {{"location", path_uri}});
+      registry.callback(
+          "api_cache_misses_total", "API reads that went to storage.",
+          metrics::Registry::kCounter,
+          [chain, cache] {
+            auto open = chain.lock();
+            return open ? static_cast<double>(cache->misses()) : 0;
+          },
+          {{"location", path_uri}});
+    }
+    std::shared_ptr<StorageExecutor> executor;
+    if (io_threads > 0)
+      executor = std::make_shared<StorageExecutor>(io_threads, io_queue);
+    handlers_[path_uri] = std::make_shared<RequestHandlerAPI>(
+        crud_handler, path_uri, body_check, executor);
   } else if (handler_type == "HealthHandler") {
     handlers_[path_uri] = std::make_shared<RequestHandlerHealth>();
   } else if (handler_type == "SleepHandler") {
     handlers_[path_uri] = std::make_shared<RequestHandlerSleep>();
+  } else if (handler_type == "MetricsHandler") {
+    handlers_[path_uri] = std::make_shared<RequestHandlerMetrics>();
   } else
     return false;
 
@@ -19,8 +19,10 @@ class RequestHandlerDispatcher {
 public:
   explicit RequestHandlerDispatcher(const NginxConfig &config);
 
+  // If matched_prefix is given, it receives the location that matched.
   virtual std::shared_ptr<RequestHandler>
-  getRequestHandler(const std::string &target) const;
+  getRequestHandler(const std::string &target,
+                    PathUri *matched_prefix = nullptr) const;
   bool registerPath(PathUri path_uri, const std::string &handler_type,
                     const NginxConfig &config);
   size_t initRequestHandlers(const NginxConfig &config);
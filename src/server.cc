@@ -10,22 +10,16 @@
 using boost::asio::ip::tcp;
 
 server::server(boost::asio::io_service &io_service, short port,
-               const NginxConfig &config,
-               const std::map<std::string, std::string> &credentials,
-               short auth_time)
+               std::shared_ptr<const ServerContext> context)
     : io_service_(io_service),
       acceptor_(io_service, tcp::endpoint(tcp::v4(), port)),
-      dispatcher_(std::make_shared<RequestHandlerDispatcher>(config)),
-      credentials_(credentials), auth_time_(auth_time) {
-        std::cout << "helgsdgs: " << auth_time_;
-  auto m_session =
-      std::make_shared<session>(io_service_, dispatcher_, credentials_, auth_time_);
+      context_(std::move(context)) {
+  auto m_session = std::make_shared<session>(io_service_, this->context());
   start_accept(*m_session);
 }
 
 void server::start_accept(session &m_session) {
-  auto new_session =
-      std::make_shared<session>(io_service_, dispatcher_, credentials_, auth_time_);
+  auto new_session = std::make_shared<session>(io_service_, context());
   acceptor_.async_accept(new_session->socket(),
                          boost::bind(&server::handle_accept, this, new_session,
                                      boost::asio::placeholders::error));
@@ -38,3 +32,11 @@ void server::handle_accept(std::shared_ptr<session> new_session,
 
   start_accept(*new_session);
 }
+
+void server::reload(std::shared_ptr<const ServerContext> context) {
+  std::atomic_store(&context_, std::move(context));
+}
+
+std::shared_ptr<const ServerContext> server::context() const {
+  return std::atomic_load(&context_);
+}
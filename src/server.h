@@ -10,6 +10,7 @@
 #include <string>
 #include "config_parser.h" 
 #include "request_handler_dispatcher.h"
+#include "server_context.h"
 #include "session.h"
 
 using boost::asio::ip::tcp;
@@ -19,20 +20,22 @@ class session; // Forward declaration to break circular dependency
 class server {
 public:
   server(boost::asio::io_service &io_service, short port,
-         const NginxConfig &config,
-         const std::map<std::string, std::string> &credentials, short auth_time);
+         std::shared_ptr<const ServerContext> context);
 
   void start_accept(session &m_session);
   void handle_accept(std::shared_ptr<session> new_session,
                      const boost::system::error_code &error);
 
+  // Swap in a new context; sessions accepted from now on use it while
+  // sessions already running keep the old one. Safe to call from any thread.
+  void reload(std::shared_ptr<const ServerContext> context);
+  std::shared_ptr<const ServerContext> context() const;
+
   boost::asio::io_service &io_service_;
   tcp::acceptor acceptor_;
 
 private:
-  std::shared_ptr<RequestHandlerDispatcher> dispatcher_;
-  std::map<std::string, std::string> credentials_;
-  short auth_time_;
+  std::shared_ptr<const ServerContext> context_;
 };
 
 #endif // SERVER_H
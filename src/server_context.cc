@@ -0,0 +1,76 @@
+#include "server_context.h"
+#include "access_log.h"
+#include "config_parser.h"
+#include "credential_store.h"
+#include "request_handler_dispatcher.h"
+#include "session_token.h"
+#include "tracing.h"
+#include <chrono>
+
+const size_t ServerContext::kDefaultMaxRequestSize;
+
+ServerContext::ServerContext(
+    std::shared_ptr<const RequestHandlerDispatcher> dispatcher,
+    std::shared_ptr<const CredentialStore> credentials, short auth_time,
+    std::shared_ptr<const SessionTokenSigner> token_signer,
+    size_t max_request_size, std::shared_ptr<const NginxConfig> config,
+    std::shared_ptr<AccessLog> access_log,
+    std::shared_ptr<tracing::Tracer> tracer)
+    : dispatcher_(dispatcher), credentials_(credentials),
+      auth_time_(auth_time), token_signer_(token_signer),
+      max_request_size_(max_request_size), config_(config),
+      access_log_(access_log), tracer_(tracer) {}
+
+/**
+ * fromConfig() - Build everything sessions share from a parsed config.
+ */
+std::shared_ptr<const ServerContext>
+ServerContext::fromConfig(const NginxConfig &config, std::string *error) {
+  auto fail = [error](const std::string &reason) {
+    if (error)
+      *error = reason;
+    return nullptr;
+  };
+  int auth_time = config.get_auth_time();
+  if (auth_time == -1)
+    return fail("Invalid Auth Time");
+
+  // One credential store, and so one verification cache, for all sessions
+  size_t cache_size;
+  int cache_ttl;
+  if (!config.get_credential_cache(&cache_size, &cache_ttl)) {
+    cache_size = 1024;
+    cache_ttl = 300;
+  }
+  auto credentials = std::make_shared<const CredentialStore>(
+      config.get_credentials(), cache_size, std::chrono::seconds(cache_ttl));
+
+  std::shared_ptr<const SessionTokenSigner> token_signer;
+  std::string secret;
+  int ttl;
+  if (config.get_session_cookie(&secret, &ttl)) {
+    token_signer = std::make_shared<const SessionTokenSigner>(
+        secret, std::chrono::seconds(ttl));
+  }
+
+  std::shared_ptr<AccessLog> access_log;
+  std::string access_log_path = config.get_access_log();
+  if (!access_log_path.empty() &&
+      !(access_log = AccessLog::open(access_log_path)))
+    return fail("Unable to open access log " + access_log_path);
+
+  std::shared_ptr<tracing::Tracer> tracer;
+  std::string trace_path;
+  double sample;
+  if (config.get_tracing(&trace_path, &sample) &&
+      !(tracer = tracing::Tracer::open(trace_path, sample)))
+    return fail("Unable to open trace file " + trace_path);
+
+  long max_request_size = config.get_max_request_size();
+  return std::make_shared<const ServerContext>(
+      std::make_shared<const RequestHandlerDispatcher>(config), credentials,
+      static_cast<short>(auth_time), token_signer,
+      max_request_size == -1 ? kDefaultMaxRequestSize
+                             : static_cast<size_t>(max_request_size),
+      std::make_shared<const NginxConfig>(config), access_log, tracer);
+}
@@ -0,0 +1,77 @@
+/**
+ * Immutable state shared by every session of a server.
+ *
+ * The context is built once from the config and handed to each accepted
+ * session as a single ref-counted pointer, so accepting a connection costs
+ * the same no matter how many users or handlers are configured. Nothing in it
+ * changes after construction; reloading the config builds a new context and
+ * swaps it in, while sessions already in flight keep the one they started
+ * with.
+ */
+
+#ifndef SERVER_CONTEXT_H
+#define SERVER_CONTEXT_H
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+
+class AccessLog;
+class CredentialStore;
+class NginxConfig;
+class RequestHandlerDispatcher;
+class SessionTokenSigner;
+namespace tracing {
+class Tracer;
+}
+
+class ServerContext {
+public:
+  // Default limit on the size of a request, headers and body included.
+  static const size_t kDefaultMaxRequestSize = 8 * 1024 * 1024;
+
+  ServerContext(std::shared_ptr<const RequestHandlerDispatcher> dispatcher,
+                std::shared_ptr<const CredentialStore> credentials,
+                short auth_time,
+                std::shared_ptr<const SessionTokenSigner> token_signer = nullptr,
+                size_t max_request_size = kDefaultMaxRequestSize,
+                std::shared_ptr<const NginxConfig> config = nullptr,
+                std::shared_ptr<AccessLog> access_log = nullptr,
+                std::shared_ptr<tracing::Tracer> tracer = nullptr);
+
+  // Build the dispatcher, credential store, token signer, access log and
+  // tracer described by config. Returns nullptr if the config has no valid
+  // auth time or its access log or trace file can't be opened, and then says
+  // which in *error if given.
+  static std::shared_ptr<const ServerContext>
+  fromConfig(const NginxConfig &config, std::string *error = nullptr);
+
+  const std::shared_ptr<const RequestHandlerDispatcher> &dispatcher() const {
+    return dispatcher_;
+  }
+  const CredentialStore &credentials() const { return *credentials_; }
+  const std::shared_ptr<const SessionTokenSigner> &tokenSigner() const {
+    return token_signer_;
+  }
+  short authTime() const { return auth_time_; }
+  size_t maxRequestSize() const { return max_request_size_; }
+  // The config this context was built from, if any.
+  const std::shared_ptr<const NginxConfig> &config() const { return config_; }
+  // Where sessions record finished requests, or nullptr for nowhere.
+  AccessLog *accessLog() const { return access_log_.get(); }
+  // Where sessions export request traces, or nullptr if tracing is off.
+  tracing::Tracer *tracer() const { return tracer_.get(); }
+
+private:
+  const std::shared_ptr<const RequestHandlerDispatcher> dispatcher_;
+  const std::shared_ptr<const CredentialStore> credentials_;
+  const short auth_time_;
+  const std::shared_ptr<const SessionTokenSigner> token_signer_;
+  const size_t max_request_size_;
+  const std::shared_ptr<const NginxConfig> config_;
+  const std::shared_ptr<AccessLog> access_log_;
+  const std::shared_ptr<tracing::Tracer> tracer_;
+};
+
+#endif // SERVER_CONTEXT_H
@@ -1,36 +1,66 @@
 #include "config_parser.h"
 #include "logger.h"
+#include "metrics.h"
 #include "server.h"
 #include "session.h"
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <csignal>
-#include <cstdlib>
 #include <iostream>
 
 #include "config_parser.h"
 #include "server.h"
+#include "server_context.h"
 #include "session.h"
 
 using boost::asio::ip::tcp;
 
-void signalHandler(int signal) {
-  Logger *logger = Logger::getLogger();
-  logger->logSig();
-  exit(1); // Exit program
+// Set the logging threshold from the config's log_level, or log everything if
+// it has none. Returns false if the level isn't a severity name.
+bool applyLogLevel(const NginxConfig &config) {
+  logging_trivial::severity_level level = logging_trivial::trace;
+  std::string name = config.get_log_level();
+  if (!name.empty() && !Logger::parseLevel(name, &level))
+    return false;
+  Logger::setLevel(level);
+  return true;
+}
+
+// Re-parse config_file on SIGHUP and hand the server a fresh context. The
+// listening port cannot change without a restart.
+void waitForReload(boost::asio::signal_set &signals, server &s,
+                   const char *config_file) {
+  signals.async_wait([&signals, &s, config_file](
+                         const boost::system::error_code &error, int) {
+    if (error)
+      return;
+    Logger *logger = Logger::getLogger();
+    NginxConfigParser parser;
+    NginxConfig config;
+    std::shared_ptr<const ServerContext> context;
+    std::string reason;
+    if (!parser.Parse(config_file, &config))
+      reason = "Unable to parse config file";
+    else if ((context = ServerContext::fromConfig(config, &reason)) &&
+             !applyLogLevel(config))
+      reason = "Invalid Log Level";
+    if (reason.empty()) {
+      s.reload(context);
+      logger->logTraceFile("Reloaded config file");
+    } else {
+      logger->logErrorFile("Unable to reload config file, keeping old one: " +
+                           reason);
+    }
+    waitForReload(signals, s, config_file);
+  });
 }
 
 int main(int argc, char *argv[]) {
   NginxConfigParser parser;
   NginxConfig config;
   Logger *logger = Logger::getLogger();
+  int status = 0;
   try {
-    struct sigaction sigIntHandler;
-    sigIntHandler.sa_handler = signalHandler;
-    sigemptyset(&sigIntHandler.sa_mask);
-    sigIntHandler.sa_flags = 0;
-    sigaction(SIGINT, &sigIntHandler, NULL);
-
     if (argc != 2) {
       logger->logErrorFile("Wrong usage port is needed");
       return 1;
@@ -59,11 +89,50 @@ int main(int argc, char *argv[]) {
     }
     logger->logTraceFile("Auth Time Retrieved!");
 
-    // Store credentials from the config
-    std::map<std::string, std::string> credentials = config.get_credentials();
+    if (!applyLogLevel(config)) {
+      logger->logErrorFile("Invalid Log Level");
+      return -1;
+    }
+
+    size_t log_queue;
+    bool log_block;
+    if (config.get_async_log(&log_queue, &log_block)) {
+      logger->startAsync(log_queue, log_block ? AsyncLogSink::kBlock
+                                              : AsyncLogSink::kDrop);
+      logger->logTraceFile("Logging asynchronously");
+    }
+    metrics::Registry::global().callback(
+        "log_records_dropped_total",
+        "Log records dropped because the asynchronous log queue was full.",
+        metrics::Registry::kCounter,
+        [logger] { return static_cast<double>(logger->droppedRecords()); });
+
+    // Build the state shared by all sessions from the config
+    std::string error;
+    std::shared_ptr<const ServerContext> context =
+        ServerContext::fromConfig(config, &error);
+    if (!context) {
+      logger->logErrorFile(error);
+      return -1;
+    }
 
     boost::asio::io_service io_service;
-    server s(io_service, static_cast<short>(port), config, credentials, auth_time);
+    server s(io_service, static_cast<short>(port), context);
+
+    // Reload the config on SIGHUP by swapping in a new server context
+    boost::asio::signal_set reload_signals(io_service, SIGHUP);
+    waitForReload(reload_signals, s, argv[1]);
+    // Stop on SIGINT and SIGTERM from the io_service, where logging is safe
+    boost::asio::signal_set stop_signals(io_service, SIGINT, SIGTERM);
+    stop_signals.async_wait([logger, &io_service, &status](
+                                const boost::system::error_code &error, int) {
+      if (error)
+        return;
+      logger->logSig();
+      logger->flush();
+      status = 1;
+      io_service.stop();
+    });
     logger->logServerInitialization();
     logger->logTraceFile("Starting server on port " + std::to_string(port));
     logger->logTraceFile("Authorization timeout: " + std::to_string(auth_time) + " seconds");
@@ -72,6 +141,10 @@ int main(int argc, char *argv[]) {
   } catch (std::exception &e) {
     logger->logErrorFile(std::string("Exception: ") + e.what());
   }
+  logger->stopAsync();
+  if (logger->droppedRecords() > 0)
+    logger->logWarningFile("Dropped " + std::to_string(logger->droppedRecords()) +
+                           " log records with the queue full");
 
-  return 0;
+  return status;
 }
@@ -1,8 +1,13 @@
 #include "session.h"
 #include "config_parser.h"
+#include "credential_store.h"
+#include "http/base64.h"
 #include "logger.h"
+#include "metrics.h"
 #include "request_handler_dispatcher.h"
 #include "server.h"
+#include "server_context.h"
+#include "session_token.h"
 #include <boost/asio.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
@@ -13,14 +18,25 @@
 using boost::asio::ip::tcp;
 namespace http = boost::beast::http;
 
+namespace {
+
+metrics::Gauge &requestsInFlight() {
+  static metrics::Gauge &gauge = metrics::Registry::global().gauge(
+      "http_requests_in_flight", "Requests read but not yet answered.");
+  return gauge;
+}
+
+} // namespace
+
 session::session(boost::asio::io_service &io_service,
-                 std::shared_ptr<const RequestHandlerDispatcher> dispatcher,
-                 const std::map<std::string, std::string> &credentials,
-                 short auth_time)
-    : socket_(io_service), dispatcher_(dispatcher), credentials_(credentials),
-      auth_time_(auth_time), last_auth_time_(std::chrono::steady_clock::now()) {
-  Logger *logger = Logger::getLogger();
-  std::cout << "Authorizaiton timeout: " << auth_time_ << "\n";
+                 std::shared_ptr<const ServerContext> context)
+    : socket_(io_service), context_(std::move(context)),
+      last_auth_time_(std::chrono::steady_clock::now()) {}
+
+session::~session() {
+  // the connection failed before the answer went out
+  if (in_flight_)
+    requestsInFlight().add(-1);
 }
 
 tcp::socket &session::socket() { return socket_; }
@@ -34,33 +50,69 @@ void session::handle_read() {
       boost::bind(&session::handle_read_callback, this, self,
                   boost::asio::placeholders::error,
                   boost::asio::placeholders::bytes_transferred));
-  Logger *logger = Logger::getLogger();
-  logger->logDebugFile("Waiting for data from client");
+  LOGGER_DEBUG("Waiting for data from client");
 }
 
 void session::handle_write() {
   auto self(shared_from_this());
-  http::async_write(socket_, response_,
-                    boost::bind(&session::handle_write_callback, this, self,
-                                boost::placeholders::_1,
-                                boost::placeholders::_2));
-  Logger *logger = Logger::getLogger();
-  logger->logDebugFile("Writing response to client");
+  access_.handle_us = lap();
+  access_.status = use_source_response_
+                       ? static_cast<int>(source_response_.result())
+                       : static_cast<int>(response_.result());
+  trace_phase("write");
+  if (context_->tracer() && trace_.context().valid()) {
+    http::response_header<> &header =
+        use_source_response_ ? source_response_.base() : response_.base();
+    header.set("traceresponse", tracing::formatTraceparent(trace_.context()));
+  }
+  if (use_source_response_) {
+    http::async_write(socket_, source_response_,
+                      boost::bind(&session::handle_write_callback, this, self,
+                                  boost::placeholders::_1,
+                                  boost::placeholders::_2));
+  } else {
+    http::async_write(socket_, response_,
+                      boost::bind(&session::handle_write_callback, this, self,
+                                  boost::placeholders::_1,
+                                  boost::placeholders::_2));
+  }
+  LOGGER_DEBUG("Writing response to client");
 }
 
 int session::handle_read_callback(std::shared_ptr<session> self,
                                   boost::system::error_code error,
                                   std::size_t bytes_transferred) {
-  Logger *logger = Logger::getLogger();
   if (!error) {
     buffer_.commit(bytes_transferred); // Ensure the data is ready for reading
+    if (access_.bytes_in == 0) {
+      // the request starts with its first bytes
+      in_flight_ = true;
+      requestsInFlight().add(1);
+      phase_start_ = std::chrono::steady_clock::now();
+      request_start_ = phase_start_;
+      access_.timestamp_us =
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::system_clock::now().time_since_epoch())
+              .count();
+    }
+    access_.bytes_in += bytes_transferred;
 
     try {
+      if (buffer_.size() > context_->maxRequestSize()) {
+        send_payload_too_large_response();
+        return 1;
+      }
+
       // Parse the incoming HTTP request
       http::request_parser<http::string_body> parser;
+      parser.body_limit(context_->maxRequestSize());
       parser.put(buffer_.data(), error);
+      if (error == http::error::body_limit) {
+        send_payload_too_large_response();
+        return 1;
+      }
       if (error) {
-        logger->logErrorFile("Error parsing request: " + error.message());
+        LOGGER_ERROR("Error parsing request: " + error.message());
         response_ =
             http::response<http::string_body>{http::status::bad_request, 11};
         response_.body() = "Bad request";
@@ -71,160 +123,268 @@ int session::handle_read_callback(std::shared_ptr<session> self,
 
       if (parser.is_done()) {
         auto request = parser.release();
-        logger->logTraceHTTPrequest(request, socket_);
+        access_.read_us = lap();
+        if (tracing::Tracer *tracer = context_->tracer()) {
+          auto traceparent = request.find("traceparent");
+          tracer->begin(traceparent == request.end()
+                            ? std::string()
+                            : traceparent->value().to_string(),
+                        request_start_, access_.timestamp_us * 1000, &trace_);
+          trace_.addSpan("read", request_start_, phase_start_);
+          trace_phase("auth");
+        }
+        LOGGER_AT(trace, logTraceHTTPrequest(request, socket_));
 
         // Log if an Authorization header is set
         auto auth_header_it = request.find(http::field::authorization);
         if (auth_header_it != request.end()) {
-          logger->logDebugFile("Authorization header is set: " +
-                               request[http::field::authorization].to_string());
+          LOGGER_DEBUG("Authorization header is set: " +
+                       request[http::field::authorization].to_string());
         } else {
-          logger->logDebugFile("Authorization header is not set");
+          LOGGER_DEBUG("Authorization header is not set");
         }
 
         // Check if the session is expired
         if (is_session_expired()) {
           // Clear the Authorization header if session is expired
           request.set(http::field::authorization, "");
-          logger->logDebugFile(
+          LOGGER_DEBUG(
               "Authorization header is set (after removing): " +
               request[http::field::authorization].to_string());
-          logger->logDebugFile(
+          LOGGER_DEBUG(
               "Authorization header removed due to expired session");
           send_unauthorized_response();
           return 1;
         }
 
+        auto shared_request =
+            std::make_shared<const http::request<http::string_body>>(
+                std::move(request));
+
+        // A valid signed session cookie stands in for Basic credentials
+        if (authenticate_cookie(*shared_request)) {
+          dispatch(shared_request, false);
+          return 0;
+        }
+
         // Check for Authorization header again after potential session
         // expiration
-        auth_header_it = request.find(http::field::authorization);
-        if (auth_header_it == request.end()) {
+        auth_header_it = shared_request->find(http::field::authorization);
+        if (auth_header_it == shared_request->end()) {
           send_unauthorized_response();
           return 1;
         }
 
         std::string auth_header = auth_header_it->value().to_string();
+        bool issue_cookie = context_->tokenSigner() != nullptr;
 
-        if (!authenticate(auth_header)) {
+        // a password that has to be hashed is checked on the verification
+        // threads, and the request carries on once it has been
+        switch (authenticate(auth_header, [this, self, shared_request,
+                                           issue_cookie](bool accepted) {
+          try {
+            if (!accepted) {
+              send_unauthorized_response();
+              return;
+            }
+            dispatch(shared_request, issue_cookie);
+          } catch (...) {
+            LOGGER_ERROR("Exception caught after authentication");
+            send_internal_error_response();
+          }
+        })) {
+        case CredentialStore::kAccepted:
+          dispatch(shared_request, issue_cookie);
+          return 0;
+        case CredentialStore::kPending:
+          return 0;
+        case CredentialStore::kBusy:
+          send_service_unavailable_response();
+          return 1;
+        default:
           send_unauthorized_response();
           return 1;
         }
-
-        // Retrieve the appropriate handler based on the request's target URI
-        auto target = request.target();
-        std::string target_string(target.data(), target.size());
-        auto handler = dispatcher_->getRequestHandler(target_string);
-        std::string handlerTag = "Handler not found";
-        if (!handler) {
-          logger->logErrorFile("No handler found for URI: " + target_string);
-          response_ =
-              http::response<http::string_body>{http::status::not_found, 11};
-          response_.body() = "Not Found";
-          response_.prepare_payload();
-        } else {
-          handlerTag = handler->getName();
-          handler->handleRequest(request, &response_);
-        }
-        logger->logDebugFile("Sending a response message to client...");
-        logger->logDebugFile("Status Code: " + std::to_string(static_cast<int>(
-                                                   response_.result())));
-        logger->logResponse(
-            handlerTag + " " +
-            std::to_string(static_cast<int>(response_.result())));
-        handle_write();
-        return 0;
       }
 
       // Not done reading, continue to read more
       handle_read();
     } catch (...) {
-      logger->logErrorFile("Exception caught in handle_read_callback");
-      response_ = http::response<http::string_body>{
-          http::status::internal_server_error, 11};
-      response_.body() = "Internal Server Error";
-      response_.prepare_payload();
-      handle_write();
+      LOGGER_ERROR("Exception caught in handle_read_callback");
+      send_internal_error_response();
       return 1;
     }
   } else {
-    logger->logErrorFile("Read error: " + error.message());
+    LOGGER_ERROR("Read error: " + error.message());
     return 1;
   }
 }
 
+// Hand an authenticated request to its handler, answering once it is done
+void session::dispatch(
+    std::shared_ptr<const http::request<http::string_body>> request,
+    bool issue_cookie) {
+  auto self(shared_from_this());
+  // Retrieve the appropriate handler based on the request's target URI
+  trace_phase("dispatch");
+  auto target = request->target();
+  std::string target_string(target.data(), target.size());
+  auto handler = context_->dispatcher()->getRequestHandler(target_string,
+                                                           &access_.route);
+  std::string handlerTag = "Handler not found";
+  if (!handler) {
+    LOGGER_ERROR("No handler found for URI: " + target_string);
+    response_ = http::response<http::string_body>{http::status::not_found, 11};
+    response_.body() = "Not Found";
+    response_.prepare_payload();
+  } else {
+    handlerTag = handler->getName();
+    trace_phase("handle");
+    // handlers doing I/O answer from their own threads; the response is
+    // written from this session's executor once they are done
+    bool async = handler->handleAsyncRequest(
+        request, &response_, &source_response_,
+        [this, self, handlerTag, issue_cookie](bool use_source_response) {
+          boost::asio::post(socket_.get_executor(),
+                            [this, self, handlerTag, issue_cookie,
+                             use_source_response] {
+                              use_source_response_ = use_source_response;
+                              send_response(handlerTag, issue_cookie);
+                            });
+        });
+    if (async)
+      return;
+    use_source_response_ =
+        handler->handleSourceRequest(*request, &source_response_);
+    if (!use_source_response_)
+      handler->handleRequest(*request, &response_);
+  }
+  send_response(handlerTag, issue_cookie);
+}
+
+// Finish the response a handler produced and start writing it
+void session::send_response(const std::string &handler_tag, bool issue_cookie) {
+  http::response_header<> &header =
+      use_source_response_ ? source_response_.base() : response_.base();
+  if (issue_cookie) {
+    const auto &signer = context_->tokenSigner();
+    header.set(http::field::set_cookie,
+               signer->cookie(signer->issue(username_)));
+  }
+  LOGGER_DEBUG("Sending a response message to client...");
+  LOGGER_DEBUG("Status Code: " +
+               std::to_string(static_cast<int>(header.result())));
+  LOGGER_AT(info,
+            logResponse(handler_tag + " " +
+                        std::to_string(static_cast<int>(header.result()))));
+  access_.handler = handler_tag;
+  handle_write();
+}
+
 int session::handle_write_callback(std::shared_ptr<session> self,
                                    boost::system::error_code error,
-                                   std::size_t) {
-  Logger *logger = Logger::getLogger();
+                                   std::size_t bytes_transferred) {
+  access_.write_us = lap();
+  access_.bytes_out = bytes_transferred;
+  record_metrics();
+  if (tracing::Tracer *tracer = context_->tracer()) {
+    trace_phase(nullptr);
+    tracer->finish(&trace_, access_.handler, access_.route, access_.status);
+  }
+  if (AccessLog *access_log = context_->accessLog()) {
+    boost::system::error_code ignored_ec;
+    tcp::endpoint remote = socket_.remote_endpoint(ignored_ec);
+    access_.client = ignored_ec ? "" : remote.address().to_string();
+    access_.user = username_;
+    access_log->write(access_);
+  }
   if (!error) {
     // Initiate graceful connection closure.
     boost::system::error_code ignored_ec;
     socket_.shutdown(tcp::socket::shutdown_both, ignored_ec);
-    logger->logDebugFile("Session Complete");
+    LOGGER_DEBUG("Session Complete");
     return 1;
   }
-  logger->logErrorFile("Error passed to handle_write_callback: " +
-                       error.message());
+  LOGGER_ERROR("Error passed to handle_write_callback: " + error.message());
   return 0;
 }
 
-// Base64 decoder function
-std::string base64_decode(const std::string &in) {
-  std::string out;
-  std::vector<int> T(256, -1);
-  for (int i = 0; i < 64; i++)
-    T["ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[i]] =
-        i;
-  int val = 0, valb = -8;
-  for (unsigned char c : in) {
-    if (T[c] == -1)
-      break;
-    val = (val << 6) + T[c];
-    valb += 6;
-    if (valb >= 0) {
-      out.push_back(char((val >> valb) & 0xFF));
-      valb -= 8;
-    }
-  }
-  return out;
-}
-
-// Function which authenticates a user based on the contents of auth_header
-bool session::authenticate(const std::string &auth_header) {
+// Function which authenticates a user based on the contents of auth_header.
+// If the password has to be hashed first, returns kPending and calls done
+// from this session's executor once it has been.
+CredentialStore::Verdict
+session::authenticate(const std::string &auth_header,
+                      std::function<void(bool)> done) {
   const std::string prefix = "Basic ";
   if (auth_header.compare(0, prefix.size(), prefix) != 0) {
-    return false;
+    return CredentialStore::kRejected;
   }
 
-  std::string encoded = auth_header.substr(prefix.size());
-  std::string decoded = base64_decode(encoded);
+  std::string decoded;
+  if (!base64::decode(auth_header.data() + prefix.size(),
+                      auth_header.size() - prefix.size(), &decoded)) {
+    return CredentialStore::kRejected;
+  }
   auto delimiter_pos = decoded.find(':');
   if (delimiter_pos == std::string::npos) {
-    return false;
+    return CredentialStore::kRejected;
   }
 
   std::string username = decoded.substr(0, delimiter_pos);
   std::string password = decoded.substr(delimiter_pos + 1);
 
-  auto it = credentials_.find(username);
-  if (it != credentials_.end() && it->second == password) {
+  // the verification threads hand the verdict back to this session's
+  // executor, which owns username_ and last_auth_time_
+  auto self(shared_from_this());
+  CredentialStore::Verdict verdict = context_->credentials().verifyAsync(
+      username, password,
+      [this, self, username, done = std::move(done)](bool accepted) {
+        boost::asio::post(socket_.get_executor(),
+                          [this, self, username, done, accepted] {
+                            if (accepted) {
+                              last_auth_time_ =
+                                  std::chrono::steady_clock::now();
+                              username_ = username;
+                            }
+                            done(accepted);
+                          });
+      });
+  if (verdict == CredentialStore::kAccepted) {
     // Update the last authentication time
     last_auth_time_ = std::chrono::steady_clock::now();
-    return true;
+    username_ = username;
   }
+  return verdict;
+}
+
+// Function which authenticates a request by its signed session cookie, if
+// session cookies are enabled. Needs no credential lookup.
+bool session::authenticate_cookie(const http::request<http::string_body> &request) {
+  const auto &signer = context_->tokenSigner();
+  if (!signer)
+    return false;
+  auto cookie_it = request.find(http::field::cookie);
+  boost::string_view token;
+  if (cookie_it == request.end() ||
+      !SessionTokenSigner::findToken(cookie_it->value(), &token))
+    return false;
 
-  return false;
+  if (!signer->verify(token, &username_)) {
+    LOGGER_DEBUG("Rejected invalid or expired session cookie");
+    return false;
+  }
+  last_auth_time_ = std::chrono::steady_clock::now();
+  LOGGER_DEBUG("Authenticated " + username_ + " by session cookie");
+  return true;
 }
 
 bool session::is_session_expired() {
   auto now = std::chrono::steady_clock::now();
-  Logger *logger = Logger::getLogger();
   bool expired =
       std::chrono::duration_cast<std::chrono::seconds>(now - last_auth_time_)
-          .count() > auth_time_;
+          .count() > context_->authTime();
   if (expired) {
-    Logger *logger = Logger::getLogger();
-    logger->logDebugFile("Session expired, starting new session...");
+    LOGGER_DEBUG("Session expired, starting new session...");
 
     // Start a new session
     last_auth_time_ = now;
@@ -235,8 +395,7 @@ bool session::is_session_expired() {
 
 // Construct unauthorized response for invalid credentials case
 void session::send_unauthorized_response() {
-  Logger *logger = Logger::getLogger();
-  logger->logDebugFile("Sending 401 Unauthorized response");
+  LOGGER_DEBUG("Sending 401 Unauthorized response");
 
   // Construct response body
   response_ = http::response<http::string_body>{http::status::unauthorized, 11};
@@ -247,8 +406,91 @@ void session::send_unauthorized_response() {
                 "Basic realm=\"User Visible Realm\"");
   response_.body() = "Unauthorized";
   response_.prepare_payload();
-  logger->logResponse(
-            "Unauthorized " +
-            std::to_string(static_cast<int>(response_.result())));
+  LOGGER_AT(info,
+            logResponse("Unauthorized " +
+                        std::to_string(static_cast<int>(response_.result()))));
+  access_.handler = "Unauthorized";
   handle_write();
-}
\ No newline at end of file
+}
+// Construct 503 response for when the password can't be checked right now
+void session::send_service_unavailable_response() {
+  LOGGER_DEBUG("Sending 503 Service Unavailable response");
+
+  response_ =
+      http::response<http::string_body>{http::status::service_unavailable, 11};
+  response_.set(http::field::content_type, "text/plain");
+  response_.set(http::field::retry_after, "1");
+  response_.body() = "Service Unavailable";
+  response_.prepare_payload();
+  LOGGER_AT(info,
+            logResponse("Unavailable " +
+                        std::to_string(static_cast<int>(response_.result()))));
+  access_.handler = "Unavailable";
+  handle_write();
+}
+
+// Construct 500 response for a request that failed unexpectedly
+void session::send_internal_error_response() {
+  use_source_response_ = false;
+  response_ = http::response<http::string_body>{
+      http::status::internal_server_error, 11};
+  response_.body() = "Internal Server Error";
+  response_.prepare_payload();
+  handle_write();
+}
+
+// Construct 413 response for requests over the configured size limit
+void session::send_payload_too_large_response() {
+  LOGGER_DEBUG("Sending 413 Payload Too Large response");
+
+  response_ =
+      http::response<http::string_body>{http::status::payload_too_large, 11};
+  response_.set(http::field::content_type, "text/plain");
+  response_.set(http::field::connection, "close");
+  response_.body() = "Payload Too Large";
+  response_.prepare_payload();
+  LOGGER_AT(info,
+            logResponse("PayloadTooLarge " +
+                        std::to_string(static_cast<int>(response_.result()))));
+  access_.handler = "PayloadTooLarge";
+  handle_write();
+}
+
+// Microseconds since the current phase began, starting the next one
+uint64_t session::lap() {
+  auto now = std::chrono::steady_clock::now();
+  uint64_t elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - phase_start_)
+          .count();
+  phase_start_ = now;
+  return elapsed;
+}
+
+// End the open span of the request's trace and start one for phase name, if
+// it is not null
+void session::trace_phase(const char *name) {
+  trace_.endSpan(trace_span_);
+  trace_span_ =
+      name ? trace_.startSpan(name) : tracing::RequestTrace::kMaxSpans;
+}
+
+// Count the finished request and its latency by handler and status
+void session::record_metrics() {
+  metrics::Registry &registry = metrics::Registry::global();
+  registry
+      .counter("http_requests_total",
+               "Requests answered, by handler and status code.",
+               {{"handler", access_.handler},
+                {"code", std::to_string(access_.status)}})
+      .inc();
+  registry
+      .histogram("http_request_duration_seconds",
+                 "Time from the first byte of a request to the last byte of "
+                 "its response.",
+                 {{"handler", access_.handler}})
+      .record(access_.latency_us());
+  if (in_flight_) {
+    in_flight_ = false;
+    requestsInFlight().add(-1);
+  }
+}
@@ -6,14 +6,20 @@
 #include <boost/beast/http.hpp>
 #include <memory>
 #include <chrono>
+#include <functional>
+#include <string>
+#include "access_log.h"
+#include "credential_store.h"
+#include "http/source_body.h"
+#include "tracing.h"
 
-class RequestHandlerDispatcher;
+class ServerContext;
 
 class session : public std::enable_shared_from_this<session> {
 public:
   explicit session(boost::asio::io_service &io_service,
-                   std::shared_ptr<const RequestHandlerDispatcher> dispatcher,
-                   const std::map<std::string, std::string> &credentials, short auth_time);
+                   std::shared_ptr<const ServerContext> context);
+  ~session();
 
   boost::asio::ip::tcp::socket &socket();
 
@@ -30,16 +36,44 @@ public:
 private:
   void handle_read();
   void handle_write();
-  bool authenticate(const std::string &auth_header);
+  void dispatch(
+      std::shared_ptr<const boost::beast::http::request<
+          boost::beast::http::string_body>>
+          request,
+      bool issue_cookie);
+  void send_response(const std::string &handler_tag, bool issue_cookie);
+  CredentialStore::Verdict authenticate(const std::string &auth_header,
+                                        std::function<void(bool)> done);
+  bool authenticate_cookie(
+      const boost::beast::http::request<boost::beast::http::string_body> &request);
   void send_unauthorized_response();
+  void send_payload_too_large_response();
+  void send_service_unavailable_response();
+  void send_internal_error_response();
   bool is_session_expired();
+  uint64_t lap();
+  void trace_phase(const char *name);
+  void record_metrics();
 
   boost::asio::ip::tcp::socket socket_;
-  const std::map<std::string, std::string> credentials_;
-  std::shared_ptr<const RequestHandlerDispatcher> dispatcher_;
+  // Shared, immutable server state; the only per-server data a session holds
+  std::shared_ptr<const ServerContext> context_;
   boost::beast::http::response<boost::beast::http::string_body> response_;
+  // used instead of response_ when the handler streamed its body
+  boost::beast::http::response<SourceBody> source_response_;
+  bool use_source_response_ = false;
   std::chrono::time_point<std::chrono::steady_clock> last_auth_time_;
-  short auth_time_;
+  std::string username_;
+  // the access log record of the request in progress, filled in phase by
+  // phase; phase_start_ is when the current phase began
+  AccessRecord access_;
+  std::chrono::steady_clock::time_point phase_start_;
+  // the trace of the request in progress, and its span now open
+  tracing::RequestTrace trace_;
+  size_t trace_span_ = tracing::RequestTrace::kMaxSpans;
+  tracing::Clock::time_point request_start_;
+  // whether this session counts toward the requests in flight
+  bool in_flight_ = false;
 };
 
 #endif // SESSION_H
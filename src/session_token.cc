@@ -0,0 +1,111 @@
+#include "session_token.h"
+#include "http/base64.h"
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <stdexcept>
+
+const char *const SessionTokenSigner::kCookieName = "swifties_session";
+
+/**
+ * Constructor - Use the configured secret, or 32 random bytes if none.
+ */
+SessionTokenSigner::SessionTokenSigner(const std::string &secret,
+                                       std::chrono::seconds ttl)
+    : secret_(secret), ttl_(ttl) {
+  if (secret_.empty()) {
+    secret_.resize(32);
+    if (RAND_bytes(reinterpret_cast<unsigned char *>(&secret_[0]),
+                   static_cast<int>(secret_.size())) != 1)
+      throw std::runtime_error("Unable to generate session token secret");
+  }
+}
+
+/**
+ * issue() - Sign username with an expiry ttl from now.
+ */
+std::string SessionTokenSigner::issue(const std::string &username) const {
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  return issue(username,
+               std::chrono::duration_cast<std::chrono::seconds>(now + ttl_)
+                   .count());
+}
+
+std::string SessionTokenSigner::issue(const std::string &username,
+                                      int64_t expires_at) const {
+  std::string payload =
+      base64::encode(username) + "." + std::to_string(expires_at);
+  return payload + "." + base64::encode(mac(payload));
+}
+
+/**
+ * verify() - Constant-time MAC check followed by an expiry check.
+ */
+bool SessionTokenSigner::verify(boost::string_view token,
+                                std::string *username) const {
+  size_t mac_pos = token.rfind('.');
+  if (mac_pos == boost::string_view::npos || mac_pos == 0)
+    return false;
+  boost::string_view payload = token.substr(0, mac_pos);
+  size_t expiry_pos = payload.find('.');
+  if (expiry_pos == boost::string_view::npos)
+    return false;
+
+  std::string presented;
+  boost::string_view encoded_mac = token.substr(mac_pos + 1);
+  if (!base64::decode(encoded_mac.data(), encoded_mac.size(), &presented))
+    return false;
+  std::string expected = mac(payload);
+  if (presented.size() != expected.size() ||
+      CRYPTO_memcmp(presented.data(), expected.data(), expected.size()) != 0)
+    return false;
+
+  // The payload is authentic, so its fields were produced by issue().
+  int64_t expires_at =
+      std::stoll(payload.substr(expiry_pos + 1).to_string());
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(
+                 std::chrono::system_clock::now().time_since_epoch())
+                 .count();
+  if (now >= expires_at)
+    return false;
+  return base64::decode(payload.data(), expiry_pos, username);
+}
+
+std::string SessionTokenSigner::cookie(const std::string &token) const {
+  return std::string(kCookieName) + "=" + token +
+         "; Path=/; Max-Age=" + std::to_string(ttl_.count()) +
+         "; HttpOnly; SameSite=Strict";
+}
+
+/**
+ * findToken() - Pick our cookie out of "a=1; swifties_session=...; b=2".
+ */
+bool SessionTokenSigner::findToken(boost::string_view cookie_header,
+                                   boost::string_view *token) {
+  const boost::string_view name(kCookieName);
+  while (!cookie_header.empty()) {
+    size_t end = cookie_header.find(';');
+    boost::string_view pair = cookie_header.substr(0, end);
+    while (!pair.empty() && pair.front() == ' ')
+      pair.remove_prefix(1);
+    if (pair.size() > name.size() && pair.starts_with(name) &&
+        pair[name.size()] == '=') {
+      *token = pair.substr(name.size() + 1);
+      return true;
+    }
+    if (end == boost::string_view::npos)
+      break;
+    cookie_header.remove_prefix(end + 1);
+  }
+  return false;
+}
+
+std::string SessionTokenSigner::mac(boost::string_view payload) const {
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_len = 0;
+  HMAC(EVP_sha256(), secret_.data(), static_cast<int>(secret_.size()),
+       reinterpret_cast<const unsigned char *>(payload.data()), payload.size(),
+       digest, &digest_len);
+  return std::string(reinterpret_cast<char *>(digest), digest_len);
+}
@@ -0,0 +1,50 @@
+/**
+ * Stateless, HMAC-signed session tokens handed out as cookies after a
+ * successful Basic login.
+ *
+ * A token is "<base64 username>.<expiry unix time>.<base64 HMAC-SHA256>".
+ * Verifying one needs only the server secret, so any connection on any
+ * thread can check it without touching the credential table or shared
+ * mutable state.
+ */
+
+#ifndef SESSION_TOKEN_H
+#define SESSION_TOKEN_H
+
+#include <boost/utility/string_view.hpp>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+class SessionTokenSigner {
+public:
+  static const char *const kCookieName;
+
+  // An empty secret makes the signer generate a random one, which means
+  // tokens do not survive a restart.
+  SessionTokenSigner(const std::string &secret, std::chrono::seconds ttl);
+
+  // Create a token for username that expires ttl from now.
+  std::string issue(const std::string &username) const;
+  std::string issue(const std::string &username, int64_t expires_at) const;
+
+  // Check the MAC and expiry of token; on success store its username.
+  bool verify(boost::string_view token, std::string *username) const;
+
+  // Value for a Set-Cookie header carrying token.
+  std::string cookie(const std::string &token) const;
+
+  // Find our cookie in the value of a Cookie request header.
+  static bool findToken(boost::string_view cookie_header,
+                        boost::string_view *token);
+
+  std::chrono::seconds ttl() const { return ttl_; }
+
+private:
+  std::string mac(boost::string_view payload) const;
+
+  std::string secret_;
+  std::chrono::seconds ttl_;
+};
+
+#endif // SESSION_TOKEN_H
@@ -0,0 +1,33 @@
+// Moves the entities under an APIHandler root from the flat file layout to
+// the sharded one ("layout sharded;"), entity/ab/cd/id.
+//
+// Usage: storage_migrate <root> [entity ...]
+// root is the location's "root" value exactly as configured. Without entity
+// names every entity directory under root is migrated. The server can keep
+// serving the root throughout as long as its location already says
+// "layout sharded;": it reads ids from either spot until they are moved.
+#include "api/file_storage.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s <root> [entity ...]\n", argv[0]);
+    return 1;
+  }
+  FileStorage storage(argv[1], false, std::chrono::microseconds(0),
+                      FileStorage::kSharded);
+  std::vector<std::string> entities(argv + 2, argv + argc);
+  if (entities.empty())
+    entities = storage.listEntities();
+
+  size_t total = 0;
+  for (const std::string &entity : entities) {
+    size_t moved = storage.migrate(entity);
+    total += moved;
+    std::printf("%s: moved %zu\n", entity.c_str(), moved);
+  }
+  std::printf("moved %zu ids in %zu entities\n", total, entities.size());
+  return 0;
+}
@@ -0,0 +1,179 @@
+#include "tracing.h"
+#include "http/json.h"
+#include <random>
+
+namespace tracing {
+
+const size_t RequestTrace::kMaxSpans;
+
+namespace {
+
+std::mt19937_64 &generator() {
+  thread_local std::mt19937_64 generator(std::random_device{}());
+  return generator;
+}
+
+uint64_t randomId() {
+  uint64_t id;
+  do {
+    id = generator()();
+  } while (id == 0);
+  return id;
+}
+
+// Parse the digits lowercase hex digits at text, as the spec requires.
+bool parseHex(const char *text, int digits, uint64_t *value) {
+  *value = 0;
+  for (int i = 0; i < digits; i++) {
+    char c = text[i];
+    int digit;
+    if (c >= '0' && c <= '9')
+      digit = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      digit = c - 'a' + 10;
+    else
+      return false;
+    *value = *value << 4 | digit;
+  }
+  return true;
+}
+
+void appendHex(uint64_t value, int digits, std::string *out) {
+  static const char kDigits[] = "0123456789abcdef";
+  for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4)
+    out->push_back(kDigits[(value >> shift) & 0xf]);
+}
+
+std::string hex(uint64_t value) {
+  std::string out;
+  appendHex(value, 16, &out);
+  return out;
+}
+
+} // namespace
+
+/**
+ * parseTraceparent() - Parse "version-trace_id-parent_id-flags", as in
+ * 00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01.
+ */
+bool parseTraceparent(const std::string &header, SpanContext *context) {
+  const size_t kLength = 55;
+  uint64_t version, flags;
+  if (header.size() < kLength || !parseHex(header.data(), 2, &version) ||
+      version == 0xff || (version == 0 && header.size() != kLength) ||
+      (header.size() > kLength && header[kLength] != '-'))
+    return false;
+  if (header[2] != '-' || header[35] != '-' || header[52] != '-')
+    return false;
+  SpanContext parsed;
+  if (!parseHex(header.data() + 3, 16, &parsed.trace_id_high) ||
+      !parseHex(header.data() + 19, 16, &parsed.trace_id_low) ||
+      !parseHex(header.data() + 36, 16, &parsed.span_id) ||
+      !parseHex(header.data() + 53, 2, &flags) || !parsed.valid())
+    return false;
+  parsed.sampled = flags & 1;
+  *context = parsed;
+  return true;
+}
+
+std::string formatTraceparent(const SpanContext &context) {
+  std::string out = "00-";
+  appendHex(context.trace_id_high, 16, &out);
+  appendHex(context.trace_id_low, 16, &out);
+  out.push_back('-');
+  appendHex(context.span_id, 16, &out);
+  out += context.sampled ? "-01" : "-00";
+  return out;
+}
+
+size_t RequestTrace::startSpan(const char *name) {
+  if (!active_ || count_ == kMaxSpans)
+    return kMaxSpans;
+  Clock::time_point now = Clock::now();
+  spans_[count_] = Span{name, randomId(), now, now};
+  return count_++;
+}
+
+void RequestTrace::endSpan(size_t span) {
+  if (span < count_)
+    spans_[span].end = Clock::now();
+}
+
+void RequestTrace::addSpan(const char *name, Clock::time_point start,
+                           Clock::time_point end) {
+  if (active_ && count_ < kMaxSpans)
+    spans_[count_++] = Span{name, randomId(), start, end};
+}
+
+uint64_t RequestTrace::unixNanos(Clock::time_point time) const {
+  return start_unix_nanos_ +
+         std::chrono::duration_cast<std::chrono::nanoseconds>(time - start_)
+             .count();
+}
+
+std::shared_ptr<Tracer> Tracer::open(const std::string &path,
+                                     double sample_ratio,
+                                     std::chrono::milliseconds flush_interval) {
+  std::unique_ptr<AppendFile> file = AppendFile::open(path, "", flush_interval);
+  if (!file)
+    return nullptr;
+  return std::shared_ptr<Tracer>(new Tracer(std::move(file), sample_ratio));
+}
+
+/**
+ * begin() - Join the caller's trace or start a new one, and decide whether
+ * this request is sampled.
+ */
+void Tracer::begin(const std::string &traceparent, Clock::time_point start,
+                   uint64_t start_unix_nanos, RequestTrace *trace) const {
+  SpanContext parent;
+  if (parseTraceparent(traceparent, &parent)) {
+    trace->context_ = parent;
+    trace->parent_span_id_ = parent.span_id;
+  } else {
+    trace->context_.trace_id_high = randomId();
+    trace->context_.trace_id_low = randomId();
+    trace->context_.sampled =
+        std::uniform_real_distribution<double>()(generator()) < sample_ratio_;
+    trace->parent_span_id_ = 0;
+  }
+  trace->context_.span_id = randomId();
+  trace->active_ = trace->context_.sampled;
+  trace->start_ = start;
+  trace->start_unix_nanos_ = start_unix_nanos;
+  trace->spans_[0] = {"request", trace->context_.span_id, start, start};
+  trace->count_ = 1;
+}
+
+/**
+ * finish() - Write one JSON object per span, the root span carrying the
+ * request's attributes.
+ */
+void Tracer::finish(RequestTrace *trace, const std::string &handler,
+                    const std::string &route, unsigned status) {
+  if (!trace->active_)
+    return;
+  trace->spans_[0].end = Clock::now();
+  std::string trace_id = hex(trace->context_.trace_id_high) +
+                         hex(trace->context_.trace_id_low);
+  std::string out;
+  for (size_t i = 0; i < trace->count_; i++) {
+    const RequestTrace::Span &span = trace->spans_[i];
+    uint64_t parent = i == 0 ? trace->parent_span_id_ : trace->spans_[0].id;
+    out += "{\"trace_id\":\"" + trace_id + "\",\"span_id\":\"" + hex(span.id) +
+           "\",\"parent_span_id\":\"" + (parent ? hex(parent) : "") +
+           "\",\"name\":\"" + span.name + "\",\"start_unix_nano\":" +
+           std::to_string(trace->unixNanos(span.start)) +
+           ",\"end_unix_nano\":" + std::to_string(trace->unixNanos(span.end));
+    if (i == 0) {
+      out += ",\"attributes\":{\"http.handler\":" + json::quote(handler) +
+             ",\"http.route\":" + json::quote(route) +
+             ",\"http.status_code\":" + std::to_string(status) + "}";
+    }
+    out += "}\n";
+  }
+  trace->active_ = false;
+  file_->append(out);
+}
+
+} // namespace tracing
@@ -0,0 +1,113 @@
+/**
+ * Per-request tracing: the phases of a request as spans, exported as JSON
+ * lines.
+ *
+ * A request joins the trace named by its W3C traceparent header, or starts a
+ * new one, and the server's root span is returned to the client in a
+ * traceresponse header. Whether a trace is recorded follows the sampled flag
+ * of the traceparent, and without one a configured fraction of requests is
+ * sampled. An unsampled request costs a branch per phase: spans are recorded
+ * into a fixed array on the session with steady clock timestamps, and only a
+ * sampled trace is turned into text, once the response is written.
+ */
+
+#ifndef TRACING_H
+#define TRACING_H
+
+#include "append_file.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace tracing {
+
+typedef std::chrono::steady_clock Clock;
+
+struct SpanContext {
+  uint64_t trace_id_high = 0;
+  uint64_t trace_id_low = 0;
+  uint64_t span_id = 0;
+  bool sampled = false;
+
+  bool valid() const {
+    return (trace_id_high != 0 || trace_id_low != 0) && span_id != 0;
+  }
+};
+
+// Parse a traceparent header. Returns false unless it is a valid version 00
+// header, or one of a later version that starts like one.
+bool parseTraceparent(const std::string &header, SpanContext *context);
+std::string formatTraceparent(const SpanContext &context);
+
+// The spans of one request. The first span is the request itself, the root
+// the others are children of.
+class RequestTrace {
+public:
+  static const size_t kMaxSpans = 8;
+
+  struct Span {
+    const char *name;
+    uint64_t id;
+    Clock::time_point start;
+    Clock::time_point end;
+  };
+
+  // Whether spans are being recorded; false until Tracer::begin() samples it.
+  bool active() const { return active_; }
+  // The root span, and the span of the caller it continues, if any.
+  const SpanContext &context() const { return context_; }
+  uint64_t parentSpanId() const { return parent_span_id_; }
+
+  // Start a span now, returning a handle for endSpan(). Does nothing unless
+  // active() and there is room left.
+  size_t startSpan(const char *name);
+  void endSpan(size_t span);
+  void addSpan(const char *name, Clock::time_point start,
+               Clock::time_point end);
+
+  size_t spanCount() const { return count_; }
+  const Span &span(size_t i) const { return spans_[i]; }
+  // Nanoseconds since the epoch of a time during the request.
+  uint64_t unixNanos(Clock::time_point time) const;
+
+private:
+  friend class Tracer;
+
+  bool active_ = false;
+  SpanContext context_;
+  uint64_t parent_span_id_ = 0;
+  Clock::time_point start_;
+  uint64_t start_unix_nanos_ = 0;
+  size_t count_ = 0;
+  Span spans_[kMaxSpans];
+};
+
+class Tracer {
+public:
+  // Open path for appending spans, sampling sample_ratio of the requests that
+  // arrive without a traceparent. Returns nullptr if path can't be opened.
+  static std::shared_ptr<Tracer>
+  open(const std::string &path, double sample_ratio,
+       std::chrono::milliseconds flush_interval = std::chrono::seconds(1));
+
+  // Start *trace for a request that began at start, continuing the trace in
+  // traceparent if it is valid.
+  void begin(const std::string &traceparent, Clock::time_point start,
+             uint64_t start_unix_nanos, RequestTrace *trace) const;
+  // End the root span now and export every span of *trace, if it is active.
+  void finish(RequestTrace *trace, const std::string &handler,
+              const std::string &route, unsigned status);
+  void flush() { file_->flush(); }
+
+private:
+  Tracer(std::unique_ptr<AppendFile> file, double sample_ratio)
+      : file_(std::move(file)), sample_ratio_(sample_ratio) {}
+
+  const std::unique_ptr<AppendFile> file_;
+  const double sample_ratio_;
+};
+
+} // namespace tracing
+
+#endif // TRACING_H
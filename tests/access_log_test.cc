@@ -0,0 +1,141 @@
+#include "gtest/gtest.h"
+#include "../src/access_log.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+const char kPath[] = "access_log_test.bin";
+
+AccessRecord makeRecord(const std::string &route, uint32_t status,
+                        uint64_t latency_us) {
+  AccessRecord record;
+  record.timestamp_us = 1700000000000000ULL;
+  record.status = status;
+  record.bytes_in = 120;
+  record.bytes_out = 4096;
+  record.read_us = 1;
+  record.handle_us = latency_us - 2;
+  record.write_us = 1;
+  record.handler = "EchoHandler";
+  record.route = route;
+  record.client = "127.0.0.1";
+  record.user = "user, \"one\"";
+  return record;
+}
+
+std::vector<AccessRecord> readAll(bool *truncated = nullptr) {
+  std::ifstream in(kPath, std::ios::binary);
+  AccessLogReader reader(in);
+  EXPECT_TRUE(reader.valid());
+  std::vector<AccessRecord> records;
+  AccessRecord record;
+  while (reader.next(&record))
+    records.push_back(record);
+  if (truncated)
+    *truncated = reader.truncated();
+  return records;
+}
+
+} // namespace
+
+class AccessLogTest : public ::testing::Test {
+protected:
+  void SetUp() override { std::remove(kPath); }
+  void TearDown() override { std::remove(kPath); }
+};
+
+TEST_F(AccessLogTest, RoundTrip) {
+  AccessRecord first = makeRecord("/echo", 200, 300);
+  AccessRecord second = makeRecord("/api", 404, 1 << 20);
+  second.user.clear();
+  {
+    auto log = AccessLog::open(kPath);
+    ASSERT_NE(nullptr, log);
+    log->write(first);
+    log->write(second);
+  }
+  // reopening appends behind the existing records
+  AccessLog::open(kPath)->write(first);
+
+  bool truncated;
+  std::vector<AccessRecord> records = readAll(&truncated);
+  EXPECT_FALSE(truncated);
+  ASSERT_EQ(3u, records.size());
+  EXPECT_EQ(first.timestamp_us, records[0].timestamp_us);
+  EXPECT_EQ(200u, records[0].status);
+  EXPECT_EQ(4096u, records[0].bytes_out);
+  EXPECT_EQ(300u, records[0].latency_us());
+  EXPECT_EQ("EchoHandler", records[0].handler);
+  EXPECT_EQ("/echo", records[0].route);
+  EXPECT_EQ("127.0.0.1", records[0].client);
+  EXPECT_EQ(first.user, records[0].user);
+  EXPECT_EQ(404u, records[1].status);
+  EXPECT_EQ(uint64_t(1) << 20, records[1].latency_us());
+  EXPECT_EQ("", records[1].user);
+  EXPECT_EQ("/echo", records[2].route);
+}
+
+TEST_F(AccessLogTest, FlushesInTheBackground) {
+  auto log = AccessLog::open(kPath, std::chrono::milliseconds(10));
+  ASSERT_NE(nullptr, log);
+  log->write(makeRecord("/echo", 200, 300));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(1u, readAll().size());
+}
+
+TEST_F(AccessLogTest, DetectsTruncatedRecord) {
+  AccessLog::open(kPath)->write(makeRecord("/echo", 200, 300));
+  AccessLog::open(kPath)->write(makeRecord("/api", 200, 300));
+  std::ifstream in(kPath, std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(in)),
+                   std::istreambuf_iterator<char>());
+  std::ofstream(kPath, std::ios::binary | std::ios::trunc)
+      << data.substr(0, data.size() - 3);
+
+  bool truncated;
+  std::vector<AccessRecord> records = readAll(&truncated);
+  EXPECT_TRUE(truncated);
+  ASSERT_EQ(1u, records.size());
+  EXPECT_EQ("/echo", records[0].route);
+}
+
+TEST_F(AccessLogTest, RefusesOtherFiles) {
+  std::ofstream(kPath) << "[2024-01-01]: not an access log\n";
+  EXPECT_EQ(nullptr, AccessLog::open(kPath));
+  std::ifstream in(kPath, std::ios::binary);
+  EXPECT_FALSE(AccessLogReader(in).valid());
+}
+
+TEST_F(AccessLogTest, SummarizesRoutes) {
+  AccessLogSummary summary;
+  for (uint64_t latency = 10; latency <= 1000; latency += 10)
+    summary.add(makeRecord("/api", latency % 100 == 0 ? 500 : 200, latency));
+  summary.add(makeRecord("/echo", 404, 50));
+
+  ASSERT_EQ(2u, summary.routes().size());
+  const AccessLogSummary::Route &api = summary.routes().at("/api");
+  EXPECT_EQ(100u, api.requests);
+  EXPECT_EQ(10u, api.server_errors);
+  EXPECT_EQ(0u, api.client_errors);
+  EXPECT_EQ(409600u, api.bytes_out);
+  EXPECT_EQ(500u, AccessLogSummary::percentile(api, 0.5));
+  EXPECT_EQ(990u, AccessLogSummary::percentile(api, 0.99));
+  EXPECT_EQ(1000u, AccessLogSummary::percentile(api, 1));
+
+  std::ostringstream csv;
+  summary.writeCsv(csv);
+  EXPECT_EQ("route,requests,4xx,5xx,bytes_in,bytes_out,p50_us,p90_us,p99_us,"
+            "max_us\n"
+            "/api,100,0,10,12000,409600,500,900,990,1000\n"
+            "/echo,1,1,0,120,4096,50,50,50,50\n",
+            csv.str());
+
+  std::ostringstream row;
+  writeCsv(makeRecord("/echo", 200, 300), row);
+  EXPECT_EQ("1700000000000000,200,120,4096,1,298,1,EchoHandler,/echo,"
+            "127.0.0.1,\"user, \"\"one\"\"\"\n",
+            row.str());
+}
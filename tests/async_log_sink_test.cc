@@ -0,0 +1,119 @@
+#include "gtest/gtest.h"
+#include "../src/async_log_sink.h"
+#include <boost/log/attributes/value_extraction.hpp>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions/message.hpp>
+#include <boost/log/sources/logger.hpp>
+#include <boost/log/sources/record_ostream.hpp>
+#include <boost/make_shared.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace logging = boost::log;
+
+// Output sink that keeps the messages it is given, and can be held up to
+// let the ring fill.
+class RecordingSink : public logging::sinks::sink {
+public:
+  RecordingSink() : logging::sinks::sink(true) {}
+  bool will_consume(logging::attribute_value_set const &) override {
+    return true;
+  }
+  void consume(logging::record_view const &rec) override {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return !held; });
+    messages.push_back(*logging::extract<std::string>(
+        logging::expressions::tag::message::get_name(), rec));
+  }
+  void flush() override { flushes++; }
+  void release() {
+    std::lock_guard<std::mutex> lock(mutex);
+    held = false;
+    cv.notify_all();
+  }
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool held = false;
+  std::vector<std::string> messages;
+  int flushes = 0;
+};
+
+class AsyncLogSinkTest : public ::testing::Test {
+protected:
+  void start(size_t capacity, AsyncLogSink::OverflowPolicy policy) {
+    output = boost::make_shared<RecordingSink>();
+    sink = boost::make_shared<AsyncLogSink>(
+        std::vector<boost::shared_ptr<logging::sinks::sink>>{output}, capacity,
+        policy);
+    logging::core::get()->add_sink(sink);
+  }
+  void TearDown() override {
+    logging::core::get()->remove_sink(sink);
+    output->release();
+    sink.reset();
+  }
+  void log(const std::string &message) {
+    BOOST_LOG(lg) << message;
+  }
+
+  logging::sources::logger_mt lg;
+  boost::shared_ptr<RecordingSink> output;
+  boost::shared_ptr<AsyncLogSink> sink;
+};
+
+TEST_F(AsyncLogSinkTest, WritesEveryRecordInOrder) {
+  start(64, AsyncLogSink::kBlock);
+  const int kThreads = 4, kRecords = 5000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t] {
+      for (int i = 0; i < kRecords; i++)
+        log(std::to_string(t) + " " + std::to_string(i));
+    });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+  sink->flush();
+
+  ASSERT_EQ(static_cast<size_t>(kThreads * kRecords), output->messages.size());
+  std::vector<int> next(kThreads, 0);
+  for (const std::string &message : output->messages) {
+    int thread = std::stoi(message);
+    EXPECT_EQ(next[thread]++, std::stoi(message.substr(message.find(' '))));
+  }
+  EXPECT_EQ(0u, sink->dropped());
+  EXPECT_GT(output->flushes, 0);
+  // flushed once per batch, not once per record
+  EXPECT_LT(output->flushes, kThreads * kRecords);
+}
+
+TEST_F(AsyncLogSinkTest, DropsAndCountsWhenFull) {
+  start(8, AsyncLogSink::kDrop);
+  output->held = true;
+  for (int i = 0; i < 100; i++)
+    log(std::to_string(i));
+  // the writer holds one record, the ring at most 8 more
+  EXPECT_GE(sink->dropped(), 91u);
+  output->release();
+  sink->flush();
+  EXPECT_EQ(100u, output->messages.size() + sink->dropped());
+  EXPECT_EQ("0", output->messages.front());
+}
+
+TEST_F(AsyncLogSinkTest, BlocksWhenFull) {
+  start(8, AsyncLogSink::kBlock);
+  output->held = true;
+  std::thread logging_thread([this] {
+    for (int i = 0; i < 100; i++)
+      log(std::to_string(i));
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  output->release();
+  logging_thread.join();
+  sink->flush();
+  EXPECT_EQ(100u, output->messages.size());
+  EXPECT_EQ(0u, sink->dropped());
+}
@@ -0,0 +1,99 @@
+#include "../src/http/base64.h"
+#include "gtest/gtest.h"
+#include <cctype>
+#include <random>
+#include <string>
+#include <vector>
+
+class Base64Test : public ::testing::Test {
+protected:
+  std::vector<base64::Implementation> implementations;
+
+  void SetUp() override {
+    for (auto impl :
+         {base64::Implementation::Scalar, base64::Implementation::SSE41,
+          base64::Implementation::AVX2}) {
+      if (base64::is_supported(impl))
+        implementations.push_back(impl);
+    }
+  }
+
+  std::string randomBytes(size_t len, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::string bytes(len, '\0');
+    for (auto &c : bytes)
+      c = static_cast<char>(gen() & 0xff);
+    return bytes;
+  }
+};
+
+// RFC 4648 section 10 test vectors
+TEST_F(Base64Test, KnownVectors) {
+  const std::pair<std::string, std::string> vectors[] = {
+      {"", ""},         {"f", "Zg=="},         {"fo", "Zm8="},
+      {"foo", "Zm9v"},  {"foob", "Zm9vYg=="},  {"fooba", "Zm9vYmE="},
+      {"foobar", "Zm9vYmFy"}, {"tariq:123", "dGFyaXE6MTIz"}};
+  for (const auto &v : vectors) {
+    EXPECT_EQ(base64::encode(v.first), v.second);
+    std::string decoded;
+    EXPECT_TRUE(base64::decode(v.second, &decoded));
+    EXPECT_EQ(decoded, v.first);
+  }
+}
+
+// Every implementation must agree with the scalar one on every length
+TEST_F(Base64Test, RoundTripAllImplementations) {
+  for (size_t len = 0; len < 300; ++len) {
+    std::string bytes = randomBytes(len, static_cast<unsigned>(len));
+    std::string expected = base64::encode_with(
+        base64::Implementation::Scalar, bytes.data(), bytes.size());
+    EXPECT_EQ(expected.size(), base64::encoded_length(len));
+    for (auto impl : implementations) {
+      std::string encoded = base64::encode_with(impl, bytes.data(), len);
+      ASSERT_EQ(encoded, expected) << base64::implementation_name(impl);
+      std::string decoded;
+      ASSERT_TRUE(base64::decode_with(impl, encoded.data(), encoded.size(),
+                                      &decoded));
+      ASSERT_EQ(decoded, bytes) << base64::implementation_name(impl);
+    }
+  }
+}
+
+// Any byte outside the alphabet is rejected wherever it appears, including
+// positions handled by the vector kernels
+TEST_F(Base64Test, RejectsInvalidCharacters) {
+  std::string valid = base64::encode(randomBytes(96, 7)); // 128 characters
+  for (auto impl : implementations) {
+    for (int c = 0; c < 256; ++c) {
+      bool in_alphabet = std::isalnum(c) || c == '+' || c == '/';
+      if (in_alphabet)
+        continue;
+      for (size_t pos : {size_t(0), size_t(17), size_t(40), size_t(127)}) {
+        std::string bad = valid;
+        bad[pos] = static_cast<char>(c);
+        std::string out;
+        EXPECT_FALSE(base64::decode_with(impl, bad.data(), bad.size(), &out))
+            << base64::implementation_name(impl) << " char " << c << " at "
+            << pos;
+      }
+    }
+  }
+}
+
+TEST_F(Base64Test, RejectsMalformedPadding) {
+  std::string out;
+  EXPECT_FALSE(base64::decode("Zg=", &out));      // length not a multiple of 4
+  EXPECT_FALSE(base64::decode("Zg", &out));       // missing padding
+  EXPECT_FALSE(base64::decode("Z===", &out));     // too much padding
+  EXPECT_FALSE(base64::decode("====", &out));     // padding only
+  EXPECT_FALSE(base64::decode("Zg==Zm9v", &out)); // padding in the middle
+  EXPECT_FALSE(base64::decode("Zh==", &out));     // non-zero trailing bits
+  EXPECT_FALSE(base64::decode("Zm9=", &out));     // non-zero trailing bits
+  EXPECT_TRUE(base64::decode("Zm8=", &out));
+  EXPECT_EQ(out, "fo");
+}
+
+TEST_F(Base64Test, ActiveImplementationIsSupported) {
+  EXPECT_TRUE(base64::is_supported(base64::active_implementation()));
+  EXPECT_TRUE(base64::is_supported(base64::Implementation::Scalar));
+}
@@ -0,0 +1,114 @@
+#include "gtest/gtest.h"
+#include "../src/api/caching_crud_handler.h"
+#include <map>
+
+// in-memory backend that counts how often it is consulted
+class CountingCRUDHandler : public ICRUDHandler {
+public:
+    std::map<std::string, std::map<int, std::string>> data;
+    int reads = 0;
+    int exists_calls = 0;
+
+    std::string create(const std::string& entity, const std::string& body) override {
+        int id = 1;
+        while (data[entity].count(id))
+            id++;
+        data[entity][id] = body;
+        return "{\"id\": " + std::to_string(id) + "}";
+    }
+    std::string read(const std::string& entity, int id) override {
+        reads++;
+        return data[entity].count(id) ? data[entity][id] : "";
+    }
+    bool update(const std::string& entity, int id, const std::string& body) override {
+        if (!data[entity].count(id))
+            return false;
+        data[entity][id] = body;
+        return true;
+    }
+    bool delete_(const std::string& entity, int id) override {
+        return data[entity].erase(id) > 0;
+    }
+    bool exists(const std::string& entity, int id) override {
+        exists_calls++;
+        return data[entity].count(id) > 0;
+    }
+    std::vector<int> list(const std::string& entity) override {
+        std::vector<int> ids;
+        for (const auto& entry : data[entity])
+            ids.push_back(entry.first);
+        return ids;
+    }
+};
+
+class CachingCRUDHandlerTest : public ::testing::Test {
+protected:
+    CountingCRUDHandler* backend = new CountingCRUDHandler();
+    CachingCRUDHandler cache{backend, 1024 * 1024};
+    const std::string entity = "Shoes";
+};
+
+TEST_F(CachingCRUDHandlerTest, RepeatedReadsServedFromMemory) {
+    cache.create(entity, "red");
+    for (int i = 0; i < 10; i++) {
+        EXPECT_TRUE(cache.exists(entity, 1));
+        EXPECT_EQ("red", cache.read(entity, 1));
+    }
+    EXPECT_EQ(1, backend->reads);
+    EXPECT_EQ(2, backend->exists_calls);
+    EXPECT_EQ(2u, cache.misses());
+    EXPECT_EQ(18u, cache.hits());
+}
+
+TEST_F(CachingCRUDHandlerTest, MissesAreCached) {
+    for (int i = 0; i < 5; i++) {
+        EXPECT_FALSE(cache.exists(entity, 42));
+        EXPECT_EQ("", cache.read(entity, 42));
+    }
+    EXPECT_EQ(1, backend->exists_calls);
+    EXPECT_EQ(0, backend->reads);
+}
+
+TEST_F(CachingCRUDHandlerTest, CreateClearsCachedMiss) {
+    EXPECT_FALSE(cache.exists(entity, 1));
+    cache.create(entity, "blue");
+    EXPECT_TRUE(cache.exists(entity, 1));
+    EXPECT_EQ("blue", cache.read(entity, 1));
+}
+
+TEST_F(CachingCRUDHandlerTest, UpdateAndDeleteInvalidate) {
+    cache.create(entity, "v1");
+    EXPECT_EQ("v1", cache.read(entity, 1));
+
+    EXPECT_TRUE(cache.update(entity, 1, "v2"));
+    EXPECT_EQ("v2", cache.read(entity, 1));
+
+    EXPECT_TRUE(cache.delete_(entity, 1));
+    EXPECT_FALSE(cache.exists(entity, 1));
+    EXPECT_EQ("", cache.read(entity, 1));
+}
+
+TEST_F(CachingCRUDHandlerTest, StaysWithinByteBudget) {
+    CountingCRUDHandler* small_backend = new CountingCRUDHandler();
+    const size_t budget = CachingCRUDHandler::kShards * 512;
+    CachingCRUDHandler small(small_backend, budget);
+    for (int i = 0; i < 200; i++) {
+        small.create(entity, std::string(100, 'x'));
+        small.read(entity, i + 1);
+        EXPECT_LE(small.bytes(), budget);
+    }
+    EXPECT_LT(small.entries(), 200u);
+
+    // bodies larger than a shard are never cached
+    small.create(entity, std::string(1000, 'y'));
+    small.read(entity, 201);
+    int reads = small_backend->reads;
+    small.read(entity, 201);
+    EXPECT_EQ(reads + 1, small_backend->reads);
+}
+
+TEST_F(CachingCRUDHandlerTest, ListPassesThrough) {
+    cache.create(entity, "a");
+    cache.create(entity, "b");
+    EXPECT_EQ(std::vector<int>({1, 2}), cache.list(entity));
+}
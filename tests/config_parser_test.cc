@@ -223,4 +223,130 @@ TEST_F(NginxConfigParserTestFixture, AuthTimeTest) {
 
   // Assert that the auth_time matches the expected value
   EXPECT_EQ(auth_time, expected_auth_time);
-}
\ No newline at end of file
+}
+TEST_F(NginxConfigParserTestFixture, SessionCookieTest) {
+  std::string config = R"(
+  server {
+      port 80;
+      session_cookie {
+          secret s3cr3t;
+          ttl 600;
+      }
+  }
+  )";
+
+  ASSERT_TRUE(ParseString(config));
+
+  std::string secret;
+  int ttl;
+  ASSERT_TRUE(out_config.get_session_cookie(&secret, &ttl));
+  EXPECT_EQ(secret, "s3cr3t");
+  EXPECT_EQ(ttl, 600);
+}
+
+TEST_F(NginxConfigParserTestFixture, SessionCookieDisabledTest) {
+  ASSERT_TRUE(ParseString("server { port 80; timer 20; }"));
+
+  std::string secret;
+  int ttl;
+  EXPECT_FALSE(out_config.get_session_cookie(&secret, &ttl));
+}
+
+TEST_F(NginxConfigParserTestFixture, CredentialCacheTest) {
+  std::string config = R"(
+  server {
+      port 80;
+      credentials {
+          tariq:$2b$04$sGp3JiWWKBspdBLxSLpH9eudRr4Xu6MldxqdYAIy/BQ8sQ8ByjXKq;
+      }
+      credential_cache {
+          size 64;
+          ttl 30;
+      }
+  }
+  )";
+
+  ASSERT_TRUE(ParseString(config));
+
+  size_t size;
+  int ttl;
+  ASSERT_TRUE(out_config.get_credential_cache(&size, &ttl));
+  EXPECT_EQ(size, 64);
+  EXPECT_EQ(ttl, 30);
+  EXPECT_EQ(out_config.get_credentials()["tariq"],
+            "$2b$04$sGp3JiWWKBspdBLxSLpH9eudRr4Xu6MldxqdYAIy/BQ8sQ8ByjXKq");
+}
+
+TEST_F(NginxConfigParserTestFixture, AsyncLogTest) {
+  std::string config = R"(
+  server {
+      port 80;
+      async_log {
+          queue 4096;
+          overflow block;
+      }
+  }
+  )";
+
+  ASSERT_TRUE(ParseString(config));
+
+  size_t queue;
+  bool block;
+  ASSERT_TRUE(out_config.get_async_log(&queue, &block));
+  EXPECT_EQ(queue, 4096);
+  EXPECT_TRUE(block);
+}
+
+TEST_F(NginxConfigParserTestFixture, CredentialsAfterOtherBlocks) {
+  std::string config = R"(
+  server {
+      port 80;
+      async_log {
+          queue 4096;
+      }
+      credentials {
+          tariq:123;
+      }
+  }
+  )";
+
+  ASSERT_TRUE(ParseString(config));
+  EXPECT_EQ(out_config.get_credentials()["tariq"], "123");
+}
+
+TEST_F(NginxConfigParserTestFixture, LogLevelTest) {
+  std::string config = R"(
+  server {
+      port 80;
+      log_level warning;
+  }
+  )";
+
+  ASSERT_TRUE(ParseString(config));
+  EXPECT_EQ(out_config.get_log_level(), "warning");
+}
+
+TEST_F(NginxConfigParserTestFixture, AccessLogTest) {
+  ASSERT_TRUE(ParseString("server { port 80; access_log ../logs/access.bin; }"));
+  EXPECT_EQ(out_config.get_access_log(), "../logs/access.bin");
+}
+
+TEST_F(NginxConfigParserTestFixture, TracingTest) {
+  std::string config = R"(
+  server {
+      port 80;
+      tracing {
+          file ../logs/traces.jsonl;
+          sample 0.25;
+      }
+  }
+  )";
+
+  ASSERT_TRUE(ParseString(config));
+
+  std::string file;
+  double sample;
+  ASSERT_TRUE(out_config.get_tracing(&file, &sample));
+  EXPECT_EQ(file, "../logs/traces.jsonl");
+  EXPECT_EQ(sample, 0.25);
+}
@@ -0,0 +1,136 @@
+#include "../src/credential_store.h"
+#include "gtest/gtest.h"
+#include <future>
+#include <thread>
+#include <vector>
+
+class CredentialStoreTest : public ::testing::Test {
+protected:
+  // bcrypt (cost 4) of "123" and scrypt of "789"
+  const std::string BCRYPT_123 =
+      "$2b$04$sGp3JiWWKBspdBLxSLpH9eudRr4Xu6MldxqdYAIy/BQ8sQ8ByjXKq";
+  const std::string SCRYPT_789 = "$7$CU..../....ShPbD1SHhOeepBBUhLur..$"
+                                 "al6usvHPj9NtdNgGUf0GBwh9y1jkfp9Hv5ehwI2CXQC";
+
+  std::map<std::string, std::string> credentials() {
+    return {{"tariq", BCRYPT_123}, {"milly", "456"}, {"shravan", SCRYPT_789}};
+  }
+};
+
+TEST_F(CredentialStoreTest, VerifiesHashedAndPlaintextPasswords) {
+  CredentialStore store(credentials());
+  EXPECT_TRUE(store.verify("tariq", "123"));
+  EXPECT_TRUE(store.verify("shravan", "789"));
+  EXPECT_TRUE(store.verify("milly", "456"));
+  EXPECT_FALSE(store.verify("tariq", "1234"));
+  EXPECT_FALSE(store.verify("milly", "45"));
+  EXPECT_FALSE(store.verify("nobody", "123"));
+}
+
+TEST_F(CredentialStoreTest, DetectsHashes) {
+  EXPECT_TRUE(CredentialStore::isHash(BCRYPT_123));
+  EXPECT_FALSE(CredentialStore::isHash("123"));
+  EXPECT_FALSE(CredentialStore::isHash(""));
+}
+
+TEST_F(CredentialStoreTest, SuccessfulVerificationIsCached) {
+  CredentialStore store(credentials());
+  EXPECT_TRUE(store.verify("tariq", "123"));
+  EXPECT_EQ(store.cacheMisses(), 1);
+  EXPECT_TRUE(store.verify("tariq", "123"));
+  EXPECT_TRUE(store.verify("tariq", "123"));
+  EXPECT_EQ(store.cacheHits(), 2);
+  EXPECT_EQ(store.cacheMisses(), 1);
+
+  // A wrong password never matches the cached entry
+  EXPECT_FALSE(store.verify("tariq", "321"));
+  EXPECT_EQ(store.cacheHits(), 2);
+}
+
+TEST_F(CredentialStoreTest, CacheEntriesExpire) {
+  CredentialStore store(credentials(), 16, std::chrono::seconds(0));
+  EXPECT_TRUE(store.verify("tariq", "123"));
+  EXPECT_TRUE(store.verify("tariq", "123"));
+  EXPECT_EQ(store.cacheHits(), 0);
+  EXPECT_EQ(store.cacheMisses(), 2);
+}
+
+TEST_F(CredentialStoreTest, CacheIsBounded) {
+  CredentialStore store(credentials(), 1);
+  EXPECT_TRUE(store.verify("tariq", "123"));
+  EXPECT_TRUE(store.verify("shravan", "789")); // evicts tariq
+  EXPECT_TRUE(store.verify("tariq", "123"));
+  EXPECT_EQ(store.cacheHits(), 0);
+  EXPECT_EQ(store.cacheMisses(), 3);
+}
+
+TEST_F(CredentialStoreTest, ConcurrentVerification) {
+  CredentialStore store(credentials());
+  std::vector<std::thread> threads;
+  std::atomic<int> failures{0};
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 100; ++i) {
+        if (!store.verify("tariq", "123") || store.verify("tariq", "x"))
+          failures++;
+      }
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+  EXPECT_EQ(failures, 0);
+}
+
+TEST_F(CredentialStoreTest, FailedVerificationIsCached) {
+  CredentialStore store(credentials());
+  EXPECT_FALSE(store.verify("tariq", "321"));
+  EXPECT_FALSE(store.verify("tariq", "321"));
+  EXPECT_EQ(store.rejectedHits(), 1);
+  EXPECT_EQ(store.cacheMisses(), 1);
+
+  // Only that password is rejected without hashing
+  EXPECT_TRUE(store.verify("tariq", "123"));
+  EXPECT_EQ(store.cacheMisses(), 2);
+}
+
+TEST_F(CredentialStoreTest, VerifyAsyncHashesOffTheCallingThread) {
+  CredentialStore store(credentials());
+  std::promise<std::pair<bool, std::thread::id>> result;
+  EXPECT_EQ(store.verifyAsync("tariq", "123",
+                              [&result](bool accepted) {
+                                result.set_value(std::make_pair(
+                                    accepted, std::this_thread::get_id()));
+                              }),
+            CredentialStore::kPending);
+  auto verdict = result.get_future().get();
+  EXPECT_TRUE(verdict.first);
+  EXPECT_NE(verdict.second, std::this_thread::get_id());
+
+  // Answered from the cache, without calling back
+  auto never = [](bool) { ADD_FAILURE(); };
+  EXPECT_EQ(store.verifyAsync("tariq", "123", never),
+            CredentialStore::kAccepted);
+  EXPECT_EQ(store.verifyAsync("milly", "456", never),
+            CredentialStore::kAccepted);
+  EXPECT_EQ(store.verifyAsync("milly", "45", never),
+            CredentialStore::kRejected);
+}
+
+TEST_F(CredentialStoreTest, UnknownUsersAreHashedToo) {
+  CredentialStore store(credentials());
+  std::promise<bool> result;
+  EXPECT_EQ(store.verifyAsync("nobody", "123",
+                              [&result](bool accepted) {
+                                result.set_value(accepted);
+                              }),
+            CredentialStore::kPending);
+  EXPECT_FALSE(result.get_future().get());
+  EXPECT_EQ(store.cacheMisses(), 1);
+  EXPECT_FALSE(store.verify("nobody", "123"));
+  EXPECT_EQ(store.rejectedHits(), 1);
+
+  // with no hashed passwords there is nothing to time
+  CredentialStore plain(std::map<std::string, std::string>{{"milly", "456"}});
+  EXPECT_EQ(plain.verifyAsync("nobody", "123", [](bool) { ADD_FAILURE(); }),
+            CredentialStore::kRejected);
+}
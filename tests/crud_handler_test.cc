@@ -1,7 +1,12 @@
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 #include "../src/api/crud_handler.h"
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
+#include <set>
+#include <thread>
+#include <vector>
 
 
 class CRUDHandlerTest : public ::testing::Test {
@@ -9,6 +14,7 @@ private:
     const std::string TEST_FS_DIRECTORY = "../fs_test";
 
 protected:
+    const std::string TEST_BASE_PATH = TEST_FS_DIRECTORY;
     CRUDHandler *crudHandler;
 
     // Variables to hold test data
@@ -32,8 +38,9 @@ public:
 
     void TearDown() override {
         // Clean up the test directory after each test
-        std::filesystem::remove_all(TEST_FS_DIRECTORY);
         delete crudHandler;
+        std::filesystem::remove_all(TEST_FS_DIRECTORY);
+        std::filesystem::remove_all(TEST_FS_DIRECTORY + entity);
     }
 };
 
@@ -81,4 +88,206 @@ TEST_F(CRUDHandlerTest, NonExistentOperations) {
     // Test delete on non-existent entity
     bool deleteResult = crudHandler->delete_(entity, nonExistentId);
     EXPECT_FALSE(deleteResult);
-}
\ No newline at end of file
+}
+
+// Test that deleted ids are handed out again, lowest first
+TEST_F(CRUDHandlerTest, ReusesLowestFreedId) {
+    for (int i = 0; i < 4; i++) {
+        crudHandler->create(entity, data);
+    }
+    EXPECT_TRUE(crudHandler->delete_(entity, 3));
+    EXPECT_TRUE(crudHandler->delete_(entity, 2));
+
+    EXPECT_EQ("{\"id\": 2}", crudHandler->create(entity, data));
+    EXPECT_EQ("{\"id\": 3}", crudHandler->create(entity, data));
+    EXPECT_EQ("{\"id\": 5}", crudHandler->create(entity, data));
+}
+
+// Test that a new handler recovers the ids already on disk
+TEST_F(CRUDHandlerTest, RecoversIdsFromDisk) {
+    for (int i = 0; i < 3; i++) {
+        crudHandler->create(entity, data);
+    }
+    crudHandler->delete_(entity, 2);
+
+    CRUDHandler restarted(TEST_BASE_PATH);
+    EXPECT_EQ("{\"id\": 2}", restarted.create(entity, data));
+    EXPECT_EQ("{\"id\": 4}", restarted.create(entity, data));
+    EXPECT_EQ(data, restarted.read(entity, 1));
+}
+
+// Test that concurrent creates never hand out the same id twice
+TEST_F(CRUDHandlerTest, ConcurrentCreatesGetDistinctIds) {
+    const int kThreads = 8;
+    const int kPerThread = 25;
+    std::vector<std::vector<std::string>> results(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([this, t, &results, kPerThread]() {
+            for (int i = 0; i < kPerThread; i++) {
+                results[t].push_back(crudHandler->create(entity, data));
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    std::set<std::string> ids;
+    for (const auto &result : results) {
+        ids.insert(result.begin(), result.end());
+    }
+    EXPECT_EQ(kThreads * kPerThread, (int)ids.size());
+    EXPECT_TRUE(crudHandler->exists(entity, kThreads * kPerThread));
+}
+
+// Test that list reflects creates and deletes in ascending order
+TEST_F(CRUDHandlerTest, ListTracksCreatesAndDeletes) {
+    EXPECT_TRUE(crudHandler->list(entity).empty());
+    for (int i = 0; i < 4; i++) {
+        crudHandler->create(entity, data);
+    }
+    crudHandler->delete_(entity, 2);
+    EXPECT_EQ(std::vector<int>({1, 3, 4}), crudHandler->list(entity));
+
+    CRUDHandler restarted(TEST_BASE_PATH);
+    EXPECT_EQ(std::vector<int>({1, 3, 4}), restarted.list(entity));
+}
+
+// Stress test: concurrent updates and reads of the same keys never expose a
+// torn or empty body, and concurrent create/delete churn leaves exactly the
+// surviving ids behind
+TEST_F(CRUDHandlerTest, ConcurrentMixedOperationsStress) {
+    const int kThreads = 8;
+    const int kIterations = 300;
+    const int kSharedKeys = 16;
+    const size_t kBodySize = 32;
+    auto body = [kBodySize](int thread, int iteration) {
+        std::string value = std::to_string(thread) + "-" + std::to_string(iteration);
+        return value + std::string(kBodySize - value.size(), '.');
+    };
+
+    for (int i = 0; i < kSharedKeys; i++)
+        crudHandler->create(entity, body(0, 0));
+
+    std::atomic<int> bad_reads{0};
+    std::vector<std::vector<int>> kept(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t]() {
+            const std::string own = "Stress" + std::to_string(t % 2);
+            for (int i = 0; i < kIterations; i++) {
+                int key = 1 + (i * 7 + t) % kSharedKeys;
+                if (i % 2 == 0) {
+                    EXPECT_TRUE(crudHandler->update(entity, key, body(t, i)));
+                } else if (!crudHandler->exists(entity, key) ||
+                           crudHandler->read(entity, key).size() != kBodySize) {
+                    bad_reads++;
+                }
+
+                // churn on entities shared by half the threads
+                std::string created = crudHandler->create(own, body(t, i));
+                int id = std::stoi(created.substr(created.find(':') + 1));
+                if (i % 3 == 0) {
+                    EXPECT_TRUE(crudHandler->delete_(own, id));
+                } else {
+                    kept[t].push_back(id);
+                }
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    EXPECT_EQ(0, bad_reads.load());
+    for (int parity = 0; parity < 2; parity++) {
+        std::vector<int> expected;
+        for (int t = parity; t < kThreads; t += 2)
+            expected.insert(expected.end(), kept[t].begin(), kept[t].end());
+        std::sort(expected.begin(), expected.end());
+        const std::string own = "Stress" + std::to_string(parity);
+        EXPECT_EQ(expected, crudHandler->list(own));
+        std::filesystem::remove_all(TEST_BASE_PATH + own);
+    }
+}
+
+// Test paging through ids with list(entity, after, limit)
+TEST_F(CRUDHandlerTest, ListPage) {
+    for (int i = 0; i < 6; i++) {
+        crudHandler->create(entity, data);
+    }
+    crudHandler->delete_(entity, 3);
+    EXPECT_EQ(std::vector<int>({1, 2}), crudHandler->list(entity, 0, 2));
+    EXPECT_EQ(std::vector<int>({4, 5}), crudHandler->list(entity, 2, 2));
+    EXPECT_EQ(std::vector<int>({6}), crudHandler->list(entity, 5, 10));
+    EXPECT_TRUE(crudHandler->list(entity, 6, 10).empty());
+}
+
+// Test that a batch runs its operations in order and reports each outcome
+TEST_F(CRUDHandlerTest, BatchOperations) {
+    crudHandler->create(entity, data);
+    std::vector<BatchOperation> ops(6);
+    ops[0].type = BatchOperation::kCreate;
+    ops[0].data = "two";
+    ops[1].type = BatchOperation::kUpdate;
+    ops[1].id = 1;
+    ops[1].data = "one";
+    ops[2].type = BatchOperation::kUpdate;   // created by ops[0] in the same run
+    ops[2].id = 2;
+    ops[2].data = "TWO";
+    ops[3].type = BatchOperation::kRead;
+    ops[3].id = 2;
+    ops[4].type = BatchOperation::kDelete;
+    ops[4].id = 1;
+    ops[5].type = BatchOperation::kUpdate;   // deleted by ops[4]
+    ops[5].id = 1;
+    ops[5].data = "gone";
+    for (BatchOperation& op : ops) {
+        op.entity = entity;
+    }
+
+    std::vector<BatchResult> results = crudHandler->batch(ops);
+    ASSERT_EQ(ops.size(), results.size());
+    EXPECT_TRUE(results[0].ok);
+    EXPECT_EQ(2, results[0].id);
+    EXPECT_TRUE(results[1].ok);
+    EXPECT_TRUE(results[2].ok);
+    EXPECT_TRUE(results[3].ok);
+    EXPECT_EQ("TWO", results[3].data);
+    EXPECT_TRUE(results[4].ok);
+    EXPECT_FALSE(results[5].ok);
+    EXPECT_EQ(std::vector<int>({2}), crudHandler->list(entity));
+}
+
+// Test that every create of a durable batch lands
+TEST_F(CRUDHandlerTest, DurableBatch) {
+    CRUDHandler durable(TEST_BASE_PATH, true);
+    std::vector<BatchOperation> ops(20);
+    for (BatchOperation& op : ops) {
+        op.type = BatchOperation::kCreate;
+        op.entity = entity;
+        op.data = data;
+    }
+    std::vector<BatchResult> results = durable.batch(ops);
+    for (size_t i = 0; i < results.size(); i++) {
+        EXPECT_TRUE(results[i].ok);
+        EXPECT_EQ(static_cast<int>(i) + 1, results[i].id);
+    }
+    EXPECT_EQ(20u, durable.list(entity).size());
+}
+
+// Test that a sharded CRUDHandler picks up ids stored flat and keeps working
+TEST_F(CRUDHandlerTest, ShardedLayoutOverFlatData) {
+    crudHandler->create(entity, "one");
+    crudHandler->create(entity, "two");
+    CRUDHandler sharded(TEST_BASE_PATH, false, std::chrono::microseconds(0),
+                        FileStorage::kSharded);
+    EXPECT_EQ(std::vector<int>({1, 2}), sharded.list(entity));
+    EXPECT_EQ("one", sharded.read(entity, 1));
+    EXPECT_EQ("{\"id\": 3}", sharded.create(entity, "three"));
+    EXPECT_TRUE(sharded.update(entity, 1, "uno"));
+    EXPECT_TRUE(sharded.delete_(entity, 2));
+    EXPECT_FALSE(sharded.exists(entity, 2));
+    EXPECT_EQ(std::vector<int>({1, 3}), sharded.list(entity));
+    EXPECT_EQ("uno", sharded.read(entity, 1));
+}
@@ -0,0 +1,168 @@
+#include "gtest/gtest.h"
+#include "../src/api/expiring_crud_handler.h"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <map>
+#include <thread>
+
+// in-memory backend
+class MemoryCRUDHandler : public ICRUDHandler {
+public:
+    std::map<std::string, std::map<int, std::string>> data;
+
+    std::string create(const std::string& entity, const std::string& body) override {
+        int id = 1;
+        while (data[entity].count(id))
+            id++;
+        data[entity][id] = body;
+        return "{\"id\": " + std::to_string(id) + "}";
+    }
+    std::string read(const std::string& entity, int id) override {
+        return data[entity].count(id) ? data[entity][id] : "";
+    }
+    bool update(const std::string& entity, int id, const std::string& body) override {
+        if (!data[entity].count(id))
+            return false;
+        data[entity][id] = body;
+        return true;
+    }
+    bool delete_(const std::string& entity, int id) override {
+        return data[entity].erase(id) > 0;
+    }
+    bool exists(const std::string& entity, int id) override {
+        return data[entity].count(id) > 0;
+    }
+    std::vector<int> list(const std::string& entity) override {
+        std::vector<int> ids;
+        for (const auto& entry : data[entity])
+            ids.push_back(entry.first);
+        return ids;
+    }
+};
+
+class ExpiringCRUDHandlerTest : public ::testing::Test {
+protected:
+    void SetUp() override { boost::filesystem::remove(journal); }
+    void TearDown() override { boost::filesystem::remove(journal); }
+
+    ExpiringCRUDHandler* makeHandler(MemoryCRUDHandler* backend) {
+        return new ExpiringCRUDHandler(backend, journal, std::chrono::milliseconds(0),
+                                       [this] { return now.load(); });
+    }
+
+    const std::string journal = "../fs_test_expiry_journal";
+    std::atomic<uint64_t> now{1700000000};
+};
+
+TEST_F(ExpiringCRUDHandlerTest, ExpiredInstancesReadAsMissing) {
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    std::unique_ptr<ExpiringCRUDHandler> handler(makeHandler(backend));
+    handler->create("Sessions", "a");
+    handler->create("Sessions", "b");
+    EXPECT_TRUE(handler->expire("Sessions", 1, std::chrono::seconds(10)));
+    EXPECT_FALSE(handler->expire("Sessions", 3, std::chrono::seconds(10)));
+    EXPECT_EQ(1u, handler->expiring());
+
+    now += 9;
+    // writes keep the deadline
+    EXPECT_TRUE(handler->update("Sessions", 1, "c"));
+    EXPECT_EQ("c", handler->read("Sessions", 1));
+    now += 1;
+    EXPECT_EQ(std::vector<int>{2}, handler->list("Sessions"));
+    EXPECT_FALSE(handler->exists("Sessions", 1));
+    // the lazy delete reached the backend
+    EXPECT_FALSE(backend->exists("Sessions", 1));
+    EXPECT_EQ(0u, handler->expiring());
+    EXPECT_FALSE(handler->update("Sessions", 1, "d"));
+    EXPECT_EQ("b", handler->read("Sessions", 2));
+}
+
+TEST_F(ExpiringCRUDHandlerTest, ReclaimsInTheBackground) {
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    std::unique_ptr<ExpiringCRUDHandler> handler(makeHandler(backend));
+    for (int i = 1; i <= 100; i++) {
+        handler->create("Cache", "x");
+        handler->expire("Cache", i, std::chrono::seconds(i));
+    }
+    // a zero ttl takes the deadline away again
+    EXPECT_TRUE(handler->expire("Cache", 100, std::chrono::seconds(0)));
+    EXPECT_EQ(99u, handler->expiring());
+
+    now += 50;
+    EXPECT_EQ(50u, handler->reclaimExpired());
+    EXPECT_EQ(50u, backend->list("Cache").size());
+    EXPECT_EQ(0u, handler->reclaimExpired());
+    now += 1000;
+    EXPECT_EQ(49u, handler->reclaimExpired());
+    EXPECT_EQ(std::vector<int>{100}, backend->list("Cache"));
+}
+
+TEST_F(ExpiringCRUDHandlerTest, ListPagesSkipExpiredIds) {
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    std::unique_ptr<ExpiringCRUDHandler> handler(makeHandler(backend));
+    for (int i = 1; i <= 10; i++) {
+        handler->create("Items", "x");
+        if (i <= 6)
+            handler->expire("Items", i, std::chrono::seconds(1));
+    }
+    now += 1;
+    // a page still holds limit ids while there are more
+    EXPECT_EQ(std::vector<int>({7, 8, 9}), handler->list("Items", 0, 3));
+    EXPECT_EQ(std::vector<int>({10}), handler->list("Items", 9, 3));
+}
+
+TEST_F(ExpiringCRUDHandlerTest, DeadlinesSurviveRestarts) {
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    {
+        std::unique_ptr<ExpiringCRUDHandler> handler(makeHandler(new MemoryCRUDHandler()));
+        for (int i = 1; i <= 3; i++) {
+            handler->create("Sessions", "x");
+            backend->create("Sessions", "x");
+            handler->expire("Sessions", i, std::chrono::seconds(60));
+        }
+        // deleted and recreated: the new instance must not inherit the deadline
+        handler->delete_("Sessions", 2);
+        handler->create("Sessions", "y");
+        handler->expire("Sessions", 3, std::chrono::seconds(0));
+    }
+    // a write torn by a crash
+    std::ofstream(journal, std::ios::app) << "1700000001 2 Sess";
+
+    std::unique_ptr<ExpiringCRUDHandler> handler(makeHandler(backend));
+    EXPECT_EQ(1u, handler->expiring());
+    now += 60;
+    EXPECT_EQ(1u, handler->reclaimExpired());
+    EXPECT_EQ(std::vector<int>({2, 3}), backend->list("Sessions"));
+}
+
+TEST_F(ExpiringCRUDHandlerTest, ReclaimThreadDeletes) {
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    ExpiringCRUDHandler handler(backend, journal, std::chrono::milliseconds(5),
+                                [this] { return now.load(); });
+    handler.create("Sessions", "a");
+    handler.expire("Sessions", 1, std::chrono::seconds(1));
+    now += 1;
+    for (int i = 0; i < 2000 && handler.expiring() > 0; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(0u, handler.expiring());
+}
+
+TEST_F(ExpiringCRUDHandlerTest, ReclaimThreadStartsWithTheFirstDeadline) {
+    {
+        ExpiringCRUDHandler handler(new MemoryCRUDHandler(), journal, std::chrono::milliseconds(5),
+                                    [this] { return now.load(); });
+        handler.create("Sessions", "a");
+        handler.delete_("Sessions", 1);
+        EXPECT_FALSE(handler.reclaiming());
+        EXPECT_FALSE(boost::filesystem::exists(journal));
+
+        handler.create("Sessions", "b");
+        handler.expire("Sessions", 1, std::chrono::seconds(60));
+        EXPECT_TRUE(handler.reclaiming());
+    }
+    // a journal with deadlines starts it right away
+    ExpiringCRUDHandler handler(new MemoryCRUDHandler(), journal, std::chrono::milliseconds(5),
+                                [this] { return now.load(); });
+    EXPECT_EQ(1u, handler.expiring());
+    EXPECT_TRUE(handler.reclaiming());
+}
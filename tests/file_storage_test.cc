@@ -1,7 +1,9 @@
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 #include "../src/api/file_storage.h"
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
 #include <thread>
 
 
@@ -89,4 +91,166 @@ TEST_F(FileStorageTest, ReadAfterDelete) {
     // OR you could check for an empty result or specific error code if exceptions are not used
     std::string result = fileStorage->read(entity, id);
     EXPECT_TRUE(result.empty());
-}
\ No newline at end of file
+}
+
+TEST_F(FileStorageTest, ListIdsSkipsNonNumericNames) {
+    std::string entity = "ListEntity";
+    fileStorage->write(entity, 3, "c");
+    fileStorage->write(entity, 1, "a");
+    std::ofstream(fileStorage->getEntityPath(entity) + "/notes.txt") << "x";
+
+    std::vector<int> ids = fileStorage->listIds(entity);
+    std::sort(ids.begin(), ids.end());
+    EXPECT_EQ(std::vector<int>({1, 3}), ids);
+    EXPECT_TRUE(fileStorage->listIds("MissingEntity").empty());
+
+    std::filesystem::remove_all(fileStorage->getEntityPath(entity));
+}
+
+TEST_F(FileStorageTest, DurableWriteReplacesFile) {
+    FileStorage durable("../fs_test", true);
+    std::string entity = "DurableEntity";
+    EXPECT_TRUE(durable.write(entity, 1, "first"));
+    EXPECT_TRUE(durable.write(entity, 1, "second"));
+    EXPECT_EQ("second", durable.read(entity, 1));
+
+    // only the committed file is left behind, no temp files
+    std::vector<int> ids = durable.listIds(entity);
+    EXPECT_EQ(std::vector<int>({1}), ids);
+    size_t files = std::distance(
+        std::filesystem::directory_iterator(durable.getEntityPath(entity)),
+        std::filesystem::directory_iterator());
+    EXPECT_EQ(1u, files);
+
+    durable.remove(entity, 1);
+    EXPECT_TRUE(durable.listIds(entity).empty());
+    EXPECT_EQ(3u, durable.committer()->commits());
+    std::filesystem::remove_all(durable.getEntityPath(entity));
+}
+
+TEST_F(FileStorageTest, ConcurrentDurableWritesShareCommits) {
+    FileStorage durable("../fs_test", true, std::chrono::milliseconds(20));
+    std::string entity = "GroupEntity";
+    std::vector<std::thread> writers;
+    for (int i = 1; i <= 16; i++) {
+        writers.emplace_back([&durable, &entity, i]() {
+            EXPECT_TRUE(durable.write(entity, i, "data " + std::to_string(i)));
+        });
+    }
+    for (auto &writer : writers)
+        writer.join();
+
+    for (int i = 1; i <= 16; i++)
+        EXPECT_EQ("data " + std::to_string(i), durable.read(entity, i));
+    EXPECT_EQ(16u, durable.committer()->commits());
+    EXPECT_LT(durable.committer()->batches(), 16u);
+    std::filesystem::remove_all(durable.getEntityPath(entity));
+}
+
+TEST_F(FileStorageTest, NonDurableHasNoCommitter) {
+    EXPECT_EQ(nullptr, fileStorage->committer());
+}
+
+TEST_F(FileStorageTest, MapLargeEntity) {
+    std::string entity = "MappedEntity";
+    std::string big(200 * 1024, 'm');
+    EXPECT_TRUE(fileStorage->write(entity, 1, big));
+    fileStorage->write(entity, 2, "small");
+
+    auto mapped = fileStorage->map(entity, 1, 64 * 1024);
+    ASSERT_NE(nullptr, mapped);
+    EXPECT_EQ(big, std::string(mapped->data(), mapped->size()));
+    EXPECT_EQ(nullptr, fileStorage->map(entity, 2, 64 * 1024));
+    EXPECT_EQ(nullptr, fileStorage->map(entity, 3));
+
+    // overwriting replaces the file, the existing mapping keeps the old bytes
+    EXPECT_TRUE(fileStorage->write(entity, 1, "replaced"));
+    EXPECT_EQ(big, std::string(mapped->data(), mapped->size()));
+    EXPECT_EQ("replaced", fileStorage->read(entity, 1));
+
+    std::filesystem::remove_all(fileStorage->getEntityPath(entity));
+}
+
+TEST_F(FileStorageTest, DurableWriteAllIsOneCommit) {
+    FileStorage durable("../fs_test", true);
+    std::string entity = "BatchEntity";
+    std::vector<std::string> bodies;
+    for (int i = 1; i <= 8; i++)
+        bodies.push_back("data " + std::to_string(i));
+    std::vector<FileStorage::Write> writes;
+    for (int i = 1; i <= 8; i++)
+        writes.push_back(FileStorage::Write{&entity, i, &bodies[i - 1]});
+
+    std::vector<bool> ok;
+    durable.writeAll(writes, &ok);
+    EXPECT_EQ(std::vector<bool>(8, true), ok);
+    for (int i = 1; i <= 8; i++)
+        EXPECT_EQ(bodies[i - 1], durable.read(entity, i));
+    EXPECT_EQ(8u, durable.committer()->commits());
+    EXPECT_EQ(1u, durable.committer()->batches());
+    std::filesystem::remove_all(durable.getEntityPath(entity));
+}
+
+TEST_F(FileStorageTest, ShardedLayoutFansOut) {
+    FileStorage sharded("../fs_test", false, std::chrono::microseconds(0),
+                        FileStorage::kSharded);
+    std::string entity = "ShardedEntity";
+    for (int i = 1; i <= 50; i++)
+        EXPECT_TRUE(sharded.write(entity, i, "data " + std::to_string(i)));
+
+    std::string path = sharded.getPath(entity, 7);
+    EXPECT_TRUE(std::filesystem::exists(path));
+    // entity/ab/cd/id
+    std::string rest = path.substr(sharded.getEntityPath(entity).size());
+    ASSERT_EQ(rest.size(), 8u);
+    EXPECT_EQ(rest.substr(0, 1), "/");
+    EXPECT_EQ(rest.substr(3, 1), "/");
+    EXPECT_EQ(rest.substr(6), "/7");
+
+    std::vector<int> ids = sharded.listIds(entity);
+    std::sort(ids.begin(), ids.end());
+    ASSERT_EQ(ids.size(), 50u);
+    EXPECT_EQ(ids.front(), 1);
+    EXPECT_EQ(ids.back(), 50);
+    EXPECT_EQ("data 7", sharded.read(entity, 7));
+    sharded.remove(entity, 7);
+    EXPECT_FALSE(sharded.exists(entity, 7));
+    std::filesystem::remove_all(sharded.getEntityPath(entity));
+}
+
+TEST_F(FileStorageTest, ShardedLayoutReadsAndMigratesFlatIds) {
+    std::string entity = "MigratedEntity";
+    for (int i = 1; i <= 5; i++)
+        fileStorage->write(entity, i, "flat " + std::to_string(i));
+    FileStorage sharded("../fs_test", false, std::chrono::microseconds(0),
+                        FileStorage::kSharded);
+
+    // ids still in the flat spot are served in place
+    EXPECT_EQ("flat 2", sharded.read(entity, 2));
+    EXPECT_TRUE(sharded.exists(entity, 2));
+    std::vector<int> ids = sharded.listIds(entity);
+    std::sort(ids.begin(), ids.end());
+    EXPECT_EQ(std::vector<int>({1, 2, 3, 4, 5}), ids);
+
+    // a write moves its id, a delete removes it from both spots
+    EXPECT_TRUE(sharded.write(entity, 1, "new 1"));
+    EXPECT_FALSE(std::filesystem::exists(sharded.getFlatPath(entity, 1)));
+    sharded.remove(entity, 2);
+    EXPECT_FALSE(sharded.exists(entity, 2));
+
+    // a flat copy of an id that also has a sharded one is stale and must
+    // not win
+    EXPECT_TRUE(sharded.write(entity, 4, "new 4"));
+    fileStorage->write(entity, 4, "stale 4");
+
+    EXPECT_EQ(2u, sharded.migrate(entity));
+    for (int i = 3; i <= 5; i++) {
+        EXPECT_FALSE(std::filesystem::exists(sharded.getFlatPath(entity, i)));
+        EXPECT_TRUE(std::filesystem::exists(sharded.getPath(entity, i)));
+    }
+    EXPECT_EQ("flat 3", sharded.read(entity, 3));
+    EXPECT_EQ("new 4", sharded.read(entity, 4));
+    EXPECT_EQ("new 1", sharded.read(entity, 1));
+    EXPECT_EQ(0u, sharded.migrate(entity));
+    std::filesystem::remove_all(sharded.getEntityPath(entity));
+}
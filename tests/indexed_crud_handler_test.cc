@@ -0,0 +1,148 @@
+#include "gtest/gtest.h"
+#include "../src/api/indexed_crud_handler.h"
+#include <functional>
+#include <map>
+#include <thread>
+
+// in-memory backend that counts reads
+class MemoryCRUDHandler : public ICRUDHandler {
+public:
+    std::map<std::string, std::map<int, std::string>> data;
+    int reads = 0;
+
+    std::string create(const std::string& entity, const std::string& body) override {
+        int id = 1;
+        while (data[entity].count(id))
+            id++;
+        data[entity][id] = body;
+        return "{\"id\": " + std::to_string(id) + "}";
+    }
+    std::string read(const std::string& entity, int id) override {
+        reads++;
+        return data[entity].count(id) ? data[entity][id] : "";
+    }
+    bool update(const std::string& entity, int id, const std::string& body) override {
+        if (!data[entity].count(id))
+            return false;
+        data[entity][id] = body;
+        return true;
+    }
+    bool delete_(const std::string& entity, int id) override {
+        return data[entity].erase(id) > 0;
+    }
+    bool exists(const std::string& entity, int id) override {
+        return data[entity].count(id) > 0;
+    }
+    std::vector<int> list(const std::string& entity) override {
+        std::vector<int> ids;
+        for (const auto& entry : data[entity])
+            ids.push_back(entry.first);
+        return ids;
+    }
+};
+
+class IndexedCRUDHandlerTest : public ::testing::Test {
+protected:
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    IndexedCRUDHandler::IndexSpec spec{{"Shoes", {"color", "size", "details.brand"}}};
+
+    std::vector<int> query(IndexedCRUDHandler* handler, const std::string& field,
+                           const std::string& value) {
+        std::vector<int> ids;
+        EXPECT_TRUE(handler->query("Shoes", field, value, &ids));
+        return ids;
+    }
+};
+
+TEST_F(IndexedCRUDHandlerTest, BuildsFromExistingData) {
+    backend->create("Shoes", "{\"color\": \"red\", \"size\": 9}");
+    backend->create("Shoes", "{\"color\": \"blue\", \"size\": 9}");
+    backend->create("Shoes", "{\"color\": \"red\", \"details\": {\"brand\": \"acme\"}}");
+    backend->create("Shoes", "not json");
+    IndexedCRUDHandler indexed(backend, spec);
+
+    EXPECT_EQ(std::vector<int>({1, 3}), query(&indexed, "color", "red"));
+    EXPECT_EQ(std::vector<int>({1, 2}), query(&indexed, "size", "9"));
+    EXPECT_EQ(std::vector<int>({3}), query(&indexed, "details.brand", "acme"));
+    EXPECT_TRUE(query(&indexed, "color", "green").empty());
+
+    // queries are answered without reading anything
+    int reads = backend->reads;
+    query(&indexed, "color", "red");
+    EXPECT_EQ(reads, backend->reads);
+}
+
+TEST_F(IndexedCRUDHandlerTest, UnindexedFieldsAndEntitiesAreRefused) {
+    IndexedCRUDHandler indexed(backend, spec);
+    std::vector<int> ids;
+    EXPECT_FALSE(indexed.query("Shoes", "price", "10", &ids));
+    EXPECT_FALSE(indexed.query("Hats", "color", "red", &ids));
+}
+
+TEST_F(IndexedCRUDHandlerTest, MaintainedOnWrites) {
+    IndexedCRUDHandler indexed(backend, spec);
+    indexed.create("Shoes", "{\"color\": \"red\"}");
+    indexed.create("Shoes", "{\"color\": \"red\"}");
+    EXPECT_EQ(std::vector<int>({1, 2}), query(&indexed, "color", "red"));
+
+    EXPECT_TRUE(indexed.update("Shoes", 1, "{\"color\": \"blue\", \"size\": 10}"));
+    EXPECT_EQ(std::vector<int>({2}), query(&indexed, "color", "red"));
+    EXPECT_EQ(std::vector<int>({1}), query(&indexed, "color", "blue"));
+    EXPECT_EQ(std::vector<int>({1}), query(&indexed, "size", "10"));
+
+    EXPECT_TRUE(indexed.delete_("Shoes", 2));
+    EXPECT_TRUE(query(&indexed, "color", "red").empty());
+    EXPECT_FALSE(indexed.update("Shoes", 7, "{\"color\": \"red\"}"));
+    EXPECT_TRUE(query(&indexed, "color", "red").empty());
+
+    std::vector<BatchOperation> ops(2);
+    ops[0].type = BatchOperation::kCreate;
+    ops[0].entity = "Shoes";
+    ops[0].data = "{\"color\": \"red\"}";
+    ops[1].type = BatchOperation::kDelete;
+    ops[1].entity = "Shoes";
+    ops[1].id = 1;
+    indexed.batch(ops);
+    EXPECT_EQ(std::vector<int>({2}), query(&indexed, "color", "red"));
+    EXPECT_TRUE(query(&indexed, "color", "blue").empty());
+}
+
+TEST_F(IndexedCRUDHandlerTest, StringValuesAreDecoded) {
+    IndexedCRUDHandler indexed(backend, spec);
+    indexed.create("Shoes", "{\"color\": \"dark red\", \"size\": \"9\"}");
+    indexed.create("Shoes", "{\"color\": \"dark\\u0020red\", \"size\": [9]}");
+    EXPECT_EQ(std::vector<int>({1, 2}), query(&indexed, "color", "dark red"));
+    // the string "9" and the number 9 both match ?size=9, arrays don't
+    EXPECT_EQ(std::vector<int>({1}), query(&indexed, "size", "9"));
+}
+
+TEST_F(IndexedCRUDHandlerTest, ReusedIdIsIndexedByWhatItHolds) {
+    // a backend that runs a hook once a create has stored its instance,
+    // before the handler above it has indexed it
+    class HookedCRUDHandler : public MemoryCRUDHandler {
+    public:
+        std::function<void(int)> after_create;
+        std::string create(const std::string& entity, const std::string& body) override {
+            std::string result = MemoryCRUDHandler::create(entity, body);
+            if (after_create) {
+                auto hook = std::move(after_create);
+                after_create = nullptr;
+                hook(createdId(result));
+            }
+            return result;
+        }
+    };
+    HookedCRUDHandler* hooked = new HookedCRUDHandler();
+    delete backend;
+    backend = hooked;
+    IndexedCRUDHandler indexed(hooked, spec);
+    // the new id is deleted and handed to a second create before the first
+    // one takes its stripe
+    hooked->after_create = [&indexed, hooked](int id) {
+        indexed.delete_("Shoes", id);
+        hooked->MemoryCRUDHandler::create("Shoes", "{\"color\": \"blue\"}");
+    };
+    indexed.create("Shoes", "{\"color\": \"red\"}");
+    EXPECT_TRUE(query(&indexed, "color", "red").empty());
+    EXPECT_EQ(std::vector<int>({1}), query(&indexed, "color", "blue"));
+}
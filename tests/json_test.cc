@@ -0,0 +1,137 @@
+#include "../src/http/json.h"
+#include "gtest/gtest.h"
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(JsonTest, ValidatesDocuments) {
+  const char *valid[] = {"0", "-1.5e+3", " \"a\\u00e9\\n\" ", "true", "null",
+                         "[]", "{}", "[1, [2, {\"a\": [false]}]]",
+                         "{\"a\": {\"b\": null}, \"c\": \"\"}"};
+  for (const char *text : valid)
+    EXPECT_TRUE(json::validate(text)) << text;
+
+  const char *invalid[] = {"", "01", "1.", "-", "[1,]", "{\"a\" 1}", "{a: 1}",
+                           "\"abc", "\"\\x\"", "\"\\u12g4\"", "tru", "[1] 2",
+                           "{\"a\": 1,}", "\"tab\there\""};
+  for (const char *text : invalid)
+    EXPECT_FALSE(json::validate(text)) << text;
+}
+
+TEST(JsonTest, RejectsDeepNesting) {
+  std::string deep(json::kMaxDepth + 1, '[');
+  deep += std::string(json::kMaxDepth + 1, ']');
+  EXPECT_FALSE(json::validate(deep));
+  std::string shallow(json::kMaxDepth, '[');
+  shallow += std::string(json::kMaxDepth, ']');
+  EXPECT_TRUE(json::validate(shallow));
+}
+
+TEST(JsonTest, SplitsArraysAndObjects) {
+  std::vector<std::string_view> elements;
+  ASSERT_TRUE(json::split_array(" [1, \"two\" , {\"x\": [3]}] ", &elements));
+  ASSERT_EQ(elements.size(), 3u);
+  EXPECT_EQ(elements[0], "1");
+  EXPECT_EQ(elements[1], "\"two\"");
+  EXPECT_EQ(elements[2], "{\"x\": [3]}");
+  EXPECT_TRUE(json::split_array("[]", &elements));
+  EXPECT_TRUE(elements.empty());
+  EXPECT_FALSE(json::split_array("{}", &elements));
+
+  std::vector<std::pair<std::string, std::string_view>> members;
+  ASSERT_TRUE(json::split_object("{\"a\\\"b\": 1, \"c\": [true]}", &members));
+  ASSERT_EQ(members.size(), 2u);
+  EXPECT_EQ(members[0].first, "a\"b");
+  EXPECT_EQ(members[0].second, "1");
+  EXPECT_EQ(members[1].first, "c");
+  EXPECT_EQ(members[1].second, "[true]");
+  EXPECT_FALSE(json::split_object("{\"a\": 1} x", &members));
+}
+
+TEST(JsonTest, ParsesStringsAndInts) {
+  std::string s;
+  ASSERT_TRUE(json::parse_string("\"a\\tb\\u00e9\\ud83d\\ude00\"", &s));
+  EXPECT_EQ(s, "a\tb\xc3\xa9\xf0\x9f\x98\x80");
+  EXPECT_FALSE(json::parse_string("abc", &s));
+
+  int value;
+  EXPECT_TRUE(json::parse_int("-2147483648", &value));
+  EXPECT_EQ(value, -2147483647 - 1);
+  EXPECT_TRUE(json::parse_int("42", &value));
+  EXPECT_EQ(value, 42);
+  EXPECT_FALSE(json::parse_int("2147483648", &value));
+  EXPECT_FALSE(json::parse_int("1.0", &value));
+  EXPECT_FALSE(json::parse_int("\"1\"", &value));
+}
+
+TEST(JsonTest, QuoteRoundTrips) {
+  std::string raw = "say \"hi\"\n\\ \x01";
+  std::string quoted = json::quote(raw);
+  EXPECT_TRUE(json::validate(quoted));
+  std::string back;
+  ASSERT_TRUE(json::parse_string(quoted, &back));
+  EXPECT_EQ(back, raw);
+}
+
+TEST(JsonTest, RequiresValidUtf8) {
+  const char *valid[] = {"\"caf\xc3\xa9\"", "\"\xe2\x82\xac\"",
+                         "\"\xf0\x9f\x98\x80\"", "\"\xf4\x8f\xbf\xbf\"",
+                         "\"\xed\x9f\xbf\""};
+  for (const char *text : valid)
+    EXPECT_TRUE(json::validate(text)) << text;
+
+  const char *invalid[] = {
+      "\"\x80\"",             // lone continuation byte
+      "\"\xc0\xaf\"",         // overlong '/'
+      "\"\xe0\x80\xaf\"",     // overlong '/'
+      "\"\xed\xa0\x80\"",     // surrogate
+      "\"\xf4\x90\x80\x80\"", // past U+10FFFF
+      "\"\xf5\x80\x80\x80\"", "\"\xe2\x82\"", "\"\xc3\"",
+      "\"\xff\""};
+  for (const char *text : invalid)
+    EXPECT_FALSE(json::validate(text)) << text;
+}
+
+TEST(JsonTest, Minifies) {
+  std::string out;
+  ASSERT_TRUE(json::minify(" { \"a b\" : [ 1 , \"x \\\" y\" ,\n\ttrue ] } ", &out));
+  EXPECT_EQ(out, "{\"a b\":[1,\"x \\\" y\",true]}");
+  ASSERT_TRUE(json::minify("\"  \"", &out));
+  EXPECT_EQ(out, "\"  \"");
+  EXPECT_FALSE(json::minify("{\"a\": }", &out));
+}
+
+// Every implementation must agree with the scalar one, whichever byte a
+// vector boundary falls on
+TEST(JsonTest, ImplementationsAgree) {
+  std::vector<json::Implementation> implementations;
+  for (auto impl : {json::Implementation::Scalar, json::Implementation::SSE2,
+                    json::Implementation::AVX2}) {
+    if (json::is_supported(impl))
+      implementations.push_back(impl);
+  }
+
+  const char *pieces[] = {"\"", "\\", "\\\"", "\\u00e9", "\xc3\xa9", "\xf0\x9f\x98\x80",
+                          "\xc3", "\x80", "\x01", "\t", "a", "abcdefghijklmnop"};
+  std::mt19937 gen(41);
+  for (int round = 0; round < 2000; ++round) {
+    std::string inner;
+    size_t count = gen() % 12;
+    for (size_t i = 0; i < count; ++i)
+      inner += pieces[gen() % (sizeof(pieces) / sizeof(pieces[0]))];
+    std::string text = std::string(gen() % 40, ' ') + "{\"k\": [\"" + inner +
+                       "\"," + std::string(gen() % 40, '\n') + "1]}";
+
+    std::string expected_minified, minified;
+    bool expected = json::minify_with(json::Implementation::Scalar, text,
+                                      &expected_minified);
+    for (auto impl : implementations) {
+      ASSERT_EQ(json::validate_with(impl, text), expected)
+          << json::implementation_name(impl) << ": " << text;
+      ASSERT_EQ(json::minify_with(impl, text, &minified), expected);
+      if (expected) {
+        ASSERT_EQ(minified, expected_minified) << json::implementation_name(impl);
+      }
+    }
+  }
+}
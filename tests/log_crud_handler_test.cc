@@ -0,0 +1,173 @@
+#include "gtest/gtest.h"
+#include "../src/api/log_crud_handler.h"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+class LogCRUDHandlerTest : public ::testing::Test {
+protected:
+    const std::string TEST_LOG_DIRECTORY = "../log_test";
+    const std::string entity = "TestEntity";
+    std::unique_ptr<LogCRUDHandler> handler;
+
+    void SetUp() override {
+        std::filesystem::remove_all(TEST_LOG_DIRECTORY);
+        reopen();
+    }
+
+    void TearDown() override {
+        handler.reset();
+        std::filesystem::remove_all(TEST_LOG_DIRECTORY);
+    }
+
+    // simulate a restart; no background compaction so tests stay deterministic
+    void reopen(size_t segment_size = LogCRUDHandler::kDefaultSegmentSize) {
+        handler.reset();
+        handler.reset(new LogCRUDHandler(TEST_LOG_DIRECTORY, segment_size,
+                                         std::chrono::milliseconds(0)));
+    }
+
+    std::string onlySegment() {
+        std::vector<std::string> segments;
+        for (const auto &entry : std::filesystem::directory_iterator(TEST_LOG_DIRECTORY))
+            segments.push_back(entry.path().string());
+        EXPECT_EQ(1u, segments.size());
+        return segments.empty() ? "" : segments[0];
+    }
+};
+
+TEST_F(LogCRUDHandlerTest, CreateReadUpdateDelete) {
+    EXPECT_EQ("{\"id\": 1}", handler->create(entity, "first"));
+    EXPECT_EQ("{\"id\": 2}", handler->create(entity, "second"));
+    EXPECT_EQ("first", handler->read(entity, 1));
+
+    EXPECT_TRUE(handler->update(entity, 1, "changed"));
+    EXPECT_EQ("changed", handler->read(entity, 1));
+
+    EXPECT_TRUE(handler->delete_(entity, 1));
+    EXPECT_FALSE(handler->exists(entity, 1));
+    EXPECT_EQ("", handler->read(entity, 1));
+    EXPECT_EQ(std::vector<int>({2}), handler->list(entity));
+}
+
+TEST_F(LogCRUDHandlerTest, NonExistentOperations) {
+    EXPECT_FALSE(handler->update(entity, 7, "data"));
+    EXPECT_FALSE(handler->delete_(entity, 7));
+    EXPECT_FALSE(handler->exists("OtherEntity", 1));
+    EXPECT_TRUE(handler->list("OtherEntity").empty());
+}
+
+TEST_F(LogCRUDHandlerTest, ReusesLowestFreedId) {
+    for (int i = 0; i < 3; i++)
+        handler->create(entity, "data");
+    handler->delete_(entity, 2);
+    EXPECT_EQ("{\"id\": 2}", handler->create(entity, "data"));
+    EXPECT_EQ("{\"id\": 4}", handler->create(entity, "data"));
+}
+
+TEST_F(LogCRUDHandlerTest, RecoversIndexAfterRestart) {
+    handler->create(entity, "one");
+    handler->create(entity, "two");
+    handler->create("Other", "three");
+    handler->update(entity, 2, "two v2");
+    handler->delete_(entity, 1);
+
+    reopen();
+    EXPECT_FALSE(handler->exists(entity, 1));
+    EXPECT_EQ("two v2", handler->read(entity, 2));
+    EXPECT_EQ("three", handler->read("Other", 1));
+    EXPECT_EQ("{\"id\": 1}", handler->create(entity, "reused"));
+}
+
+TEST_F(LogCRUDHandlerTest, TruncatesTornTailOnRecovery) {
+    handler->create(entity, "intact");
+    handler.reset();
+
+    // half of a record, as if the process died mid-append
+    std::string segment = onlySegment();
+    auto intact_size = std::filesystem::file_size(segment);
+    std::ofstream(segment, std::ios::app | std::ios::binary) << "\x01\x02\x03\x04\x01";
+
+    reopen();
+    EXPECT_EQ(intact_size, std::filesystem::file_size(segment));
+    EXPECT_EQ("intact", handler->read(entity, 1));
+    EXPECT_EQ("{\"id\": 2}", handler->create(entity, "after"));
+
+    reopen();
+    EXPECT_EQ("after", handler->read(entity, 2));
+}
+
+TEST_F(LogCRUDHandlerTest, IgnoresRecordWithBadChecksum) {
+    handler->create(entity, "good");
+    handler->create(entity, "flipped");
+    handler.reset();
+
+    // corrupt the last byte of the second record's data
+    std::string segment = onlySegment();
+    std::fstream file(segment, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(-1, std::ios::end);
+    file.put('X');
+    file.close();
+
+    reopen();
+    EXPECT_EQ("good", handler->read(entity, 1));
+    EXPECT_FALSE(handler->exists(entity, 2));
+}
+
+TEST_F(LogCRUDHandlerTest, RollsOverSegments) {
+    reopen(64);
+    for (int i = 0; i < 10; i++)
+        handler->create(entity, std::string(40, 'a' + i));
+    EXPECT_EQ(10u, handler->segmentCount());
+
+    reopen(64);
+    for (int i = 0; i < 10; i++)
+        EXPECT_EQ(std::string(40, 'a' + i), handler->read(entity, i + 1));
+}
+
+TEST_F(LogCRUDHandlerTest, CompactionDropsDeadRecords) {
+    reopen(64);
+    for (int i = 0; i < 10; i++)
+        handler->create(entity, std::string(40, 'a' + i));
+    for (int i = 1; i <= 10; i += 2)
+        handler->delete_(entity, i);
+    handler->update(entity, 2, "latest");
+    uint64_t dead = handler->deadBytes();
+    EXPECT_GT(dead, 0u);
+
+    size_t before = handler->segmentCount();
+    EXPECT_GT(handler->compact(), 0u);
+    EXPECT_LT(handler->segmentCount(), before);
+    EXPECT_LT(handler->deadBytes(), dead);
+
+    // the compacted log replays to the same state
+    reopen(64);
+    EXPECT_EQ(std::vector<int>({2, 4, 6, 8, 10}), handler->list(entity));
+    EXPECT_EQ("latest", handler->read(entity, 2));
+    EXPECT_EQ(std::string(40, 'a' + 9), handler->read(entity, 10));
+    EXPECT_FALSE(handler->exists(entity, 1));
+}
+
+TEST_F(LogCRUDHandlerTest, BackgroundCompaction) {
+    handler.reset(new LogCRUDHandler(TEST_LOG_DIRECTORY, 64,
+                                     std::chrono::milliseconds(10)));
+    for (int i = 0; i < 10; i++)
+        handler->create(entity, std::string(40, 'a'));
+    for (int i = 1; i <= 9; i++)
+        handler->delete_(entity, i);
+
+    for (int i = 0; i < 200 && handler->deadBytes() > 0; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(0u, handler->deadBytes());
+    EXPECT_EQ(std::string(40, 'a'), handler->read(entity, 10));
+}
+
+TEST_F(LogCRUDHandlerTest, ListPage) {
+    for (int i = 0; i < 5; i++)
+        handler->create(entity, "data");
+    handler->delete_(entity, 2);
+    EXPECT_EQ(std::vector<int>({1, 3}), handler->list(entity, 0, 2));
+    EXPECT_EQ(std::vector<int>({4, 5}), handler->list(entity, 3, 5));
+    EXPECT_TRUE(handler->list("Other", 0, 5).empty());
+}
@@ -71,3 +71,40 @@ TEST_F(LoggerTest, LogTraceHTTPRequest) {
     EXPECT_NO_THROW(logger->logTraceHTTPrequest(req, socket));
 }
 
+
+TEST_F(LoggerTest, AsyncMode) {
+    logger->startAsync(1024, AsyncLogSink::kDrop);
+    for (int i = 0; i < 100; i++) {
+        logger->logDebugFile("Test async message " + std::to_string(i));
+    }
+    EXPECT_NO_THROW(logger->flush());
+    EXPECT_EQ(0u, logger->droppedRecords());
+    logger->stopAsync();
+    EXPECT_NO_THROW(logger->logDebugFile("Test message after async mode"));
+}
+
+TEST_F(LoggerTest, LevelThreshold) {
+    logging_trivial::severity_level level;
+    ASSERT_TRUE(Logger::parseLevel("warning", &level));
+    EXPECT_EQ(logging_trivial::warning, level);
+    EXPECT_FALSE(Logger::parseLevel("loud", &level));
+
+    Logger::setLevel(logging_trivial::warning);
+    EXPECT_FALSE(Logger::enabled(logging_trivial::debug));
+    EXPECT_TRUE(Logger::enabled(logging_trivial::error));
+
+    // arguments of a disabled record are never evaluated
+    int evaluated = 0;
+    auto message = [&evaluated] {
+        evaluated++;
+        return std::string("Test message");
+    };
+    LOGGER_DEBUG(message());
+    EXPECT_EQ(0, evaluated);
+    LOGGER_WARNING(message());
+    EXPECT_EQ(1, evaluated);
+
+    Logger::setLevel(logging_trivial::trace);
+    LOGGER_TRACE(message());
+    EXPECT_EQ(2, evaluated);
+}
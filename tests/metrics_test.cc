@@ -0,0 +1,116 @@
+#include "gtest/gtest.h"
+#include "../src/metrics.h"
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace metrics;
+
+TEST(MetricsTest, CountsAcrossThreads) {
+  Registry registry;
+  Counter &counter = registry.counter("requests_total", "Requests.");
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&registry] {
+      for (int i = 0; i < 10000; i++)
+        registry.counter("requests_total", "Requests.").inc();
+    });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+  EXPECT_EQ(80000u, counter.value());
+  // the same name and labels are the same metric
+  EXPECT_EQ(&counter, &registry.counter("requests_total", "Requests."));
+  EXPECT_NE(&counter,
+            &registry.counter("requests_total", "Requests.", {{"code", "200"}}));
+  EXPECT_THROW(registry.gauge("requests_total", "Requests."),
+               std::invalid_argument);
+}
+
+TEST(MetricsTest, GaugeAddsAcrossThreads) {
+  Registry registry;
+  Gauge &gauge = registry.gauge("requests_in_flight", "In flight.");
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&gauge, t] {
+      for (int i = 0; i < 10000; i++) {
+        gauge.add(1);
+        if (t % 2 == 0)
+          gauge.add(-1);
+      }
+    });
+  }
+  for (std::thread &thread : threads)
+    thread.join();
+  EXPECT_EQ(40000, gauge.value());
+  Gauge absolute;
+  absolute.set(5);
+  absolute.set(2);
+  EXPECT_EQ(2, absolute.value());
+}
+
+TEST(MetricsTest, HistogramBuckets) {
+  for (uint64_t value : {0ULL, 7ULL, 8ULL, 9ULL, 1000ULL, 123456789ULL}) {
+    size_t bucket = Histogram::bucketOf(value);
+    EXPECT_LE(bucket == 0 ? 0 : Histogram::bucketLimit(bucket - 1), value);
+    EXPECT_GT(Histogram::bucketLimit(bucket), value);
+  }
+  // buckets are no wider than an eighth of their values
+  size_t bucket = Histogram::bucketOf(1000);
+  EXPECT_LE(Histogram::bucketLimit(bucket) - Histogram::bucketLimit(bucket - 1),
+            1000u / 8);
+  EXPECT_EQ(Histogram::kBuckets - 1, Histogram::bucketOf(~0ULL));
+
+  Histogram histogram;
+  EXPECT_EQ(0u, histogram.quantile(0.5));
+  for (uint64_t value = 1; value <= 1000; value++)
+    histogram.record(value);
+  EXPECT_EQ(1000u, histogram.count());
+  EXPECT_EQ(500500u, histogram.sum());
+  EXPECT_EQ(511u, histogram.countBelow(512));
+  EXPECT_NEAR(500, histogram.quantile(0.5), 500 / 8);
+  EXPECT_NEAR(990, histogram.quantile(0.99), 990 / 8);
+  EXPECT_EQ(1023u, histogram.quantile(1));
+}
+
+TEST(MetricsTest, Exposition) {
+  Registry registry;
+  registry.counter("http_requests_total", "Requests answered.",
+                   {{"handler", "Echo\"Handler"}, {"code", "200"}})
+      .inc(3);
+  registry.gauge("http_requests_in_flight", "In flight.").set(2);
+  registry.callback("log_records_dropped_total", "Dropped.",
+                    Registry::kCounter, [] { return 5.0; });
+  registry.callback("api_cache_hits_total", "Hits.", Registry::kCounter,
+                    [] { return 1.0; }, {{"location", "/api"}});
+  registry.callback("api_cache_hits_total", "Hits.", Registry::kCounter,
+                    [] { return 7.0; }, {{"location", "/api"}});
+  Histogram &latency = registry.histogram("latency_seconds", "Latency.",
+                                          {{"handler", "Echo"}});
+  latency.record(20);
+  latency.record(3000000);
+
+  std::string text = registry.exposition();
+  EXPECT_NE(std::string::npos,
+            text.find("# HELP http_requests_total Requests answered.\n"
+                      "# TYPE http_requests_total counter\n"
+                      "http_requests_total{handler=\"Echo\\\"Handler\","
+                      "code=\"200\"} 3\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("# TYPE http_requests_in_flight gauge\n"
+                      "http_requests_in_flight 2\n"));
+  EXPECT_NE(std::string::npos, text.find("log_records_dropped_total 5\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("api_cache_hits_total{location=\"/api\"} 7\n"));
+  EXPECT_NE(std::string::npos, text.find("# TYPE latency_seconds histogram\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("latency_seconds_bucket{handler=\"Echo\",le=\"1.6e-05\"} 0\n"
+                      "latency_seconds_bucket{handler=\"Echo\",le=\"3.2e-05\"} 1\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("latency_seconds_bucket{handler=\"Echo\",le=\"2.097152\"} 1\n"
+                      "latency_seconds_bucket{handler=\"Echo\",le=\"4.194304\"} 2\n"));
+  EXPECT_NE(std::string::npos,
+            text.find("latency_seconds_bucket{handler=\"Echo\",le=\"+Inf\"} 2\n"
+                      "latency_seconds_sum{handler=\"Echo\"} 3.00002\n"
+                      "latency_seconds_count{handler=\"Echo\"} 2\n"));
+}
@@ -0,0 +1,59 @@
+#include "gtest/gtest.h"
+#include "../src/mpsc_ring.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(MpscRingTest, FirstInFirstOut) {
+  MpscRing<std::string> ring(3);
+  EXPECT_EQ(4u, ring.capacity());
+  EXPECT_TRUE(ring.empty());
+  for (int i = 0; i < 4; i++)
+    EXPECT_TRUE(ring.tryPush(std::to_string(i)));
+  std::string extra = "4";
+  EXPECT_FALSE(ring.tryPush(std::move(extra)));
+  // a refused value is left alone
+  EXPECT_EQ("4", extra);
+
+  std::string value;
+  for (int lap = 0; lap < 3; lap++) {
+    for (int i = 0; i < 4; i++) {
+      ASSERT_TRUE(ring.tryPop(&value));
+      EXPECT_EQ(std::to_string(lap * 4 + i), value);
+      EXPECT_TRUE(ring.tryPush(std::to_string((lap + 1) * 4 + i)));
+    }
+  }
+  EXPECT_FALSE(ring.empty());
+}
+
+TEST(MpscRingTest, ManyProducersLoseNothing) {
+  const int kProducers = 4;
+  const int kPerProducer = 200000;
+  MpscRing<int> ring(1024);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; p++) {
+    producers.emplace_back([&ring, p] {
+      for (int i = 0; i < kPerProducer; i++) {
+        while (!ring.tryPush(p * kPerProducer + i))
+          std::this_thread::yield();
+      }
+    });
+  }
+
+  // each producer's values arrive in the order it pushed them
+  std::vector<int> next(kProducers, 0);
+  int value;
+  for (int received = 0; received < kProducers * kPerProducer;) {
+    if (!ring.tryPop(&value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    int producer = value / kPerProducer;
+    ASSERT_EQ(next[producer], value % kPerProducer);
+    next[producer]++;
+    received++;
+  }
+  for (std::thread &producer : producers)
+    producer.join();
+  EXPECT_TRUE(ring.empty());
+}
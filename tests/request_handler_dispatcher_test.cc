@@ -1,11 +1,16 @@
 #include "../src/config_parser.h"
+#include "../src/metrics.h"
 #include "../src/request_handler/request_handler_404.h"
 #include "../src/request_handler/request_handler_api.h"
 #include "../src/request_handler/request_handler_echo.h"
 #include "../src/request_handler/request_handler_health.h"
+#include "../src/request_handler/request_handler_metrics.h"
 #include "../src/request_handler/request_handler_static.h"
 #include "../src/request_handler_dispatcher.h"
 #include "gtest/gtest.h"
+#include <filesystem>
+
+namespace http = boost::beast::http;
 
 class RequestHandlerDispatcherTest : public ::testing::Test {
 protected:
@@ -62,6 +67,121 @@ TEST_F(RequestHandlerDispatcherTest, RegisterPathAPIHandler) {
   EXPECT_EQ(typeid(*handler), typeid(RequestHandlerAPI));
 }
 
+TEST_F(RequestHandlerDispatcherTest, RegisterPathAPIHandlerLogStorage) {
+  NginxConfig config =
+      parseConfig("root ../log_dispatch_test; storage log;");
+  EXPECT_TRUE(dispatcher->registerPath("/api", "APIHandler", config));
+  EXPECT_TRUE(std::filesystem::exists("../log_dispatch_test"));
+  std::filesystem::remove_all("../log_dispatch_test");
+}
+
+TEST_F(RequestHandlerDispatcherTest, RegisterPathAPIHandlerUnknownStorage) {
+  NginxConfig config =
+      parseConfig("root /api_root; storage tape;");
+  EXPECT_FALSE(dispatcher->registerPath("/api", "APIHandler", config));
+  EXPECT_EQ(typeid(*dispatcher->getRequestHandler("/api")),
+            typeid(RequestHandler404));
+}
+
+TEST_F(RequestHandlerDispatcherTest, RegisterPathAPIHandlerCacheSize) {
+  EXPECT_TRUE(dispatcher->registerPath(
+      "/api", "APIHandler", parseConfig("root /api_root; cache_size 1048576;")));
+  EXPECT_EQ(typeid(*dispatcher->getRequestHandler("/api")),
+            typeid(RequestHandlerAPI));
+  EXPECT_FALSE(dispatcher->registerPath(
+      "/api2", "APIHandler", parseConfig("root /api_root; cache_size big;")));
+}
+
+TEST_F(RequestHandlerDispatcherTest, RegisterPathAPIHandlerCacheMetrics) {
+  const std::string root = "../cache_metrics_dispatch_test";
+  EXPECT_TRUE(dispatcher->registerPath(
+      "/cached", "APIHandler",
+      parseConfig("root " + root + "; cache_size 1048576;")));
+  http::request<http::string_body> get{http::verb::get, "/cached/Shoes/1", 11};
+  http::response<http::string_body> response;
+  dispatcher->getRequestHandler("/cached")->handleRequest(get, &response);
+  dispatcher->getRequestHandler("/cached")->handleRequest(get, &response);
+
+  std::string text = metrics::Registry::global().exposition();
+  EXPECT_NE(text.find("api_cache_hits_total{location=\"/cached\"} 1\n"),
+            std::string::npos);
+  EXPECT_NE(text.find("api_cache_misses_total{location=\"/cached\"} 1\n"),
+            std::string::npos);
+  std::filesystem::remove_all(root);
+  std::filesystem::remove(root + ".expiry");
+}
+
+TEST_F(RequestHandlerDispatcherTest, RegisterPathAPIHandlerLayout) {
+  EXPECT_TRUE(dispatcher->registerPath(
+      "/api", "APIHandler", parseConfig("root /api_root; layout sharded;")));
+  EXPECT_TRUE(dispatcher->registerPath(
+      "/api2", "APIHandler", parseConfig("root /api_root; layout flat;")));
+  EXPECT_FALSE(dispatcher->registerPath(
+      "/api3", "APIHandler", parseConfig("root /api_root; layout deep;")));
+}
+
+TEST_F(RequestHandlerDispatcherTest, RegisterPathAPIHandlerJsonBodies) {
+  EXPECT_TRUE(dispatcher->registerPath(
+      "/api", "APIHandler", parseConfig("root /api_root; json_bodies validate;")));
+  EXPECT_TRUE(dispatcher->registerPath(
+      "/api2", "APIHandler", parseConfig("root /api_root; json_bodies minify;")));
+  EXPECT_TRUE(dispatcher->registerPath(
+      "/api3", "APIHandler", parseConfig("root /api_root; json_bodies any;")));
+  EXPECT_FALSE(dispatcher->registerPath(
+      "/api4", "APIHandler", parseConfig("root /api_root; json_bodies strict;")));
+}
+
+TEST_F(RequestHandlerDispatcherTest, RegisterPathAPIHandlerIoThreads) {
+  EXPECT_TRUE(dispatcher->registerPath(
+      "/api", "APIHandler", parseConfig("root /api_root; io_threads 8; io_queue 64;")));
+  EXPECT_TRUE(dispatcher->registerPath(
+      "/api2", "APIHandler", parseConfig("root /api_root; io_threads 0;")));
+  EXPECT_FALSE(dispatcher->registerPath(
+      "/api3", "APIHandler", parseConfig("root /api_root; io_queue 0;")));
+  EXPECT_FALSE(dispatcher->registerPath(
+      "/api4", "APIHandler", parseConfig("root /api_root; io_threads many;")));
+}
+
+TEST_F(RequestHandlerDispatcherTest, RegisterPathAPIHandlerIndexes) {
+  EXPECT_TRUE(dispatcher->registerPath(
+      "/api", "APIHandler",
+      parseConfig("root /api_root; index Shoes.color Shoes.size; index Hats.brim.width;")));
+  EXPECT_EQ(typeid(*dispatcher->getRequestHandler("/api")),
+            typeid(RequestHandlerAPI));
+  EXPECT_FALSE(dispatcher->registerPath(
+      "/api2", "APIHandler", parseConfig("root /api_root; index color;")));
+  EXPECT_FALSE(dispatcher->registerPath(
+      "/api3", "APIHandler", parseConfig("root /api_root; index Shoes.;")));
+}
+
+// Dispatchers built by a config reload share the storage already open over a
+// root instead of opening it a second time
+TEST_F(RequestHandlerDispatcherTest, RegisterPathAPIHandlerSharesStorage) {
+  const std::string root = "../shared_storage_dispatch_test";
+  std::filesystem::remove_all(root);
+  NginxConfig config = parseConfig("root " + root + "; storage log;");
+  {
+    RequestHandlerDispatcher old_dispatcher(empty_config);
+    RequestHandlerDispatcher new_dispatcher(empty_config);
+    ASSERT_TRUE(old_dispatcher.registerPath("/api", "APIHandler", config));
+    ASSERT_TRUE(new_dispatcher.registerPath("/api", "APIHandler", config));
+
+    http::request<http::string_body> create{http::verb::post, "/api/Shoes", 11};
+    create.body() = "{}";
+    create.prepare_payload();
+    http::response<http::string_body> first, second;
+    old_dispatcher.getRequestHandler("/api")->handleRequest(create, &first);
+    new_dispatcher.getRequestHandler("/api")->handleRequest(create, &second);
+    EXPECT_EQ(first.body(), "{\"id\": 1}");
+    EXPECT_EQ(second.body(), "{\"id\": 2}");
+  }
+  // once nothing uses it, the next dispatcher opens it again
+  RequestHandlerDispatcher reopened(empty_config);
+  EXPECT_TRUE(reopened.registerPath("/api", "APIHandler", config));
+  std::filesystem::remove_all(root);
+  std::filesystem::remove(root + ".expiry");
+}
+
 TEST_F(RequestHandlerDispatcherTest, RegisterPathHealthHandler) {
   NginxConfig config = parseConfig("location /health HealthHandler {}");
   dispatcher->registerPath("/health", "HealthHandler", config);
@@ -71,6 +191,17 @@ TEST_F(RequestHandlerDispatcherTest, RegisterPathHealthHandler) {
   EXPECT_EQ(typeid(*handler), typeid(RequestHandlerHealth));
 }
 
+TEST_F(RequestHandlerDispatcherTest, RegisterPathMetricsHandler) {
+  NginxConfig config = parseConfig("location /metrics MetricsHandler {}");
+  EXPECT_TRUE(dispatcher->registerPath("/metrics", "MetricsHandler", config));
+
+  PathUri matched;
+  auto handler = dispatcher->getRequestHandler("/metrics", &matched);
+  ASSERT_NE(handler, nullptr);
+  EXPECT_EQ(typeid(*handler), typeid(RequestHandlerMetrics));
+  EXPECT_EQ(matched, "/metrics");
+}
+
 // TEST_F(RequestHandlerDispatcherTest, RegisterPathSleepHandler) {
 //   NginxConfig config = parseConfig("location /sleep SleepHandler {}");
 //   dispatcher->registerPath("/sleep", "SleepHandler", config);
@@ -1,17 +1,26 @@
+#include "../src/api/expiring_crud_handler.h"
+#include "../src/api/indexed_crud_handler.h"
+#include "../src/api/versioned_crud_handler.h"
 #include "../src/http/request_parser.h"
 #include "../src/request_handler/request_handler_404.h"
 #include "../src/request_handler/request_handler_api.h"
 #include "../src/request_handler/request_handler_echo.h"
 #include "../src/request_handler/request_handler_health.h"
+#include "../src/request_handler/request_handler_metrics.h"
 #include "../src/request_handler/request_handler_sleep.h"
 #include "../src/request_handler/request_handler_static.h"
+#include <algorithm>
 #include <boost/asio/buffer.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <filesystem>
+#include <future>
 #include <gtest/gtest.h>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <type_traits>
 
 namespace http = boost::beast::http;
@@ -77,6 +86,17 @@ public:
     mock_filesystem.erase(iter);
     return true;
   }
+
+  std::vector<int> list(const std::string &entity) override {
+    std::vector<int> ids;
+    const std::string prefix = entity + "/";
+    for (const auto &entry : mock_filesystem) {
+      if (entry.first.compare(0, prefix.size(), prefix) == 0)
+        ids.push_back(std::stoi(entry.first.substr(prefix.size())));
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+  }
 };
 
 class RequestHandlerTest : public ::testing::Test {
@@ -97,7 +117,7 @@ public:
   // Default constructor
   RequestHandlerTest()
       : handler_static("/data/", "/static/"),
-        handler_api(new MockCRUDHandler(), TEST_API_STORAGE_PREFIX) {}
+        handler_api(std::make_shared<MockCRUDHandler>(), TEST_API_STORAGE_PREFIX) {}
 
   void SetUp() override {
     // Initialize objects before each test
@@ -709,6 +729,39 @@ TEST_F(RequestHandlerTest, HealthRequestHandling) {
   EXPECT_EQ("OK", response_health.body());
 }
 
+TEST_F(RequestHandlerTest, MetricsRequestHandling) {
+  metrics::Registry registry;
+  registry.counter("http_requests_total", "Requests answered.",
+                   {{"code", "200"}})
+      .inc();
+  RequestHandlerMetrics handler_metrics(registry);
+  EXPECT_EQ("MetricsHandler", handler_metrics.getName());
+
+  http::request<http::string_body> request{http::verb::get, "/metrics", 11};
+  http::response<http::string_body> response;
+  handler_metrics.handleRequest(request, &response);
+  EXPECT_EQ(http::status::ok, response.result());
+  EXPECT_EQ("text/plain; version=0.0.4", response[http::field::content_type]);
+  EXPECT_EQ("# HELP http_requests_total Requests answered.\n"
+            "# TYPE http_requests_total counter\n"
+            "http_requests_total{code=\"200\"} 1\n",
+            response.body());
+
+  // HEAD gets the headers alone
+  request.method(http::verb::head);
+  http::response<http::string_body> head;
+  handler_metrics.handleRequest(request, &head);
+  EXPECT_EQ(http::status::ok, head.result());
+  EXPECT_EQ(std::to_string(response.body().size()),
+            head[http::field::content_length]);
+  EXPECT_TRUE(head.body().empty());
+
+  request.method(http::verb::post);
+  http::response<http::string_body> rejected;
+  handler_metrics.handleRequest(request, &rejected);
+  EXPECT_EQ(http::status::method_not_allowed, rejected.result());
+}
+
 TEST_F(RequestHandlerTest, SleepRequestHandling) {
   const std::string input = "GET /sleep HTTP/1.1\r\nHost: "
                             "www.example.com\r\nConnection: close\r\n\r\n";
@@ -806,3 +859,681 @@ TEST_F(RequestHandlerTest, PathCaseSensitivity) {
             http::status::not_found); // Assuming case-sensitivity that results
                                       // in a "not found" error
 }
+
+// Test case to verify base64 encoded payloads are decoded before storage
+TEST_F(RequestHandlerTest, CRUDAPIBase64BodyHandling) {
+  http::request<http::string_body> create{http::verb::post, "/api/Blobs", 11};
+  create.set(http::field::content_transfer_encoding, "base64");
+  create.body() = "AAECAw=="; // bytes 00 01 02 03
+  create.prepare_payload();
+  http::response<http::string_body> response_create;
+  handler_api.handleRequest(create, &response_create);
+  EXPECT_EQ(response_create.body(), "{\"id\": 1}");
+
+  http::request<http::string_body> read{http::verb::get, "/api/Blobs/1", 11};
+  http::response<http::string_body> response_read;
+  handler_api.handleRequest(read, &response_read);
+  EXPECT_EQ(response_read.body(), std::string("\0\1\2\3", 4));
+
+  http::request<http::string_body> bad{http::verb::put, "/api/Blobs/1", 11};
+  bad.set(http::field::content_transfer_encoding, "base64");
+  bad.body() = "not base64!";
+  bad.prepare_payload();
+  http::response<http::string_body> response_bad;
+  handler_api.handleRequest(bad, &response_bad);
+  EXPECT_EQ(response_bad.result(), http::status::bad_request);
+}
+
+// Test that a listing skips deleted ids instead of stopping at the first gap
+TEST_F(RequestHandlerTest, CRUDAPIListSkipsDeletedIds) {
+  for (int i = 0; i < 3; i++) {
+    http::request<http::string_body> create{http::verb::post, "/api/Hats", 11};
+    create.body() = "{}";
+    create.prepare_payload();
+    http::response<http::string_body> response_create;
+    handler_api.handleRequest(create, &response_create);
+  }
+
+  http::request<http::string_body> remove{http::verb::delete_, "/api/Hats/1",
+                                          11};
+  http::response<http::string_body> response_remove;
+  handler_api.handleRequest(remove, &response_remove);
+  EXPECT_EQ(response_remove.result(), http::status::ok);
+
+  http::request<http::string_body> list{http::verb::get, "/api/Hats", 11};
+  http::response<http::string_body> response_list;
+  handler_api.handleRequest(list, &response_list);
+  EXPECT_EQ(response_list.body(), "[2, 3]");
+}
+
+// Test that large entities are served from a mapping and small ones are not
+TEST_F(RequestHandlerTest, CRUDAPIMappedReadHandling) {
+  const std::string root = "../mapped_api_test/";
+  RequestHandlerAPI handler(std::make_shared<CRUDHandler>(root), "/api");
+  std::string big = "\"" + std::string(100 * 1024, 'x') + "\"";
+
+  http::request<http::string_body> create{http::verb::post, "/api/Docs", 11};
+  create.body() = big;
+  create.prepare_payload();
+  http::response<http::string_body> response_create;
+  handler.handleRequest(create, &response_create);
+  create.body() = "{}";
+  create.prepare_payload();
+  handler.handleRequest(create, &response_create);
+
+  http::request<http::string_body> read{http::verb::get, "/api/Docs/1", 11};
+  RequestHandler::SourceResponse response_read;
+  ASSERT_TRUE(handler.handleSourceRequest(read, &response_read));
+  std::ostringstream wire;
+  wire << response_read;
+  EXPECT_NE(wire.str().find("Content-Length: " + std::to_string(big.size())),
+            std::string::npos);
+  EXPECT_EQ(wire.str().substr(wire.str().size() - big.size()), big);
+
+  // small and missing bodies take the regular path
+  RequestHandler::SourceResponse unused;
+  http::request<http::string_body> small{http::verb::get, "/api/Docs/2", 11};
+  EXPECT_FALSE(handler.handleSourceRequest(small, &unused));
+  http::request<http::string_body> missing{http::verb::get, "/api/Docs/9", 11};
+  EXPECT_FALSE(handler.handleSourceRequest(missing, &unused));
+
+  std::filesystem::remove_all(root);
+}
+
+// Test that ?limit= pages through a collection with opaque cursors
+TEST_F(RequestHandlerTest, CRUDAPIPaginatedListHandling) {
+  for (int i = 0; i < 5; i++) {
+    http::request<http::string_body> create{http::verb::post, "/api/Pages", 11};
+    create.body() = "{}";
+    create.prepare_payload();
+    http::response<http::string_body> response_create;
+    handler_api.handleRequest(create, &response_create);
+  }
+
+  std::vector<std::string> pages;
+  std::string target = "/api/Pages?limit=2";
+  for (int i = 0; i < 5; i++) {
+    http::request<http::string_body> list{http::verb::get, target, 11};
+    http::response<http::string_body> response_list;
+    handler_api.handleRequest(list, &response_list);
+    EXPECT_EQ(response_list.result(), http::status::ok);
+    pages.push_back(response_list.body());
+    auto cursor = response_list.find("X-Next-Cursor");
+    if (cursor == response_list.end())
+      break;
+    target = "/api/Pages?limit=2&cursor=" + cursor->value().to_string();
+  }
+  EXPECT_EQ(pages, std::vector<std::string>({"[1, 2]", "[3, 4]", "[5]"}));
+}
+
+// Test that malformed pagination parameters are rejected
+TEST_F(RequestHandlerTest, CRUDAPIPaginationRejectsBadParameters) {
+  std::string other_cursor = RequestHandlerAPI::encodeCursor("Other", 3);
+  for (const std::string &target : std::vector<std::string>{
+           "/api/Pages?limit=0", "/api/Pages?limit=abc", "/api/Pages?limit=100000",
+        "/api/Pages?cursor=%%%", "/api/Pages?cursor=" + other_cursor}) {
+    http::request<http::string_body> list{http::verb::get, target, 11};
+    http::response<http::string_body> response_list;
+    handler_api.handleRequest(list, &response_list);
+    EXPECT_EQ(response_list.result(), http::status::bad_request) << target;
+  }
+
+  int after = 0;
+  EXPECT_TRUE(RequestHandlerAPI::decodeCursor(
+      "Pages", RequestHandlerAPI::encodeCursor("Pages", 42), &after));
+  EXPECT_EQ(after, 42);
+}
+
+// Test that ?expand=true inlines entity bodies
+TEST_F(RequestHandlerTest, CRUDAPIExpandedListHandling) {
+  // bodies that aren't JSON are inlined as strings
+  for (const std::string body : {"{\"a\": 1}", "{\"b\": 2}", "not \"json\""}) {
+    http::request<http::string_body> create{http::verb::post, "/api/Wide", 11};
+    create.body() = body;
+    create.prepare_payload();
+    http::response<http::string_body> response_create;
+    handler_api.handleRequest(create, &response_create);
+  }
+
+  http::request<http::string_body> list{http::verb::get, "/api/Wide?expand=true",
+                                        11};
+  http::response<http::string_body> response_list;
+  handler_api.handleRequest(list, &response_list);
+  EXPECT_EQ(response_list.body(), "[{\"id\": 1, \"data\": {\"a\": 1}}, "
+                                  "{\"id\": 2, \"data\": {\"b\": 2}}, "
+                                  "{\"id\": 3, \"data\": \"not \\\"json\\\"\"}]");
+}
+
+// Test that listings go out chunked, a page of ids at a time
+TEST_F(RequestHandlerTest, CRUDAPIStreamedListHandling) {
+  const int kEntities = 1200;
+  std::string expected = "[";
+  for (int i = 1; i <= kEntities; i++) {
+    http::request<http::string_body> create{http::verb::post, "/api/Many", 11};
+    create.prepare_payload();
+    http::response<http::string_body> response_create;
+    handler_api.handleRequest(create, &response_create);
+    expected += (i > 1 ? ", " : "") + std::to_string(i);
+  }
+  expected += "]";
+
+  http::request<http::string_body> list{http::verb::get, "/api/Many", 11};
+  RequestHandler::SourceResponse response_list;
+  ASSERT_TRUE(handler_api.handleSourceRequest(list, &response_list));
+  EXPECT_TRUE(response_list.chunked());
+
+  std::ostringstream wire;
+  wire << response_list;
+  http::response_parser<http::string_body> parser;
+  boost::system::error_code error;
+  parser.eager(true);
+  parser.put(boost::asio::buffer(wire.str()), error);
+  ASSERT_FALSE(error);
+  ASSERT_TRUE(parser.is_done());
+  EXPECT_EQ(parser.get().body(), expected);
+}
+
+// Test that POST <prefix>/_batch runs every operation and reports each result
+TEST_F(RequestHandlerTest, CRUDAPIBatchHandling) {
+  http::request<http::string_body> batch{http::verb::post, "/api/_batch", 11};
+  batch.body() = "[{\"op\": \"create\", \"entity\": \"Bags\", \"data\": {\"a\": 1}},"
+                 " {\"op\": \"create\", \"entity\": \"Bags\", \"data\": [2]},"
+                 " {\"op\": \"read\", \"entity\": \"Bags\", \"id\": 1},"
+                 " {\"op\": \"update\", \"entity\": \"Bags\", \"id\": 2, \"data\": 3},"
+                 " {\"op\": \"delete\", \"entity\": \"Bags\", \"id\": 1},"
+                 " {\"op\": \"read\", \"entity\": \"Bags\", \"id\": 7}]";
+  batch.prepare_payload();
+  http::response<http::string_body> response_batch;
+  handler_api.handleRequest(batch, &response_batch);
+  EXPECT_EQ(response_batch.result(), http::status::ok);
+  EXPECT_EQ(response_batch.body(),
+            "[{\"status\": 200, \"id\": 1}, {\"status\": 200, \"id\": 2}, "
+            "{\"status\": 200, \"id\": 1, \"data\": {\"a\": 1}}, "
+            "{\"status\": 200, \"id\": 2}, {\"status\": 200, \"id\": 1}, "
+            "{\"status\": 404, \"id\": 7}]");
+
+  http::request<http::string_body> read{http::verb::get, "/api/Bags/2", 11};
+  http::response<http::string_body> response_read;
+  handler_api.handleRequest(read, &response_read);
+  EXPECT_EQ(response_read.body(), "3");
+
+  // a body that isn't JSON is read back as a string
+  http::request<http::string_body> create{http::verb::post, "/api/Bags", 11};
+  create.body() = "plain text";
+  create.prepare_payload();
+  http::response<http::string_body> response_create;
+  handler_api.handleRequest(create, &response_create);
+  http::request<http::string_body> read_batch{http::verb::post, "/api/_batch", 11};
+  read_batch.body() = "[{\"op\": \"read\", \"entity\": \"Bags\", \"id\": 1}]";
+  read_batch.prepare_payload();
+  http::response<http::string_body> response_read_batch;
+  handler_api.handleRequest(read_batch, &response_read_batch);
+  EXPECT_EQ(response_read_batch.body(),
+            "[{\"status\": 200, \"id\": 1, \"data\": \"plain text\"}]");
+}
+
+// Test that a malformed batch is rejected before anything runs
+TEST_F(RequestHandlerTest, CRUDAPIBadBatchHandling) {
+  for (const std::string &body : std::vector<std::string>{
+           "{}", "[1]", "[{\"op\": \"create\", \"entity\": \"Bags\"}]",
+           "[{\"op\": \"read\", \"entity\": \"Bags\"}]",
+           "[{\"op\": \"read\", \"entity\": \"../etc\", \"id\": 1}]",
+           "[{\"op\": \"drop\", \"entity\": \"Bags\", \"id\": 1}]",
+           "[{\"op\": \"create\", \"entity\": \"Bags\", \"data\": 1}, 2]"}) {
+    http::request<http::string_body> batch{http::verb::post, "/api/_batch", 11};
+    batch.body() = body;
+    batch.prepare_payload();
+    http::response<http::string_body> response_batch;
+    handler_api.handleRequest(batch, &response_batch);
+    EXPECT_EQ(response_batch.result(), http::status::bad_request) << body;
+  }
+
+  http::request<http::string_body> list{http::verb::get, "/api/Bags", 11};
+  http::response<http::string_body> response_list;
+  handler_api.handleRequest(list, &response_list);
+  EXPECT_EQ(response_list.body(), "[]");
+}
+
+// Test that field=value parameters are answered from a secondary index
+TEST_F(RequestHandlerTest, CRUDAPIIndexedQueryHandling) {
+  RequestHandlerAPI handler(
+      std::make_shared<IndexedCRUDHandler>(new MockCRUDHandler(),
+                                           IndexedCRUDHandler::IndexSpec{{"Shoes", {"color", "size"}}}),
+      "/api");
+  for (const std::string body :
+       {"{\"color\": \"red\", \"size\": 9}", "{\"color\": \"blue\", \"size\": 9}",
+        "{\"color\": \"dark red\", \"size\": 10}", "{\"color\": \"red\", \"size\": 10}"}) {
+    http::request<http::string_body> create{http::verb::post, "/api/Shoes", 11};
+    create.body() = body;
+    create.prepare_payload();
+    http::response<http::string_body> response_create;
+    handler.handleRequest(create, &response_create);
+  }
+
+  const std::pair<std::string, std::string> queries[] = {
+      {"/api/Shoes?color=red", "[1, 4]"},
+      {"/api/Shoes?color=dark%20red", "[3]"},
+      {"/api/Shoes?color=red&size=10", "[4]"},
+      {"/api/Shoes?color=green", "[]"},
+      {"/api/Shoes?color=red&limit=1", "[1]"},
+      {"/api/Shoes?size=9&expand=true",
+       "[{\"id\": 1, \"data\": {\"color\": \"red\", \"size\": 9}}, "
+       "{\"id\": 2, \"data\": {\"color\": \"blue\", \"size\": 9}}]"}};
+  for (const auto &query : queries) {
+    http::request<http::string_body> list{http::verb::get, query.first, 11};
+    http::response<http::string_body> response_list;
+    handler.handleRequest(list, &response_list);
+    EXPECT_EQ(response_list.result(), http::status::ok) << query.first;
+    EXPECT_EQ(response_list.body(), query.second) << query.first;
+  }
+
+  // the next page of a filtered listing stays filtered
+  http::request<http::string_body> page{http::verb::get,
+                                        "/api/Shoes?color=red&limit=1", 11};
+  http::response<http::string_body> response_page;
+  handler.handleRequest(page, &response_page);
+  std::string next = "/api/Shoes?color=red&limit=1&cursor=" +
+                     response_page["X-Next-Cursor"].to_string();
+  http::request<http::string_body> page2{http::verb::get, next, 11};
+  http::response<http::string_body> response_page2;
+  handler.handleRequest(page2, &response_page2);
+  EXPECT_EQ(response_page2.body(), "[4]");
+  EXPECT_EQ(response_page2.find("X-Next-Cursor"), response_page2.end());
+
+  // parameters that name no indexed field are ignored rather than scanned for
+  const std::pair<std::string, std::string> ignored[] = {
+      {"/api/Shoes?price=5", "[1, 2, 3, 4]"},
+      {"/api/Shoes?color=red&price=5", "[1, 4]"}};
+  for (const auto &query : ignored) {
+    http::request<http::string_body> list{http::verb::get, query.first, 11};
+    http::response<http::string_body> response_list;
+    handler.handleRequest(list, &response_list);
+    EXPECT_EQ(response_list.result(), http::status::ok) << query.first;
+    EXPECT_EQ(response_list.body(), query.second) << query.first;
+  }
+}
+
+// Test that bodies are checked before anything is stored, and stored minified
+TEST_F(RequestHandlerTest, CRUDAPIJsonBodyHandling) {
+  auto crud = std::make_shared<MockCRUDHandler>();
+  RequestHandlerAPI handler(crud, "/api", RequestHandlerAPI::kMinify);
+
+  for (const std::string body : {"{\"a\": ", "not json", "\"\xc3\x28\""}) {
+    http::request<http::string_body> create{http::verb::post, "/api/Shoes", 11};
+    create.body() = body;
+    create.prepare_payload();
+    http::response<http::string_body> response_create;
+    handler.handleRequest(create, &response_create);
+    EXPECT_EQ(response_create.result(), http::status::bad_request) << body;
+    EXPECT_EQ(response_create.body(), "Invalid Request: body is not valid JSON");
+  }
+  EXPECT_TRUE(crud->list("Shoes").empty());
+
+  http::request<http::string_body> create{http::verb::post, "/api/Shoes", 11};
+  create.body() = "{ \"color\" : \"dark red\",\n  \"size\": [ 9, 10 ] }";
+  create.prepare_payload();
+  http::response<http::string_body> response_create;
+  handler.handleRequest(create, &response_create);
+  EXPECT_EQ(response_create.result(), http::status::ok);
+  EXPECT_EQ(crud->read("Shoes", 1), "{\"color\":\"dark red\",\"size\":[9,10]}");
+
+  http::request<http::string_body> update{http::verb::put, "/api/Shoes/1", 11};
+  update.body() = "{\"size\": 9,}";
+  update.prepare_payload();
+  http::response<http::string_body> response_update;
+  handler.handleRequest(update, &response_update);
+  EXPECT_EQ(response_update.result(), http::status::bad_request);
+  EXPECT_EQ(crud->read("Shoes", 1), "{\"color\":\"dark red\",\"size\":[9,10]}");
+
+  http::request<http::string_body> batch{http::verb::post, "/api/_batch", 11};
+  batch.body() = "[{\"op\": \"update\", \"entity\": \"Shoes\", \"id\": 1, "
+                 "\"data\": { \"size\" : 11 }}]";
+  batch.prepare_payload();
+  http::response<http::string_body> response_batch;
+  handler.handleRequest(batch, &response_batch);
+  EXPECT_EQ(response_batch.result(), http::status::ok);
+  EXPECT_EQ(crud->read("Shoes", 1), "{\"size\":11}");
+}
+
+// Test NDJSON imports, and exports that can be imported again
+TEST_F(RequestHandlerTest, CRUDAPINdjsonHandling) {
+  auto crud = std::make_shared<MockCRUDHandler>();
+  RequestHandlerAPI handler(crud, "/api", RequestHandlerAPI::kMinify);
+
+  // one bad line refuses the whole upload
+  http::request<http::string_body> bad{http::verb::post,
+                                       "/api/Shoes?format=ndjson", 11};
+  bad.body() = "{\"size\": 9}\n{\"size\": \n";
+  bad.prepare_payload();
+  http::response<http::string_body> response_bad;
+  handler.handleRequest(bad, &response_bad);
+  EXPECT_EQ(response_bad.result(), http::status::bad_request);
+  EXPECT_EQ(response_bad.body(), "Invalid Request: line 2 is not valid JSON");
+  EXPECT_TRUE(crud->list("Shoes").empty());
+
+  // more lines than one storage batch, with blank lines and CRLFs
+  const int kLines = RequestHandlerAPI::kMaxBatchOperations + 5;
+  std::string upload = "\r\n";
+  for (int i = 1; i <= kLines; i++)
+    upload += "{ \"size\": " + std::to_string(i) + " }\r\n";
+  http::request<http::string_body> import{http::verb::post,
+                                          "/api/Shoes?format=ndjson", 11};
+  import.body() = upload;
+  import.prepare_payload();
+  http::response<http::string_body> response_import;
+  handler.handleRequest(import, &response_import);
+  EXPECT_EQ(response_import.result(), http::status::ok);
+  std::string summary = "{\"created\": " + std::to_string(kLines) +
+                        ", \"failed\": 0, \"ids\": [1, 2, ";
+  EXPECT_EQ(response_import.body().substr(0, summary.size()), summary);
+  // ids are only listed for the first batch of lines
+  const std::string &answer = response_import.body();
+  EXPECT_EQ(std::count(answer.begin(), answer.end(), ','),
+            RequestHandlerAPI::kMaxBatchOperations + 1);
+  EXPECT_NE(answer.find(", 1000]}"), std::string::npos);
+  ASSERT_EQ(crud->list("Shoes").size(), static_cast<size_t>(kLines));
+  EXPECT_EQ(crud->read("Shoes", kLines),
+            "{\"size\":" + std::to_string(kLines) + "}");
+
+  // the export streams one record per line
+  crud->update("Shoes", 2, "not json");
+  http::request<http::string_body> list{http::verb::get,
+                                        "/api/Shoes?format=ndjson", 11};
+  RequestHandler::SourceResponse response_list;
+  ASSERT_TRUE(handler.handleSourceRequest(list, &response_list));
+  EXPECT_EQ(response_list[http::field::content_type], "application/x-ndjson");
+  std::ostringstream wire;
+  wire << response_list;
+  http::response_parser<http::string_body> parser;
+  boost::system::error_code error;
+  parser.eager(true);
+  parser.put(boost::asio::buffer(wire.str()), error);
+  ASSERT_TRUE(parser.is_done());
+  std::string exported = parser.get().body();
+  std::string head = "{\"id\":1,\"data\":{\"size\":1}}\n"
+                     "{\"id\":2,\"data\":\"not json\"}\n";
+  EXPECT_EQ(exported.substr(0, head.size()), head);
+  EXPECT_EQ(std::count(exported.begin(), exported.end(), '\n'), kLines);
+
+  // which can be loaded into another collection as it is
+  http::request<http::string_body> reimport{
+      http::verb::post, "/api/Boots?format=ndjson&wrapped=true", 11};
+  reimport.body() = exported;
+  reimport.prepare_payload();
+  http::response<http::string_body> response_reimport;
+  handler.handleRequest(reimport, &response_reimport);
+  EXPECT_EQ(response_reimport.result(), http::status::ok);
+  ASSERT_EQ(crud->list("Boots").size(), static_cast<size_t>(kLines));
+  EXPECT_EQ(crud->read("Boots", 1), "{\"size\":1}");
+  EXPECT_EQ(crud->read("Boots", 2), "\"not json\"");
+
+  http::request<http::string_body> paged{
+      http::verb::get, "/api/Boots?format=ndjson&limit=1", 11};
+  http::response<http::string_body> response_paged;
+  handler.handleRequest(paged, &response_paged);
+  EXPECT_EQ(response_paged.body(), "{\"id\":1,\"data\":{\"size\":1}}\n");
+  EXPECT_FALSE(response_paged["X-Next-Cursor"].empty());
+
+  http::request<http::string_body> unknown{http::verb::get,
+                                           "/api/Boots?format=xml", 11};
+  http::response<http::string_body> response_unknown;
+  handler.handleRequest(unknown, &response_unknown);
+  EXPECT_EQ(response_unknown.result(), http::status::bad_request);
+}
+
+// Test that X-TTL and ?ttl= make instances expire
+TEST_F(RequestHandlerTest, CRUDAPITtlHandling) {
+  std::atomic<uint64_t> now{1700000000};
+  const std::string journal = "../fs_test_ttl_journal";
+  std::filesystem::remove(journal);
+  RequestHandlerAPI handler(
+      std::make_shared<ExpiringCRUDHandler>(new MockCRUDHandler(), journal,
+                                            std::chrono::milliseconds(0),
+                                            [&now] { return now.load(); }),
+      "/api");
+
+  http::request<http::string_body> create{http::verb::post, "/api/Sessions", 11};
+  create.set(RequestHandlerAPI::kTtlHeader, "30");
+  create.body() = "{\"user\": 1}";
+  create.prepare_payload();
+  http::response<http::string_body> response_create;
+  handler.handleRequest(create, &response_create);
+  EXPECT_EQ(response_create.result(), http::status::ok);
+
+  // a refresh moves the deadline out
+  now += 20;
+  http::request<http::string_body> refresh{http::verb::put,
+                                           "/api/Sessions/1?ttl=30", 11};
+  refresh.body() = "{\"user\": 1}";
+  refresh.prepare_payload();
+  http::response<http::string_body> response_refresh;
+  handler.handleRequest(refresh, &response_refresh);
+  EXPECT_EQ(response_refresh.result(), http::status::ok);
+
+  now += 20;
+  http::request<http::string_body> get{http::verb::get, "/api/Sessions/1", 11};
+  http::response<http::string_body> response_live;
+  handler.handleRequest(get, &response_live);
+  EXPECT_EQ(response_live.result(), http::status::ok);
+
+  now += 10;
+  http::response<http::string_body> response_expired;
+  handler.handleRequest(get, &response_expired);
+  EXPECT_EQ(response_expired.result(), http::status::not_found);
+
+  refresh.target("/api/Sessions/1?ttl=soon");
+  http::response<http::string_body> response_bad;
+  handler.handleRequest(refresh, &response_bad);
+  EXPECT_EQ(response_bad.result(), http::status::bad_request);
+  std::filesystem::remove(journal);
+}
+
+// Test that a create the backend fails to store is answered 500, with or
+// without a ttl
+TEST_F(RequestHandlerTest, CRUDAPIFailedCreateHandling) {
+  class FailingCRUDHandler : public MockCRUDHandler {
+  public:
+    std::string create(const std::string &, const std::string &) override {
+      return "";
+    }
+  };
+  RequestHandlerAPI handler(std::make_shared<FailingCRUDHandler>(), "/api");
+
+  for (const std::string target : {"/api/Shoes", "/api/Shoes?ttl=30"}) {
+    http::request<http::string_body> create{http::verb::post, target, 11};
+    create.body() = "{\"size\": 9}";
+    create.prepare_payload();
+    http::response<http::string_body> response;
+    handler.handleRequest(create, &response);
+    EXPECT_EQ(response.result(), http::status::internal_server_error) << target;
+  }
+}
+
+// Test that an import whose instances can't be given their ttl is answered
+// 500 and leaves none of them behind
+TEST_F(RequestHandlerTest, CRUDAPINdjsonTtlFailureHandling) {
+  // a backend that can't expire instances
+  auto crud = std::make_shared<MockCRUDHandler>();
+  RequestHandlerAPI handler(crud, "/api");
+
+  http::request<http::string_body> import{
+      http::verb::post, "/api/Shoes?format=ndjson&ttl=30", 11};
+  import.body() = "{\"size\": 9}\n{\"size\": 10}\n";
+  import.prepare_payload();
+  http::response<http::string_body> response;
+  handler.handleRequest(import, &response);
+  EXPECT_EQ(response.result(), http::status::internal_server_error);
+  EXPECT_TRUE(crud->list("Shoes").empty());
+}
+
+// Test ETags, If-None-Match on GET and If-Match on PUT and DELETE
+TEST_F(RequestHandlerTest, CRUDAPIConditionalRequestHandling) {
+  RequestHandlerAPI handler(std::make_shared<VersionedCRUDHandler>(new MockCRUDHandler()), "/api");
+  http::request<http::string_body> create{http::verb::post, "/api/Shoes", 11};
+  create.body() = "{\"size\": 9}";
+  create.prepare_payload();
+  http::response<http::string_body> response_create;
+  handler.handleRequest(create, &response_create);
+
+  http::request<http::string_body> get{http::verb::get, "/api/Shoes/1", 11};
+  http::response<http::string_body> response_get;
+  handler.handleRequest(get, &response_get);
+  std::string etag = response_get[http::field::etag].to_string();
+  ASSERT_FALSE(etag.empty());
+  EXPECT_EQ(etag.front(), '"');
+
+  // unchanged: 304 without a body
+  get.set(http::field::if_none_match, "\"1\", W/" + etag);
+  http::response<http::string_body> response_cached;
+  handler.handleRequest(get, &response_cached);
+  EXPECT_EQ(response_cached.result(), http::status::not_modified);
+  EXPECT_TRUE(response_cached.body().empty());
+
+  // the first writer holding the ETag wins, the second gets a 412
+  http::request<http::string_body> put{http::verb::put, "/api/Shoes/1", 11};
+  put.set(http::field::if_match, etag);
+  put.body() = "{\"size\": 10}";
+  put.prepare_payload();
+  http::response<http::string_body> response_put;
+  handler.handleRequest(put, &response_put);
+  EXPECT_EQ(response_put.result(), http::status::ok);
+  std::string new_etag = response_put[http::field::etag].to_string();
+  EXPECT_NE(new_etag, etag);
+
+  put.body() = "{\"size\": 11}";
+  put.prepare_payload();
+  http::response<http::string_body> response_conflict;
+  handler.handleRequest(put, &response_conflict);
+  EXPECT_EQ(response_conflict.result(), http::status::precondition_failed);
+
+  // weak tags never satisfy If-Match
+  put.set(http::field::if_match, "W/" + new_etag);
+  http::response<http::string_body> response_weak;
+  handler.handleRequest(put, &response_weak);
+  EXPECT_EQ(response_weak.result(), http::status::precondition_failed);
+
+  // a stale If-None-Match gets the new body
+  http::response<http::string_body> response_changed;
+  handler.handleRequest(get, &response_changed);
+  EXPECT_EQ(response_changed.result(), http::status::ok);
+  EXPECT_EQ(response_changed.body(), "{\"size\": 10}");
+  EXPECT_EQ(response_changed[http::field::etag].to_string(), new_etag);
+
+  http::request<http::string_body> del{http::verb::delete_, "/api/Shoes/1", 11};
+  del.set(http::field::if_match, etag);
+  http::response<http::string_body> response_stale_delete;
+  handler.handleRequest(del, &response_stale_delete);
+  EXPECT_EQ(response_stale_delete.result(), http::status::precondition_failed);
+  del.set(http::field::if_match, "*");
+  http::response<http::string_body> response_delete;
+  handler.handleRequest(del, &response_delete);
+  EXPECT_EQ(response_delete.result(), http::status::ok);
+  http::response<http::string_body> response_gone;
+  handler.handleRequest(del, &response_gone);
+  EXPECT_EQ(response_gone.result(), http::status::precondition_failed);
+}
+
+// Test that a streamed listing reads the bodies of all but its first chunk on
+// the storage executor, ahead of the writer
+TEST_F(RequestHandlerTest, CRUDAPIPrefetchedListHandling) {
+  class ThreadRecordingCRUDHandler : public MockCRUDHandler {
+  public:
+    std::string read(const std::string &entity, int id) override {
+      std::lock_guard<std::mutex> lock(mutex);
+      readers.push_back(std::this_thread::get_id());
+      return MockCRUDHandler::read(entity, id);
+    }
+    std::mutex mutex;
+    std::vector<std::thread::id> readers;
+  };
+  auto crud = std::make_shared<ThreadRecordingCRUDHandler>();
+  RequestHandlerAPI handler(crud, "/api", RequestHandlerAPI::kNoCheck,
+                            std::make_shared<StorageExecutor>(1, 4));
+  const int kEntities = 1200;
+  std::string expected = "[";
+  for (int i = 1; i <= kEntities; i++) {
+    crud->create("Many", std::to_string(i));
+    expected += (i > 1 ? ", " : "") + std::string("{\"id\": ") +
+                std::to_string(i) + ", \"data\": " + std::to_string(i) + "}";
+  }
+  expected += "]";
+
+  // this thread stands in for the I/O thread the request is answered on,
+  // which builds the first chunk, and then for the network thread
+  http::request<http::string_body> list{http::verb::get,
+                                        "/api/Many?expand=true", 11};
+  RequestHandler::SourceResponse response_list;
+  ASSERT_TRUE(handler.handleSourceRequest(list, &response_list));
+  std::ostringstream wire;
+  wire << response_list;
+  http::response_parser<http::string_body> parser;
+  boost::system::error_code error;
+  parser.eager(true);
+  parser.put(boost::asio::buffer(wire.str()), error);
+  ASSERT_TRUE(parser.is_done());
+  EXPECT_EQ(parser.get().body(), expected);
+
+  std::lock_guard<std::mutex> lock(crud->mutex);
+  ASSERT_EQ(crud->readers.size(), static_cast<size_t>(kEntities));
+  EXPECT_EQ(std::count(crud->readers.begin(), crud->readers.end(),
+                       std::this_thread::get_id()),
+            512);
+}
+
+// Test that requests run on the storage executor and are refused with a 503
+// once its queue is full
+TEST_F(RequestHandlerTest, CRUDAPIAsyncRequestHandling) {
+  auto executor = std::make_shared<StorageExecutor>(1, 1);
+  RequestHandlerAPI handler(std::make_shared<MockCRUDHandler>(), "/api",
+                            RequestHandlerAPI::kNoCheck, executor);
+
+  auto create = std::make_shared<http::request<http::string_body>>(
+      http::verb::post, "/api/Shoes", 11);
+  create->body() = "{\"size\": 9}";
+  create->prepare_payload();
+  http::response<http::string_body> response_create;
+  RequestHandler::SourceResponse source_create;
+  std::promise<bool> created;
+  ASSERT_TRUE(handler.handleAsyncRequest(
+      create, &response_create, &source_create,
+      [&created](bool use_source) { created.set_value(use_source); }));
+  EXPECT_FALSE(created.get_future().get());
+  EXPECT_EQ(response_create.result(), http::status::ok);
+  EXPECT_EQ(response_create.body(), "{\"id\": 1}");
+
+  // park the only I/O thread and fill the one queue slot
+  std::promise<void> release, started;
+  std::shared_future<void> released = release.get_future().share();
+  executor->submit([&started, released] {
+    started.set_value();
+    released.wait();
+  });
+  started.get_future().wait();
+  executor->submit([] {});
+
+  auto get = std::make_shared<http::request<http::string_body>>(
+      http::verb::get, "/api/Shoes/1", 11);
+  http::response<http::string_body> response_get;
+  RequestHandler::SourceResponse source_get;
+  bool answered = false;
+  ASSERT_TRUE(handler.handleAsyncRequest(
+      get, &response_get, &source_get,
+      [&answered](bool) { answered = true; }));
+  EXPECT_TRUE(answered);
+  EXPECT_EQ(response_get.result(), http::status::service_unavailable);
+
+  // stats don't wait behind the queue
+  auto stats = std::make_shared<http::request<http::string_body>>(
+      http::verb::get, "/api/_storage", 11);
+  http::response<http::string_body> response_stats;
+  RequestHandler::SourceResponse source_stats;
+  EXPECT_FALSE(handler.handleAsyncRequest(stats, &response_stats, &source_stats,
+                                          [](bool) {}));
+  handler.handleRequest(*stats, &response_stats);
+  EXPECT_EQ(response_stats.result(), http::status::ok);
+  EXPECT_NE(response_stats.body().find("\"queued\": 1, \"running\": 1"),
+            std::string::npos)
+      << response_stats.body();
+  EXPECT_NE(response_stats.body().find("\"rejected\": 1,"), std::string::npos);
+  release.set_value();
+}
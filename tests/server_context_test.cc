@@ -0,0 +1,92 @@
+#include "../src/config_parser.h"
+#include "../src/credential_store.h"
+#include "../src/request_handler_dispatcher.h"
+#include "../src/server_context.h"
+#include "../src/session_token.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <sstream>
+
+class ServerContextTest : public ::testing::Test {
+protected:
+  NginxConfigParser parser;
+  NginxConfig config;
+
+  bool parseString(const std::string &config_string) {
+    std::istringstream config_stream(config_string);
+    return parser.Parse(&config_stream, &config);
+  }
+};
+
+TEST_F(ServerContextTest, BuildsFromConfig) {
+  ASSERT_TRUE(parseString(R"(
+  server {
+      port 80;
+      timer 15;
+      client_max_body_size 1024;
+      credentials {
+          tariq:123;
+      }
+      session_cookie {
+          secret abc;
+      }
+      location /echo/ EchoHandler {
+      }
+  }
+  )"));
+
+  auto context = ServerContext::fromConfig(config);
+  ASSERT_NE(context, nullptr);
+  EXPECT_EQ(context->authTime(), 15);
+  EXPECT_EQ(context->maxRequestSize(), 1024);
+  EXPECT_TRUE(context->credentials().verify("tariq", "123"));
+  EXPECT_NE(context->tokenSigner(), nullptr);
+  EXPECT_NE(context->dispatcher()->getRequestHandler("/echo"), nullptr);
+  EXPECT_NE(context->config(), nullptr);
+}
+
+TEST_F(ServerContextTest, DefaultsWithoutOptionalSettings) {
+  ASSERT_TRUE(parseString("server { port 80; timer 10; }"));
+
+  auto context = ServerContext::fromConfig(config);
+  ASSERT_NE(context, nullptr);
+  EXPECT_EQ(context->maxRequestSize(), ServerContext::kDefaultMaxRequestSize);
+  EXPECT_EQ(context->tokenSigner(), nullptr);
+  EXPECT_EQ(context->credentials().size(), 0);
+  EXPECT_EQ(context->accessLog(), nullptr);
+}
+
+TEST_F(ServerContextTest, RequiresAuthTime) {
+  ASSERT_TRUE(parseString("server { port 80; }"));
+  EXPECT_EQ(ServerContext::fromConfig(config), nullptr);
+}
+
+TEST_F(ServerContextTest, OpensAccessLog) {
+  ASSERT_TRUE(parseString(
+      "server { port 80; timer 10; access_log server_context_access.bin; }"));
+  auto context = ServerContext::fromConfig(config);
+  ASSERT_NE(context, nullptr);
+  EXPECT_NE(context->accessLog(), nullptr);
+  context.reset();
+  std::remove("server_context_access.bin");
+
+  config = NginxConfig();
+  ASSERT_TRUE(parseString(
+      "server { port 80; timer 10; access_log no_such_dir/access.bin; }"));
+  EXPECT_EQ(ServerContext::fromConfig(config), nullptr);
+}
+
+TEST_F(ServerContextTest, OpensTraceFile) {
+  ASSERT_TRUE(parseString("server { port 80; timer 10; "
+                          "tracing { file server_context_trace.jsonl; } }"));
+  auto context = ServerContext::fromConfig(config);
+  ASSERT_NE(context, nullptr);
+  EXPECT_NE(context->tracer(), nullptr);
+  context.reset();
+  std::remove("server_context_trace.jsonl");
+
+  config = NginxConfig();
+  ASSERT_TRUE(parseString("server { port 80; timer 10; "
+                          "tracing { file no_such_dir/trace.jsonl; } }"));
+  EXPECT_EQ(ServerContext::fromConfig(config), nullptr);
+}
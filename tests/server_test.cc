@@ -1,5 +1,7 @@
 #include "../src/config_parser.h"
+#include "../src/credential_store.h"
 #include "../src/server.h"
+#include "../src/server_context.h"
 #include "../src/session.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -22,8 +24,8 @@ protected:
 class MockSession : public session {
 public:
   MockSession(boost::asio::io_service &io_service,
-              std::shared_ptr<const RequestHandlerDispatcher> dispatcher, const std::map<std::string, std::string> &credentials, short auth_time)
-      : session(io_service, dispatcher, credentials, auth_time) {}
+              std::shared_ptr<const ServerContext> context)
+      : session(io_service, context) {}
   MOCK_METHOD0(start, void());
 };
 
@@ -31,12 +33,17 @@ TEST_F(ServerTest, HandleAcceptTest) {
   // Initialize the io_service
   boost::asio::io_service io_service;
 
-  // Create a mock session with the io_service and dispatcher
+  // Create a mock session with the io_service and an empty context
+  auto context = std::make_shared<const ServerContext>(
+      nullptr,
+      std::make_shared<const CredentialStore>(
+          std::map<std::string, std::string>()),
+      10);
   std::shared_ptr<MockSession> mock_session =
-      std::make_shared<MockSession>(io_service, nullptr, std::map<std::string, std::string>(), 10);
+      std::make_shared<MockSession>(io_service, context);
 
   // Create a server object
-  server s(io_service, 8080, out_config_, std::map<std::string, std::string>(), 10);
+  server s(io_service, 8080, context);
 
   // Simulate an incoming connection
   tcp::socket mock_socket(io_service);
@@ -51,3 +58,17 @@ TEST_F(ServerTest, HandleAcceptTest) {
   // Close the mock socket
   mock_socket.close();
 }
+
+TEST_F(ServerTest, ReloadSwapsContext) {
+  boost::asio::io_service io_service;
+  auto credentials = std::make_shared<const CredentialStore>(
+      std::map<std::string, std::string>());
+  auto first = std::make_shared<const ServerContext>(nullptr, credentials, 10);
+  auto second = std::make_shared<const ServerContext>(nullptr, credentials, 20);
+
+  server s(io_service, 8081, first);
+  EXPECT_EQ(s.context(), first);
+  s.reload(second);
+  EXPECT_EQ(s.context(), second);
+  EXPECT_EQ(s.context()->authTime(), 20);
+}
@@ -1,7 +1,10 @@
 #include "../src/config_parser.h"
+#include "../src/credential_store.h"
 #include "../src/request_handler/request_handler_echo.h"
 #include "../src/request_handler_dispatcher.h"
+#include "../src/server_context.h"
 #include "../src/session.h"
+#include "../src/session_token.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include <sstream>
@@ -24,7 +27,7 @@ protected:
   std::shared_ptr<MockRequestHandlerDispatcher> dispatcher;
   boost::asio::io_service io_service;
   std::shared_ptr<session> new_session;
-  std::map<std::string, std::string> credentials;
+  std::shared_ptr<const CredentialStore> credentials;
   short auth_time;
 
   void SetUp() override {
@@ -60,11 +63,13 @@ protected:
 
     auth_time = config.get_auth_time();
     // Extract credentials from the configuration
-    credentials = config.get_credentials();
+    credentials =
+        std::make_shared<const CredentialStore>(config.get_credentials());
 
     dispatcher = std::make_shared<MockRequestHandlerDispatcher>(config);
-    new_session =
-        std::make_shared<session>(io_service, dispatcher, credentials, auth_time);
+    new_session = std::make_shared<session>(
+        io_service,
+        std::make_shared<const ServerContext>(dispatcher, credentials, auth_time));
   }
 
   void TearDown() override {
@@ -201,3 +206,69 @@ TEST_F(SessionTest, SessionExpiration) {
 
   EXPECT_EQ(ret, 1);
 }
+
+TEST_F(SessionTest, SessionCookieReplacesCredentials) {
+  std::shared_ptr<RequestHandler> empty_handler =
+      std::make_shared<RequestHandlerEcho>();
+  EXPECT_CALL(*dispatcher, getRequestHandler(_))
+      .WillRepeatedly(Return(empty_handler));
+
+  auto signer = std::make_shared<const SessionTokenSigner>(
+      "secret", std::chrono::seconds(60));
+  auto cookie_session = std::make_shared<session>(
+      io_service, std::make_shared<const ServerContext>(
+                      dispatcher, credentials, auth_time, signer));
+
+  // No Authorization header, only a cookie issued by the same secret
+  cookie_session->start();
+  simulate_read_data(*cookie_session,
+                     "GET / HTTP/1.1\r\nCookie: swifties_session=" +
+                         signer->issue("tariq") + "\r\n\r\n");
+  int ret = cookie_session->handle_read_callback(
+      cookie_session, boost::system::error_code(), 4096);
+  EXPECT_EQ(ret, 0);
+}
+
+TEST_F(SessionTest, ForgedSessionCookieRejected) {
+  auto signer = std::make_shared<const SessionTokenSigner>(
+      "secret", std::chrono::seconds(60));
+  SessionTokenSigner attacker("guess", std::chrono::seconds(60));
+  auto cookie_session = std::make_shared<session>(
+      io_service, std::make_shared<const ServerContext>(
+                      dispatcher, credentials, auth_time, signer));
+
+  cookie_session->start();
+  simulate_read_data(*cookie_session,
+                     "GET / HTTP/1.1\r\nCookie: swifties_session=" +
+                         attacker.issue("tariq") + "\r\n\r\n");
+  int ret = cookie_session->handle_read_callback(
+      cookie_session, boost::system::error_code(), 4096);
+  EXPECT_EQ(ret, 1);
+}
+
+TEST_F(SessionTest, RequestOverSizeLimitRejected) {
+  EXPECT_CALL(*dispatcher, getRequestHandler(_)).Times(0);
+
+  auto limited_session = std::make_shared<session>(
+      io_service, std::make_shared<const ServerContext>(
+                      dispatcher, credentials, auth_time, nullptr, 64));
+  limited_session->start();
+  simulate_read_data(*limited_session,
+                     "POST / HTTP/1.1\r\nAuthorization: Basic "
+                     "dGFyaXE6MTIz\r\nContent-Length: 100\r\n\r\n" +
+                         std::string(100, 'x'));
+  int ret = limited_session->handle_read_callback(
+      limited_session, boost::system::error_code(), 4096);
+  EXPECT_EQ(ret, 1);
+}
+
+TEST_F(SessionTest, SessionsShareContext) {
+  auto context =
+      std::make_shared<const ServerContext>(dispatcher, credentials, auth_time);
+  {
+    auto a = std::make_shared<session>(io_service, context);
+    auto b = std::make_shared<session>(io_service, context);
+    EXPECT_EQ(context.use_count(), 3);
+  }
+  EXPECT_EQ(context.use_count(), 1);
+}
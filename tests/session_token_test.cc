@@ -0,0 +1,65 @@
+#include "../src/session_token.h"
+#include "gtest/gtest.h"
+
+class SessionTokenTest : public ::testing::Test {
+protected:
+  SessionTokenSigner signer{"test-secret", std::chrono::seconds(60)};
+};
+
+TEST_F(SessionTokenTest, IssueAndVerify) {
+  std::string token = signer.issue("tariq");
+  std::string username;
+  EXPECT_TRUE(signer.verify(token, &username));
+  EXPECT_EQ(username, "tariq");
+}
+
+TEST_F(SessionTokenTest, RejectsTamperedToken) {
+  std::string token = signer.issue("tariq");
+  std::string username;
+  // Swap the username while keeping the original MAC
+  std::string forged = signer.issue("milly").substr(0, token.find('.')) +
+                       token.substr(token.find('.'));
+  EXPECT_FALSE(signer.verify(forged, &username));
+  token[token.size() - 3] = token[token.size() - 3] == 'A' ? 'B' : 'A';
+  EXPECT_FALSE(signer.verify(token, &username));
+  EXPECT_FALSE(signer.verify("garbage", &username));
+  EXPECT_FALSE(signer.verify("", &username));
+}
+
+TEST_F(SessionTokenTest, RejectsExpiredToken) {
+  std::string username;
+  EXPECT_FALSE(signer.verify(signer.issue("tariq", 1), &username));
+}
+
+TEST_F(SessionTokenTest, RejectsTokenFromOtherSecret) {
+  SessionTokenSigner other("other-secret", std::chrono::seconds(60));
+  std::string username;
+  EXPECT_FALSE(signer.verify(other.issue("tariq"), &username));
+}
+
+TEST_F(SessionTokenTest, RandomSecretsDiffer) {
+  SessionTokenSigner a("", std::chrono::seconds(60));
+  SessionTokenSigner b("", std::chrono::seconds(60));
+  std::string username;
+  EXPECT_TRUE(a.verify(a.issue("tariq"), &username));
+  EXPECT_FALSE(b.verify(a.issue("tariq"), &username));
+}
+
+TEST_F(SessionTokenTest, FindTokenInCookieHeader) {
+  boost::string_view token;
+  EXPECT_TRUE(SessionTokenSigner::findToken(
+      "theme=dark; swifties_session=abc.1.xyz=; lang=en", &token));
+  EXPECT_EQ(token, "abc.1.xyz=");
+  EXPECT_TRUE(SessionTokenSigner::findToken("swifties_session=t", &token));
+  EXPECT_EQ(token, "t");
+  EXPECT_FALSE(SessionTokenSigner::findToken("theme=dark", &token));
+  EXPECT_FALSE(
+      SessionTokenSigner::findToken("swifties_session_old=x", &token));
+}
+
+TEST_F(SessionTokenTest, CookieAttributes) {
+  std::string cookie = signer.cookie("tok");
+  EXPECT_EQ(cookie.rfind("swifties_session=tok;", 0), 0);
+  EXPECT_NE(cookie.find("Max-Age=60"), std::string::npos);
+  EXPECT_NE(cookie.find("HttpOnly"), std::string::npos);
+}
@@ -0,0 +1,80 @@
+#include "gtest/gtest.h"
+#include "../src/api/storage_executor.h"
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+
+TEST(StorageExecutorTest, RunsTasksOffTheCallingThread) {
+    StorageExecutor executor(2, 16);
+    std::promise<std::thread::id> ran_on;
+    ASSERT_TRUE(executor.submit([&ran_on] { ran_on.set_value(std::this_thread::get_id()); }));
+    EXPECT_NE(std::this_thread::get_id(), ran_on.get_future().get());
+}
+
+TEST(StorageExecutorTest, RejectsWhenQueueIsFull) {
+    StorageExecutor executor(1, 2);
+    // park the only thread so the queue fills up behind it
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool release = false;
+    std::promise<void> started;
+    ASSERT_TRUE(executor.submit([&] {
+        started.set_value();
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&release] { return release; });
+    }));
+    started.get_future().wait();
+
+    std::atomic<int> ran{0};
+    EXPECT_TRUE(executor.submit([&ran] { ran++; }));
+    EXPECT_TRUE(executor.submit([&ran] { ran++; }));
+    EXPECT_FALSE(executor.submit([&ran] { ran++; }));
+
+    StorageExecutor::Stats stats = executor.stats();
+    EXPECT_EQ(1u, stats.threads);
+    EXPECT_EQ(2u, stats.queue_capacity);
+    EXPECT_EQ(2u, stats.queued);
+    EXPECT_EQ(1u, stats.running);
+    EXPECT_EQ(1u, stats.rejected);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    cv.notify_all();
+    std::promise<void> drained;
+    while (!executor.submit([&drained] { drained.set_value(); })) {
+        std::this_thread::yield();
+    }
+    drained.get_future().wait();
+    EXPECT_EQ(2, ran);
+}
+
+TEST(StorageExecutorTest, TracksLatency) {
+    StorageExecutor executor(1, 16);
+    std::promise<void> done;
+    executor.submit([] { std::this_thread::sleep_for(std::chrono::milliseconds(20)); });
+    executor.submit([&done] { done.set_value(); });
+    done.get_future().wait();
+    // the second task's bookkeeping happens just after it runs
+    StorageExecutor::Stats stats;
+    do {
+        stats = executor.stats();
+    } while (stats.completed < 2);
+    EXPECT_GE(stats.max_run_us, 20000u);
+    EXPECT_GE(stats.max_wait_us, 20000u);
+    EXPECT_EQ(0u, stats.queued);
+}
+
+TEST(StorageExecutorTest, DrainsQueueOnDestruction) {
+    std::atomic<int> ran{0};
+    {
+        StorageExecutor executor(1, 64);
+        for (int i = 0; i < 50; i++) {
+            ASSERT_TRUE(executor.submit([&ran] { ran++; }));
+        }
+    }
+    EXPECT_EQ(50, ran);
+}
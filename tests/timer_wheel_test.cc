@@ -0,0 +1,83 @@
+#include "gtest/gtest.h"
+#include "../src/api/timer_wheel.h"
+#include <map>
+#include <random>
+
+TEST(TimerWheelTest, FiresAtDeadline) {
+    TimerWheel wheel(100);
+    wheel.schedule("soon", 105);
+    wheel.schedule("late", 100);
+    wheel.schedule("far", 100 + 5000);
+    EXPECT_EQ(3u, wheel.size());
+    EXPECT_EQ(105u, wheel.deadline("soon"));
+
+    std::vector<std::string> expired;
+    // past deadlines fire on the next tick
+    wheel.advance(104, &expired);
+    EXPECT_EQ(std::vector<std::string>{"late"}, expired);
+    expired.clear();
+    wheel.advance(105, &expired);
+    EXPECT_EQ(std::vector<std::string>{"soon"}, expired);
+    expired.clear();
+    wheel.advance(5099, &expired);
+    EXPECT_TRUE(expired.empty());
+    wheel.advance(5100, &expired);
+    EXPECT_EQ(std::vector<std::string>{"far"}, expired);
+    EXPECT_EQ(0u, wheel.size());
+    EXPECT_EQ(0u, wheel.deadline("far"));
+}
+
+TEST(TimerWheelTest, ReschedulesAndCancels) {
+    TimerWheel wheel(0);
+    wheel.schedule("a", 10);
+    wheel.schedule("b", 10);
+    wheel.schedule("a", 3000);
+    EXPECT_TRUE(wheel.cancel("b"));
+    EXPECT_FALSE(wheel.cancel("b"));
+
+    std::vector<std::string> expired;
+    wheel.advance(2999, &expired);
+    EXPECT_TRUE(expired.empty());
+    wheel.advance(3000, &expired);
+    EXPECT_EQ(std::vector<std::string>{"a"}, expired);
+}
+
+TEST(TimerWheelTest, MatchesSortedDeadlines) {
+    std::mt19937_64 random(7);
+    const uint64_t start = 1700000000;
+    TimerWheel wheel(start);
+    std::map<std::string, uint64_t> deadlines;
+    for (int i = 0; i < 20000; i++) {
+        std::string key = std::to_string(i);
+        // spread over every level, and past the end of the wheel
+        uint64_t delta = random() % (uint64_t(1) << (6 * (i % 6) + 6));
+        deadlines[key] = start + delta;
+        wheel.schedule(key, start + delta);
+    }
+
+    uint64_t now = start;
+    while (wheel.size() > 0) {
+        // steps grow with time; past 2^26 ticks the wheel is skipped across
+        uint64_t elapsed = now - start;
+        now += elapsed < (uint64_t(1) << 26) ? 1 + random() % (1 + elapsed / 4)
+                                             : uint64_t(1) << 31;
+        std::vector<std::string> expired;
+        wheel.advance(now, &expired);
+        for (const std::string& key : expired) {
+            uint64_t deadline = deadlines.at(key);
+            ASSERT_LE(deadline, now) << key;
+            deadlines.erase(key);
+        }
+        for (const auto& entry : deadlines) {
+            ASSERT_GT(entry.second, now) << entry.first;
+        }
+        // timers set midway land at whatever point each level has turned to
+        for (int i = 0; i < 10 && now - start < (uint64_t(1) << 26); i++) {
+            std::string key = std::to_string(now) + "+" + std::to_string(i);
+            uint64_t delta = random() % (uint64_t(1) << (6 * (i % 5) + 6));
+            deadlines[key] = now + delta;
+            wheel.schedule(key, now + delta);
+        }
+    }
+    EXPECT_TRUE(deadlines.empty());
+}
@@ -0,0 +1,133 @@
+#include "gtest/gtest.h"
+#include "../src/tracing.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace tracing;
+
+namespace {
+
+const char kPath[] = "tracing_test.jsonl";
+const char kParent[] =
+    "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01";
+
+std::vector<std::string> readLines() {
+  std::ifstream in(kPath);
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(in, line))
+    lines.push_back(line);
+  return lines;
+}
+
+} // namespace
+
+class TracingTest : public ::testing::Test {
+protected:
+  void SetUp() override { std::remove(kPath); }
+  void TearDown() override { std::remove(kPath); }
+};
+
+TEST_F(TracingTest, ParsesTraceparent) {
+  SpanContext context;
+  ASSERT_TRUE(parseTraceparent(kParent, &context));
+  EXPECT_EQ(context.trace_id_high, 0x4bf92f3577b34da6ULL);
+  EXPECT_EQ(context.trace_id_low, 0xa3ce929d0e0e4736ULL);
+  EXPECT_EQ(context.span_id, 0x00f067aa0ba902b7ULL);
+  EXPECT_TRUE(context.sampled);
+  EXPECT_EQ(formatTraceparent(context), kParent);
+
+  // a later version may add fields after a dash
+  EXPECT_TRUE(parseTraceparent(
+      "01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00-extra",
+      &context));
+  EXPECT_FALSE(context.sampled);
+}
+
+TEST_F(TracingTest, RejectsInvalidTraceparent) {
+  SpanContext context;
+  for (const char *header : {
+           "",
+           "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-",
+           "00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01",
+           "00-00000000000000000000000000000000-00f067aa0ba902b7-01",
+           "00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01",
+           "ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+           "00_4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+           "01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01x",
+       })
+    EXPECT_FALSE(parseTraceparent(header, &context)) << header;
+}
+
+TEST_F(TracingTest, ExportsSampledTrace) {
+  auto tracer = Tracer::open(kPath, 0);
+  ASSERT_NE(tracer, nullptr);
+  RequestTrace trace;
+  Clock::time_point start = Clock::now();
+  tracer->begin(kParent, start, 1700000000000000000ULL, &trace);
+  ASSERT_TRUE(trace.active());
+  EXPECT_EQ(trace.parentSpanId(), 0x00f067aa0ba902b7ULL);
+  EXPECT_NE(trace.context().span_id, trace.parentSpanId());
+  trace.addSpan("read", start, start + std::chrono::microseconds(5));
+  trace.endSpan(trace.startSpan("handle"));
+  tracer->finish(&trace, "EchoHandler", "/echo", 200);
+  EXPECT_FALSE(trace.active());
+  tracer->flush();
+
+  std::vector<std::string> lines = readLines();
+  ASSERT_EQ(lines.size(), 3);
+  std::string root_id = "\"span_id\":\"" + formatTraceparent(trace.context())
+                                               .substr(36, 16) + "\"";
+  EXPECT_NE(lines[0].find("\"name\":\"request\""), std::string::npos);
+  EXPECT_NE(lines[0].find(root_id), std::string::npos);
+  EXPECT_NE(lines[0].find("\"parent_span_id\":\"00f067aa0ba902b7\""),
+            std::string::npos);
+  EXPECT_NE(lines[0].find("\"start_unix_nano\":1700000000000000000,"),
+            std::string::npos);
+  EXPECT_NE(lines[0].find("\"http.route\":\"/echo\""), std::string::npos);
+  EXPECT_NE(lines[0].find("\"http.status_code\":200"), std::string::npos);
+  EXPECT_NE(lines[1].find("\"name\":\"read\""), std::string::npos);
+  EXPECT_NE(lines[1].find("\"end_unix_nano\":1700000000000005000}"),
+            std::string::npos);
+  EXPECT_NE(lines[2].find("\"name\":\"handle\""), std::string::npos);
+  for (const std::string &line : lines) {
+    EXPECT_NE(line.find("\"trace_id\":\"4bf92f3577b34da6a3ce929d0e0e4736\""),
+              std::string::npos);
+  }
+  EXPECT_NE(lines[2].find("\"parent_span_id\":\"" +
+                          root_id.substr(11, 16) + "\""),
+            std::string::npos);
+}
+
+TEST_F(TracingTest, FollowsSampling) {
+  auto never = Tracer::open(kPath, 0);
+  auto always = Tracer::open(kPath, 1);
+  ASSERT_NE(never, nullptr);
+  ASSERT_NE(always, nullptr);
+  RequestTrace trace;
+  never->begin("", Clock::now(), 0, &trace);
+  EXPECT_FALSE(trace.active());
+  // unsampled requests still get ids to pass on
+  EXPECT_TRUE(trace.context().valid());
+  EXPECT_EQ(trace.startSpan("read"), RequestTrace::kMaxSpans);
+  never->finish(&trace, "EchoHandler", "/echo", 200);
+
+  always->begin("", Clock::now(), 0, &trace);
+  EXPECT_TRUE(trace.active());
+  EXPECT_EQ(trace.parentSpanId(), 0);
+  // the caller's decision wins over the ratio
+  always->begin("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00",
+                Clock::now(), 0, &trace);
+  EXPECT_FALSE(trace.active());
+
+  // spans past the limit are dropped
+  never->begin(kParent, Clock::now(), 0, &trace);
+  for (size_t i = 0; i < RequestTrace::kMaxSpans + 2; i++)
+    trace.endSpan(trace.startSpan("span"));
+  EXPECT_EQ(trace.spanCount(), RequestTrace::kMaxSpans);
+  never->finish(&trace, "EchoHandler", "/echo", 200);
+  never->flush();
+  EXPECT_EQ(readLines().size(), RequestTrace::kMaxSpans);
+}
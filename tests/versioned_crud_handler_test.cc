@@ -0,0 +1,147 @@
+#include "gtest/gtest.h"
+#include "../src/api/versioned_crud_handler.h"
+#include <atomic>
+#include <map>
+#include <thread>
+
+// in-memory backend
+class MemoryCRUDHandler : public ICRUDHandler {
+public:
+    std::map<std::string, std::map<int, std::string>> data;
+
+    std::string create(const std::string& entity, const std::string& body) override {
+        int id = 1;
+        while (data[entity].count(id))
+            id++;
+        data[entity][id] = body;
+        return "{\"id\": " + std::to_string(id) + "}";
+    }
+    std::string read(const std::string& entity, int id) override {
+        return data[entity].count(id) ? data[entity][id] : "";
+    }
+    bool update(const std::string& entity, int id, const std::string& body) override {
+        if (!data[entity].count(id))
+            return false;
+        data[entity][id] = body;
+        return true;
+    }
+    bool delete_(const std::string& entity, int id) override {
+        return data[entity].erase(id) > 0;
+    }
+    bool exists(const std::string& entity, int id) override {
+        return data[entity].count(id) > 0;
+    }
+    std::vector<int> list(const std::string& entity) override {
+        std::vector<int> ids;
+        for (const auto& entry : data[entity])
+            ids.push_back(entry.first);
+        return ids;
+    }
+};
+
+TEST(VersionedCRUDHandlerTest, WritesBumpVersions) {
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    VersionedCRUDHandler versioned(backend);
+    EXPECT_EQ(0u, versioned.version("Shoes", 1));
+
+    versioned.create("Shoes", "a");
+    uint64_t created = versioned.version("Shoes", 1);
+    EXPECT_GT(created, 0u);
+    EXPECT_EQ(created, versioned.version("Shoes", 1));
+
+    uint64_t updated = 0;
+    EXPECT_EQ(ICRUDHandler::kWritten, versioned.updateIf("Shoes", 1, "b", 0, &updated));
+    EXPECT_GT(updated, created);
+    EXPECT_EQ(updated, versioned.version("Shoes", 1));
+    EXPECT_TRUE(versioned.update("Shoes", 1, "c"));
+    EXPECT_GT(versioned.version("Shoes", 1), updated);
+
+    EXPECT_TRUE(versioned.delete_("Shoes", 1));
+    EXPECT_EQ(0u, versioned.version("Shoes", 1));
+    // a reused id never gets a version it had before
+    versioned.create("Shoes", "d");
+    EXPECT_GT(versioned.version("Shoes", 1), updated);
+}
+
+TEST(VersionedCRUDHandlerTest, ConditionalWrites) {
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    VersionedCRUDHandler versioned(backend);
+    versioned.create("Shoes", "a");
+    uint64_t seen = versioned.version("Shoes", 1);
+
+    uint64_t written = 0;
+    EXPECT_EQ(ICRUDHandler::kWritten, versioned.updateIf("Shoes", 1, "b", seen, &written));
+    // a second writer still holding the old version loses
+    EXPECT_EQ(ICRUDHandler::kVersionMismatch, versioned.updateIf("Shoes", 1, "c", seen));
+    EXPECT_EQ("b", backend->data["Shoes"][1]);
+    EXPECT_EQ(ICRUDHandler::kVersionMismatch, versioned.deleteIf("Shoes", 1, seen));
+    EXPECT_EQ(ICRUDHandler::kNotFound, versioned.updateIf("Shoes", 2, "c", seen));
+
+    EXPECT_EQ(ICRUDHandler::kWritten, versioned.deleteIf("Shoes", 1, written));
+    EXPECT_FALSE(backend->exists("Shoes", 1));
+    EXPECT_EQ(ICRUDHandler::kNotFound, versioned.deleteIf("Shoes", 1, written));
+}
+
+TEST(VersionedCRUDHandlerTest, VersionsSurviveRestarts) {
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    backend->create("Shoes", "a");
+    uint64_t before;
+    {
+        VersionedCRUDHandler first(new MemoryCRUDHandler(*backend));
+        first.update("Shoes", 1, "b");
+        first.update("Shoes", 1, "c");
+        before = first.version("Shoes", 1);
+    }
+    // data written before startup reports a version newer than any handed out
+    // by an earlier run
+    VersionedCRUDHandler second(backend);
+    EXPECT_GT(second.version("Shoes", 1), before);
+    EXPECT_EQ(ICRUDHandler::kVersionMismatch, second.updateIf("Shoes", 1, "d", before));
+}
+
+TEST(VersionedCRUDHandlerTest, BatchWritesBumpVersions) {
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    VersionedCRUDHandler versioned(backend);
+    versioned.create("Shoes", "a");
+    versioned.create("Shoes", "b");
+    uint64_t first = versioned.version("Shoes", 1);
+    uint64_t second = versioned.version("Shoes", 2);
+
+    std::vector<BatchOperation> ops(3);
+    ops[0].type = BatchOperation::kUpdate;
+    ops[0].entity = "Shoes";
+    ops[0].id = 1;
+    ops[0].data = "c";
+    ops[1].type = BatchOperation::kDelete;
+    ops[1].entity = "Shoes";
+    ops[1].id = 2;
+    ops[2].type = BatchOperation::kCreate;
+    ops[2].entity = "Shoes";
+    ops[2].data = "d";
+    std::vector<BatchResult> results = versioned.batch(ops);
+    ASSERT_TRUE(results[0].ok && results[1].ok && results[2].ok);
+
+    EXPECT_GT(versioned.version("Shoes", 1), first);
+    EXPECT_GT(versioned.version("Shoes", results[2].id), second);
+    EXPECT_EQ(ICRUDHandler::kVersionMismatch, versioned.updateIf("Shoes", 1, "e", first));
+}
+
+TEST(VersionedCRUDHandlerTest, OneOfRacingWritersWins) {
+    MemoryCRUDHandler* backend = new MemoryCRUDHandler();
+    VersionedCRUDHandler versioned(backend);
+    versioned.create("Shoes", "start");
+    uint64_t seen = versioned.version("Shoes", 1);
+
+    std::atomic<int> wins{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&, t] {
+            if (versioned.updateIf("Shoes", 1, std::to_string(t), seen) ==
+                ICRUDHandler::kWritten)
+                wins++;
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    EXPECT_EQ(1, wins);
+}